@@ -0,0 +1,70 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace fabricrpc {
+
+// features a side supports. Values match capability in fabricrpc.proto
+enum class Capability : std::uint64_t {
+  None = 0,
+  Compression = 1,
+  Batch = 2,
+  Metadata = 4,
+  ServerStream = 8,
+  ClientStream = 16,
+  OneWay = 32,
+  Notification = 64
+};
+
+// version of the protocol this runtime speaks.
+constexpr std::uint32_t ProtocolVersion = 1;
+
+// capability bitset this runtime sends to peers.
+constexpr std::uint64_t LocalCapabilities =
+    static_cast<std::uint64_t>(Capability::Compression) |
+    static_cast<std::uint64_t>(Capability::Batch) |
+    static_cast<std::uint64_t>(Capability::OneWay);
+
+// what the server of a client supports, learned from the first reply that
+// has it. Servers that do not send it are old servers with no capabilities.
+// Thread safe.
+class PeerCapabilities {
+public:
+  PeerCapabilities() : known_(false), version_(0), capabilities_(0) {}
+
+  bool Known() const { return known_.load(std::memory_order_acquire); }
+
+  // 0 for old servers.
+  std::uint32_t GetVersion() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  // true if server is known to support cap.
+  bool Has(Capability cap) const {
+    return Known() && (capabilities_.load(std::memory_order_acquire) &
+                       static_cast<std::uint64_t>(cap)) != 0;
+  }
+
+  // false only if server is known not to support cap.
+  bool MayHave(Capability cap) const { return !Known() || Has(cap); }
+
+  void Set(std::uint32_t version, std::uint64_t capabilities) {
+    version_.store(version, std::memory_order_release);
+    capabilities_.store(capabilities, std::memory_order_release);
+    known_.store(true, std::memory_order_release);
+  }
+
+private:
+  std::atomic<bool> known_;
+  std::atomic<std::uint32_t> version_;
+  std::atomic<std::uint64_t> capabilities_;
+};
+
+} // namespace fabricrpc
@@ -6,46 +6,106 @@
 
 #pragma once
 
+#include "fabricrpc/Capabilities.hpp"
+#include "fabricrpc/Codec.hpp"
 #include "fabricrpc/FRPCHeader.hpp"
 #include "fabricrpc/FRPCTransportMessage.hpp"
 #include "fabricrpc/Status.hpp"
+#include "fabricrpc_tool/alloc_stats.hpp"
 
+#include <cassert>
 #include <chrono>
+#include <mutex>
+#include <span>
+#include <vector>
 
 // some helpers for generated client code
 namespace fabricrpc {
 
+// asks the server for its capabilities until they are known.
+inline void SetClientHandshake(const PeerCapabilities *peer,
+                               FabricRPCRequestHeader *header) {
+  if (!peer->Known()) {
+    header->SetProtocolVersion(ProtocolVersion);
+    header->SetCapabilities(LocalCapabilities);
+  }
+}
+
+// learns the server capabilities from the reply of a request.
+inline void LearnServerCapabilities(PeerCapabilities *peer,
+                                    const FabricRPCReplyHeader &header) {
+  if (header.GetProtocolVersion() != 0) {
+    peer->Set(header.GetProtocolVersion(), header.GetCapabilities());
+  } else if (header.GetStatusCode() == 0 && !peer->Known()) {
+    // old server ignored the handshake.
+    peer->Set(0, 0);
+  }
+}
+
+// compresses body_str if the server is known to decompress it.
+inline Status CompressClientBody(const PeerCapabilities *peer,
+                                 const CompressionOptions &compression,
+                                 FabricRPCRequestHeader *header,
+                                 std::string *body_str) {
+  if (!peer->Has(Capability::Compression) ||
+      !ShouldCompress(compression, *body_str)) {
+    return Status();
+  }
+  std::string compressed;
+  Status err = CompressBody(compression.Codec, *body_str, &compressed);
+  if (err) {
+    return err;
+  }
+  header->SetCodec(compression.Codec);
+  header->SetUncompressedSize(static_cast<std::uint32_t>(body_str->size()));
+  *body_str = std::move(compressed);
+  return Status();
+}
+
+// compression codec is also offered to server for the reply. Requests are
+// compressed only after peer knows the server supports it.
 template <typename ProtoReq>
 Status ExecClientBegin(IFabricTransportClient *client,
                        std::shared_ptr<IFabricRPCHeaderProtoConverter> cv,
-                       DWORD timeoutMilliseconds, std::string const &url,
+                       PeerCapabilities *peer, DWORD timeoutMilliseconds, std::string const &url,
                        const ProtoReq *request,
                        IFabricAsyncOperationCallback *callback,
-                       /*out*/ IFabricAsyncOperationContext **context) {
+                       /*out*/ IFabricAsyncOperationContext **context,
+                       const CompressionOptions &compression =
+                           CompressionOptions()) {
   HRESULT hr = S_OK;
+  alloc_scope encodeScope(alloc_phase::client_encode);
 
   // calculate new timeout. Parsing may take some time if payload is big.
   auto starttime = std::chrono::steady_clock::now();
 
+  // prepare body
+  std::string body_str;
+  bool ok = request->SerializeToString(&body_str);
+  assert(ok);
+  if (!ok) {
+    return Status(StatusCode::INTERNAL,
+                  "Client cannot serialize request body.");
+  }
+
   fabricrpc::FabricRPCRequestHeader fRequestHeader;
   // prepare header
   fRequestHeader.SetUrl(url);
+  fRequestHeader.SetAcceptCodec(compression.Codec);
+  SetClientHandshake(peer, &fRequestHeader);
+  Status err = CompressClientBody(peer, compression, &fRequestHeader,
+                                  &body_str);
+  if (err) {
+    return err;
+  }
 
   std::string header_str;
-  bool ok = cv->SerializeRequestHeader(&fRequestHeader, &header_str);
+  ok = cv->SerializeRequestHeader(&fRequestHeader, &header_str);
   assert(ok);
   if (!ok) {
     return Status(StatusCode::INTERNAL,
                   "Client cannot serialize request header.");
   }
-  // prepare body
-  std::string body_str;
-  ok = request->SerializeToString(&body_str);
-  assert(ok);
-  if (!ok) {
-    return Status(StatusCode::INTERNAL,
-                  "Client cannot serialize request body.");
-  }
 
   CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
       new CComObjectNoLock<FRPCTransportMessage>());
@@ -61,8 +121,11 @@ Status ExecClientBegin(IFabricTransportClient *client,
     newTimeout = timeoutMilliseconds - static_cast<DWORD>(ms);
   }
 
-  // send request
-  hr = client->BeginRequest(msgPtr, newTimeout, callback, context);
+  // send request. Allocations of transport are not counted.
+  {
+    alloc_scope transportScope(alloc_phase::none);
+    hr = client->BeginRequest(msgPtr, newTimeout, callback, context);
+  }
   if (FAILED(hr)) {
     return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "BeginRequest failed",
                   hr);
@@ -70,9 +133,59 @@ Status ExecClientBegin(IFabricTransportClient *client,
   return Status();
 }
 
+// Sends a one way request. There is no reply, and the returned status only
+// tells if the request is handed to transport. There is no handshake either,
+// so the request is compressed only if a reply already told peer.
+template <typename ProtoReq>
+Status ExecClientSend(IFabricTransportClient *client,
+                      std::shared_ptr<IFabricRPCHeaderProtoConverter> cv,
+                      PeerCapabilities *peer, std::string const &url, const ProtoReq *request,
+                      const CompressionOptions &compression =
+                          CompressionOptions()) {
+  alloc_scope encodeScope(alloc_phase::client_encode);
+  std::string body_str;
+  bool ok = request->SerializeToString(&body_str);
+  assert(ok);
+  if (!ok) {
+    return Status(StatusCode::INTERNAL,
+                  "Client cannot serialize request body.");
+  }
+
+  fabricrpc::FabricRPCRequestHeader fRequestHeader;
+  fRequestHeader.SetUrl(url);
+  Status err = CompressClientBody(peer, compression, &fRequestHeader,
+                                  &body_str);
+  if (err) {
+    return err;
+  }
+
+  std::string header_str;
+  ok = cv->SerializeRequestHeader(&fRequestHeader, &header_str);
+  assert(ok);
+  if (!ok) {
+    return Status(StatusCode::INTERNAL,
+                  "Client cannot serialize request header.");
+  }
+
+  CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
+      new CComObjectNoLock<FRPCTransportMessage>());
+  msgPtr->Initialize(std::move(header_str), std::move(body_str));
+
+  HRESULT hr = S_OK;
+  {
+    alloc_scope transportScope(alloc_phase::none);
+    hr = client->Send(msgPtr);
+  }
+  if (FAILED(hr)) {
+    return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "Send failed", hr);
+  }
+  return Status();
+}
+
 template <typename ResponseProto>
 Status ExecClientEnd(IFabricTransportClient *client,
                      std::shared_ptr<IFabricRPCHeaderProtoConverter> cv,
+                     PeerCapabilities *peer,
                      IFabricAsyncOperationContext *context,
                      /*out*/ ResponseProto *response) {
   HRESULT hr = S_OK;
@@ -81,6 +194,7 @@ Status ExecClientEnd(IFabricTransportClient *client,
   if (hr != S_OK) {
     return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "EndRequest failed", hr);
   }
+  alloc_scope decodeScope(alloc_phase::client_decode);
 
   // copy request reply to fabric rpc impl
   CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
@@ -97,16 +211,304 @@ Status ExecClientEnd(IFabricTransportClient *client,
   if (!cv->DeserializeReplyHeader(&header_str, &fReplyHeader)) {
     return Status(StatusCode::UNKNOWN, "Server returned bad header");
   }
+  LearnServerCapabilities(peer, fReplyHeader);
   if (fReplyHeader.GetStatusCode() != 0) {
     return Status(StatusCode(fReplyHeader.GetStatusCode()),
                   fReplyHeader.GetStatusMessage());
   }
   // parse response
   auto data = msgPtr->GetBody();
+  if (fReplyHeader.GetCodec() != BodyCodec::None) {
+    std::string plain;
+    Status err = DecompressBody(fReplyHeader.GetCodec(), data,
+                                fReplyHeader.GetUncompressedSize(),
+                                kDefaultMaxUncompressedSize, &plain);
+    if (err) {
+      return Status(StatusCode::UNKNOWN, "Server returned bad body");
+    }
+    data = std::move(plain);
+  }
   if (!response->ParseFromArray(data.c_str(), static_cast<int>(data.size()))) {
     return Status(StatusCode::UNKNOWN, "Server returned bad body");
   }
   return Status();
 }
 
+// Context returned by ExecClientBatchBegin. It wraps the transport context,
+// and keeps the number of requests for ExecClientBatchEnd.
+class FRPCClientBatchCtx : public CComObjectRootEx<CComMultiThreadModel>,
+                           public IFabricAsyncOperationContext {
+  BEGIN_COM_MAP(FRPCClientBatchCtx)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationContext)
+  END_COM_MAP()
+
+public:
+  FRPCClientBatchCtx() : requestCount_(0), callback_(), innerCtx_(), mtx_() {}
+
+  // callback is the user's callback.
+  void Initialize(std::size_t requestCount,
+                  IFabricAsyncOperationCallback *callback) {
+    assert(callback != nullptr);
+    requestCount_ = requestCount;
+    callback->AddRef();
+    callback_.Attach(callback);
+  }
+
+  std::size_t GetRequestCount() const { return requestCount_; }
+
+  // set the transport ctx thread safe.
+  // This can be called on BeginRequest thread and the transport callback
+  // thread, and is set before the user sees this ctx.
+  void SetInnerCtx(IFabricAsyncOperationContext *context) {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (innerCtx_ == nullptr) {
+      context->AddRef();
+      innerCtx_.Attach(context);
+    } else {
+      assert(innerCtx_ == context);
+    }
+  }
+
+  CComPtr<IFabricAsyncOperationContext> GetInnerCtx() {
+    std::lock_guard<std::mutex> l(mtx_);
+    return innerCtx_;
+  }
+
+  // impl
+  BOOLEAN STDMETHODCALLTYPE IsCompleted() override {
+    return GetInnerCtx()->IsCompleted();
+  }
+  BOOLEAN STDMETHODCALLTYPE CompletedSynchronously() override {
+    return GetInnerCtx()->CompletedSynchronously();
+  }
+  HRESULT STDMETHODCALLTYPE get_Callback(
+      /* [retval][out] */ IFabricAsyncOperationCallback **callback) override {
+    return callback_.CopyTo(callback);
+  }
+  HRESULT STDMETHODCALLTYPE Cancel() override {
+    return GetInnerCtx()->Cancel();
+  }
+
+private:
+  std::size_t requestCount_;
+  CComPtr<IFabricAsyncOperationCallback> callback_;
+  CComPtr<IFabricAsyncOperationContext> innerCtx_;
+  std::mutex mtx_;
+};
+
+// Callback given to transport for a batch request. It invokes the user's
+// callback with the batch ctx instead of the transport one.
+class FRPCClientBatchCallback : public CComObjectRootEx<CComMultiThreadModel>,
+                                public IFabricAsyncOperationCallback {
+  BEGIN_COM_MAP(FRPCClientBatchCallback)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationCallback)
+  END_COM_MAP()
+
+public:
+  void Initialize(CComObjectNoLock<FRPCClientBatchCtx> *wrapCtx) {
+    assert(wrapCtx != nullptr);
+    wrapCtx->AddRef();
+    wrapCtx_.Attach(wrapCtx);
+  }
+
+  void STDMETHODCALLTYPE Invoke(
+      /* [in] */ IFabricAsyncOperationContext *context) override {
+    assert(context != nullptr);
+    assert(wrapCtx_ != nullptr);
+    wrapCtx_->SetInnerCtx(context);
+    CComPtr<IFabricAsyncOperationCallback> callback;
+    wrapCtx_->get_Callback(&callback);
+    callback->Invoke(wrapCtx_);
+    // the transport ctx holds this callback, and wrapCtx holds the transport
+    // ctx. Release wrapCtx to break the circular refcount.
+    wrapCtx_.Release();
+  }
+
+private:
+  CComPtr<CComObjectNoLock<FRPCClientBatchCtx>> wrapCtx_;
+};
+
+// Sends all requests in one transport message, one body blob per request.
+// The server runs the same method for each request. The returned context
+// keeps the number of requests for ExecClientBatchEnd.
+template <typename ProtoReq>
+Status ExecClientBatchBegin(IFabricTransportClient *client,
+                            std::shared_ptr<IFabricRPCHeaderProtoConverter> cv,
+                            PeerCapabilities *peer, DWORD timeoutMilliseconds,
+                            std::string const &url,
+                            std::span<const ProtoReq> requests,
+                            IFabricAsyncOperationCallback *callback,
+                            /*out*/ IFabricAsyncOperationContext **context) {
+  HRESULT hr = S_OK;
+  alloc_scope encodeScope(alloc_phase::client_encode);
+
+  if (requests.empty()) {
+    return Status(StatusCode::INVALID_ARGUMENT, "Batch has no request.");
+  }
+  if (!peer->MayHave(Capability::Batch)) {
+    return Status(StatusCode::UNKNOWN, "Server does not support batch.");
+  }
+
+  // calculate new timeout. Parsing may take some time if payload is big.
+  auto starttime = std::chrono::steady_clock::now();
+
+  // prepare bodies
+  std::vector<std::string> bodies;
+  std::vector<std::uint32_t> sizes;
+  bodies.reserve(requests.size());
+  sizes.reserve(requests.size());
+  for (const ProtoReq &request : requests) {
+    std::string body_str;
+    bool ok = request.SerializeToString(&body_str);
+    assert(ok);
+    if (!ok) {
+      return Status(StatusCode::INTERNAL,
+                    "Client cannot serialize request body.");
+    }
+    sizes.push_back(static_cast<std::uint32_t>(body_str.size()));
+    bodies.push_back(std::move(body_str));
+  }
+
+  fabricrpc::FabricRPCRequestHeader fRequestHeader;
+  // prepare header
+  fRequestHeader.SetUrl(url);
+  fRequestHeader.SetBatchItemSizes(std::move(sizes));
+  SetClientHandshake(peer, &fRequestHeader);
+
+  std::string header_str;
+  bool ok = cv->SerializeRequestHeader(&fRequestHeader, &header_str);
+  assert(ok);
+  if (!ok) {
+    return Status(StatusCode::INTERNAL,
+                  "Client cannot serialize request header.");
+  }
+
+  CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
+      new CComObjectNoLock<FRPCTransportMessage>());
+  msgPtr->Initialize(std::move(header_str), std::move(bodies));
+
+  // prepare timeout value
+  auto endtime = std::chrono::steady_clock::now();
+  auto ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(endtime - starttime)
+          .count();
+  DWORD newTimeout = {};
+  if (timeoutMilliseconds > ms) {
+    newTimeout = timeoutMilliseconds - static_cast<DWORD>(ms);
+  }
+
+  CComPtr<CComObjectNoLock<FRPCClientBatchCtx>> batchCtx(
+      new CComObjectNoLock<FRPCClientBatchCtx>());
+  batchCtx->Initialize(requests.size(), callback);
+  CComPtr<CComObjectNoLock<FRPCClientBatchCallback>> batchCallback(
+      new CComObjectNoLock<FRPCClientBatchCallback>());
+  batchCallback->Initialize(batchCtx);
+
+  // send request. Allocations of transport are not counted.
+  CComPtr<IFabricAsyncOperationContext> innerCtx;
+  {
+    alloc_scope transportScope(alloc_phase::none);
+    hr = client->BeginRequest(msgPtr, newTimeout, batchCallback, &innerCtx);
+  }
+  if (FAILED(hr)) {
+    return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "BeginRequest failed",
+                  hr);
+  }
+  batchCtx->SetInnerCtx(innerCtx);
+  *context = batchCtx.Detach();
+  return Status();
+}
+
+// Parses a batch reply of requestCount requests. Returned status is for the
+// batch as a whole. If it is ok, statuses has the status of each request in
+// order, and responses are valid for the ok ones. A reply with a different
+// number of items than requests is an error.
+template <typename ResponseProto>
+Status ParseClientBatchReply(IFabricRPCHeaderProtoConverter *cv,
+                             PeerCapabilities *peer,
+                             IFabricTransportMessage *reply,
+                             std::size_t requestCount,
+                             /*out*/ std::vector<ResponseProto> *responses,
+                             /*out*/ std::vector<Status> *statuses) {
+  // copy request reply to fabric rpc impl
+  CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
+      new CComObjectNoLock<FRPCTransportMessage>());
+  msgPtr->CopyMsg(reply);
+
+  std::string const &header_str = msgPtr->GetHeader();
+  if (header_str.size() == 0) {
+    return Status(StatusCode::UNKNOWN, "Server returned empty header");
+  }
+
+  fabricrpc::FabricRPCReplyHeader fReplyHeader;
+
+  if (!cv->DeserializeReplyHeader(&header_str, &fReplyHeader)) {
+    return Status(StatusCode::UNKNOWN, "Server returned bad header");
+  }
+  LearnServerCapabilities(peer, fReplyHeader);
+  if (fReplyHeader.GetStatusCode() != 0) {
+    return Status(StatusCode(fReplyHeader.GetStatusCode()),
+                  fReplyHeader.GetStatusMessage());
+  }
+
+  // body blobs of each item are concatenated in order.
+  std::string const &data = msgPtr->GetBody();
+  const std::vector<FabricRPCBatchItemStatus> &items =
+      fReplyHeader.GetBatchItemStatus();
+  if (items.size() != requestCount) {
+    return Status(StatusCode::UNKNOWN, "Server returned wrong batch size");
+  }
+  responses->clear();
+  responses->resize(items.size());
+  statuses->clear();
+  statuses->reserve(items.size());
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < items.size(); i++) {
+    const FabricRPCBatchItemStatus &item = items[i];
+    if (data.size() - offset < item.GetBodySize()) {
+      return Status(StatusCode::UNKNOWN, "Server returned bad batch body");
+    }
+    if (item.GetStatusCode() != 0) {
+      statuses->push_back(
+          Status(StatusCode(item.GetStatusCode()), item.GetStatusMessage()));
+    } else if (!(*responses)[i].ParseFromArray(
+                   data.c_str() + offset,
+                   static_cast<int>(item.GetBodySize()))) {
+      statuses->push_back(
+          Status(StatusCode::UNKNOWN, "Server returned bad body"));
+    } else {
+      statuses->push_back(Status());
+    }
+    offset += item.GetBodySize();
+  }
+  return Status();
+}
+
+// context is returned by ExecClientBatchBegin.
+template <typename ResponseProto>
+Status ExecClientBatchEnd(IFabricTransportClient *client,
+                          std::shared_ptr<IFabricRPCHeaderProtoConverter> cv,
+                          PeerCapabilities *peer,
+                          IFabricAsyncOperationContext *context,
+                          /*out*/ std::vector<ResponseProto> *responses,
+                          /*out*/ std::vector<Status> *statuses) {
+  CComObjectNoLock<FRPCClientBatchCtx> *batchCtx =
+      dynamic_cast<CComObjectNoLock<FRPCClientBatchCtx> *>(context);
+  assert(batchCtx != nullptr);
+  if (batchCtx == nullptr) {
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "Context is not from a batch request.");
+  }
+  HRESULT hr = S_OK;
+  CComPtr<IFabricTransportMessage> reply;
+  hr = client->EndRequest(batchCtx->GetInnerCtx(), &reply);
+  if (hr != S_OK) {
+    return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "EndRequest failed", hr);
+  }
+  alloc_scope decodeScope(alloc_phase::client_decode);
+  return ParseClientBatchReply(cv.get(), peer, reply,
+                               batchCtx->GetRequestCount(), responses,
+                               statuses);
+}
+
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,44 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabricrpc/Status.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fabricrpc {
+
+// codec of a compressed body. Values match body_codec in fabricrpc.proto
+enum class BodyCodec : int { None = 0, Lz4 = 1, Zstd = 2 };
+
+// body compression settings of one side.
+// Bodies smaller than Threshold are sent raw, since compressing them does not
+// pay off.
+struct CompressionOptions {
+  BodyCodec Codec = BodyCodec::None;
+  std::size_t Threshold = 1024;
+};
+
+// uncompressed size a peer may claim for a body by default. The size is
+// allocated before decompressing, so larger claims are rejected.
+static const std::size_t kDefaultMaxUncompressedSize = 64 * 1024 * 1024;
+
+// returns true if body should be compressed with the options
+bool ShouldCompress(const CompressionOptions &options, const std::string &body);
+
+Status CompressBody(BodyCodec codec, const std::string &in,
+                    /*out*/ std::string *out);
+
+// uncompressedSize is from the header and out is checked to have this size.
+// Sizes above maxSize fail before any allocation.
+Status DecompressBody(BodyCodec codec, const std::string &in,
+                      std::uint32_t uncompressedSize, std::size_t maxSize,
+                      /*out*/ std::string *out);
+
+} // namespace fabricrpc
@@ -6,8 +6,12 @@
 
 #pragma once
 
+#include "fabricrpc/Codec.hpp"
+
 #include <cassert>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace fabricrpc {
 
@@ -18,8 +22,53 @@ public:
   const std::string &GetUrl() const;
   void SetUrl(std::string url);
 
+  // body size of each item in a batch request.
+  // empty if request is not batched.
+  const std::vector<std::uint32_t> &GetBatchItemSizes() const;
+  void SetBatchItemSizes(std::vector<std::uint32_t> sizes);
+  bool IsBatch() const;
+
+  // codec of the request body, and body size before compression.
+  BodyCodec GetCodec() const;
+  void SetCodec(BodyCodec codec);
+  std::uint32_t GetUncompressedSize() const;
+  void SetUncompressedSize(std::uint32_t size);
+
+  // codec the client accepts for the reply body.
+  BodyCodec GetAcceptCodec() const;
+  void SetAcceptCodec(BodyCodec codec);
+
+  // handshake of the client. Version is 0 if not set.
+  std::uint32_t GetProtocolVersion() const;
+  void SetProtocolVersion(std::uint32_t version);
+  std::uint64_t GetCapabilities() const;
+  void SetCapabilities(std::uint64_t capabilities);
+
 private:
   std::string url_;
+  std::vector<std::uint32_t> batchItemSizes_;
+  BodyCodec codec_;
+  std::uint32_t uncompressedSize_;
+  BodyCodec acceptCodec_;
+  std::uint32_t protocolVersion_;
+  std::uint64_t capabilities_;
+};
+
+// result of one item in a batch reply.
+class FabricRPCBatchItemStatus {
+public:
+  FabricRPCBatchItemStatus();
+  FabricRPCBatchItemStatus(int StatusCode, const std::string &StatusMessage,
+                           std::uint32_t BodySize);
+
+  int GetStatusCode() const;
+  const std::string &GetStatusMessage() const;
+  std::uint32_t GetBodySize() const;
+
+private:
+  int StatusCode_;
+  std::string StatusMessage_;
+  std::uint32_t BodySize_;
 };
 
 class FabricRPCReplyHeader {
@@ -33,9 +82,30 @@ public:
   const std::string &GetStatusMessage() const;
   void SetStatusMessage(const std::string &StatusMessage);
 
+  // per item results if the request is batched.
+  const std::vector<FabricRPCBatchItemStatus> &GetBatchItemStatus() const;
+  void AddBatchItemStatus(FabricRPCBatchItemStatus status);
+
+  // codec of the reply body, and body size before compression.
+  BodyCodec GetCodec() const;
+  void SetCodec(BodyCodec codec);
+  std::uint32_t GetUncompressedSize() const;
+  void SetUncompressedSize(std::uint32_t size);
+
+  // handshake reply of the server. Version is 0 if not set.
+  std::uint32_t GetProtocolVersion() const;
+  void SetProtocolVersion(std::uint32_t version);
+  std::uint64_t GetCapabilities() const;
+  void SetCapabilities(std::uint64_t capabilities);
+
 private:
   int StatusCode_;
   std::string StatusMessage_;
+  std::vector<FabricRPCBatchItemStatus> batchItemStatus_;
+  BodyCodec codec_;
+  std::uint32_t uncompressedSize_;
+  std::uint32_t protocolVersion_;
+  std::uint64_t capabilities_;
 };
 
 // This is needed because we do not want fabric_rpc.lib to have dependency on
@@ -66,6 +136,16 @@ public:
     assert(data != nullptr);
     RequestProto header;
     header.set_url(request->GetUrl());
+    for (std::uint32_t size : request->GetBatchItemSizes()) {
+      header.add_batch_item_sizes(size);
+    }
+    // codec enum of the proto has the same values as BodyCodec
+    using ProtoCodec = decltype(header.codec());
+    header.set_codec(static_cast<ProtoCodec>(request->GetCodec()));
+    header.set_uncompressed_size(request->GetUncompressedSize());
+    header.set_accept_codec(static_cast<ProtoCodec>(request->GetAcceptCodec()));
+    header.set_protocol_version(request->GetProtocolVersion());
+    header.set_capabilities(request->GetCapabilities());
     return header.SerializeToString(data);
   }
 
@@ -76,6 +156,16 @@ public:
     ReplyProto header;
     header.set_status_code(reply->GetStatusCode());
     header.set_status_message(reply->GetStatusMessage());
+    for (const FabricRPCBatchItemStatus &item : reply->GetBatchItemStatus()) {
+      auto *item_header = header.add_batch_status();
+      item_header->set_status_code(item.GetStatusCode());
+      item_header->set_status_message(item.GetStatusMessage());
+      item_header->set_body_size(item.GetBodySize());
+    }
+    header.set_codec(static_cast<decltype(header.codec())>(reply->GetCodec()));
+    header.set_uncompressed_size(reply->GetUncompressedSize());
+    header.set_protocol_version(reply->GetProtocolVersion());
+    header.set_capabilities(reply->GetCapabilities());
     return header.SerializeToString(data);
   }
   bool DeserializeRequestHeader(const std::string *data,
@@ -87,6 +177,13 @@ public:
       return false;
     }
     request->SetUrl(header.url());
+    request->SetBatchItemSizes(std::vector<std::uint32_t>(
+        header.batch_item_sizes().begin(), header.batch_item_sizes().end()));
+    request->SetCodec(static_cast<BodyCodec>(header.codec()));
+    request->SetUncompressedSize(header.uncompressed_size());
+    request->SetAcceptCodec(static_cast<BodyCodec>(header.accept_codec()));
+    request->SetProtocolVersion(header.protocol_version());
+    request->SetCapabilities(header.capabilities());
     return true;
   }
   bool DeserializeReplyHeader(const std::string *data,
@@ -99,6 +196,15 @@ public:
     }
     reply->SetStatusCode(header.status_code());
     reply->SetStatusMessage(header.status_message());
+    for (const auto &item_header : header.batch_status()) {
+      reply->AddBatchItemStatus(FabricRPCBatchItemStatus(
+          item_header.status_code(), item_header.status_message(),
+          item_header.body_size()));
+    }
+    reply->SetCodec(static_cast<BodyCodec>(header.codec()));
+    reply->SetUncompressedSize(header.uncompressed_size());
+    reply->SetProtocolVersion(header.protocol_version());
+    reply->SetCapabilities(header.capabilities());
     return true;
   }
 };
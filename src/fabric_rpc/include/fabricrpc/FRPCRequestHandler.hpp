@@ -13,8 +13,10 @@
 
 #include "fabricrpc/FRPCHeader.hpp"
 #include "fabricrpc/Operation.hpp"
+#include "fabricrpc_tool/request_span.hpp"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace fabricrpc {
@@ -30,6 +32,17 @@ public:
   void Initialize(const std::vector<std::shared_ptr<MiddleWare>> &svcList,
                   std::shared_ptr<IFabricRPCHeaderProtoConverter> cv);
 
+  // unary replies at least this size are compressed with the codec the
+  // client accepts.
+  void SetCompressionThreshold(std::size_t threshold);
+
+  // compressed requests claiming a larger body are rejected.
+  void SetMaxUncompressedSize(std::size_t size);
+
+  // sink of the spans of replied requests. Spans are not marked without one.
+  // Set before the handler is given to transport.
+  void SetSpanSink(std::shared_ptr<span_sink> sink);
+
   HRESULT STDMETHODCALLTYPE BeginProcessRequest(
       /* [in] */ COMMUNICATION_CLIENT_ID clientId,
       /* [in] */ IFabricTransportMessage *message,
@@ -48,6 +61,11 @@ public:
 private:
   std::shared_ptr<MiddleWare> svc_;
   std::shared_ptr<IFabricRPCHeaderProtoConverter> cv_;
+  std::size_t compressionThreshold_;
+  std::size_t maxUncompressedSize_;
+  // serialized reply header of an ok unary reply without codec.
+  std::string okReplyHeader_;
+  std::shared_ptr<span_sink> spanSink_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -8,10 +8,43 @@
 #include <atlcom.h>
 
 #include "fabrictransport_.h"
+#include <memory>
 #include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 namespace fabricrpc {
 
+// one body buffer of an outgoing message.
+// Transport sends all segments of a message without concatenating them.
+class BodySegment {
+public:
+  // message owns the data.
+  static BodySegment Owned(std::string data);
+
+  // data needs to be valid until transport disposes the message.
+  static BodySegment Borrowed(std::string_view data);
+
+  // message keeps a reference to data, i.e. for a cached part shared by
+  // replies.
+  static BodySegment Shared(std::shared_ptr<const std::string> data);
+
+  std::string_view View() const;
+
+  // returns nullptr if the segment does not own its data.
+  const std::string *GetOwned() const;
+
+private:
+  BodySegment(std::variant<std::string, std::string_view,
+                           std::shared_ptr<const std::string>>
+                  data);
+
+  std::variant<std::string, std::string_view,
+               std::shared_ptr<const std::string>>
+      data_;
+};
+
 // atl implementation of transport message
 class FRPCTransportMessage : public CComObjectRootEx<CComMultiThreadModel>,
                              public IFabricTransportMessage {
@@ -31,12 +64,21 @@ public:
 
   void Initialize(std::string header, std::string body);
 
+  // each body is sent as a separate body blob.
+  void Initialize(std::string header, std::vector<std::string> bodies);
+
+  // each segment is sent as a separate body blob.
+  void Initialize(std::string header, std::vector<BodySegment> segments);
+
   // copy content from another msg
   // if msg blob has multiple parts, this will concat all msg blobs into one
   void CopyMsg(IFabricTransportMessage *other);
 
   const std::string &GetHeader();
+  // only valid if msg has one owned body blob, i.e. msg is copied or
+  // initialized with a single body.
   const std::string &GetBody();
+  const std::vector<BodySegment> &GetBodies();
 
   // IFabricTransportMessage impl
 
@@ -48,8 +90,8 @@ public:
   STDMETHOD_(void, Dispose)(void) override;
 
 private:
-  std::string body_;
-  FABRIC_TRANSPORT_MESSAGE_BUFFER body_ret_;
+  std::vector<BodySegment> bodies_;
+  std::vector<FABRIC_TRANSPORT_MESSAGE_BUFFER> bodies_ret_;
   std::string header_;
   FABRIC_TRANSPORT_MESSAGE_BUFFER header_ret_;
 };
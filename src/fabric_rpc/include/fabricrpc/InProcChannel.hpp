@@ -0,0 +1,72 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include <atlbase.h>
+#include <atlcom.h>
+
+#include "fabrictransport_.h"
+
+#include "fabricrpc/Operation.hpp"
+#include "fabricrpc/Status.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fabricrpc {
+
+class InProcTimer;
+
+// Calls services linked into the same process without transport, headers
+// and serialization. Generated clients created with a channel use it instead
+// of a transport client.
+// The request and reply protos are passed to the service's Begin and End
+// methods by pointer. Begin gets the request as const, and parsed requests
+// are only valid in Begin as well, so no copy is needed.
+// Statuses and timeouts are the same as calls over transport: routing and
+// begin errors are returned by EndRequest, and the service gets the caller's
+// timeout. If the service does not complete in time, the caller's callback is
+// invoked and EndRequest returns FABRIC_E_TIMEOUT as a transport error. The
+// late reply is dropped.
+// Thread safe.
+class InProcChannel {
+public:
+  explicit InProcChannel(
+      const std::vector<std::shared_ptr<MiddleWare>> &svcList);
+  ~InProcChannel();
+
+  InProcChannel(const InProcChannel &) = delete;
+  InProcChannel &operator=(const InProcChannel &) = delete;
+
+  // request needs to be the request proto of the method at url.
+  Status BeginRequest(const std::string &url,
+                      const google::protobuf::MessageLite *request,
+                      DWORD timeoutMilliseconds,
+                      IFabricAsyncOperationCallback *callback,
+                      /*out*/ IFabricAsyncOperationContext **context);
+
+  // reply needs to be the reply proto of the method.
+  Status EndRequest(IFabricAsyncOperationContext *context,
+                    /*out*/ google::protobuf::MessageLite *reply);
+
+  // one way request. The service runs the method, and the reply and errors
+  // after begin are dropped.
+  Status Send(const std::string &url,
+              const google::protobuf::MessageLite *request);
+
+private:
+  Status Route(const std::string &url,
+               std::unique_ptr<IBeginOperation> &beginOp,
+               std::unique_ptr<IEndOperation> &endOp);
+
+  std::vector<std::shared_ptr<MiddleWare>> svcList_;
+  // timeouts of calls in flight.
+  std::shared_ptr<InProcTimer> timer_;
+};
+
+} // namespace fabricrpc
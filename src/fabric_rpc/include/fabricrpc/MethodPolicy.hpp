@@ -0,0 +1,53 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabricrpc/Status.hpp"
+
+#include <cstddef>
+
+namespace fabricrpc {
+
+enum class MethodKind {
+  Unary,
+  ServerStreaming,
+  ClientStreaming,
+  // not supported, only described.
+  BidiStreaming
+};
+
+// compile time description of a generated method.
+struct MethodDescriptor {
+  // full name of the service, i.e. helloworld.FabricHello
+  const char *service;
+  const char *name;
+  // url of the method, i.e. /helloworld.FabricHello/SayHello
+  const char *path;
+  MethodKind kind;
+  bool oneWay;
+  // position of the method in the service.
+  std::size_t index;
+};
+
+// Hooks of generated services. A generated service is
+// <Service>::BasicService<Policy>, and the begin and end operations of each
+// request call:
+//   RequestStart  before the request body is parsed
+//   ParseEnd      after the body is parsed, with whether it parsed
+//   HandlerEnd    after the user's End method returns
+//   SerializeEnd  after the reply is serialized
+// Begin and end of a request may run on different threads, so hooks are
+// static, and the policy keeps its own state.
+// The default policy compiles to nothing.
+struct NullMethodPolicy {
+  static void RequestStart(const MethodDescriptor &) {}
+  static void ParseEnd(const MethodDescriptor &, bool) {}
+  static void HandlerEnd(const MethodDescriptor &, const Status &) {}
+  static void SerializeEnd(const MethodDescriptor &, const Status &) {}
+};
+
+} // namespace fabricrpc
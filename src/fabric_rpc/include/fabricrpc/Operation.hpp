@@ -6,11 +6,16 @@
 
 #pragma once
 
+#include "fabricrpc/MethodPolicy.hpp"
 #include "fabricrpc/Status.hpp"
 #include <chrono>
 #include <functional>
 #include <memory>
 
+namespace google::protobuf {
+class MessageLite;
+} // namespace google::protobuf
+
 namespace fabricrpc {
 
 class IBeginOperation {
@@ -18,28 +23,40 @@ public:
   virtual Status Invoke(std::string body, DWORD timeoutMilliseconds,
                         IFabricAsyncOperationCallback *callback,
                         /*out*/ IFabricAsyncOperationContext **context) = 0;
+  // same as Invoke for callers in the same process. request is the request
+  // proto of the method, and is not copied.
+  virtual Status
+  InvokeLocal(const google::protobuf::MessageLite *request,
+              DWORD timeoutMilliseconds,
+              IFabricAsyncOperationCallback *callback,
+              /*out*/ IFabricAsyncOperationContext **context) = 0;
   virtual ~IBeginOperation() = default;
 };
 
-template <typename T> class BeginOperation : public IBeginOperation {
+template <typename T, typename Policy = NullMethodPolicy>
+class BeginOperation : public IBeginOperation {
 public:
   BeginOperation(
+      const MethodDescriptor &method,
       std::function<Status(const T *, DWORD, IFabricAsyncOperationCallback *,
                            /*out*/ IFabricAsyncOperationContext **)>
           op)
-      : op_(op) {}
+      : method_(method), op_(op) {}
 
   Status Invoke(std::string body, DWORD timeoutMilliseconds,
                 IFabricAsyncOperationCallback *callback,
                 /*out*/ IFabricAsyncOperationContext **context) override {
     // calculate new timeout. Parsing may take some time if payload is big.
     auto starttime = std::chrono::steady_clock::now();
+    Policy::RequestStart(method_);
 
     T req;
     // deserialize
     bool ok = req.ParseFromArray(body.c_str(), static_cast<int>(body.size()));
+    Policy::ParseEnd(method_, ok);
     if (!ok) {
-      return Status(StatusCode::INVALID_ARGUMENT, "cannot parse body");
+      static const std::string badBody = "cannot parse body";
+      return Status(StatusCode::INVALID_ARGUMENT, &badBody);
     }
 
     // prepare timeout value
@@ -54,7 +71,18 @@ public:
     return op_(&req, newTimeout, callback, context);
   }
 
+  Status InvokeLocal(const google::protobuf::MessageLite *request,
+                     DWORD timeoutMilliseconds,
+                     IFabricAsyncOperationCallback *callback,
+                     /*out*/ IFabricAsyncOperationContext **context) override {
+    Policy::RequestStart(method_);
+    Policy::ParseEnd(method_, true);
+    return op_(static_cast<const T *>(request), timeoutMilliseconds, callback,
+               context);
+  }
+
 private:
+  const MethodDescriptor &method_;
   std::function<Status(const T *, DWORD, IFabricAsyncOperationCallback *,
                        /*out*/ IFabricAsyncOperationContext **)>
       op_;
@@ -64,20 +92,27 @@ class IEndOperation {
 public:
   virtual Status Invoke(IFabricAsyncOperationContext *context,
                         std::string &reply) = 0;
+  // same as Invoke for callers in the same process. reply is the reply proto
+  // of the method, and is filled without serialization.
+  virtual Status InvokeLocal(IFabricAsyncOperationContext *context,
+                             google::protobuf::MessageLite *reply) = 0;
   virtual ~IEndOperation() = default;
 };
 
-template <typename T> class EndOperation : public IEndOperation {
+template <typename T, typename Policy = NullMethodPolicy>
+class EndOperation : public IEndOperation {
 public:
   EndOperation(
+      const MethodDescriptor &method,
       std::function<Status(IFabricAsyncOperationContext *context, /*out*/ T *)>
           op)
-      : op_(op) {}
+      : method_(method), op_(op) {}
 
   Status Invoke(IFabricAsyncOperationContext *context,
                 std::string &reply) override {
     T proto;
     Status err = op_(context, &proto);
+    Policy::HandlerEnd(method_, err);
     if (err) {
       return err;
     }
@@ -85,12 +120,26 @@ public:
     bool ok = proto.SerializeToString(&reply);
     assert(ok); // This only happens in dbg mode
     if (!ok) {
-      return Status(StatusCode::INTERNAL, "Server cannot serialize body.");
+      static const std::string badReply = "Server cannot serialize body.";
+      err = Status(StatusCode::INTERNAL, &badReply);
+    }
+    Policy::SerializeEnd(method_, err);
+    return err;
+  }
+
+  Status InvokeLocal(IFabricAsyncOperationContext *context,
+                     google::protobuf::MessageLite *reply) override {
+    Status err = op_(context, static_cast<T *>(reply));
+    Policy::HandlerEnd(method_, err);
+    if (!err) {
+      // nothing to serialize.
+      Policy::SerializeEnd(method_, err);
     }
-    return Status();
+    return err;
   }
 
 private:
+  const MethodDescriptor &method_;
   std::function<Status(IFabricAsyncOperationContext *context, /*out*/ T *)> op_;
 };
 
@@ -13,12 +13,21 @@
 
 namespace fabricrpc {
 
+// OK and errors with static messages carry no heap string, so creating and
+// copying them does not allocate. Other messages are owned by each copy.
 class Status {
 public:
   Status(StatusCode code, std::string error_message,
          HRESULT transportErrorCode);
   Status(StatusCode code, std::string error_message);
 
+  // staticMessage is not copied and needs static storage duration, i.e. a
+  // function local static.
+  Status(StatusCode code, const std::string *staticMessage);
+
+  // message is the name of code.
+  explicit Status(StatusCode code);
+
   Status();
   StatusCode GetErrorCode() const;
   const std::string &GetErrorMessage() const;
@@ -31,8 +40,12 @@ public:
 
 private:
   StatusCode code_;
+  // message with static storage. nullptr if message is owned or is the name
+  // of code.
+  const std::string *staticMessage_;
+  // owned message. Empty if the message is static or is the name of code.
   std::string error_message_;
   HRESULT transportErrorCode_;
 };
 
-} // namespace fabricrpc
\ No newline at end of file
+} // namespace fabricrpc
@@ -0,0 +1,109 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc/Codec.hpp"
+
+#include <lz4.h>
+#include <zstd.h>
+
+#include <limits>
+
+namespace fabricrpc {
+
+// zstd level that favors speed. Higher levels cost too much cpu for rpc.
+static const int kZstdLevel = 3;
+
+bool ShouldCompress(const CompressionOptions &options,
+                    const std::string &body) {
+  return options.Codec != BodyCodec::None &&
+         body.size() >= options.Threshold &&
+         body.size() <= std::numeric_limits<std::uint32_t>::max();
+}
+
+Status CompressBody(BodyCodec codec, const std::string &in,
+                    /*out*/ std::string *out) {
+  switch (codec) {
+  case BodyCodec::None:
+    *out = in;
+    return Status();
+  case BodyCodec::Lz4: {
+    if (in.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+      return Status(StatusCode::INVALID_ARGUMENT, "body too large for lz4");
+    }
+    int inSize = static_cast<int>(in.size());
+    out->resize(LZ4_compressBound(inSize));
+    int len = LZ4_compress_default(in.data(), out->data(), inSize,
+                                   static_cast<int>(out->size()));
+    if (len <= 0) {
+      return Status(StatusCode::INTERNAL, "lz4 compress failed");
+    }
+    out->resize(len);
+    return Status();
+  }
+  case BodyCodec::Zstd: {
+    out->resize(ZSTD_compressBound(in.size()));
+    std::size_t len = ZSTD_compress(out->data(), out->size(), in.data(),
+                                    in.size(), kZstdLevel);
+    if (ZSTD_isError(len)) {
+      return Status(StatusCode::INTERNAL, "zstd compress failed");
+    }
+    out->resize(len);
+    return Status();
+  }
+  default:
+    return Status(StatusCode::INVALID_ARGUMENT, "unknown body codec");
+  }
+}
+
+Status DecompressBody(BodyCodec codec, const std::string &in,
+                      std::uint32_t uncompressedSize, std::size_t maxSize,
+                      /*out*/ std::string *out) {
+  if (codec != BodyCodec::None && uncompressedSize > maxSize) {
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "uncompressed body is too large");
+  }
+  switch (codec) {
+  case BodyCodec::None:
+    *out = in;
+    return Status();
+  case BodyCodec::Lz4: {
+    if (in.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE) ||
+        uncompressedSize > static_cast<std::uint32_t>(LZ4_MAX_INPUT_SIZE)) {
+      return Status(StatusCode::INVALID_ARGUMENT, "body too large for lz4");
+    }
+    out->resize(uncompressedSize);
+    int len = LZ4_decompress_safe(in.data(), out->data(),
+                                  static_cast<int>(in.size()),
+                                  static_cast<int>(uncompressedSize));
+    if (len < 0 || static_cast<std::uint32_t>(len) != uncompressedSize) {
+      return Status(StatusCode::INVALID_ARGUMENT, "lz4 decompress failed");
+    }
+    return Status();
+  }
+  case BodyCodec::Zstd: {
+    // the frame has the size too, so a lying header fails before allocation.
+    unsigned long long frameSize =
+        ZSTD_getFrameContentSize(in.data(), in.size());
+    if (frameSize == ZSTD_CONTENTSIZE_ERROR ||
+        (frameSize != ZSTD_CONTENTSIZE_UNKNOWN &&
+         frameSize != uncompressedSize)) {
+      return Status(StatusCode::INVALID_ARGUMENT,
+                    "zstd frame size does not match");
+    }
+    out->resize(uncompressedSize);
+    std::size_t len =
+        ZSTD_decompress(out->data(), out->size(), in.data(), in.size());
+    if (ZSTD_isError(len) || len != uncompressedSize) {
+      return Status(StatusCode::INVALID_ARGUMENT, "zstd decompress failed");
+    }
+    return Status();
+  }
+  default:
+    return Status(StatusCode::INVALID_ARGUMENT, "unknown body codec");
+  }
+}
+
+} // namespace fabricrpc
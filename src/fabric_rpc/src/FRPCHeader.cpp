@@ -8,20 +8,94 @@
 
 namespace fabricrpc {
 
-FabricRPCRequestHeader::FabricRPCRequestHeader() : url_() {}
+FabricRPCRequestHeader::FabricRPCRequestHeader()
+    : url_(), batchItemSizes_(), codec_(BodyCodec::None), uncompressedSize_(0),
+      acceptCodec_(BodyCodec::None), protocolVersion_(0), capabilities_(0) {}
 
 FabricRPCRequestHeader::FabricRPCRequestHeader(const std::string &url)
-    : url_(url) {}
+    : url_(url), batchItemSizes_(), codec_(BodyCodec::None),
+      uncompressedSize_(0), acceptCodec_(BodyCodec::None), protocolVersion_(0),
+      capabilities_(0) {}
 
 const std::string &FabricRPCRequestHeader::GetUrl() const { return url_; }
 
 void FabricRPCRequestHeader::SetUrl(std::string url) { url_ = std::move(url); }
 
+const std::vector<std::uint32_t> &
+FabricRPCRequestHeader::GetBatchItemSizes() const {
+  return batchItemSizes_;
+}
+
+void FabricRPCRequestHeader::SetBatchItemSizes(
+    std::vector<std::uint32_t> sizes) {
+  batchItemSizes_ = std::move(sizes);
+}
+
+bool FabricRPCRequestHeader::IsBatch() const {
+  return !batchItemSizes_.empty();
+}
+
+BodyCodec FabricRPCRequestHeader::GetCodec() const { return codec_; }
+
+void FabricRPCRequestHeader::SetCodec(BodyCodec codec) { codec_ = codec; }
+
+std::uint32_t FabricRPCRequestHeader::GetUncompressedSize() const {
+  return uncompressedSize_;
+}
+
+void FabricRPCRequestHeader::SetUncompressedSize(std::uint32_t size) {
+  uncompressedSize_ = size;
+}
+
+BodyCodec FabricRPCRequestHeader::GetAcceptCodec() const {
+  return acceptCodec_;
+}
+
+void FabricRPCRequestHeader::SetAcceptCodec(BodyCodec codec) {
+  acceptCodec_ = codec;
+}
+
+std::uint32_t FabricRPCRequestHeader::GetProtocolVersion() const {
+  return protocolVersion_;
+}
+
+void FabricRPCRequestHeader::SetProtocolVersion(std::uint32_t version) {
+  protocolVersion_ = version;
+}
+
+std::uint64_t FabricRPCRequestHeader::GetCapabilities() const {
+  return capabilities_;
+}
+
+void FabricRPCRequestHeader::SetCapabilities(std::uint64_t capabilities) {
+  capabilities_ = capabilities;
+}
+
+FabricRPCBatchItemStatus::FabricRPCBatchItemStatus()
+    : FabricRPCBatchItemStatus(0, "", 0) {}
+
+FabricRPCBatchItemStatus::FabricRPCBatchItemStatus(
+    int StatusCode, const std::string &StatusMessage, std::uint32_t BodySize)
+    : StatusCode_(StatusCode), StatusMessage_(StatusMessage),
+      BodySize_(BodySize) {}
+
+int FabricRPCBatchItemStatus::GetStatusCode() const { return StatusCode_; }
+
+const std::string &FabricRPCBatchItemStatus::GetStatusMessage() const {
+  return StatusMessage_;
+}
+
+std::uint32_t FabricRPCBatchItemStatus::GetBodySize() const {
+  return BodySize_;
+}
+
 FabricRPCReplyHeader::FabricRPCReplyHeader() : FabricRPCReplyHeader(0, "") {}
 
 FabricRPCReplyHeader::FabricRPCReplyHeader(int StatusCode,
                                            const std::string &StatusMessage)
-    : StatusCode_(StatusCode), StatusMessage_(StatusMessage) {}
+    : StatusCode_(StatusCode), StatusMessage_(StatusMessage),
+      batchItemStatus_(), codec_(BodyCodec::None), uncompressedSize_(0),
+      protocolVersion_(0), capabilities_(0) {}
 
 int FabricRPCReplyHeader::GetStatusCode() const { return StatusCode_; }
 void FabricRPCReplyHeader::SetStatusCode(int statusCode) {
@@ -36,4 +110,41 @@ void FabricRPCReplyHeader::SetStatusMessage(const std::string &StatusMessage) {
   StatusMessage_ = StatusMessage;
 }
 
+const std::vector<FabricRPCBatchItemStatus> &
+FabricRPCReplyHeader::GetBatchItemStatus() const {
+  return batchItemStatus_;
+}
+
+void FabricRPCReplyHeader::AddBatchItemStatus(FabricRPCBatchItemStatus status) {
+  batchItemStatus_.push_back(std::move(status));
+}
+
+BodyCodec FabricRPCReplyHeader::GetCodec() const { return codec_; }
+
+void FabricRPCReplyHeader::SetCodec(BodyCodec codec) { codec_ = codec; }
+
+std::uint32_t FabricRPCReplyHeader::GetUncompressedSize() const {
+  return uncompressedSize_;
+}
+
+void FabricRPCReplyHeader::SetUncompressedSize(std::uint32_t size) {
+  uncompressedSize_ = size;
+}
+
+std::uint32_t FabricRPCReplyHeader::GetProtocolVersion() const {
+  return protocolVersion_;
+}
+
+void FabricRPCReplyHeader::SetProtocolVersion(std::uint32_t version) {
+  protocolVersion_ = version;
+}
+
+std::uint64_t FabricRPCReplyHeader::GetCapabilities() const {
+  return capabilities_;
+}
+
+void FabricRPCReplyHeader::SetCapabilities(std::uint64_t capabilities) {
+  capabilities_ = capabilities;
+}
+
 } // namespace fabricrpc
\ No newline at end of file
@@ -5,14 +5,19 @@
 // ------------------------------------------------------------
 
 #include "fabricrpc/FRPCRequestHandler.hpp"
+#include "fabricrpc/Capabilities.hpp"
+#include "fabricrpc/Codec.hpp"
 #include "fabricrpc/FRPCTransportMessage.hpp"
 #include "fabricrpc/Operation.hpp"
 #include "fabricrpc/exp/AsyncAnyContext.hpp"
+#include "fabricrpc_tool/alloc_stats.hpp"
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <vector>
 
 namespace fabricrpc {
@@ -43,6 +48,14 @@ private:
   std::vector<std::shared_ptr<MiddleWare>> svcList_;
 };
 
+// state of one item in a batch request.
+struct batchItemPayload {
+  // User's begin operation status for this item.
+  fabricrpc::Status beginStatus;
+  // User's ctx for this item to be passed in to user's end operation.
+  CComPtr<IFabricAsyncOperationContext> innerCtx;
+};
+
 // payload to carry around between proccess request begin and end.
 struct ctxPayload {
   // User's end operation
@@ -52,6 +65,17 @@ struct ctxPayload {
   fabricrpc::Status beginStatus;
   // User's ctx to be passed in to user's end operation.
   CComPtr<IFabricAsyncOperationContext> innerCtx;
+  // items of a batch request. Empty if the request is not batched.
+  std::vector<batchItemPayload> batchItems;
+  // number of batch items not yet completed, plus one held by
+  // BeginProcessRequest until all items are started.
+  std::atomic<std::size_t> batchPending;
+  // codec client accepts for the reply body.
+  BodyCodec acceptCodec = BodyCodec::None;
+  // client sent its protocol version, and is replied with ours.
+  bool handshake = false;
+  // stages of the request. Only marked if the handler has a span sink.
+  request_span span;
   std::mutex mtx_;
 
   // set innerCtx thread safe
@@ -66,8 +90,28 @@ struct ctxPayload {
       assert(innerCtx == context);
     }
   }
+
+  // same as SetInnerCtx but for a batch item.
+  void SetBatchInnerCtx(std::size_t index,
+                        IFabricAsyncOperationContext *context) {
+    std::lock_guard<std::mutex> l(mtx_);
+    CComPtr<IFabricAsyncOperationContext> &itemCtx = batchItems[index].innerCtx;
+    if (itemCtx == nullptr) {
+      context->AddRef();
+      itemCtx.Attach(context);
+    } else {
+      assert(itemCtx == context);
+    }
+  }
 };
 
+// Marks the point if the request is traced, i.e. span is not nullptr.
+void MarkSpan(request_span *span, span_point point) {
+  if (span != nullptr) {
+    span->mark(point);
+  }
+}
+
 // This is the ctx type passed from transport begin process request
 // to end process request.
 using trCtx = fabricrpc::AsyncAnyCtx<std::unique_ptr<ctxPayload>>;
@@ -102,6 +146,10 @@ public:
     assert(context != nullptr);
     assert(transportCallback_ != nullptr);
     assert(wrapCtx_ != nullptr);
+    request_span &span = wrapCtx_->GetContent()->span;
+    if (span.has(span_point::handler_start)) {
+      span.mark(span_point::handler_end);
+    }
     wrapCtx_->GetContent()->SetInnerCtx(context);
     transportCallback_->Invoke(wrapCtx_);
     // User may have this callback in the context and form a circular refcount.
@@ -114,7 +162,133 @@ private:
   CComPtr<CComObjectNoLock<trCtx>> wrapCtx_;
 };
 
-FRPCRequestHandler::FRPCRequestHandler() : svc_(), cv_() {}
+// Marks one batch item (or the begin guard) done.
+// The last one invokes the transport callback.
+void CompleteBatchItem(IFabricAsyncOperationCallback *transportCallback,
+                       CComObjectNoLock<trCtx> *wrapCtx) {
+  if (wrapCtx->GetContent()->batchPending.fetch_sub(1) == 1) {
+    request_span &span = wrapCtx->GetContent()->span;
+    if (span.has(span_point::handler_start)) {
+      span.mark(span_point::handler_end);
+    }
+    transportCallback->Invoke(wrapCtx);
+  }
+}
+
+// Callback passed to user's begin operation for each item in a batch.
+// The transport callback is invoked after all items are completed.
+class FRPCBatchItemCallback : public CComObjectRootEx<CComMultiThreadModel>,
+                              public IFabricAsyncOperationCallback {
+
+  BEGIN_COM_MAP(FRPCBatchItemCallback)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationCallback)
+  END_COM_MAP()
+public:
+  void Initialize(IFabricAsyncOperationCallback *callback,
+                  CComObjectNoLock<trCtx> *wrapCtx, std::size_t index) {
+    assert(callback != nullptr);
+    assert(wrapCtx != nullptr);
+
+    callback->AddRef();
+    transportCallback_.Attach(callback);
+    wrapCtx->AddRef();
+    wrapCtx_.Attach(wrapCtx);
+    index_ = index;
+  }
+
+  void STDMETHODCALLTYPE Invoke(
+      /* [in] */ IFabricAsyncOperationContext *context) override {
+    assert(context != nullptr);
+    assert(wrapCtx_ != nullptr);
+    wrapCtx_->GetContent()->SetBatchInnerCtx(index_, context);
+    CompleteBatchItem(transportCallback_, wrapCtx_);
+    // break circular refcount the same way as FRPCOperationCallback.
+    wrapCtx_.Release();
+  }
+
+private:
+  CComPtr<IFabricAsyncOperationCallback> transportCallback_;
+  CComPtr<CComObjectNoLock<trCtx>> wrapCtx_;
+  std::size_t index_ = 0;
+};
+
+// Invokes user's begin operation for each item in the batch.
+// Items failed to begin are completed immediately with the error.
+Status BeginProcessBatch(const std::vector<std::uint32_t> &itemSizes,
+                         const std::string &body, IBeginOperation *beginOp,
+                         DWORD timeoutMilliseconds,
+                         IFabricAsyncOperationCallback *callback,
+                         CComObjectNoLock<trCtx> *retCtx) {
+  std::size_t total =
+      std::accumulate(itemSizes.begin(), itemSizes.end(), std::size_t(0));
+  if (total != body.size()) {
+    return Status(StatusCode::INVALID_ARGUMENT,
+                  "batch item sizes do not match body");
+  }
+
+  const std::unique_ptr<ctxPayload> &payload = retCtx->GetContent();
+  payload->batchItems.resize(itemSizes.size());
+  // the extra one is released after all items are started, so that transport
+  // callback is not invoked while still looping.
+  payload->batchPending = itemSizes.size() + 1;
+
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < itemSizes.size(); i++) {
+    std::string itemBody = body.substr(offset, itemSizes[i]);
+    offset += itemSizes[i];
+
+    CComPtr<CComObjectNoLock<FRPCBatchItemCallback>> itemCallback(
+        new CComObjectNoLock<FRPCBatchItemCallback>());
+    itemCallback->Initialize(callback, retCtx, i);
+
+    CComPtr<IFabricAsyncOperationContext> itemCtx;
+    Status err = beginOp->Invoke(std::move(itemBody), timeoutMilliseconds,
+                                 itemCallback, &itemCtx);
+    if (err) {
+      // callback is never invoked by user for this item.
+      payload->batchItems[i].beginStatus = err;
+      CompleteBatchItem(callback, retCtx);
+    } else {
+      payload->SetBatchInnerCtx(i, itemCtx);
+    }
+  }
+  // release the begin guard
+  CompleteBatchItem(callback, retCtx);
+  return Status();
+}
+
+// Callback passed to user's begin operation of a one way request.
+// There is no transport callback to chain to, so it runs user's end operation
+// right away and drops the reply.
+class FRPCOneWayCallback : public CComObjectRootEx<CComMultiThreadModel>,
+                           public IFabricAsyncOperationCallback {
+
+  BEGIN_COM_MAP(FRPCOneWayCallback)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationCallback)
+  END_COM_MAP()
+public:
+  void Initialize(std::unique_ptr<IEndOperation> endOp) {
+    assert(endOp != nullptr);
+    endOp_ = std::move(endOp);
+  }
+
+  void STDMETHODCALLTYPE Invoke(
+      /* [in] */ IFabricAsyncOperationContext *context) override {
+    assert(context != nullptr);
+    assert(endOp_ != nullptr);
+    std::string reply;
+    // nobody to report the error to.
+    endOp_->Invoke(context, reply);
+  }
+
+private:
+  std::unique_ptr<IEndOperation> endOp_;
+};
+
+FRPCRequestHandler::FRPCRequestHandler()
+    : svc_(), cv_(), compressionThreshold_(CompressionOptions().Threshold),
+      maxUncompressedSize_(kDefaultMaxUncompressedSize), okReplyHeader_(),
+      spanSink_() {}
 
 void FRPCRequestHandler::Initialize(
     const std::vector<std::shared_ptr<MiddleWare>> &svcList,
@@ -127,6 +301,27 @@ void FRPCRequestHandler::Initialize(
   }
   svc_ = router;
   cv_ = cv;
+
+  // most replies are ok, so the header is serialized once.
+  FabricRPCReplyHeader okHeader;
+  Status okStatus;
+  okHeader.SetStatusCode(okStatus.GetErrorCode());
+  okHeader.SetStatusMessage(okStatus.GetErrorMessage());
+  bool ok = cv_->SerializeReplyHeader(&okHeader, &okReplyHeader_);
+  assert(ok);
+  DBG_UNREFERENCED_LOCAL_VARIABLE(ok);
+}
+
+void FRPCRequestHandler::SetCompressionThreshold(std::size_t threshold) {
+  compressionThreshold_ = threshold;
+}
+
+void FRPCRequestHandler::SetMaxUncompressedSize(std::size_t size) {
+  maxUncompressedSize_ = size;
+}
+
+void FRPCRequestHandler::SetSpanSink(std::shared_ptr<span_sink> sink) {
+  spanSink_ = std::move(sink);
 }
 
 HRESULT STDMETHODCALLTYPE FRPCRequestHandler::BeginProcessRequest(
@@ -139,6 +334,9 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::BeginProcessRequest(
 
   assert(svc_ != nullptr); // must initialize
 
+  // allocations until the user begin operation, and on failure the reply.
+  alloc_scope decodeScope(alloc_phase::server_decode);
+
   // calculate time spent parsing headers, and substract from timeout passed to
   // user handlers.
   auto starttime = std::chrono::steady_clock::now();
@@ -148,8 +346,9 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::BeginProcessRequest(
       new CComObjectNoLock<FRPCTransportMessage>());
   msgPtr->CopyMsg(message);
 
-  const std::string &body = msgPtr->GetBody();
   const std::string &header = msgPtr->GetHeader();
+  // body after decompression
+  std::string body = msgPtr->GetBody();
 
   Status err; // The error to be sent back to client
   // context to be returned by the begin operation
@@ -163,21 +362,40 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::BeginProcessRequest(
   // ctx to be returned to caller
   CComPtr<CComObjectNoLock<trCtx>> retCtx(new CComObjectNoLock<trCtx>());
   retCtx->SetContent(std::make_unique<ctxPayload>());
+  // there is no queue before the handler, so dequeue is not marked.
+  request_span *span = spanSink_ ? &retCtx->GetContent()->span : nullptr;
+  if (span != nullptr) {
+    span->mark(span_point::arrival, starttime);
+  }
 
   CComPtr<CComObjectNoLock<FRPCOperationCallback>> frpcCallback(
       new CComObjectNoLock<FRPCOperationCallback>());
   frpcCallback->Initialize(callback, retCtx);
 
   if (header.size() == 0) {
-    err = Status(StatusCode::INVALID_ARGUMENT, "fabric rpc header is empty");
+    static const std::string emptyHeader = "fabric rpc header is empty";
+    err = Status(StatusCode::INVALID_ARGUMENT, &emptyHeader);
   } else {
     bool ok = cv_->DeserializeRequestHeader(&header, &fRequestHeader);
     if (!ok) {
-      err = Status(StatusCode::INVALID_ARGUMENT,
-                   "Cannot parse fabric rpc header");
+      static const std::string badHeader = "Cannot parse fabric rpc header";
+      err = Status(StatusCode::INVALID_ARGUMENT, &badHeader);
     } else {
-      std::string url = fRequestHeader.GetUrl();
-      err = svc_->Route(url, beginOp, endOp);
+      retCtx->GetContent()->acceptCodec = fRequestHeader.GetAcceptCodec();
+      retCtx->GetContent()->handshake =
+          fRequestHeader.GetProtocolVersion() != 0;
+      MarkSpan(span, span_point::header_parsed);
+      // route before decompressing, so unknown urls are rejected early.
+      err = svc_->Route(fRequestHeader.GetUrl(), beginOp, endOp);
+      MarkSpan(span, span_point::routed);
+      if (!err && fRequestHeader.GetCodec() != BodyCodec::None) {
+        std::string plain;
+        err = DecompressBody(fRequestHeader.GetCodec(), body,
+                             fRequestHeader.GetUncompressedSize(),
+                             maxUncompressedSize_, &plain);
+        body = std::move(plain);
+      }
+      MarkSpan(span, span_point::body_parsed);
       if (!err) {
         assert(endOp != nullptr);
         retCtx->GetContent()->endOp = std::move(endOp);
@@ -191,13 +409,25 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::BeginProcessRequest(
         if (timeoutMilliseconds > ms) {
           newTimeout = timeoutMilliseconds - static_cast<DWORD>(ms);
         }
-        //  invoke begin op
-        err = beginOp->Invoke(body, newTimeout, frpcCallback, &ctx);
-        if (!err) {
-          retCtx->GetContent()->SetInnerCtx(ctx);
-          // return a ctx and done.
-          *context = retCtx.Detach();
-          return S_OK;
+        alloc_scope handlerScope(alloc_phase::server_handler);
+        MarkSpan(span, span_point::handler_start);
+        if (fRequestHeader.IsBatch()) {
+          err = BeginProcessBatch(fRequestHeader.GetBatchItemSizes(), body,
+                                  beginOp.get(), newTimeout, callback, retCtx);
+          if (!err) {
+            *context = retCtx.Detach();
+            return S_OK;
+          }
+        } else {
+          //  invoke begin op
+          err = beginOp->Invoke(std::move(body), newTimeout, frpcCallback,
+                                &ctx);
+          if (!err) {
+            retCtx->GetContent()->SetInnerCtx(ctx);
+            // return a ctx and done.
+            *context = retCtx.Detach();
+            return S_OK;
+          }
         }
       }
     }
@@ -222,6 +452,8 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::EndProcessRequest(
     /* [in] */ IFabricAsyncOperationContext *context,
     /* [retval][out] */ IFabricTransportMessage **reply) {
 
+  alloc_scope encodeScope(alloc_phase::server_encode);
+
   // get the packed additional info
   CComObjectNoLock<trCtx> *ctxWrap =
       dynamic_cast<CComObjectNoLock<trCtx> *>(context);
@@ -232,6 +464,10 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::EndProcessRequest(
 
   fabricrpc::FabricRPCReplyHeader fReplyHeader;
   std::string reply_str;
+  // body blobs of a batch reply, one per item.
+  std::vector<std::string> batchReplies;
+  // reply header is the same as okReplyHeader_.
+  bool plainOk = false;
 
   Status const &beginErr = ctxPayload->beginStatus;
   std::unique_ptr<IEndOperation> const &end = ctxPayload->endOp;
@@ -240,12 +476,37 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::EndProcessRequest(
     // we send the err back to client in header while body is empty.
     fReplyHeader.SetStatusCode(beginErr.GetErrorCode());
     fReplyHeader.SetStatusMessage(beginErr.GetErrorMessage());
+  } else if (!ctxPayload->batchItems.empty()) {
+    assert(end != nullptr);
+    // the request is ok as a whole, and each item carries its own status.
+    Status batchStatus;
+    fReplyHeader.SetStatusCode(batchStatus.GetErrorCode());
+    fReplyHeader.SetStatusMessage(batchStatus.GetErrorMessage());
+    for (batchItemPayload &item : ctxPayload->batchItems) {
+      std::string itemReply;
+      Status err = item.beginStatus;
+      if (!err) {
+        assert(item.innerCtx != nullptr);
+        alloc_scope handlerScope(alloc_phase::server_handler);
+        err = end->Invoke(item.innerCtx, itemReply);
+        if (err) {
+          itemReply.clear();
+        }
+      }
+      fReplyHeader.AddBatchItemStatus(FabricRPCBatchItemStatus(
+          err.GetErrorCode(), err.GetErrorMessage(),
+          static_cast<std::uint32_t>(itemReply.size())));
+      batchReplies.push_back(std::move(itemReply));
+    }
   } else {
     assert(end != nullptr);
     assert(innerCtx != nullptr);
     Status err;
-    // invoke user end operation
-    err = end->Invoke(innerCtx, reply_str);
+    {
+      // invoke user end operation
+      alloc_scope handlerScope(alloc_phase::server_handler);
+      err = end->Invoke(innerCtx, reply_str);
+    }
     if (err) {
       reply_str.clear();
     }
@@ -254,25 +515,102 @@ HRESULT STDMETHODCALLTYPE FRPCRequestHandler::EndProcessRequest(
     // prepare header
     fReplyHeader.SetStatusCode(err.GetErrorCode());
     fReplyHeader.SetStatusMessage(err.GetErrorMessage());
+
+    CompressionOptions compression;
+    compression.Codec = ctxPayload->acceptCodec;
+    compression.Threshold = compressionThreshold_;
+    if (ShouldCompress(compression, reply_str)) {
+      std::string compressed;
+      // send uncompressed if compression fails.
+      if (!CompressBody(compression.Codec, reply_str, &compressed)) {
+        fReplyHeader.SetCodec(compression.Codec);
+        fReplyHeader.SetUncompressedSize(
+            static_cast<std::uint32_t>(reply_str.size()));
+        reply_str = std::move(compressed);
+      }
+    }
+    plainOk = !err && fReplyHeader.GetCodec() == BodyCodec::None;
   }
   std::string h_response_str;
-  bool ok = cv_->SerializeReplyHeader(&fReplyHeader, &h_response_str);
-  assert(ok);
-  DBG_UNREFERENCED_LOCAL_VARIABLE(ok);
+  if (plainOk && !ctxPayload->handshake) {
+    h_response_str = okReplyHeader_;
+  } else {
+    if (ctxPayload->handshake) {
+      fReplyHeader.SetProtocolVersion(ProtocolVersion);
+      fReplyHeader.SetCapabilities(LocalCapabilities);
+    }
+    bool ok = cv_->SerializeReplyHeader(&fReplyHeader, &h_response_str);
+    assert(ok);
+    DBG_UNREFERENCED_LOCAL_VARIABLE(ok);
+  }
 
   // create com msg
   CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
       new CComObjectNoLock<FRPCTransportMessage>());
-  msgPtr->Initialize(std::move(h_response_str), std::move(reply_str));
+  if (batchReplies.empty()) {
+    msgPtr->Initialize(std::move(h_response_str), std::move(reply_str));
+  } else {
+    msgPtr->Initialize(std::move(h_response_str), std::move(batchReplies));
+  }
   *reply = msgPtr.Detach();
+  if (spanSink_) {
+    // the reply is handed to transport on return.
+    request_span &span = ctxPayload->span;
+    span.mark(span_point::reply_serialized);
+    span.mark(span_point::completed);
+    spanSink_->record(span);
+  }
   return S_OK;
 }
 
+// Routes the one way request the same way as BeginProcessRequest, but
+// without the ctx objects needed for a reply. Errors are dropped since the
+// client does not wait for anything.
 HRESULT STDMETHODCALLTYPE FRPCRequestHandler::HandleOneWay(
     /* [in] */ COMMUNICATION_CLIENT_ID clientId,
     /* [in] */ IFabricTransportMessage *message) {
   UNREFERENCED_PARAMETER(clientId);
-  UNREFERENCED_PARAMETER(message);
+
+  assert(svc_ != nullptr); // must initialize
+
+  CComPtr<CComObjectNoLock<FRPCTransportMessage>> msgPtr(
+      new CComObjectNoLock<FRPCTransportMessage>());
+  msgPtr->CopyMsg(message);
+
+  const std::string &header = msgPtr->GetHeader();
+  fabricrpc::FabricRPCRequestHeader fRequestHeader;
+  if (header.size() == 0 ||
+      !cv_->DeserializeRequestHeader(&header, &fRequestHeader) ||
+      fRequestHeader.IsBatch()) {
+    return S_OK;
+  }
+
+  std::string body = msgPtr->GetBody();
+  if (fRequestHeader.GetCodec() != BodyCodec::None) {
+    std::string plain;
+    if (DecompressBody(fRequestHeader.GetCodec(), body,
+                       fRequestHeader.GetUncompressedSize(),
+                       maxUncompressedSize_, &plain)) {
+      return S_OK;
+    }
+    body = std::move(plain);
+  }
+
+  std::unique_ptr<IBeginOperation> beginOp;
+  std::unique_ptr<IEndOperation> endOp;
+  Status err = svc_->Route(fRequestHeader.GetUrl(), beginOp, endOp);
+  if (err) {
+    return S_OK;
+  }
+  assert(endOp != nullptr);
+
+  CComPtr<CComObjectNoLock<FRPCOneWayCallback>> oneWayCallback(
+      new CComObjectNoLock<FRPCOneWayCallback>());
+  oneWayCallback->Initialize(std::move(endOp));
+
+  // client does not wait, so there is no deadline.
+  CComPtr<IFabricAsyncOperationContext> ctx;
+  beginOp->Invoke(std::move(body), INFINITE, oneWayCallback, &ctx);
   return S_OK;
 }
 } // namespace fabricrpc
\ No newline at end of file
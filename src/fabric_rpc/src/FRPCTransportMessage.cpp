@@ -9,6 +9,38 @@
 
 namespace fabricrpc {
 
+BodySegment::BodySegment(std::variant<std::string, std::string_view,
+                                      std::shared_ptr<const std::string>>
+                             data)
+    : data_(std::move(data)) {}
+
+BodySegment BodySegment::Owned(std::string data) {
+  return BodySegment(std::move(data));
+}
+
+BodySegment BodySegment::Borrowed(std::string_view data) {
+  return BodySegment(data);
+}
+
+BodySegment BodySegment::Shared(std::shared_ptr<const std::string> data) {
+  return BodySegment(std::move(data));
+}
+
+std::string_view BodySegment::View() const {
+  if (const std::string *s = std::get_if<std::string>(&data_)) {
+    return *s;
+  }
+  if (const std::string_view *s = std::get_if<std::string_view>(&data_)) {
+    return *s;
+  }
+  const auto &p = std::get<std::shared_ptr<const std::string>>(data_);
+  return p ? std::string_view(*p) : std::string_view();
+}
+
+const std::string *BodySegment::GetOwned() const {
+  return std::get_if<std::string>(&data_);
+}
+
 std::string FRPCTransportMessage::get_header(IFabricTransportMessage *message) {
   if (message == nullptr) {
     return "";
@@ -43,16 +75,38 @@ std::string FRPCTransportMessage::get_body(IFabricTransportMessage *message) {
   return body;
 }
 
-FRPCTransportMessage::FRPCTransportMessage() : body_(), header_() {}
+FRPCTransportMessage::FRPCTransportMessage()
+    : bodies_(), bodies_ret_(), header_() {}
 
 void FRPCTransportMessage::Initialize(std::string header, std::string body) {
+  std::vector<std::string> bodies;
+  bodies.push_back(std::move(body));
+  this->Initialize(std::move(header), std::move(bodies));
+}
+
+void FRPCTransportMessage::Initialize(std::string header,
+                                      std::vector<std::string> bodies) {
+  std::vector<BodySegment> segments;
+  segments.reserve(bodies.size());
+  for (std::string &body : bodies) {
+    segments.push_back(BodySegment::Owned(std::move(body)));
+  }
+  this->Initialize(std::move(header), std::move(segments));
+}
+
+void FRPCTransportMessage::Initialize(std::string header,
+                                      std::vector<BodySegment> segments) {
   header_ = std::move(header);
-  body_ = std::move(body);
+  bodies_ = std::move(segments);
   // prepare ret pointers
   header_ret_.Buffer = (BYTE *)header_.c_str();
   header_ret_.BufferSize = static_cast<ULONG>(header_.size());
-  body_ret_.Buffer = (BYTE *)body_.c_str();
-  body_ret_.BufferSize = static_cast<ULONG>(body_.size());
+  bodies_ret_.resize(bodies_.size());
+  for (std::size_t i = 0; i < bodies_.size(); i++) {
+    std::string_view body = bodies_[i].View();
+    bodies_ret_[i].Buffer = (BYTE *)body.data();
+    bodies_ret_[i].BufferSize = static_cast<ULONG>(body.size());
+  }
 }
 
 // copy content from another msg
@@ -65,7 +119,16 @@ void FRPCTransportMessage::CopyMsg(IFabricTransportMessage *other) {
 
 const std::string &FRPCTransportMessage::GetHeader() { return this->header_; }
 
-const std::string &FRPCTransportMessage::GetBody() { return this->body_; }
+const std::string &FRPCTransportMessage::GetBody() {
+  assert(this->bodies_.size() == 1);
+  const std::string *body = this->bodies_.front().GetOwned();
+  assert(body != nullptr);
+  return *body;
+}
+
+const std::vector<BodySegment> &FRPCTransportMessage::GetBodies() {
+  return this->bodies_;
+}
 
 // IFabricTransportMessage impl
 
@@ -73,10 +136,10 @@ void FRPCTransportMessage::GetHeaderAndBodyBuffer(
     /* [out] */ const FABRIC_TRANSPORT_MESSAGE_BUFFER **headerBuffer,
     /* [out] */ ULONG *msgBufferCount,
     /* [out] */ const FABRIC_TRANSPORT_MESSAGE_BUFFER **MsgBuffers) {
-  assert(body_ret_.Buffer != nullptr && header_ret_.Buffer != nullptr);
+  assert(header_ret_.Buffer != nullptr);
   *headerBuffer = &header_ret_;
-  *msgBufferCount = 1;
-  *MsgBuffers = &body_ret_;
+  *msgBufferCount = static_cast<ULONG>(bodies_ret_.size());
+  *MsgBuffers = bodies_ret_.data();
 }
 
 void FRPCTransportMessage::Dispose() {}
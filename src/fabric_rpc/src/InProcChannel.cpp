@@ -0,0 +1,342 @@
+// ------------------------------------------------------------
+// Copyright 2022 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc/InProcChannel.hpp"
+#include "fabricrpc/exp/AsyncAnyContext.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace fabricrpc {
+
+// runs functions at their deadlines on a thread of its own. The thread starts
+// with the first function, and functions not run yet are dropped by Stop.
+// Needs to be created with make_shared, since the thread holds a ref.
+class InProcTimer : public std::enable_shared_from_this<InProcTimer> {
+public:
+  typedef std::chrono::steady_clock clock;
+  // deadline and a sequence number, unique per function.
+  typedef std::pair<clock::time_point, std::uint64_t> Key;
+
+  InProcTimer() : mtx_(), cv_(), fns_(), seq_(0), stop_(false), thread_() {}
+
+  Key Add(std::chrono::milliseconds after, std::function<void()> fn) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    Key key(clock::now() + after, ++seq_);
+    if (stop_) {
+      return key;
+    }
+    bool first = fns_.empty() || key < fns_.begin()->first;
+    fns_.emplace(key, std::move(fn));
+    if (!thread_.joinable()) {
+      thread_ = std::thread([self = shared_from_this()]() { self->Run(); });
+    } else if (first) {
+      cv_.notify_all();
+    }
+    return key;
+  }
+
+  // does nothing if the function has run.
+  void Cancel(const Key &key) {
+    std::function<void()> fn;
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = fns_.find(key);
+    if (it != fns_.end()) {
+      // released after the lock, since it may hold the last ref of a ctx.
+      fn = std::move(it->second);
+      fns_.erase(it);
+    }
+  }
+
+  // a function may stop the timer from the timer thread, i.e. by releasing
+  // the channel in a callback. The thread is not joined then.
+  void Stop() {
+    std::map<Key, std::function<void()>> dropped;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      stop_ = true;
+      dropped.swap(fns_);
+    }
+    cv_.notify_all();
+    if (!thread_.joinable()) {
+      return;
+    }
+    if (thread_.get_id() == std::this_thread::get_id()) {
+      thread_.detach();
+    } else {
+      thread_.join();
+    }
+  }
+
+private:
+  void Run() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    while (!stop_) {
+      if (fns_.empty()) {
+        cv_.wait(lk);
+        continue;
+      }
+      auto it = fns_.begin();
+      // copied, since the function may be cancelled during the wait.
+      clock::time_point deadline = it->first.first;
+      if (clock::now() < deadline) {
+        cv_.wait_until(lk, deadline);
+        continue;
+      }
+      std::function<void()> fn = std::move(it->second);
+      fns_.erase(it);
+      lk.unlock();
+      fn();
+      fn = nullptr;
+      lk.lock();
+    }
+  }
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::map<Key, std::function<void()>> fns_;
+  std::uint64_t seq_;
+  bool stop_;
+  std::thread thread_;
+};
+
+namespace {
+
+// the call is completed once, by the service or by the timeout.
+enum class inProcState { pending, completed, timedOut };
+
+} // namespace
+
+// payload to carry between BeginRequest and EndRequest.
+struct inProcPayload {
+  // service's end operation
+  std::unique_ptr<IEndOperation> endOp;
+  // routing or service's begin status. If failed it is returned by end.
+  Status beginStatus;
+  // service's ctx to be passed to its end operation.
+  CComPtr<IFabricAsyncOperationContext> innerCtx;
+  std::mutex mtx;
+  std::atomic<inProcState> state{inProcState::pending};
+  // timeout of the call. Not set for INFINITE.
+  std::weak_ptr<InProcTimer> timer;
+  InProcTimer::Key timerKey;
+
+  // returns false if the call is already completed.
+  bool TryComplete(inProcState to) {
+    inProcState expected = inProcState::pending;
+    return state.compare_exchange_strong(expected, to);
+  }
+
+  // service may invoke the callback before its begin returns.
+  void SetInnerCtx(IFabricAsyncOperationContext *context) {
+    std::lock_guard<std::mutex> l(mtx);
+    if (innerCtx == nullptr) {
+      context->AddRef();
+      innerCtx.Attach(context);
+    } else {
+      assert(innerCtx == context);
+    }
+  }
+};
+
+// ctx returned to the caller.
+using inProcCtx = AsyncAnyCtx<std::unique_ptr<inProcPayload>>;
+
+// callback passed to the service's begin operation. Invokes the caller's
+// callback with the ctx returned to the caller.
+class InProcCallback : public CComObjectRootEx<CComMultiThreadModel>,
+                       public IFabricAsyncOperationCallback {
+
+  BEGIN_COM_MAP(InProcCallback)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationCallback)
+  END_COM_MAP()
+public:
+  void Initialize(IFabricAsyncOperationCallback *callback,
+                  CComObjectNoLock<inProcCtx> *wrapCtx) {
+    assert(callback != nullptr);
+    assert(wrapCtx != nullptr);
+    callback->AddRef();
+    callerCallback_.Attach(callback);
+    wrapCtx->AddRef();
+    wrapCtx_.Attach(wrapCtx);
+  }
+
+  void STDMETHODCALLTYPE Invoke(
+      /* [in] */ IFabricAsyncOperationContext *context) override {
+    assert(context != nullptr);
+    assert(wrapCtx_ != nullptr);
+    const std::unique_ptr<inProcPayload> &payload = wrapCtx_->GetContent();
+    payload->SetInnerCtx(context);
+    if (payload->TryComplete(inProcState::completed)) {
+      if (std::shared_ptr<InProcTimer> timer = payload->timer.lock()) {
+        timer->Cancel(payload->timerKey);
+      }
+      callerCallback_->Invoke(wrapCtx_);
+    } else if (!payload->beginStatus && payload->endOp != nullptr) {
+      // the caller has timed out. End the service operation so it can
+      // release its resources, and drop the reply as transport does.
+      std::string reply;
+      payload->endOp->Invoke(context, reply);
+    }
+    // service may hold this callback in its ctx. Break the cycle.
+    wrapCtx_.Release();
+  }
+
+private:
+  CComPtr<IFabricAsyncOperationCallback> callerCallback_;
+  CComPtr<CComObjectNoLock<inProcCtx>> wrapCtx_;
+};
+
+// callback passed to the service's begin operation of a one way request.
+class InProcOneWayCallback : public CComObjectRootEx<CComMultiThreadModel>,
+                             public IFabricAsyncOperationCallback {
+
+  BEGIN_COM_MAP(InProcOneWayCallback)
+  COM_INTERFACE_ENTRY(IFabricAsyncOperationCallback)
+  END_COM_MAP()
+public:
+  void Initialize(std::unique_ptr<IEndOperation> endOp) {
+    assert(endOp != nullptr);
+    endOp_ = std::move(endOp);
+  }
+
+  void STDMETHODCALLTYPE Invoke(
+      /* [in] */ IFabricAsyncOperationContext *context) override {
+    assert(context != nullptr);
+    std::string reply;
+    // nobody to report the error to.
+    endOp_->Invoke(context, reply);
+  }
+
+private:
+  std::unique_ptr<IEndOperation> endOp_;
+};
+
+InProcChannel::InProcChannel(
+    const std::vector<std::shared_ptr<MiddleWare>> &svcList)
+    : svcList_(svcList), timer_(std::make_shared<InProcTimer>()) {}
+
+InProcChannel::~InProcChannel() { timer_->Stop(); }
+
+Status InProcChannel::Route(const std::string &url,
+                            std::unique_ptr<IBeginOperation> &beginOp,
+                            std::unique_ptr<IEndOperation> &endOp) {
+  for (auto &svc : svcList_) {
+    Status err = svc->Route(url, beginOp, endOp);
+    if (!err) {
+      return Status();
+    }
+  }
+  // same as the server.
+  return Status(StatusCode::NOT_FOUND, "method not found: " + url);
+}
+
+Status
+InProcChannel::BeginRequest(const std::string &url,
+                            const google::protobuf::MessageLite *request,
+                            DWORD timeoutMilliseconds,
+                            IFabricAsyncOperationCallback *callback,
+                            /*out*/ IFabricAsyncOperationContext **context) {
+  assert(callback != nullptr);
+  CComPtr<CComObjectNoLock<inProcCtx>> retCtx(
+      new CComObjectNoLock<inProcCtx>());
+  retCtx->Initialize(callback);
+  retCtx->SetContent(std::make_unique<inProcPayload>());
+
+  CComPtr<CComObjectNoLock<InProcCallback>> proxyCallback(
+      new CComObjectNoLock<InProcCallback>());
+  proxyCallback->Initialize(callback, retCtx);
+
+  std::unique_ptr<IBeginOperation> beginOp;
+  std::unique_ptr<IEndOperation> endOp;
+  Status err = Route(url, beginOp, endOp);
+  if (!err && timeoutMilliseconds == 0) {
+    // the request cannot reach the service in time.
+    err = Status(StatusCode::FABRIC_TRANSPORT_ERROR, "request timed out",
+                 FABRIC_E_TIMEOUT);
+  }
+  if (!err) {
+    const std::unique_ptr<inProcPayload> &payload = retCtx->GetContent();
+    // the end op is needed by a late completion, before begin returns.
+    payload->endOp = std::move(endOp);
+    if (timeoutMilliseconds != INFINITE) {
+      CComPtr<CComObjectNoLock<inProcCtx>> timeoutCtx = retCtx;
+      CComPtr<IFabricAsyncOperationCallback> timeoutCallback = callback;
+      payload->timer = timer_;
+      payload->timerKey = timer_->Add(
+          std::chrono::milliseconds(timeoutMilliseconds),
+          [timeoutCtx, timeoutCallback]() {
+            if (timeoutCtx->GetContent()->TryComplete(
+                    inProcState::timedOut)) {
+              timeoutCallback->Invoke(timeoutCtx);
+            }
+          });
+    }
+    CComPtr<IFabricAsyncOperationContext> ctx;
+    err = beginOp->InvokeLocal(request, timeoutMilliseconds, proxyCallback,
+                               &ctx);
+    if (!err) {
+      payload->SetInnerCtx(ctx);
+      *context = retCtx.Detach();
+      return Status();
+    }
+  }
+
+  // the error is returned by end, the same as a server reply. Complete with a
+  // dummy inner ctx.
+  retCtx->GetContent()->beginStatus = err;
+  CComPtr<CComObjectNoLock<AsyncAnyCtx<bool>>> dummyCtx(
+      new CComObjectNoLock<AsyncAnyCtx<bool>>());
+  dummyCtx->Initialize(proxyCallback);
+  proxyCallback->Invoke(dummyCtx);
+  *context = retCtx.Detach();
+  return Status();
+}
+
+Status InProcChannel::EndRequest(IFabricAsyncOperationContext *context,
+                                 /*out*/ google::protobuf::MessageLite *reply) {
+  CComObjectNoLock<inProcCtx> *ctxWrap =
+      dynamic_cast<CComObjectNoLock<inProcCtx> *>(context);
+  assert(ctxWrap != nullptr);
+  const std::unique_ptr<inProcPayload> &payload = ctxWrap->GetContent();
+  if (payload->state.load() == inProcState::timedOut) {
+    return Status(StatusCode::FABRIC_TRANSPORT_ERROR, "request timed out",
+                  FABRIC_E_TIMEOUT);
+  }
+  if (payload->beginStatus) {
+    return payload->beginStatus;
+  }
+  assert(payload->endOp != nullptr);
+  assert(payload->innerCtx != nullptr);
+  return payload->endOp->InvokeLocal(payload->innerCtx, reply);
+}
+
+Status InProcChannel::Send(const std::string &url,
+                           const google::protobuf::MessageLite *request) {
+  std::unique_ptr<IBeginOperation> beginOp;
+  std::unique_ptr<IEndOperation> endOp;
+  Status err = Route(url, beginOp, endOp);
+  if (err) {
+    // over transport the error is dropped by the server.
+    return Status();
+  }
+  CComPtr<CComObjectNoLock<InProcOneWayCallback>> oneWayCallback(
+      new CComObjectNoLock<InProcOneWayCallback>());
+  oneWayCallback->Initialize(std::move(endOp));
+  CComPtr<IFabricAsyncOperationContext> ctx;
+  beginOp->InvokeLocal(request, INFINITE, oneWayCallback, &ctx);
+  return Status();
+}
+
+} // namespace fabricrpc
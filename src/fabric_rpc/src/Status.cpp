@@ -8,19 +8,65 @@
 
 namespace fabricrpc {
 
+namespace {
+
+// name of each code, used as message of status without one.
+const std::string &CodeName(StatusCode code) {
+  static const std::string ok = "OK";
+  static const std::string unknown = "UNKNOWN";
+  static const std::string invalidArgument = "INVALID_ARGUMENT";
+  static const std::string deadlineExceeded = "DEADLINE_EXCEEDED";
+  static const std::string notFound = "NOT_FOUND";
+  static const std::string internal = "INTERNAL";
+  static const std::string transportError = "FABRIC_TRANSPORT_ERROR";
+  switch (code) {
+  case StatusCode::OK:
+    return ok;
+  case StatusCode::INVALID_ARGUMENT:
+    return invalidArgument;
+  case StatusCode::DEADLINE_EXCEEDED:
+    return deadlineExceeded;
+  case StatusCode::NOT_FOUND:
+    return notFound;
+  case StatusCode::INTERNAL:
+    return internal;
+  case StatusCode::FABRIC_TRANSPORT_ERROR:
+    return transportError;
+  default:
+    return unknown;
+  }
+}
+
+} // namespace
+
 Status::Status(StatusCode code, std::string error_message,
                HRESULT transportErrorCode)
-    : code_(code), error_message_(std::move(error_message)),
+    : code_(code), staticMessage_(nullptr),
+      error_message_(std::move(error_message)),
       transportErrorCode_(transportErrorCode) {}
 
 Status::Status(StatusCode code, std::string error_message)
     : Status(code, std::move(error_message), S_OK) {}
 
-Status::Status() : Status(StatusCode::OK, std::string("OK")) {}
+Status::Status(StatusCode code, const std::string *staticMessage)
+    : code_(code), staticMessage_(staticMessage), error_message_(),
+      transportErrorCode_(S_OK) {}
+
+Status::Status(StatusCode code)
+    : code_(code), staticMessage_(nullptr), error_message_(),
+      transportErrorCode_(S_OK) {}
+
+Status::Status() : Status(StatusCode::OK) {}
 
 StatusCode Status::GetErrorCode() const { return this->code_; }
 const std::string &Status::GetErrorMessage() const {
-  return this->error_message_;
+  if (this->staticMessage_ != nullptr) {
+    return *this->staticMessage_;
+  }
+  if (!this->error_message_.empty()) {
+    return this->error_message_;
+  }
+  return CodeName(this->code_);
 }
 
 // quick error check
@@ -34,4 +80,4 @@ HRESULT Status::GetTransportErrorCode() const {
   return this->transportErrorCode_;
 }
 
-} // namespace fabricrpc
\ No newline at end of file
+} // namespace fabricrpc
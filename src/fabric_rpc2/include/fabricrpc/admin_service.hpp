@@ -0,0 +1,43 @@
+#pragma once
+
+#include "fabricrpc/server_metrics.hpp"
+#include "fabricrpc/service.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace fabricrpc {
+
+class stats_reply;
+
+// built in service of /fabricrpc.Admin. Servers do not have it unless it is
+// added, i.e. with ex_server::add_admin_service.
+// /fabricrpc.Admin/GetStats takes a stats_request and replies a stats_reply
+// with a snapshot of server metrics, method stats and connection queues.
+// Clients call it with rpc_client::async_send and the protos in
+// fabricrpc.proto.
+class admin_service : public service {
+public:
+  // returns the queue state of each connection of the server.
+  typedef std::function<std::vector<connection_stats>()> connection_source;
+
+  // connections may be empty if the server has no connection state.
+  explicit admin_service(connection_source connections = nullptr);
+
+  const std::string_view name() override { return "fabricrpc.Admin"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override;
+
+  bool execute_sync(const std::string &url, const std::string_view req,
+                    std::string *resp, absl::Status *st) override;
+
+  // fills reply with the current snapshot.
+  void get_stats(stats_reply *reply) const;
+
+private:
+  connection_source connections_;
+};
+
+} // namespace fabricrpc
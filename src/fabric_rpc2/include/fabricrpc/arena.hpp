@@ -0,0 +1,134 @@
+#pragma once
+// handler helpers that allocate protos of a call on an arena. Used by code
+// generated with arena=true.
+
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/server_reader.hpp"
+#include "fabricrpc/server_writer.hpp"
+
+#include <google/protobuf/arena.h>
+
+#include <array>
+
+namespace fabricrpc {
+
+// arena of one call. Small calls fit in the initial block, which lives in
+// the handler frame, and need no heap allocation for their protos.
+class call_arena {
+public:
+  static constexpr std::size_t initial_block_size = 1024;
+
+  call_arena() : arena_(make_options(block_)) {}
+
+  call_arena(const call_arena &) = delete;
+  call_arena &operator=(const call_arena &) = delete;
+
+  template <typename Proto> Proto *create() {
+    return google::protobuf::Arena::Create<Proto>(&arena_);
+  }
+
+private:
+  static google::protobuf::ArenaOptions
+  make_options(std::array<char, initial_block_size> &block) {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = block.data();
+    options.initial_block_size = block.size();
+    return options;
+  }
+
+  // outlives arena_, which is destroyed first.
+  alignas(8) std::array<char, initial_block_size> block_;
+  google::protobuf::Arena arena_;
+};
+
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
+net::awaitable<absl::Status>
+codegen_arena_handler_helper(const method_descriptor &method,
+                             const std::string_view req, std::string *resp,
+                             HandlerFunc fn, Service svc) {
+  Policy call(method);
+  call_arena arena;
+  ReqProto *p1 = arena.create<ReqProto>();
+  ReplyProto *p2 = arena.create<ReplyProto>();
+  absl::Status st = fabricrpc::parse_proto_payload(req, p1);
+  call.parsed(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = co_await (svc->*fn)(p1, p2);
+  call.handled(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = fabricrpc::serialize_proto_payload(p2, resp);
+  call.serialized(st);
+  co_return st;
+}
+
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
+absl::Status codegen_arena_sync_handler_helper(const method_descriptor &method,
+                                               const std::string_view req,
+                                               std::string *resp,
+                                               HandlerFunc fn, Service svc) {
+  Policy call(method);
+  call_arena arena;
+  ReqProto *p1 = arena.create<ReqProto>();
+  ReplyProto *p2 = arena.create<ReplyProto>();
+  absl::Status st = fabricrpc::parse_proto_payload(req, p1);
+  call.parsed(st);
+  if (!st.ok()) {
+    return st;
+  }
+  st = (svc->*fn)(p1, p2);
+  call.handled(st);
+  if (!st.ok()) {
+    return st;
+  }
+  st = fabricrpc::serialize_proto_payload(p2, resp);
+  call.serialized(st);
+  return st;
+}
+
+template <typename Policy, typename ReqProto, typename HandlerFunc,
+          typename Service>
+net::awaitable<absl::Status>
+codegen_arena_stream_handler_helper(const method_descriptor &method,
+                                    const std::string_view req,
+                                    server_writer *writer, HandlerFunc fn,
+                                    Service svc) {
+  Policy call(method);
+  call_arena arena;
+  ReqProto *p1 = arena.create<ReqProto>();
+  absl::Status st = fabricrpc::parse_proto_payload(req, p1);
+  call.parsed(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = co_await (svc->*fn)(p1, writer);
+  call.handled(st);
+  co_return st;
+}
+
+template <typename Policy, typename ReplyProto, typename HandlerFunc,
+          typename Service>
+net::awaitable<absl::Status>
+codegen_arena_client_stream_handler_helper(const method_descriptor &method,
+                                           server_reader *reader,
+                                           std::string *resp, HandlerFunc fn,
+                                           Service svc) {
+  Policy call(method);
+  call_arena arena;
+  ReplyProto *p2 = arena.create<ReplyProto>();
+  absl::Status st = co_await (svc->*fn)(reader, p2);
+  call.handled(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = fabricrpc::serialize_proto_payload(p2, resp);
+  call.serialized(st);
+  co_return st;
+}
+
+} // namespace fabricrpc
@@ -9,6 +9,7 @@
 #include "fabricrpc/basic_server_connection.hpp"
 #include <boost/asio/compose.hpp>
 #include <boost/asio/coroutine.hpp>
+#include <fabricrpc_tool/transport_factory.hpp>
 #include <fabricrpc_tool/waitable_callback.hpp>
 #include <fabrictransport_.h>
 
@@ -50,6 +51,7 @@ public:
       std::shared_ptr<conn_manager_entry<executor_type>> e_copy = *e;
       assert(e_copy);
       c.set_queue(e_copy->queue);
+      c.set_transport_conn(e_copy->conn);
       self.complete(ec, std::move(c));
     });
   }
@@ -83,7 +85,7 @@ public:
     winrt::com_ptr<IFabricTransportListener> listener;
 
     // create listener
-    HRESULT hr = CreateFabricTransportListener(
+    HRESULT hr = fabricrpc::get_transport().create_listener(
         IID_IFabricTransportListener,
         (FABRIC_TRANSPORT_SETTINGS *)ep_.get_settings(),
         (FABRIC_TRANSPORT_LISTEN_ADDRESS *)ep_.get_addr(), req_handler.get(),
@@ -136,6 +138,12 @@ public:
                                      boost::asio::error::get_system_category());
   }
 
+  // holds all connections. Used to push notifications to clients.
+  std::shared_ptr<basic_connection_manager<executor_type>>
+  get_connection_manager() {
+    return mgr_;
+  }
+
   // accepts connection
   // handler type void(ec, basic_server_connection)
   template <typename Token> auto async_accept_conn(Token &&token) {
@@ -2,11 +2,15 @@
 
 #include <boost/asio/any_io_executor.hpp>
 #include <fabricrpc/basic_event.hpp>
+#include <fabricrpc/basic_stream_reader.hpp>
+#include <fabricrpc/basic_subscription.hpp>
+#include <fabricrpc/connection_context.hpp>
 #include <fabrictransport_.h>
 #include <winrt/base.h>
 
 #include <fabricrpc_tool/tool_client_connection_handler.hpp>
 #include <fabricrpc_tool/tool_client_notification_handler.hpp>
+#include <fabricrpc_tool/transport_factory.hpp>
 
 namespace fabricrpc {
 
@@ -109,7 +113,11 @@ class basic_client_connection {
 public:
   typedef Executor executor_type;
 
-  basic_client_connection(const executor_type &ex) : ex_(ex) {}
+  basic_client_connection(const executor_type &ex)
+      : streams_(std::make_shared<basic_stream_registry<executor_type>>()),
+        subscriptions_(
+            std::make_shared<basic_subscription_registry<executor_type>>()),
+        context_(std::make_shared<connection_context>()), ex_(ex) {}
 
   basic_client_connection(basic_client_connection<executor_type> &) = delete;
 
@@ -118,8 +126,21 @@ public:
   boost::system::error_code open(const endpoint &ep) {
     assert(!client_);
     auto url = ep.get_url();
+    // msgs from server are chunks of streams or pushed notifications.
     winrt::com_ptr<IFabricTransportCallbackMessageHandler> client_notify_h =
-        winrt::make<fabricrpc::tool_client_notification_handler>();
+        winrt::make<fabricrpc::tool_client_notification_handler>(
+            [streams = streams_,
+             subs = subscriptions_](IFabricTransportMessage *message) {
+              fabricrpc::callback_header header;
+              if (!header.ParseFromString(fabricrpc::get_header(message))) {
+                return;
+              }
+              if (!header.topic().empty()) {
+                subs->dispatch(header, message);
+              } else {
+                streams->dispatch(header, message);
+              }
+            });
 
     winrt::com_ptr<IFabricTransportClientEventHandler> client_event_h =
         winrt::make<fabricrpc::tool_client_connection_handler>();
@@ -129,7 +150,7 @@ public:
     auto settings = ep.get_settings();
 
     // open client
-    HRESULT hr = CreateFabricTransportClient(
+    HRESULT hr = fabricrpc::get_transport().create_client(
         /* [in] */ IID_IFabricTransportClient,
         /* [in] */ (FABRIC_TRANSPORT_SETTINGS *)settings,
         /* [in] */ url.c_str(),
@@ -167,10 +188,56 @@ public:
         async_req_op<executor_type>(ex_, client_, msg), token, this->ex_);
   }
 
+  // sends a msg the server does not reply to.
+  // Transport sends it in the background, so this does not block.
+  boost::system::error_code
+  send_one_way(winrt::com_ptr<IFabricTransportMessage> msg) {
+    assert(client_);
+    HRESULT hr = client_->Send(msg.get());
+    return boost::system::error_code(hr,
+                                     boost::asio::error::get_system_category());
+  }
+
+  // closes the connection. The server ends the streams of this connection.
+  boost::system::error_code close() {
+    assert(client_);
+    winrt::com_ptr<IWaitableCallback> callback =
+        winrt::make<waitable_callback>();
+    winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+    HRESULT hr = client_->BeginClose(1000, callback.get(), ctx.put());
+    if (hr != S_OK) {
+      return boost::system::error_code(
+          hr, boost::asio::error::get_system_category());
+    }
+    callback->Wait();
+    hr = client_->EndClose(ctx.get());
+    return boost::system::error_code(hr,
+                                     boost::asio::error::get_system_category());
+  }
+
   executor_type get_executor() { return ex_; }
 
+  // open server streams of this connection.
+  std::shared_ptr<basic_stream_registry<executor_type>> get_streams() {
+    return streams_;
+  }
+
+  // metadata tables and server capabilities of this connection.
+  std::shared_ptr<connection_context> get_context() { return context_; }
+
+  // starts receiving notifications of topic into sub.
+  void subscribe(const std::string &topic,
+                 basic_subscription<executor_type> *sub) {
+    auto state = std::make_shared<basic_subscription_state<executor_type>>();
+    std::uint64_t id = subscriptions_->add(topic, state);
+    sub->attach(subscriptions_, id, state);
+  }
+
 private:
   winrt::com_ptr<IFabricTransportClient> client_;
+  std::shared_ptr<basic_stream_registry<executor_type>> streams_;
+  std::shared_ptr<basic_subscription_registry<executor_type>> subscriptions_;
+  std::shared_ptr<connection_context> context_;
   const executor_type &ex_;
 };
 
@@ -4,9 +4,13 @@
 #include <winrt/base.h>
 
 #include <fabricrpc/basic_item_queue.hpp>
+#include <fabricrpc/notification.hpp>
+#include <fabricrpc/server_metrics.hpp>
 
+#include <functional>
 #include <map>
 #include <mutex>
+#include <vector>
 
 namespace fabricrpc {
 
@@ -24,7 +28,8 @@ class basic_connection_manager {
 public:
   typedef Executor executor_type;
 
-  basic_connection_manager() : conns_(), mtx_(), conn_queue_() {}
+  basic_connection_manager()
+      : conns_(), mtx_(), conn_queue_(), on_disconnect_() {}
 
   ~basic_connection_manager() { assert(conns_.empty()); }
 
@@ -54,28 +59,111 @@ public:
     conn_queue_.async_pop(event, out);
   }
 
+  // fn is called with the client id after a connection is removed, i.e. to
+  // end its streams. Set before connections are accepted.
+  void set_on_disconnect(std::function<void(std::wstring const &)> fn) {
+    on_disconnect_ = std::move(fn);
+  }
+
   // should be immediate
   // removes connection in conns_
   // but the queue needs to pop/drain
   void disconnect(std::wstring const &id) noexcept {
-    std::lock_guard<std::mutex> lk(mtx_);
-    // find the entry
-    auto entry = conns_.at(id);
-    // erase from conns
-    auto it = conns_.find(id);
-    assert(it != conns_.end());
-    conns_.erase(it);
-    // TODO: erase items in entry?
-    // TODO: set disconnected error code in conn entry and propagate to user.
-    // needs to handle ec in the async_accept_conn before pass the pipe to user.
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      // find the entry
+      auto entry = conns_.at(id);
+      // erase from conns
+      auto it = conns_.find(id);
+      assert(it != conns_.end());
+      conns_.erase(it);
+      // TODO: erase items in entry?
+      // TODO: set disconnected error code in conn entry and propagate to
+      // user. needs to handle ec in the async_accept_conn before pass the
+      // pipe to user.
+    }
+    if (on_disconnect_) {
+      on_disconnect_(id);
+    }
   }
 
   // add a request msg.
-  // it will be routed to the right connection.
+  // it will be routed to the right connection. Requests of a connection that
+  // is gone are rejected.
   void post_request(p_request_t &&req) noexcept {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto it = conns_.find(req->get_conn_id());
+      if (it != conns_.end()) {
+        add_server_metric(server_metric::queued);
+        it->second->queue->push(std::move(req));
+        return;
+      }
+    }
+    add_server_metric(server_metric::rejected);
+    if (!req->is_one_way()) {
+      req->complete_rpc_error(absl::UnavailableError("connection is closed"));
+    }
+  }
+
+  // queue state of each connection.
+  std::vector<connection_stats> get_connection_stats() {
+    std::vector<connection_stats> ret;
     std::lock_guard<std::mutex> lk(mtx_);
-    auto entry = conns_.at(req->get_conn_id());
-    entry->queue->push(std::move(req));
+    ret.reserve(conns_.size());
+    for (auto &[id, entry] : conns_) {
+      ret.push_back({id, entry->queue->size()});
+    }
+    return ret;
+  }
+
+  // pushes a notification to one connection.
+  absl::Status push(std::wstring const &id, const std::string &topic,
+                    const google::protobuf::MessageLite &msg) {
+    winrt::com_ptr<IFabricTransportClientConnection> conn;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto it = conns_.find(id);
+      if (it == conns_.end()) {
+        return absl::NotFoundError("connection not found");
+      }
+      conn = it->second->conn;
+    }
+    std::string header;
+    std::string body;
+    absl::Status st = serialize_notification(topic, msg, &header, &body);
+    if (!st.ok()) {
+      return st;
+    }
+    return send_notification(conn.get(), std::move(header), std::move(body));
+  }
+
+  // pushes a notification to all connections.
+  // returns the number of connections it is sent to. Connections that are
+  // gone are skipped.
+  std::size_t broadcast(const std::string &topic,
+                        const google::protobuf::MessageLite &msg) {
+    std::string header;
+    std::string body;
+    if (!serialize_notification(topic, msg, &header, &body).ok()) {
+      return 0;
+    }
+    // send outside the lock since send may be slow.
+    std::vector<winrt::com_ptr<IFabricTransportClientConnection>> conns;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      conns.reserve(conns_.size());
+      for (auto &[id, entry] : conns_) {
+        conns.push_back(entry->conn);
+      }
+    }
+    std::size_t sent = 0;
+    for (auto &conn : conns) {
+      if (send_notification(conn.get(), header, body).ok()) {
+        sent++;
+      }
+    }
+    return sent;
   }
 
   // cancel previous queued async operation
@@ -93,6 +181,7 @@ private:
       conn_queue_;
 
   std::mutex mtx_;
+  std::function<void(std::wstring const &)> on_disconnect_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <winrt/base.h>
 
 #include "fabricrpc/request.hpp"
+#include <deque>
 #include <mutex>
 
 namespace fabricrpc {
@@ -18,6 +19,7 @@ struct queue_entry {
 };
 
 // queue for keeping items with notifying events.
+// items and waiters are served in fifo order.
 template <typename T, typename Executor = net::any_io_executor>
 class basic_item_queue {
 public:
@@ -36,8 +38,8 @@ public:
       items_.push_back(std::move(item));
     } else {
       // directly finish a waiter.
-      queue_entry<T, executor_type> e = std::move(queue_entries_.back());
-      queue_entries_.pop_back();
+      queue_entry<T, executor_type> e = std::move(queue_entries_.front());
+      queue_entries_.pop_front();
       *e.item = std::move(item);
       e.event->set();
     }
@@ -52,8 +54,8 @@ public:
       queue_entries_.push_back({std::move(event), msgout});
     } else {
       // has item, so directly fill the item and invoke event
-      T item = std::move(items_.back());
-      items_.pop_back();
+      T item = std::move(items_.front());
+      items_.pop_front();
       *msgout = std::move(item);
       event->set();
     }
@@ -74,9 +76,22 @@ public:
     }
   }
 
+  // number of items waiting for a pop.
+  std::size_t size() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return items_.size();
+  }
+
+  // drops all items and waiters. Waiters are not notified.
+  void clear() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    items_.clear();
+    queue_entries_.clear();
+  }
+
 private:
-  std::vector<T> items_;
-  std::vector<queue_entry<T, executor_type>> queue_entries_;
+  std::deque<T> items_;
+  std::deque<queue_entry<T, executor_type>> queue_entries_;
   std::mutex mtx_;
 };
 
@@ -2,6 +2,8 @@
 
 #include "fabricrpc/basic_connection_manager.hpp"
 #include "fabricrpc/basic_item_queue.hpp"
+#include "fabricrpc/server_metrics.hpp"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
 #include <fabrictransport_.h>
 #include <winrt/base.h>
 
@@ -32,6 +34,8 @@ public:
       /* [in] */ DWORD timeoutMilliseconds,
       /* [in] */ IFabricAsyncOperationCallback *callback,
       /* [retval][out] */ IFabricAsyncOperationContext **context) override {
+    add_server_metric(server_metric::bytes_in,
+                      static_cast<std::int64_t>(get_message_size(message)));
 
     winrt::com_ptr<IFabricTransportMessage> msg;
     msg.copy_from(message);
@@ -69,13 +73,28 @@ public:
     }
 
     assert(content.reply_msg);
+    add_server_metric(server_metric::bytes_out,
+                      static_cast<std::int64_t>(
+                          get_message_size(content.reply_msg.get())));
     content.reply_msg.copy_to(reply);
     return S_OK;
   }
 
+  // one way requests go through the same queue as other requests, but
+  // without callback and ctx since there is no reply.
   HRESULT STDMETHODCALLTYPE HandleOneWay(
       /* [in] */ COMMUNICATION_CLIENT_ID clientId,
       /* [in] */ IFabricTransportMessage *message) override {
+    add_server_metric(server_metric::bytes_in,
+                      static_cast<std::int64_t>(get_message_size(message)));
+    winrt::com_ptr<IFabricTransportMessage> msg;
+    msg.copy_from(message);
+
+    std::wstring id(clientId);
+
+    p_request_t pl = std::make_unique<request>(std::move(id), std::move(msg),
+                                               nullptr, nullptr);
+    mgr_->post_request(std::move(pl));
     return S_OK;
   }
 
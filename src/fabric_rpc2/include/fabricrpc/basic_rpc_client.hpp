@@ -1,25 +1,245 @@
 #pragma once
 
 #include "boost/asio/any_io_executor.hpp"
+#include "boost/asio/post.hpp"
 #include "fabricrpc.pb.h"
 #include "fabricrpc/basic_client_connection.hpp"
+#include "fabricrpc/basic_stream_reader.hpp"
+#include "fabricrpc/codec.hpp"
+#include "fabricrpc/inproc_channel.hpp"
+#include "fabricrpc/metadata.hpp"
 #include "fabricrpc/parse.hpp"
 #include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc_tool/alloc_stats.hpp"
 #include "fabricrpc_tool/tool_transport_msg.hpp"
 
+#include <functional>
+#include <vector>
+
 namespace fabricrpc {
 
 namespace net = boost::asio;
 
+// makes the request message of a unary call. ctx is the state of the
+// connection, and is updated for the handshake and metadata.
+inline absl::Status make_unary_request(
+    const std::string &url, const google::protobuf::MessageLite &request,
+    const compression_options &compression, const metadata *request_md,
+    connection_context *ctx, winrt::com_ptr<IFabricTransportMessage> *req) {
+  fabricrpc::request_header header;
+  header.set_url(url);
+  header.set_accept_codec(compression.codec);
+  const peer_capabilities &peer = ctx->peer;
+  if (!peer.known()) {
+    // handshake until the server replies with its capabilities.
+    header.set_protocol_version(current_protocol_version);
+    header.set_capabilities(local_capabilities);
+  }
+  if (request_md != nullptr && !request_md->empty() &&
+      peer.may_have(capability::capability_metadata)) {
+    ctx->metadata.encoder.encode(*request_md, header.mutable_metadata());
+  }
+  std::string ack_slots;
+  header.set_metadata_ack(ctx->metadata.decoder.ack(&ack_slots));
+  if (!ack_slots.empty()) {
+    header.set_metadata_ack_slots(std::move(ack_slots));
+  }
+  // body
+  std::string body = request.SerializeAsString();
+  // old servers cannot decompress, and are only known after a reply.
+  if (peer.has(capability::capability_compression) &&
+      fabricrpc::should_compress(compression, body)) {
+    std::string compressed;
+    absl::Status st =
+        fabricrpc::compress_body(compression.codec, body, &compressed);
+    if (!st.ok()) {
+      return st;
+    }
+    header.set_codec(compression.codec);
+    header.set_uncompressed_size(static_cast<std::uint32_t>(body.size()));
+    body = std::move(compressed);
+  }
+  *req = winrt::make<fabricrpc::tool_transport_msg>(std::move(body),
+                                                    header.SerializeAsString());
+  return absl::OkStatus();
+}
+
+// parses the reply message of a unary call into proto_reply.
+// reply_md is optional.
+inline absl::Status parse_unary_reply(IFabricTransportMessage *reply,
+                                      google::protobuf::MessageLite *proto_reply,
+                                      connection_context *ctx,
+                                      metadata *reply_md) {
+  fabricrpc::reply_header reply_header;
+  absl::Status st = fabricrpc::parse_reply_header(fabricrpc::get_header(reply),
+                                                  &reply_header);
+  if (reply_header.protocol_version() != 0) {
+    ctx->peer.set(reply_header.protocol_version(), reply_header.capabilities());
+  } else if (st.ok() && !ctx->peer.known()) {
+    // old server ignored the handshake.
+    ctx->peer.set(0, 0);
+  }
+  // error replies also carry metadata fields.
+  ctx->metadata.encoder.on_ack(reply_header.metadata_ack(),
+                               reply_header.metadata_ack_slots());
+  if (st.ok() && !reply_header.metadata().empty()) {
+    metadata_view md;
+    st = ctx->metadata.decoder.decode(reply_header.metadata(), &md);
+    if (st.ok() && reply_md != nullptr) {
+      md.copy_to(reply_md);
+    }
+  }
+  if (!st.ok()) {
+    return st;
+  }
+  std::string reply_body = fabricrpc::get_body(reply);
+  if (reply_header.codec() != body_codec::codec_none) {
+    std::string plain;
+    st = fabricrpc::decompress_body(reply_header.codec(), reply_body,
+                                    reply_header.uncompressed_size(),
+                                    default_max_uncompressed_size, &plain);
+    if (!st.ok()) {
+      return st;
+    }
+    reply_body = std::move(plain);
+  }
+  return fabricrpc::parse_proto_payload(reply_body, proto_reply);
+}
+
+// makes the request message of a batch call, with one body per request.
+inline winrt::com_ptr<IFabricTransportMessage> make_batch_request(
+    const std::string &url,
+    const std::vector<const google::protobuf::MessageLite *> &requests) {
+  fabricrpc::request_header header;
+  header.set_url(url);
+  std::vector<std::string> bodies;
+  for (const google::protobuf::MessageLite *request : requests) {
+    bodies.push_back(request->SerializeAsString());
+    header.add_batch_item_sizes(
+        static_cast<std::uint32_t>(bodies.back().size()));
+  }
+  return winrt::make<fabricrpc::tool_transport_msg>(std::move(bodies),
+                                                    header.SerializeAsString());
+}
+
+// parses the reply message of a batch call into proto_replies, one per
+// request. The returned status is for the batch as a whole, and statuses are
+// filled when it is ok. A reply with a different number of items than
+// proto_replies is an error.
+inline absl::Status
+parse_batch_reply(IFabricTransportMessage *reply,
+                  const std::vector<google::protobuf::MessageLite *> &proto_replies,
+                  std::vector<absl::Status> *statuses) {
+  std::vector<absl::Status> item_sts;
+  std::vector<std::uint32_t> item_sizes;
+  absl::Status st = fabricrpc::parse_batch_reply_header(
+      fabricrpc::get_header(reply), &item_sts, &item_sizes);
+  if (!st.ok()) {
+    return st;
+  }
+  if (item_sts.size() != proto_replies.size()) {
+    return absl::UnknownError("batch reply size mismatch");
+  }
+  // body blobs of each item are concatenated in order.
+  std::string body = fabricrpc::get_body(reply);
+  std::string_view body_view = body;
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < item_sts.size(); i++) {
+    if (body_view.size() - offset < item_sizes[i]) {
+      return absl::UnknownError("bad batch reply body");
+    }
+    if (item_sts[i].ok()) {
+      item_sts[i] = fabricrpc::parse_proto_payload(
+          body_view.substr(offset, item_sizes[i]), proto_replies[i]);
+    }
+    offset += item_sizes[i];
+  }
+  *statuses = std::move(item_sts);
+  return absl::OkStatus();
+}
+
 // signature: void(ec, absl::Status)
+// request_md and reply_md are optional.
 template <typename Executor> class async_rpc_op : boost::asio::coroutine {
 public:
   typedef Executor executor_type;
 
   async_rpc_op(fabricrpc::basic_client_connection<executor_type> &conn,
                const std::string url, google::protobuf::MessageLite *request,
-               google::protobuf::MessageLite *reply)
-      : conn_(conn), url_(url), request_(request), reply_(reply) {}
+               google::protobuf::MessageLite *reply,
+               compression_options compression = {},
+               const metadata *request_md = nullptr,
+               metadata *reply_md = nullptr)
+      : conn_(conn), url_(url), request_(request), reply_(reply),
+        compression_(compression), request_md_(request_md),
+        reply_md_(reply_md) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, {});
+      return;
+    }
+
+    std::shared_ptr<connection_context> ctx = conn_.get_context();
+    winrt::com_ptr<IFabricTransportMessage> req;
+    absl::Status st;
+    {
+      alloc_scope encode_scope(alloc_phase::client_encode);
+      st = make_unary_request(url_, *request_, compression_, request_md_,
+                              ctx.get(), &req);
+    }
+    if (!st.ok()) {
+      self.complete({}, st);
+      return;
+    }
+
+    // to be filled
+    google::protobuf::MessageLite *proto_reply = reply_;
+    conn_.async_send(
+        req, [self = std::move(self), proto_reply, ctx,
+              reply_md = reply_md_](
+                 boost::system::error_code ec,
+                 winrt::com_ptr<IFabricTransportMessage> reply) mutable {
+          if (ec.failed()) {
+            self.complete(ec, {});
+            return;
+          }
+          absl::Status st;
+          {
+            alloc_scope decode_scope(alloc_phase::client_decode);
+            st = parse_unary_reply(reply.get(), proto_reply, ctx.get(),
+                                   reply_md);
+          }
+          self.complete({}, st);
+        });
+  }
+
+private:
+  fabricrpc::basic_client_connection<executor_type> &conn_;
+  const std::string url_; // takes ownership
+  google::protobuf::MessageLite *request_;
+  google::protobuf::MessageLite *reply_;
+  const compression_options compression_;
+  const metadata *request_md_;
+  metadata *reply_md_;
+};
+
+// signature: void(ec, absl::Status)
+// The returned status is for the batch as a whole. Item statuses are filled
+// when the batch is ok.
+template <typename Executor> class async_batch_rpc_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_batch_rpc_op(
+      fabricrpc::basic_client_connection<executor_type> &conn,
+      const std::string url,
+      std::vector<const google::protobuf::MessageLite *> requests,
+      std::vector<google::protobuf::MessageLite *> replies,
+      std::vector<absl::Status> *statuses)
+      : conn_(conn), url_(url), requests_(std::move(requests)),
+        replies_(std::move(replies)), statuses_(statuses) {}
 
   template <typename Self>
   void operator()(Self &self, boost::system::error_code ec = {}) {
@@ -28,15 +248,158 @@ public:
       return;
     }
 
-    // make message
+    if (requests_.empty()) {
+      self.complete({}, absl::InvalidArgumentError("batch has no request"));
+      return;
+    }
+    if (!conn_.get_context()->peer.may_have(capability::capability_batch)) {
+      self.complete({}, absl::UnimplementedError("server has no batch"));
+      return;
+    }
+
+    winrt::com_ptr<IFabricTransportMessage> req =
+        make_batch_request(url_, requests_);
+
+    // to be filled
+    std::vector<google::protobuf::MessageLite *> proto_replies =
+        std::move(replies_);
+    std::vector<absl::Status> *statuses = statuses_;
+    conn_.async_send(
+        req, [self = std::move(self), proto_replies, statuses](
+                 boost::system::error_code ec,
+                 winrt::com_ptr<IFabricTransportMessage> reply) mutable {
+          if (ec.failed()) {
+            self.complete(ec, {});
+            return;
+          }
+          absl::Status st =
+              parse_batch_reply(reply.get(), proto_replies, statuses);
+          self.complete({}, st);
+        });
+  }
+
+private:
+  fabricrpc::basic_client_connection<executor_type> &conn_;
+  const std::string url_; // takes ownership
+  std::vector<const google::protobuf::MessageLite *> requests_;
+  std::vector<google::protobuf::MessageLite *> replies_;
+  std::vector<absl::Status> *statuses_;
+};
+
+// signature: void(ec, absl::Status)
+// Opens a server stream. The returned status is whether the server accepted
+// the stream. Reply msgs and the final status are read from the reader.
+template <typename Executor>
+class async_open_stream_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_open_stream_op(fabricrpc::basic_client_connection<executor_type> &conn,
+                       const std::string url,
+                       google::protobuf::MessageLite *request,
+                       basic_stream_reader<executor_type> *reader)
+      : conn_(conn), url_(url), request_(request), reader_(reader) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, {});
+      return;
+    }
+
+    if (!conn_.get_context()->peer.may_have(
+            capability::capability_server_stream)) {
+      absl::Status st = absl::UnimplementedError("server has no streaming");
+      reader_->fail(st);
+      self.complete({}, st);
+      return;
+    }
+
+    // register the stream before sending, since chunks may arrive before
+    // the reply.
+    auto streams = conn_.get_streams();
+    auto state = std::make_shared<basic_stream_state<executor_type>>();
+    std::uint64_t stream_id = streams->add(state);
+    // acks are one way msgs. Without them the server sends without a window.
+    std::uint32_t window = 0;
+    std::function<void(std::uint64_t)> send_ack;
+    if (reader_->window() != 0 &&
+        conn_.get_context()->peer.may_have(capability::capability_one_way)) {
+      window = reader_->window();
+      send_ack = [conn = &conn_, stream_id](std::uint64_t acked) {
+        fabricrpc::request_header ack_header;
+        ack_header.set_stream_id(stream_id);
+        ack_header.set_stream_acked(acked);
+        // nothing to do on failure, the stream ends with the connection.
+        conn->send_one_way(winrt::make<fabricrpc::tool_transport_msg>(
+            "", ack_header.SerializeAsString()));
+      };
+    }
+    reader_->attach(streams, stream_id, state, std::move(send_ack));
+
     fabricrpc::request_header header;
     header.set_url(url_);
-    // body
+    header.set_stream_id(stream_id);
+    header.set_stream_window(window);
     winrt::com_ptr<IFabricTransportMessage> req =
         winrt::make<fabricrpc::tool_transport_msg>(
             request_->SerializeAsString(), header.SerializeAsString());
 
-    // to be filled
+    basic_stream_reader<executor_type> *reader = reader_;
+    conn_.async_send(
+        req, [self = std::move(self),
+              reader](boost::system::error_code ec,
+                      winrt::com_ptr<IFabricTransportMessage> reply) mutable {
+          if (ec.failed()) {
+            reader->fail(absl::UnavailableError("failed to open stream"));
+            self.complete(ec, {});
+            return;
+          }
+          absl::Status st =
+              fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get()));
+          if (!st.ok()) {
+            reader->fail(st);
+          }
+          self.complete({}, st);
+        });
+  }
+
+private:
+  fabricrpc::basic_client_connection<executor_type> &conn_;
+  const std::string url_; // takes ownership
+  google::protobuf::MessageLite *request_;
+  basic_stream_reader<executor_type> *reader_;
+};
+
+// signature: void(ec, absl::Status)
+// sends one chunk of a client streaming call. reply is parsed if not null.
+template <typename Executor>
+class async_client_chunk_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_client_chunk_op(fabricrpc::basic_client_connection<executor_type> &conn,
+                        std::string header, std::string body,
+                        google::protobuf::MessageLite *reply)
+      : conn_(conn), header_(std::move(header)), body_(std::move(body)),
+        reply_(reply) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, {});
+      return;
+    }
+
+    if (!conn_.get_context()->peer.may_have(
+            capability::capability_client_stream)) {
+      self.complete({}, absl::UnimplementedError("server has no streaming"));
+      return;
+    }
+
+    winrt::com_ptr<IFabricTransportMessage> req =
+        winrt::make<fabricrpc::tool_transport_msg>(std::move(body_),
+                                                   std::move(header_));
     google::protobuf::MessageLite *proto_reply = reply_;
     conn_.async_send(
         req, [self = std::move(self), proto_reply](
@@ -48,29 +411,119 @@ public:
           }
           absl::Status st =
               fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get()));
-          if (!st.ok()) {
-            self.complete({}, st);
-            return;
+          if (st.ok() && proto_reply != nullptr) {
+            st = fabricrpc::parse_proto_payload(
+                fabricrpc::get_body(reply.get()), proto_reply);
           }
-          st = fabricrpc::parse_proto_payload(fabricrpc::get_body(reply.get()),
-                                              proto_reply);
           self.complete({}, st);
         });
   }
 
 private:
   fabricrpc::basic_client_connection<executor_type> &conn_;
-  const std::string url_; // takes ownership
-  google::protobuf::MessageLite *request_;
+  std::string header_;
+  std::string body_;
   google::protobuf::MessageLite *reply_;
 };
 
+// sends request msgs of a client streaming call one by one, so that a large
+// upload does not need to fit in one transport message.
+// Each write completes after the server handler has taken the msg. Writes
+// should not overlap.
+template <typename Executor = net::any_io_executor>
+class basic_client_stream_writer {
+public:
+  typedef Executor executor_type;
+
+  basic_client_stream_writer(
+      fabricrpc::basic_client_connection<executor_type> &conn,
+      const std::string &url)
+      : conn_(&conn), ex_(conn.get_executor()), url_(url),
+        stream_id_(conn.get_streams()->new_id()), sequence_(0),
+        failed_() {}
+
+  // writer without a connection. Writes and finish complete with st.
+  basic_client_stream_writer(const executor_type &ex, absl::Status st)
+      : conn_(nullptr), ex_(ex), url_(), stream_id_(0), sequence_(0),
+        failed_(std::move(st)) {
+    assert(!failed_.ok());
+  }
+
+  // handler void(ec, absl::Status)
+  // not ok status means the server has ended the call with the status.
+  template <typename Token>
+  auto async_write(const google::protobuf::MessageLite *msg, Token &&token) {
+    return this->async_send_chunk(msg->SerializeAsString(), false, nullptr,
+                                  std::move(token));
+  }
+
+  // ends the request stream and gets the reply of the call.
+  // handler void(ec, absl::Status)
+  template <typename Token>
+  auto async_finish(google::protobuf::MessageLite *reply, Token &&token) {
+    return this->async_send_chunk("", true, reply, std::move(token));
+  }
+
+private:
+  template <typename Token>
+  auto async_send_chunk(std::string body, bool end_of_stream,
+                        google::protobuf::MessageLite *reply, Token &&token) {
+    fabricrpc::request_header header;
+    header.set_url(url_);
+    header.set_stream_id(stream_id_);
+    header.set_client_stream(true);
+    header.set_sequence(sequence_++);
+    header.set_end_of_stream(end_of_stream);
+    return boost::asio::async_initiate<Token, void(boost::system::error_code,
+                                                   absl::Status)>(
+        [this, header_str = header.SerializeAsString(), body = std::move(body),
+         reply](auto handler) mutable {
+          if (conn_ == nullptr) {
+            boost::asio::post(ex_, [handler = std::move(handler),
+                                    st = failed_]() mutable {
+              std::move(handler)(boost::system::error_code{}, st);
+            });
+            return;
+          }
+          boost::asio::async_compose<decltype(handler),
+                                     void(boost::system::error_code,
+                                          absl::Status)>(
+              async_client_chunk_op<executor_type>(*conn_,
+                                                   std::move(header_str),
+                                                   std::move(body), reply),
+              handler, ex_);
+        },
+        token);
+  }
+
+  // null if the writer has no connection.
+  fabricrpc::basic_client_connection<executor_type> *conn_;
+  executor_type ex_;
+  const std::string url_;
+  const std::uint64_t stream_id_;
+  // sequence of the next chunk
+  std::uint64_t sequence_;
+  // status of writes without a connection.
+  const absl::Status failed_;
+};
+
 template <typename Executor = net::any_io_executor> class rpc_client {
 public:
   typedef Executor executor_type;
 
   rpc_client(fabricrpc::basic_client_connection<executor_type> &conn)
-      : conn_(conn) {}
+      : conn_(&conn), inproc_(nullptr), compression_() {}
+
+  // calls services of the channel in the same process. Only unary and one way
+  // methods are supported.
+  rpc_client(fabricrpc::basic_inproc_channel<executor_type> &channel)
+      : conn_(nullptr), inproc_(&channel), compression_() {}
+
+  // compresses request bodies of unary calls, and accepts compressed replies.
+  // Requests are compressed only after the server is known to support it.
+  void set_compression(compression_options compression) {
+    compression_ = compression;
+  }
 
   // handler void(ec, absl::Status)
   // reply pointer needs to be valid
@@ -78,14 +531,172 @@ public:
   auto async_send(const std::string &url,
                   google::protobuf::MessageLite *request,
                   google::protobuf::MessageLite *reply, Token &&token) {
-    return boost::asio::async_compose<Token, void(boost::system::error_code,
-                                                  absl::Status)>(
-        async_rpc_op<executor_type>(conn_, url, request, reply),
-        std::move(token), this->conn_.get_executor());
+    return this->async_send(url, request, reply, nullptr, nullptr,
+                            std::move(token));
+  }
+
+  // same as above, and sends request_md with the request. Metadata the
+  // server replies with is added to reply_md.
+  // handler void(ec, absl::Status)
+  // reply and reply_md pointers need to be valid
+  template <typename Token>
+  auto async_send(const std::string &url,
+                  google::protobuf::MessageLite *request,
+                  google::protobuf::MessageLite *reply,
+                  const metadata *request_md, metadata *reply_md,
+                  Token &&token) {
+    // the handler type is the same for both, so the channel is picked at run
+    // time.
+    return boost::asio::async_initiate<Token, void(boost::system::error_code,
+                                                   absl::Status)>(
+        [this, url, request, reply, request_md, reply_md](auto handler) {
+          if (inproc_ != nullptr) {
+            inproc_->async_send(url, request, reply, request_md, reply_md,
+                                std::move(handler));
+            return;
+          }
+          boost::asio::async_compose<decltype(handler),
+                                     void(boost::system::error_code,
+                                          absl::Status)>(
+              async_rpc_op<executor_type>(*conn_, url, request, reply,
+                                          compression_, request_md, reply_md),
+              handler, conn_->get_executor());
+        },
+        token);
+  }
+
+  // sends a one way request. Server runs the method and does not reply.
+  // returns whether the request is handed to transport.
+  absl::Status send_one_way(const std::string &url,
+                            const google::protobuf::MessageLite *request) {
+    if (inproc_ != nullptr) {
+      return inproc_->send_one_way(url, request);
+    }
+    const peer_capabilities &peer = conn_->get_context()->peer;
+    if (!peer.may_have(capability::capability_one_way)) {
+      return absl::UnimplementedError("server has no one way requests");
+    }
+    fabricrpc::request_header header;
+    header.set_url(url);
+    std::string body = request->SerializeAsString();
+    if (peer.has(capability::capability_compression) &&
+        fabricrpc::should_compress(compression_, body)) {
+      std::string compressed;
+      absl::Status st =
+          fabricrpc::compress_body(compression_.codec, body, &compressed);
+      if (!st.ok()) {
+        return st;
+      }
+      header.set_codec(compression_.codec);
+      header.set_uncompressed_size(static_cast<std::uint32_t>(body.size()));
+      body = std::move(compressed);
+    }
+    winrt::com_ptr<IFabricTransportMessage> req =
+        winrt::make<fabricrpc::tool_transport_msg>(std::move(body),
+                                                   header.SerializeAsString());
+    boost::system::error_code ec = conn_->send_one_way(req);
+    if (ec.failed()) {
+      return absl::UnavailableError(ec.message());
+    }
+    return absl::OkStatus();
+  }
+
+  // sends all requests of the same method in one transport message.
+  // handler void(ec, absl::Status)
+  // replies and statuses need to be valid, and replies has the same size as
+  // requests.
+  template <typename Token>
+  auto async_send_batch(
+      const std::string &url,
+      std::vector<const google::protobuf::MessageLite *> requests,
+      std::vector<google::protobuf::MessageLite *> replies,
+      std::vector<absl::Status> *statuses, Token &&token) {
+    assert(requests.size() == replies.size());
+    return boost::asio::async_initiate<Token, void(boost::system::error_code,
+                                                   absl::Status)>(
+        [this, url, statuses](auto handler,
+                              std::vector<const google::protobuf::MessageLite *>
+                                  requests,
+                              std::vector<google::protobuf::MessageLite *>
+                                  replies) {
+          if (inproc_ != nullptr) {
+            inproc_->async_send_batch(url, std::move(requests),
+                                      std::move(replies), statuses,
+                                      std::move(handler));
+            return;
+          }
+          boost::asio::async_compose<decltype(handler),
+                                     void(boost::system::error_code,
+                                          absl::Status)>(
+              async_batch_rpc_op<executor_type>(*conn_, url,
+                                                std::move(requests),
+                                                std::move(replies), statuses),
+              handler, conn_->get_executor());
+        },
+        token, std::move(requests), std::move(replies));
+  }
+
+  // starts a server streaming call.
+  // handler void(ec, absl::Status)
+  // reader needs to be valid until the stream ends.
+  template <typename Token>
+  auto async_open_stream(const std::string &url,
+                         google::protobuf::MessageLite *request,
+                         basic_stream_reader<executor_type> *reader,
+                         Token &&token) {
+    return boost::asio::async_initiate<Token, void(boost::system::error_code,
+                                                   absl::Status)>(
+        [this, url, request, reader](auto handler) {
+          if (inproc_ != nullptr) {
+            absl::Status st =
+                absl::UnimplementedError("in process has no streaming");
+            reader->fail(st);
+            boost::asio::post(inproc_->get_executor(),
+                              [handler = std::move(handler), st]() mutable {
+                                std::move(handler)(
+                                    boost::system::error_code{}, st);
+                              });
+            return;
+          }
+          boost::asio::async_compose<decltype(handler),
+                                     void(boost::system::error_code,
+                                          absl::Status)>(
+              async_open_stream_op<executor_type>(*conn_, url, request,
+                                                  reader),
+              handler, conn_->get_executor());
+        },
+        token);
+  }
+
+  // starts a client streaming call. Nothing is sent until the first write.
+  // Without a connection, writes fail with Unimplemented.
+  basic_client_stream_writer<executor_type>
+  open_client_stream(const std::string &url) {
+    if (conn_ == nullptr) {
+      return basic_client_stream_writer<executor_type>(
+          inproc_->get_executor(),
+          absl::UnimplementedError("in process has no streaming"));
+    }
+    return basic_client_stream_writer<executor_type>(*conn_, url);
+  }
+
+  // receives notifications server pushes for topic.
+  // sub needs to be valid as long as the connection is open. Fails with
+  // Unimplemented without a connection, and reads of sub fail.
+  absl::Status subscribe(const std::string &topic,
+                         basic_subscription<executor_type> *sub) {
+    if (conn_ == nullptr) {
+      return absl::UnimplementedError("in process has no notifications");
+    }
+    conn_->subscribe(topic, sub);
+    return absl::OkStatus();
   }
 
 private:
-  fabricrpc::basic_client_connection<executor_type> &conn_;
+  // one of the two is set.
+  fabricrpc::basic_client_connection<executor_type> *conn_;
+  fabricrpc::basic_inproc_channel<executor_type> *inproc_;
+  compression_options compression_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
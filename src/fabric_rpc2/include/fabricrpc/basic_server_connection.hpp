@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fabricrpc/basic_item_queue.hpp"
+#include "fabricrpc/server_metrics.hpp"
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/asio/compose.hpp>
 #include <boost/asio/coroutine.hpp>
@@ -39,6 +40,9 @@ public:
     // wait for payload to arrive
     ev_->async_wait([self = std::move(self),
                      p = pl_](boost::system::error_code ec) mutable {
+      if (!ec && *p) {
+        add_server_metric(server_metric::queued, -1);
+      }
       self.complete(ec, std::move(*p));
     });
   }
@@ -56,7 +60,8 @@ public:
 
   basic_server_connection(const executor_type &ex)
       : queue_(), // queue needs to be set on accept
-        ev_(std::make_shared<basic_event<executor_type>>(ex)), pl_() {}
+        ev_(std::make_shared<basic_event<executor_type>>(ex)), pl_(),
+        conn_() {}
 
   ~basic_server_connection() {
     if (queue_) {
@@ -92,12 +97,24 @@ public:
     queue_ = queue;
   }
 
+  // transport connection used to send msgs back to client.
+  winrt::com_ptr<IFabricTransportClientConnection> get_transport_conn() {
+    return conn_;
+  }
+
+  void
+  set_transport_conn(winrt::com_ptr<IFabricTransportClientConnection> conn) {
+    assert(!conn_);
+    conn_ = conn;
+  }
+
 private:
   std::shared_ptr<basic_item_queue<p_request_t, executor_type>> queue_;
   // event used for waiting arriving msg
   std::shared_ptr<basic_event<executor_type>> ev_;
   // payload holder. payload will be passed into handler.
   p_request_t pl_;
+  winrt::com_ptr<IFabricTransportClientConnection> conn_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc/basic_event.hpp"
+#include "fabricrpc/basic_item_queue.hpp"
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+#include <boost/asio/compose.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <fabrictransport_.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// one msg of a server stream received on the callback channel.
+struct stream_chunk {
+  std::string body;
+  bool end_of_stream;
+  // final status of the stream. Only valid at end of stream.
+  absl::Status status;
+};
+
+// client side state of one stream.
+// Chunks may arrive out of order and are reordered by sequence before they
+// are made available to the reader.
+template <typename Executor = net::any_io_executor> class basic_stream_state {
+public:
+  typedef Executor executor_type;
+
+  basic_stream_state() : mtx_(), next_sequence_(0), pending_(), ready_() {}
+
+  ~basic_stream_state() { ready_.clear(); }
+
+  void on_chunk(std::uint64_t sequence, stream_chunk chunk) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (sequence < next_sequence_) {
+      // duplicate
+      return;
+    }
+    pending_.insert({sequence, std::move(chunk)});
+    // release all chunks that are now in order.
+    for (auto it = pending_.begin();
+         it != pending_.end() && it->first == next_sequence_;
+         it = pending_.erase(it)) {
+      ready_.push(std::move(it->second));
+      next_sequence_++;
+    }
+  }
+
+  basic_item_queue<stream_chunk, executor_type> &get_ready_queue() {
+    return ready_;
+  }
+
+private:
+  std::mutex mtx_;
+  // sequence of the next chunk to release.
+  std::uint64_t next_sequence_;
+  // chunks arrived ahead of order.
+  std::map<std::uint64_t, stream_chunk> pending_;
+  // chunks in order to be read.
+  basic_item_queue<stream_chunk, executor_type> ready_;
+};
+
+// all open streams of a client connection.
+// callback msgs are routed to the stream by stream id.
+template <typename Executor = net::any_io_executor>
+class basic_stream_registry {
+public:
+  typedef Executor executor_type;
+
+  basic_stream_registry() : mtx_(), next_id_(1), streams_() {}
+
+  // returns the new stream id
+  std::uint64_t add(std::shared_ptr<basic_stream_state<executor_type>> state) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::uint64_t id = next_id_++;
+    streams_.insert({id, state});
+    return id;
+  }
+
+  // returns a stream id unique on the connection without registering a state.
+  // used by client streams that do not receive callback msgs.
+  std::uint64_t new_id() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return next_id_++;
+  }
+
+  void remove(std::uint64_t id) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    streams_.erase(id);
+  }
+
+  // handles a msg from callback channel.
+  // msgs of unknown streams are dropped.
+  void dispatch(IFabricTransportMessage *message) {
+    fabricrpc::callback_header header;
+    if (!header.ParseFromString(fabricrpc::get_header(message))) {
+      return;
+    }
+    dispatch(header, message);
+  }
+
+  // same as above, with header already parsed by the caller.
+  void dispatch(const fabricrpc::callback_header &header,
+                IFabricTransportMessage *message) {
+    std::shared_ptr<basic_stream_state<executor_type>> state;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto it = streams_.find(header.stream_id());
+      if (it == streams_.end()) {
+        return;
+      }
+      state = it->second;
+    }
+    stream_chunk chunk;
+    chunk.end_of_stream = header.end_of_stream();
+    if (chunk.end_of_stream) {
+      chunk.status =
+          absl::Status(static_cast<absl::StatusCode>(header.status_code()),
+                       header.status_message());
+    } else {
+      chunk.body = fabricrpc::get_body(message);
+    }
+    state->on_chunk(header.sequence(), std::move(chunk));
+  }
+
+private:
+  std::mutex mtx_;
+  std::uint64_t next_id_;
+  std::map<std::uint64_t,
+           std::shared_ptr<basic_stream_state<executor_type>>>
+      streams_;
+};
+
+template <typename Executor> class basic_stream_reader;
+
+// signature: void(ec, bool)
+// false means the stream has ended and no msg is read.
+template <typename Executor>
+class async_stream_read_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_stream_read_op(basic_stream_reader<executor_type> *reader,
+                       google::protobuf::MessageLite *msg)
+      : reader_(reader), msg_(msg) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, false);
+      return;
+    }
+    if (reader_->done_) {
+      self.complete({}, false);
+      return;
+    }
+
+    auto ev = reader_->ev_;
+    ev->reset();
+    reader_->state_->get_ready_queue().async_pop(ev, &reader_->chunk_);
+
+    // wait for chunk to arrive
+    ev->async_wait([self = std::move(self), reader = reader_,
+                    msg = msg_](boost::system::error_code ec) mutable {
+      if (ec) {
+        self.complete(ec, false);
+        return;
+      }
+      self.complete({}, reader->take_chunk(msg));
+    });
+  }
+
+private:
+  basic_stream_reader<executor_type> *reader_;
+  google::protobuf::MessageLite *msg_;
+};
+
+// chunks a server stream may send ahead of the reader by default.
+constexpr std::uint32_t default_stream_window = 16;
+
+// reads reply msgs of a server streaming call.
+// The server sends at most window chunks ahead of the msgs read, so a slow
+// reader holds at most window chunks. 0 is no limit.
+// Reader needs to be valid until the pending read completes.
+template <typename Executor = net::any_io_executor>
+class basic_stream_reader {
+public:
+  typedef Executor executor_type;
+
+  basic_stream_reader(const executor_type &ex,
+                      std::uint32_t window = default_stream_window)
+      : ev_(std::make_shared<basic_event<executor_type>>(ex)), registry_(),
+        state_(), stream_id_(0), chunk_(), done_(false), status_(),
+        window_(window), send_ack_(), read_(0), acked_(0) {}
+
+  ~basic_stream_reader() {
+    if (state_) {
+      state_->get_ready_queue().cancel(ev_);
+    }
+    this->detach();
+  }
+
+  basic_stream_reader(const basic_stream_reader<executor_type> &) = delete;
+
+  // reads the next msg.
+  // handler void(ec, bool). false means the stream has ended, and status()
+  // has the final status.
+  template <typename Token>
+  auto async_read(google::protobuf::MessageLite *msg, Token &&token) {
+    assert(state_ || done_);
+    return boost::asio::async_compose<Token,
+                                      void(boost::system::error_code, bool)>(
+        async_stream_read_op<executor_type>(this, msg), token,
+        this->ev_->get_executor());
+  }
+
+  // final status of the stream. Valid after read returns false.
+  const absl::Status &status() const { return status_; }
+
+  std::uint32_t window() const { return window_; }
+
+  // used by rpc client to bind the reader to an opened stream.
+  // send_ack sends the number of msgs read to the server. It is not set if
+  // the stream has no window.
+  void attach(std::shared_ptr<basic_stream_registry<executor_type>> registry,
+              std::uint64_t stream_id,
+              std::shared_ptr<basic_stream_state<executor_type>> state,
+              std::function<void(std::uint64_t)> send_ack = nullptr) {
+    assert(!registry_);
+    registry_ = registry;
+    stream_id_ = stream_id;
+    state_ = state;
+    send_ack_ = std::move(send_ack);
+  }
+
+  // ends the stream with error, i.e. the stream failed to open.
+  void fail(absl::Status st) {
+    assert(!st.ok());
+    done_ = true;
+    status_ = std::move(st);
+    this->detach();
+  }
+
+private:
+  template <typename> friend class async_stream_read_op;
+
+  // consumes the chunk poped from queue.
+  bool take_chunk(google::protobuf::MessageLite *msg) {
+    stream_chunk chunk = std::move(chunk_);
+    if (chunk.end_of_stream) {
+      done_ = true;
+      status_ = std::move(chunk.status);
+      this->detach();
+      return false;
+    }
+    absl::Status st = fabricrpc::parse_proto_payload(chunk.body, msg);
+    if (!st.ok()) {
+      done_ = true;
+      status_ = std::move(st);
+      this->detach();
+      return false;
+    }
+    this->ack();
+    return true;
+  }
+
+  // acks every half window, so the server can send the next chunks while
+  // the reader works on the rest.
+  void ack() {
+    read_++;
+    const std::uint64_t every = std::max<std::uint32_t>(window_ / 2, 1);
+    if (send_ack_ && read_ - acked_ >= every) {
+      acked_ = read_;
+      send_ack_(read_);
+    }
+  }
+
+  // stops receiving chunks for the stream.
+  void detach() {
+    if (registry_) {
+      registry_->remove(stream_id_);
+      registry_.reset();
+    }
+  }
+
+  // event used for waiting arriving chunk
+  std::shared_ptr<basic_event<executor_type>> ev_;
+  std::shared_ptr<basic_stream_registry<executor_type>> registry_;
+  std::shared_ptr<basic_stream_state<executor_type>> state_;
+  std::uint64_t stream_id_;
+  // chunk holder. filled by the queue.
+  stream_chunk chunk_;
+  bool done_;
+  absl::Status status_;
+  const std::uint32_t window_;
+  std::function<void(std::uint64_t)> send_ack_;
+  // msgs read, and the last count sent to the server.
+  std::uint64_t read_;
+  std::uint64_t acked_;
+};
+
+} // namespace fabricrpc
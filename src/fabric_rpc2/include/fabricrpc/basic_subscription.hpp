@@ -0,0 +1,194 @@
+#pragma once
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc/basic_event.hpp"
+#include "fabricrpc/basic_item_queue.hpp"
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+#include <boost/asio/compose.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/post.hpp>
+#include <fabrictransport_.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// client side state of one subscription.
+// Notifications are queued until read. There is no limit, so subscribers
+// need to keep reading.
+template <typename Executor = net::any_io_executor>
+class basic_subscription_state {
+public:
+  typedef Executor executor_type;
+
+  basic_subscription_state() : queue_() {}
+
+  ~basic_subscription_state() { queue_.clear(); }
+
+  basic_item_queue<std::string, executor_type> &get_queue() { return queue_; }
+
+private:
+  // notification bodies in arrival order.
+  basic_item_queue<std::string, executor_type> queue_;
+};
+
+// all subscriptions of a client connection.
+// notifications are routed to the subscriptions of their topic.
+template <typename Executor = net::any_io_executor>
+class basic_subscription_registry {
+public:
+  typedef Executor executor_type;
+
+  basic_subscription_registry() : mtx_(), next_id_(1), subs_() {}
+
+  // returns the subscription id
+  std::uint64_t
+  add(const std::string &topic,
+      std::shared_ptr<basic_subscription_state<executor_type>> state) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::uint64_t id = next_id_++;
+    subs_.insert({id, {topic, state}});
+    return id;
+  }
+
+  void remove(std::uint64_t id) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    subs_.erase(id);
+  }
+
+  // handles a notification from callback channel.
+  // notifications of topics nobody subscribes are dropped.
+  void dispatch(const fabricrpc::callback_header &header,
+                IFabricTransportMessage *message) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto &[id, sub] : subs_) {
+      if (sub.first == header.topic()) {
+        sub.second->get_queue().push(fabricrpc::get_body(message));
+      }
+    }
+  }
+
+private:
+  std::mutex mtx_;
+  std::uint64_t next_id_;
+  // subscriptions are few, so a topic lookup scans all of them.
+  std::map<std::uint64_t,
+           std::pair<std::string,
+                     std::shared_ptr<basic_subscription_state<executor_type>>>>
+      subs_;
+};
+
+template <typename Executor> class basic_subscription;
+
+// signature: void(ec, absl::Status)
+// status is not ok if the notification cannot be parsed into msg.
+template <typename Executor>
+class async_subscription_read_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_subscription_read_op(basic_subscription<executor_type> *sub,
+                             google::protobuf::MessageLite *msg)
+      : sub_(sub), msg_(msg) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, {});
+      return;
+    }
+    if (!sub_->state_) {
+      // subscribe failed. Completes after the initiation returns.
+      boost::asio::post(sub_->ev_->get_executor(),
+                        [self = std::move(self)]() mutable {
+                          self.complete({}, absl::FailedPreconditionError(
+                                                "subscription is not attached"));
+                        });
+      return;
+    }
+
+    auto ev = sub_->ev_;
+    ev->reset();
+    sub_->state_->get_queue().async_pop(ev, &sub_->body_);
+
+    // wait for notification to arrive
+    ev->async_wait([self = std::move(self), sub = sub_,
+                    msg = msg_](boost::system::error_code ec) mutable {
+      if (ec) {
+        self.complete(ec, {});
+        return;
+      }
+      std::string body = std::move(sub->body_);
+      self.complete({}, fabricrpc::parse_proto_payload(body, msg));
+    });
+  }
+
+private:
+  basic_subscription<executor_type> *sub_;
+  google::protobuf::MessageLite *msg_;
+};
+
+// receives notifications the server pushes for one topic.
+// Notifications sent before subscribing are not received.
+// Subscription needs to be valid until the pending read completes.
+template <typename Executor = net::any_io_executor> class basic_subscription {
+public:
+  typedef Executor executor_type;
+
+  basic_subscription(const executor_type &ex)
+      : ev_(std::make_shared<basic_event<executor_type>>(ex)), registry_(),
+        state_(), id_(0), body_() {}
+
+  ~basic_subscription() {
+    if (state_) {
+      state_->get_queue().cancel(ev_);
+    }
+    if (registry_) {
+      registry_->remove(id_);
+    }
+  }
+
+  basic_subscription(const basic_subscription<executor_type> &) = delete;
+
+  // reads the next notification. Fails if the subscription is not attached
+  // to a connection.
+  // handler void(ec, absl::Status)
+  template <typename Token>
+  auto async_read(google::protobuf::MessageLite *msg, Token &&token) {
+    return boost::asio::async_compose<Token, void(boost::system::error_code,
+                                                  absl::Status)>(
+        async_subscription_read_op<executor_type>(this, msg), token,
+        this->ev_->get_executor());
+  }
+
+  // used by client connection to bind the subscription to a topic.
+  void
+  attach(std::shared_ptr<basic_subscription_registry<executor_type>> registry,
+         std::uint64_t id,
+         std::shared_ptr<basic_subscription_state<executor_type>> state) {
+    assert(!registry_);
+    registry_ = registry;
+    id_ = id;
+    state_ = state;
+  }
+
+private:
+  template <typename> friend class async_subscription_read_op;
+
+  // event used for waiting arriving notification
+  std::shared_ptr<basic_event<executor_type>> ev_;
+  std::shared_ptr<basic_subscription_registry<executor_type>> registry_;
+  std::shared_ptr<basic_subscription_state<executor_type>> state_;
+  std::uint64_t id_;
+  // body holder. filled by the queue.
+  std::string body_;
+};
+
+} // namespace fabricrpc
@@ -0,0 +1,58 @@
+#pragma once
+// protocol version and capabilities exchanged with the peer.
+
+#include "fabricrpc.pb.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace fabricrpc {
+
+// version of the protocol this runtime speaks.
+constexpr std::uint32_t current_protocol_version = 1;
+
+// capability bitset of this runtime.
+constexpr std::uint64_t local_capabilities =
+    capability::capability_compression | capability::capability_batch |
+    capability::capability_metadata | capability::capability_server_stream |
+    capability::capability_client_stream | capability::capability_one_way |
+    capability::capability_notification;
+
+// what the peer of a connection supports, learned from the first reply or
+// request that has it. Peers that do not send it are old peers with no
+// capabilities.
+// thread safe.
+class peer_capabilities {
+public:
+  peer_capabilities() : known_(false), version_(0), capabilities_(0) {}
+
+  bool known() const { return known_.load(std::memory_order_acquire); }
+
+  // 0 for old peers.
+  std::uint32_t version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  // true if peer is known to support cap.
+  bool has(capability cap) const {
+    return known() &&
+           (capabilities_.load(std::memory_order_acquire) & cap) != 0;
+  }
+
+  // false only if peer is known not to support cap. Features that old peers
+  // misread should not be sent in this case.
+  bool may_have(capability cap) const { return !known() || has(cap); }
+
+  void set(std::uint32_t version, std::uint64_t capabilities) {
+    version_.store(version, std::memory_order_release);
+    capabilities_.store(capabilities, std::memory_order_release);
+    known_.store(true, std::memory_order_release);
+  }
+
+private:
+  std::atomic<bool> known_;
+  std::atomic<std::uint32_t> version_;
+  std::atomic<std::uint64_t> capabilities_;
+};
+
+} // namespace fabricrpc
@@ -0,0 +1,40 @@
+#pragma once
+// body compression
+
+#include "fabricrpc.pb.h"
+
+#include "absl/status/status.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace fabricrpc {
+
+// body compression settings of one side.
+// Bodies smaller than threshold are sent raw, since compressing them does not
+// pay off.
+struct compression_options {
+  body_codec codec = body_codec::codec_none;
+  std::size_t threshold = 1024;
+};
+
+// uncompressed size a peer may claim for a body by default. The size is
+// allocated before decompressing, so larger claims are rejected.
+constexpr std::size_t default_max_uncompressed_size = 64 * 1024 * 1024;
+
+// returns true if body should be compressed with the options
+bool should_compress(const compression_options &options,
+                     const std::string_view body);
+
+absl::Status compress_body(body_codec codec, const std::string_view in,
+                           std::string *ret);
+
+// uncompressed_size is from the header and ret is checked to have this size.
+// Sizes above max_size fail with ResourceExhausted before any allocation.
+absl::Status decompress_body(body_codec codec, const std::string_view in,
+                             std::uint32_t uncompressed_size,
+                             std::size_t max_size, std::string *ret);
+
+} // namespace fabricrpc
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "fabricrpc/capabilities.hpp"
+#include "fabricrpc/metadata.hpp"
+
+namespace fabricrpc {
+
+// state of one side of a connection shared by all its requests.
+struct connection_context {
+  metadata_tables metadata;
+  peer_capabilities peer;
+};
+
+} // namespace fabricrpc
@@ -2,8 +2,12 @@
 
 #include "absl/status/status.h"
 #include "boost/asio/io_context.hpp"
+#include "fabricrpc/basic_connection_manager.hpp"
 #include "fabricrpc/middleware.hpp"
 
+#include <memory>
+#include <mutex>
+
 // experimental server impl
 
 namespace fabricrpc {
@@ -16,15 +20,51 @@ public:
 
   void add_service(std::shared_ptr<service> svc);
 
+  // see middleware::set_compression_threshold
+  void set_compression_threshold(std::size_t threshold);
+
+  // see middleware::set_max_uncompressed_size
+  void set_max_uncompressed_size(std::size_t size);
+
+  // see middleware::set_client_stream_idle_timeout
+  void set_client_stream_idle_timeout(std::chrono::milliseconds timeout);
+
+  // see middleware::set_span_sink. Spans are recorded after the reply is
+  // handed to transport.
+  void set_span_sink(std::shared_ptr<span_sink> sink);
+
+  // adds the built in fabricrpc.Admin service, see admin_service.hpp.
+  // Connection queues are reported while serving.
+  void add_admin_service();
+
   // run the server and block the thread.
   absl::Status serve(int port);
 
   // stop the server
   void shutdown();
 
+  // pushes a notification to the client. Only valid while serving.
+  absl::Status push(std::wstring const &client_id, const std::string &topic,
+                    const google::protobuf::MessageLite &msg);
+
+  // pushes a notification to all clients. Only valid while serving.
+  // returns the number of clients it is sent to.
+  std::size_t broadcast(const std::string &topic,
+                        const google::protobuf::MessageLite &msg);
+
 private:
+  typedef basic_connection_manager<net::io_context::executor_type>
+      manager_type;
+
+  // returns the connections while serving, or null.
+  std::shared_ptr<manager_type> get_manager();
+
   fabricrpc::middleware md_;
   net::io_context ioc_;
+  // connections of the acceptor. set by serve, and read by push from other
+  // threads.
+  std::mutex mgr_mtx_;
+  std::shared_ptr<manager_type> mgr_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
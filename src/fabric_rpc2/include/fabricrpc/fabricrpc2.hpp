@@ -2,6 +2,7 @@
 
 // all fabricrpc2 headers
 
+#include "fabricrpc/admin_service.hpp"
 #include "fabricrpc/any_context.hpp"
 #include "fabricrpc/basic_acceptor.hpp"
 #include "fabricrpc/basic_connection_handler.hpp"
@@ -9,11 +10,24 @@
 #include "fabricrpc/basic_item_queue.hpp"
 #include "fabricrpc/basic_msg_handler.hpp"
 #include "fabricrpc/basic_server_connection.hpp"
+#include "fabricrpc/basic_stream_reader.hpp"
+#include "fabricrpc/basic_subscription.hpp"
+#include "fabricrpc/capabilities.hpp"
+#include "fabricrpc/codec.hpp"
+#include "fabricrpc/connection_context.hpp"
 #include "fabricrpc/endpoint.hpp"
+#include "fabricrpc/inproc_channel.hpp"
+#include "fabricrpc/metadata.hpp"
+#include "fabricrpc/method_descriptor.hpp"
+#include "fabricrpc/method_policy.hpp"
 #include "fabricrpc/request.hpp"
 
 #include "fabricrpc/basic_client_connection.hpp"
 #include "fabricrpc/basic_rpc_client.hpp"
 #include "fabricrpc/middleware.hpp"
+#include "fabricrpc/notification.hpp"
 #include "fabricrpc/parse.hpp"
+#include "fabricrpc/server_metrics.hpp"
+#include "fabricrpc/server_reader.hpp"
+#include "fabricrpc/server_writer.hpp"
 #include "fabricrpc/service.hpp"
@@ -0,0 +1,302 @@
+#pragma once
+// calls services in the same process without transport and serialization.
+
+#include "absl/status/status.h"
+#include "boost/asio/any_io_executor.hpp"
+#include "boost/asio/compose.hpp"
+#include "boost/asio/co_spawn.hpp"
+#include "boost/asio/coroutine.hpp"
+#include "boost/asio/detached.hpp"
+#include "boost/asio/this_coro.hpp"
+#include "boost/asio/use_awaitable.hpp"
+#include "fabricrpc/basic_event.hpp"
+#include "fabricrpc/metadata.hpp"
+#include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc/service.hpp"
+
+#include <google/protobuf/message_lite.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// metadata of an in process call, as the middleware passes it to handlers.
+struct inproc_call_metadata {
+  explicit inproc_call_metadata(const metadata *request_md)
+      : request(), reply(), ctx{&request, &reply} {
+    if (request_md != nullptr) {
+      for (const metadata::entry &e : request_md->entries()) {
+        request.add(e.first, e.second);
+      }
+    }
+  }
+
+  inproc_call_metadata(const inproc_call_metadata &) = delete;
+  inproc_call_metadata &operator=(const inproc_call_metadata &) = delete;
+
+  metadata_view request;
+  metadata reply;
+  call_context ctx;
+};
+
+// signature: void(ec, absl::Status)
+// runs the handler of url with the request and reply protos.
+// request_md and reply_md are optional. Without both the handler gets no
+// call_context.
+template <typename Executor> class async_inproc_op : boost::asio::coroutine {
+public:
+  typedef Executor executor_type;
+
+  async_inproc_op(executor_type ex, std::shared_ptr<service> svc,
+                  const std::string url, google::protobuf::MessageLite *request,
+                  google::protobuf::MessageLite *reply, bool copy_request,
+                  const metadata *request_md = nullptr,
+                  metadata *reply_md = nullptr)
+      : ex_(ex), svc_(std::move(svc)), url_(url), request_(request),
+        reply_(reply), copy_request_(copy_request), request_md_(request_md),
+        reply_md_(reply_md) {}
+
+  template <typename Self>
+  void operator()(Self &self, boost::system::error_code ec = {}) {
+    if (ec) {
+      self.complete(ec, {});
+      return;
+    }
+    // the handler may change the request. A copy keeps the caller's intact.
+    std::shared_ptr<google::protobuf::MessageLite> copy;
+    google::protobuf::MessageLite *request = request_;
+    if (copy_request_) {
+      copy.reset(request_->New());
+      copy->CheckTypeAndMergeFrom(*request_);
+      request = copy.get();
+    }
+    google::protobuf::MessageLite *reply = reply_;
+    // request entries are viewed, so the caller's request_md is not copied.
+    std::shared_ptr<inproc_call_metadata> md;
+    if (request_md_ != nullptr || reply_md_ != nullptr) {
+      md = std::make_shared<inproc_call_metadata>(request_md_);
+    }
+    // members are gone after self is moved.
+    executor_type ex = ex_;
+    metadata *reply_md = reply_md_;
+    auto handle = [svc = svc_, url = url_, copy, request, reply,
+                   md]() -> net::awaitable<absl::Status> {
+      if (md != nullptr) {
+        co_return co_await svc->execute_inproc_with_context(url, request,
+                                                            reply, &md->ctx);
+      }
+      co_return co_await svc->execute_inproc(url, request, reply);
+    };
+    net::co_spawn(ex, std::move(handle),
+                  [self = std::move(self), reply, md,
+                   reply_md](std::exception_ptr e, absl::Status st) mutable {
+                    if (e) {
+                      st = absl::InternalError("handler has exception");
+                    }
+                    if (!st.ok()) {
+                      // over transport the reply is not parsed on error.
+                      reply->Clear();
+                    } else if (reply_md != nullptr) {
+                      for (const metadata::entry &e : md->reply.entries()) {
+                        reply_md->add(e.first, e.second);
+                      }
+                    }
+                    self.complete({}, st);
+                  });
+  }
+
+private:
+  executor_type ex_;
+  std::shared_ptr<service> svc_;
+  const std::string url_; // takes ownership
+  google::protobuf::MessageLite *request_;
+  google::protobuf::MessageLite *reply_;
+  bool copy_request_;
+  const metadata *request_md_;
+  metadata *reply_md_;
+};
+
+// Calls unary methods of services added to it, i.e. services linked into the
+// client process. Requests and replies are passed to handlers by pointer, so
+// there is no header, serialization or transport. Statuses are the same as
+// over transport: unknown urls are UnimplementedError, handler errors are
+// returned as is, and the reply is cleared on error.
+// rpc_client can be created with a channel, so generated clients work with
+// it unchanged. Metadata of unary calls is passed to
+// execute_inproc_with_context in a call_context, and reply metadata is added
+// to the caller's on success as over transport. Server streaming calls fail
+// with UnimplementedError, and client streaming and subscriptions need a
+// connection.
+// Services need to be added before calls start.
+template <typename Executor = net::any_io_executor>
+class basic_inproc_channel {
+public:
+  typedef Executor executor_type;
+
+  explicit basic_inproc_channel(executor_type ex)
+      : ex_(ex), svc_vec_(), copy_requests_(false) {}
+
+  void add_service(std::shared_ptr<service> svc) { svc_vec_.push_back(svc); }
+
+  // handlers get a copy of each request instead of the caller's proto. Off by
+  // default, since handlers seldom change requests.
+  void set_copy_requests(bool copy) { copy_requests_ = copy; }
+
+  executor_type get_executor() { return ex_; }
+
+  // handler void(ec, absl::Status)
+  // request and reply pointers need to be valid until completion.
+  template <typename Token>
+  auto async_send(const std::string &url,
+                  google::protobuf::MessageLite *request,
+                  google::protobuf::MessageLite *reply, Token &&token) {
+    return this->async_send(url, request, reply, nullptr, nullptr,
+                            std::move(token));
+  }
+
+  // same as above, and passes request_md to the handler. Metadata the
+  // handler replies with is added to reply_md. Both are optional, and need to
+  // be valid until completion.
+  template <typename Token>
+  auto async_send(const std::string &url,
+                  google::protobuf::MessageLite *request,
+                  google::protobuf::MessageLite *reply,
+                  const metadata *request_md, metadata *reply_md,
+                  Token &&token) {
+    std::shared_ptr<service> svc;
+    absl::Status st = fabricrpc::find_service(svc_vec_, url, &svc);
+    if (!st.ok()) {
+      svc = std::make_shared<not_found_service>(std::move(st));
+    }
+    return boost::asio::async_compose<Token, void(boost::system::error_code,
+                                                  absl::Status)>(
+        async_inproc_op<executor_type>(ex_, std::move(svc), url, request,
+                                       reply, copy_requests_, request_md,
+                                       reply_md),
+        token, ex_);
+  }
+
+  // runs a one way method in the background. Errors are dropped as over
+  // transport. The request is always copied, since the caller does not wait.
+  absl::Status send_one_way(const std::string &url,
+                            const google::protobuf::MessageLite *request) {
+    std::shared_ptr<service> svc;
+    if (!fabricrpc::find_service(svc_vec_, url, &svc).ok()) {
+      return absl::OkStatus();
+    }
+    std::shared_ptr<google::protobuf::MessageLite> copy(request->New());
+    copy->CheckTypeAndMergeFrom(*request);
+    auto handle = [svc, url, copy]() -> net::awaitable<void> {
+      co_await svc->execute_inproc(url, copy.get(), nullptr);
+    };
+    net::co_spawn(ex_, std::move(handle), net::detached);
+    return absl::OkStatus();
+  }
+
+  // runs all items of a batch concurrently, as the server does over
+  // transport. Requests are always copied, since handlers take mutable
+  // requests.
+  // handler void(ec, absl::Status)
+  template <typename Token>
+  auto async_send_batch(
+      const std::string &url,
+      std::vector<const google::protobuf::MessageLite *> requests,
+      std::vector<google::protobuf::MessageLite *> replies,
+      std::vector<absl::Status> *statuses, Token &&token) {
+    assert(requests.size() == replies.size());
+    std::shared_ptr<service> svc;
+    absl::Status find_st = fabricrpc::find_service(svc_vec_, url, &svc);
+    auto run = [svc, url, find_st, requests = std::move(requests),
+                replies = std::move(replies),
+                statuses]() -> net::awaitable<absl::Status> {
+      if (requests.empty()) {
+        co_return absl::InvalidArgumentError("batch has no request");
+      }
+      if (!find_st.ok()) {
+        // fail the batch as a whole
+        co_return find_st;
+      }
+      std::size_t count = requests.size();
+      std::vector<std::unique_ptr<google::protobuf::MessageLite>> copies;
+      for (const google::protobuf::MessageLite *request : requests) {
+        copies.emplace_back(request->New());
+        copies.back()->CheckTypeAndMergeFrom(*request);
+      }
+      std::vector<absl::Status> item_sts(count);
+      auto executor = co_await net::this_coro::executor;
+      // event is used because items may complete on other threads.
+      std::atomic<std::size_t> pending(count);
+      basic_event<> done(executor);
+      for (std::size_t i = 0; i < count; i++) {
+        net::co_spawn(executor,
+                      svc->execute_inproc(url, copies[i].get(), replies[i]),
+                      [&, i](std::exception_ptr e, absl::Status st) {
+                        if (e) {
+                          st = absl::InternalError("handler has exception");
+                        }
+                        if (!st.ok()) {
+                          replies[i]->Clear();
+                        }
+                        item_sts[i] = std::move(st);
+                        if (pending.fetch_sub(1) == 1) {
+                          done.set();
+                        }
+                      });
+      }
+      co_await done.async_wait(net::use_awaitable);
+      *statuses = std::move(item_sts);
+      co_return absl::OkStatus();
+    };
+    return boost::asio::async_compose<Token, void(boost::system::error_code,
+                                                  absl::Status)>(
+        [ex = ex_, run = std::move(run),
+         started = false](auto &self, std::exception_ptr e = nullptr,
+                          absl::Status st = {}) mutable {
+          if (!started) {
+            started = true;
+            // captures are gone after self is moved.
+            executor_type run_ex = ex;
+            auto run_batch = std::move(run);
+            net::co_spawn(run_ex, std::move(run_batch), std::move(self));
+            return;
+          }
+          if (e) {
+            st = absl::InternalError("handler has exception");
+          }
+          self.complete({}, st);
+        },
+        token, ex_);
+  }
+
+private:
+  // completes unknown urls with the find_service error.
+  class not_found_service : public service {
+  public:
+    explicit not_found_service(absl::Status st) : st_(std::move(st)) {}
+    const std::string_view name() override { return ""; }
+    net::awaitable<absl::Status> execute(const std::string &,
+                                         const std::string_view,
+                                         std::string *) override {
+      co_return st_;
+    }
+    net::awaitable<absl::Status>
+    execute_inproc(const std::string &, google::protobuf::MessageLite *,
+                   google::protobuf::MessageLite *) override {
+      co_return st_;
+    }
+
+  private:
+    absl::Status st_;
+  };
+
+  executor_type ex_;
+  std::vector<std::shared_ptr<service>> svc_vec_;
+  bool copy_requests_;
+};
+
+} // namespace fabricrpc
@@ -0,0 +1,361 @@
+#pragma once
+// load generator used by code generated with loadgen=true. Drives one method
+// from many workers and reports throughput and latency.
+// Closed loop workers send the next call when the last one completes. Open
+// loop sends calls on an arrival timeline that does not wait for
+// completions, and measures latency from the intended send time, so a slow
+// server shows up as latency instead of as fewer sends.
+
+#include "fabricrpc/fabricrpc2.hpp"
+#include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include "absl/status/status.h"
+#include "boost/asio/co_spawn.hpp"
+#include "boost/asio/detached.hpp"
+#include "boost/asio/io_context.hpp"
+#include "boost/asio/steady_timer.hpp"
+#include "boost/asio/use_awaitable.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// when calls are sent.
+enum class loadgen_arrival {
+  // each worker sends after its last call completes.
+  closed,
+  // open loop, evenly spaced at rate.
+  fixed,
+  // open loop, exponential gaps with a mean of 1 / rate.
+  poisson
+};
+
+// parses closed, fixed or poisson.
+absl::Status parse_loadgen_arrival(std::string_view value,
+                                   loadgen_arrival *ret);
+
+struct loadgen_options {
+  std::wstring host = L"localhost";
+  std::uint32_t port = 12345;
+  // path of the method to run, i.e. /helloworld.FabricHello/SayHello.
+  // Empty runs all methods one after another.
+  std::string method;
+  // dir of sample requests. The request of a method is the serialized proto
+  // in <service full name>.<method>.bin. Methods without one send a default
+  // request.
+  std::string requests;
+  std::size_t connections = 1;
+  // requests in flight on each connection.
+  std::size_t concurrency = 1;
+  // total requests per second of all workers. 0 sends as fast as replies
+  // come back. Open loop needs a rate.
+  double rate = 0;
+  // open loop ignores concurrency: calls in flight are not capped.
+  loadgen_arrival arrival = loadgen_arrival::closed;
+  // open loop only. Runs ramp_steps runs of duration, at rate, rate +
+  // ramp_step, rate + 2 * ramp_step and so on, and stops after the first
+  // saturated one. 0 is a single run.
+  std::size_t ramp_steps = 0;
+  // 0 steps by rate.
+  double ramp_step = 0;
+  std::chrono::seconds duration = std::chrono::seconds(5);
+  // threads running the io context.
+  std::size_t threads = 1;
+  bool help = false;
+};
+
+// parses --key=value args into ret. Keys are the field names of
+// loadgen_options.
+absl::Status parse_loadgen_args(int argc, char **argv, loadgen_options *ret);
+
+std::string loadgen_usage();
+
+// whether options selects the method.
+bool loadgen_selected(const loadgen_options &options,
+                      const method_descriptor &method);
+
+// reads the sample request of method into ret. Returns not found if there
+// is no sample, and ret is left as is.
+absl::Status load_sample_request(const loadgen_options &options,
+                                 const method_descriptor &method,
+                                 google::protobuf::MessageLite *ret);
+
+// stats of one worker, or of all of them once merged.
+struct loadgen_stats {
+  std::size_t ok = 0;
+  std::size_t failed = 0;
+  // first failure, to tell why calls fail.
+  absl::Status first_error;
+  // fixed size, so a long run does not keep every sample. Percentiles are
+  // within 1.6% of the recorded latency.
+  latency_histogram latency;
+
+  void merge(const loadgen_stats &other);
+};
+
+struct loadgen_result {
+  // not ok if the load could not start, i.e. connection failed.
+  absl::Status status;
+  loadgen_stats stats;
+  // open loop includes the wait for calls in flight at the end.
+  std::chrono::duration<double> elapsed = {};
+  // requests per second sent by open loop. 0 for closed loop.
+  double offered_rate = 0;
+  // most open loop calls in flight at once.
+  std::size_t max_outstanding = 0;
+};
+
+struct loadgen_ramp_result {
+  absl::Status status;
+  std::vector<loadgen_result> steps;
+  // highest offered rate of a step that is not saturated. 0 if the first
+  // step is.
+  double knee_rate = 0;
+};
+
+// a step is saturated if it completes less than 95% of its offered rate, or
+// its p99 latency is over 10 times the p99 of the first step.
+bool loadgen_saturated(loadgen_result &first, loadgen_result &step);
+
+// prints throughput and latency percentiles of the method.
+void print_loadgen_result(std::string_view method,
+                          loadgen_result &result, std::ostream &os);
+
+// prints a line per step and the knee.
+void print_loadgen_ramp_result(std::string_view method,
+                               loadgen_ramp_result &result, std::ostream &os);
+
+namespace details {
+
+// sends calls until deadline. With a non zero interval sends are paced,
+// and a late send goes out right away.
+template <typename Executor, typename Call>
+net::awaitable<void>
+loadgen_worker(rpc_client<Executor> &client, Call &call,
+               std::chrono::steady_clock::time_point deadline,
+               std::chrono::nanoseconds interval, loadgen_stats *stats) {
+  net::steady_timer timer(co_await net::this_coro::executor);
+  std::chrono::steady_clock::time_point send_at =
+      std::chrono::steady_clock::now();
+  for (;;) {
+    if (interval.count() > 0) {
+      timer.expires_at(send_at);
+      co_await timer.async_wait(net::use_awaitable);
+      send_at += interval;
+    }
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    if (begin >= deadline) {
+      break;
+    }
+    absl::Status st;
+    try {
+      st = co_await call(client);
+    } catch (const std::exception &e) {
+      st = absl::UnknownError(std::string("call has exception ") + e.what());
+    }
+    if (!st.ok()) {
+      if (stats->failed == 0) {
+        stats->first_error = st;
+      }
+      stats->failed++;
+      continue;
+    }
+    stats->ok++;
+    stats->latency.record(std::chrono::steady_clock::now() - begin);
+  }
+}
+
+// open loop calls complete on any io context thread, so they share stats
+// under a lock.
+struct open_loop_state {
+  std::mutex mtx;
+  loadgen_stats stats;
+  std::size_t outstanding = 0;
+  std::size_t max_outstanding = 0;
+};
+
+template <typename Executor, typename Call>
+net::awaitable<void>
+open_loop_call(rpc_client<Executor> &client, Call &call,
+               std::chrono::steady_clock::time_point intended,
+               open_loop_state *state) {
+  absl::Status st;
+  try {
+    st = co_await call(client);
+  } catch (const std::exception &e) {
+    st = absl::UnknownError(std::string("call has exception ") + e.what());
+  }
+  std::chrono::steady_clock::time_point done =
+      std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lk(state->mtx);
+  state->outstanding--;
+  if (!st.ok()) {
+    if (state->stats.failed == 0) {
+      state->stats.first_error = st;
+    }
+    state->stats.failed++;
+    co_return;
+  }
+  state->stats.ok++;
+  state->stats.latency.record(done - intended);
+}
+
+// starts calls at the arrival times until deadline, round robin over
+// clients. A send that is behind schedule goes out right away, and keeps its
+// intended time.
+template <typename Executor, typename Call>
+net::awaitable<void> open_loop_scheduler(
+    std::vector<std::unique_ptr<rpc_client<Executor>>> &clients, Call &call,
+    loadgen_arrival arrival, double rate,
+    std::chrono::steady_clock::time_point deadline, open_loop_state *state) {
+  auto ex = co_await net::this_coro::executor;
+  net::steady_timer timer(ex);
+  std::mt19937_64 rng(std::random_device{}());
+  std::exponential_distribution<double> gap(rate);
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  // seconds since start. Summed as double so fixed gaps do not drift.
+  double offset = 0;
+  for (std::size_t i = 0;; i++) {
+    std::chrono::steady_clock::time_point send_at =
+        start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::duration<double>(offset));
+    if (send_at >= deadline) {
+      break;
+    }
+    timer.expires_at(send_at);
+    co_await timer.async_wait(net::use_awaitable);
+    {
+      std::lock_guard<std::mutex> lk(state->mtx);
+      state->outstanding++;
+      state->max_outstanding =
+          std::max(state->max_outstanding, state->outstanding);
+    }
+    net::co_spawn(
+        ex, open_loop_call(*clients[i % clients.size()], call, send_at, state),
+        net::detached);
+    offset += arrival == loadgen_arrival::poisson ? gap(rng) : 1 / rate;
+  }
+}
+
+} // namespace details
+
+// runs call from connections * concurrency workers for the duration, or
+// on the open loop arrival timeline of options.
+// call is net::awaitable<absl::Status>(rpc_client<executor_type> &), and
+// needs to be safe to run concurrently.
+template <typename Call>
+loadgen_result run_loadgen(const loadgen_options &options, Call call) {
+  typedef net::io_context::executor_type executor_type;
+  loadgen_result result;
+  net::io_context ioc;
+  // connections keep a reference to the executor.
+  executor_type ex = ioc.get_executor();
+  endpoint ep(options.host, options.port);
+
+  std::vector<std::unique_ptr<basic_client_connection<executor_type>>> conns;
+  std::vector<std::unique_ptr<rpc_client<executor_type>>> clients;
+  for (std::size_t i = 0; i < options.connections; i++) {
+    conns.push_back(
+        std::make_unique<basic_client_connection<executor_type>>(ex));
+    boost::system::error_code ec = conns.back()->open(ep);
+    if (ec.failed()) {
+      result.status = absl::UnavailableError("open: " + ec.message());
+      return result;
+    }
+    clients.push_back(std::make_unique<rpc_client<executor_type>>(*conns[i]));
+  }
+
+  bool open_loop = options.arrival != loadgen_arrival::closed;
+  if (open_loop && options.rate <= 0) {
+    result.status = absl::InvalidArgumentError("open loop needs a rate");
+    return result;
+  }
+  std::size_t workers =
+      open_loop ? 0 : options.connections * options.concurrency;
+  std::vector<loadgen_stats> stats(workers);
+  details::open_loop_state open_state;
+  std::chrono::nanoseconds interval(0);
+  if (options.rate > 0 && !open_loop) {
+    interval = std::chrono::nanoseconds(
+        static_cast<std::int64_t>(1e9 * workers / options.rate));
+  }
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point deadline = start + options.duration;
+  if (open_loop) {
+    net::co_spawn(ioc,
+                  details::open_loop_scheduler(clients, call, options.arrival,
+                                               options.rate, deadline,
+                                               &open_state),
+                  net::detached);
+  }
+  for (std::size_t i = 0; i < workers; i++) {
+    net::co_spawn(ioc,
+                  details::loadgen_worker(*clients[i % clients.size()], call,
+                                          deadline, interval, &stats[i]),
+                  net::detached);
+  }
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < options.threads; i++) {
+    threads.emplace_back([&ioc]() { ioc.run(); });
+  }
+  ioc.run();
+  for (std::thread &th : threads) {
+    th.join();
+  }
+  result.elapsed = std::chrono::steady_clock::now() - start;
+  for (const loadgen_stats &s : stats) {
+    result.stats.merge(s);
+  }
+  if (open_loop) {
+    result.stats.merge(open_state.stats);
+    result.offered_rate = options.rate;
+    result.max_outstanding = open_state.max_outstanding;
+  }
+  return result;
+}
+
+// runs open loop steps of increasing rate to find the knee, the highest rate
+// the server keeps up with. See loadgen_options::ramp_steps.
+template <typename Call>
+loadgen_ramp_result run_loadgen_ramp(const loadgen_options &options,
+                                     Call call) {
+  loadgen_ramp_result ramp;
+  if (options.arrival == loadgen_arrival::closed) {
+    ramp.status = absl::InvalidArgumentError("ramp needs open loop arrival");
+    return ramp;
+  }
+  double step = options.ramp_step > 0 ? options.ramp_step : options.rate;
+  for (std::size_t i = 0; i < std::max<std::size_t>(options.ramp_steps, 1);
+       i++) {
+    loadgen_options step_options = options;
+    step_options.rate = options.rate + i * step;
+    ramp.steps.push_back(run_loadgen(step_options, call));
+    loadgen_result &last = ramp.steps.back();
+    if (!last.status.ok()) {
+      ramp.status = last.status;
+      return ramp;
+    }
+    if (loadgen_saturated(ramp.steps.front(), last)) {
+      break;
+    }
+    ramp.knee_rate = last.offered_rate;
+  }
+  return ramp;
+}
+
+} // namespace fabricrpc
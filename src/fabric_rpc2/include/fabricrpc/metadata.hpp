@@ -0,0 +1,148 @@
+#pragma once
+// request and reply metadata, i.e. trace id, tenant or auth token.
+// Metadata is encoded into headers with a static table of well known keys
+// and a table per connection and direction, so that repeated keys and values
+// cost a byte or two. See ProtocolSpec.md for the format.
+
+#include "absl/container/inlined_vector.h"
+#include "absl/status/status.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace fabricrpc {
+
+// metadata owned by the user, for sending and for received replies.
+class metadata {
+public:
+  typedef std::pair<std::string, std::string> entry;
+
+  void add(std::string key, std::string value) {
+    entries_.emplace_back(std::move(key), std::move(value));
+  }
+
+  // returns the value of the first entry of key.
+  std::optional<std::string_view> get(std::string_view key) const;
+
+  const absl::InlinedVector<entry, 4> &entries() const { return entries_; }
+
+  bool empty() const { return entries_.empty(); }
+
+  void clear() { entries_.clear(); }
+
+private:
+  absl::InlinedVector<entry, 4> entries_;
+};
+
+// decoded metadata seen by handlers. Views point into the request header and
+// the connection table, and are valid during the call.
+class metadata_view {
+public:
+  typedef std::pair<std::string_view, std::string_view> entry;
+
+  void add(std::string_view key, std::string_view value) {
+    entries_.emplace_back(key, value);
+  }
+
+  // returns the value of the first entry of key. Does not allocate.
+  std::optional<std::string_view> get(std::string_view key) const;
+
+  const absl::InlinedVector<entry, 8> &entries() const { return entries_; }
+
+  bool empty() const { return entries_.empty(); }
+
+  // copies entries into ret.
+  void copy_to(metadata *ret) const;
+
+private:
+  absl::InlinedVector<entry, 8> entries_;
+};
+
+// sizes of the dynamic table. Each entry costs key size + value size +
+// entry_overhead. Entries are never evicted, since requests in flight may
+// refer to them, and pairs are sent literally once the table is full.
+constexpr std::size_t metadata_table_max_size = 4096;
+constexpr std::size_t metadata_table_max_entries = 128;
+constexpr std::size_t metadata_entry_overhead = 32;
+
+// returns index of key in the static table, or 0 if not found.
+std::uint32_t metadata_static_index(std::string_view key);
+
+// number of keys in the static table.
+std::uint32_t metadata_static_size();
+
+// encodes metadata sent in one direction of a connection.
+// thread safe.
+class metadata_encoder {
+public:
+  metadata_encoder();
+
+  void encode(const metadata &md, std::string *ret);
+
+  // peer decoder has all table entries before count, and the ones in the
+  // bitmap of slots after count, see metadata_decoder::ack.
+  void on_ack(std::uint32_t count, std::string_view slots = {});
+
+private:
+  // returns table index of key usable by peer, or 0 if not found.
+  std::uint32_t name_index(const std::string &key);
+
+  std::mutex mtx_;
+  // slots of inserted pairs.
+  std::map<std::pair<std::string, std::string>, std::uint32_t> slots_;
+  // first slot of each key, to index names.
+  std::map<std::string, std::uint32_t, std::less<>> key_slots_;
+  // pairs seen once. A pair is inserted on the second time, so that unique
+  // values like trace ids do not fill the table.
+  std::set<std::pair<std::string, std::string>> seen_;
+  std::uint32_t next_slot_;
+  std::size_t table_size_;
+  // slots the peer has. Inserts of other slots are sent again on use, in
+  // case the request carrying them was lost.
+  std::bitset<metadata_table_max_entries> acked_;
+  std::uint32_t acked_count_;
+};
+
+// decodes metadata received in one direction of a connection.
+// thread safe. Requests may arrive out of order, so table entries are
+// addressed by slot instead of insertion order.
+class metadata_decoder {
+public:
+  metadata_decoder();
+
+  // views in ret point into in and into this decoder.
+  absl::Status decode(std::string_view in, metadata_view *ret);
+
+  // number of leading slots received. Sent back to the peer encoder.
+  // slots is set to the bitmap of slots received after them, with bit
+  // i % 8 of byte i / 8 for slot ack + 1 + i, and is empty if there are
+  // none, so that a lost insert does not hold back later slots.
+  std::uint32_t ack(std::string *slots = nullptr);
+
+private:
+  absl::Status lookup(std::uint32_t index, std::string_view *key,
+                      std::string_view *value);
+
+  std::mutex mtx_;
+  // deque keeps addresses of entries on growth.
+  std::deque<std::optional<std::pair<std::string, std::string>>> slots_;
+  std::size_t table_size_;
+  std::uint32_t acked_;
+};
+
+// metadata tables of one side of a connection.
+struct metadata_tables {
+  metadata_encoder encoder;
+  metadata_decoder decoder;
+};
+
+} // namespace fabricrpc
@@ -0,0 +1,48 @@
+#pragma once
+// compile time description of generated methods, and the hash generated
+// services dispatch on.
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace fabricrpc {
+
+enum class method_kind {
+  unary,
+  server_streaming,
+  client_streaming,
+  // not supported, only described.
+  bidi_streaming
+};
+
+struct method_descriptor {
+  // full name of the service, i.e. helloworld.FabricHello
+  std::string_view service;
+  std::string_view name;
+  // url of the method, i.e. /helloworld.FabricHello/SayHello
+  std::string_view path;
+  method_kind kind;
+  // unary method whose reply is dropped.
+  bool one_way;
+  // unary method whose handler does not suspend.
+  bool sync_handler;
+  // position of the method in the service, i.e. to index per method arrays.
+  std::size_t index;
+};
+
+// 64 bit FNV-1a of the method path.
+// Generated services switch on method_hash(url) % dispatch_size, where the
+// generator picks dispatch_size so that methods of the service have
+// different case labels. The generator has a copy of this function, and
+// both need to change together.
+constexpr std::uint64_t method_hash(std::string_view path) {
+  std::uint64_t h = 14695981039346656037ull;
+  for (char c : path) {
+    h ^= static_cast<std::uint8_t>(c);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,102 @@
+#pragma once
+// compile time hooks of generated handlers. A generated service is
+// Basic<Service><Policy>, and its handler helpers make one Policy object per
+// call:
+//   Policy call(method);     // request start
+//   call.parsed(st);         // request parsed
+//   call.handled(st);        // handler returned
+//   call.serialized(st);     // reply serialized
+// Hooks after a failed one are not called, and the object is destroyed when
+// the call ends. Streaming calls have no parsed (client streaming) or
+// serialized (server streaming) hook.
+
+#include "fabricrpc/method_descriptor.hpp"
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include "absl/status/status.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace fabricrpc {
+
+// default policy. Compiles to nothing.
+struct null_method_policy {
+  constexpr explicit null_method_policy(const method_descriptor &) {}
+  constexpr void parsed(const absl::Status &) {}
+  constexpr void handled(const absl::Status &) {}
+  constexpr void serialized(const absl::Status &) {}
+};
+
+// metrics of one method.
+struct method_stats {
+  const method_descriptor *method = nullptr;
+  std::uint64_t calls = 0;
+  std::uint64_t parse_failed = 0;
+  std::uint64_t handler_failed = 0;
+  std::uint64_t serialize_failed = 0;
+  // request start to the end of the call.
+  latency_histogram latency;
+  // handler only.
+  latency_histogram handler_latency;
+
+  void merge(const method_stats &other);
+};
+
+namespace details {
+
+struct method_call_sample {
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point parsed;
+  std::chrono::steady_clock::time_point handled;
+  bool parse_failed = false;
+  bool handler_failed = false;
+  bool serialize_failed = false;
+};
+
+// adds sample into the slot of the calling thread.
+void record_method_call(const method_descriptor &method,
+                        const method_call_sample &sample);
+
+} // namespace details
+
+// records counters and latency of each method into a slot of the thread
+// that ends the call. Slots are merged by collect_method_stats.
+class metrics_method_policy {
+public:
+  explicit metrics_method_policy(const method_descriptor &method)
+      : method_(method), sample_() {
+    sample_.start = std::chrono::steady_clock::now();
+    sample_.parsed = sample_.start;
+  }
+
+  metrics_method_policy(const metrics_method_policy &) = delete;
+  metrics_method_policy &operator=(const metrics_method_policy &) = delete;
+
+  ~metrics_method_policy() { details::record_method_call(method_, sample_); }
+
+  void parsed(const absl::Status &st) {
+    sample_.parsed = std::chrono::steady_clock::now();
+    sample_.parse_failed = !st.ok();
+  }
+
+  void handled(const absl::Status &st) {
+    sample_.handled = std::chrono::steady_clock::now();
+    sample_.handler_failed = !st.ok();
+  }
+
+  void serialized(const absl::Status &st) {
+    sample_.serialize_failed = !st.ok();
+  }
+
+private:
+  const method_descriptor &method_;
+  details::method_call_sample sample_;
+};
+
+// stats of all methods called with metrics_method_policy, merged over all
+// threads. Sorted by method path.
+std::vector<method_stats> collect_method_stats();
+
+} // namespace fabricrpc
@@ -1,71 +1,719 @@
 #pragma once
 
+#include "boost/asio/co_spawn.hpp"
+#include "boost/asio/detached.hpp"
+#include "boost/asio/post.hpp"
+#include "boost/asio/redirect_error.hpp"
+#include "boost/asio/steady_timer.hpp"
+#include "boost/asio/strand.hpp"
+#include "boost/asio/use_awaitable.hpp"
+#include "fabricrpc.pb.h"
+#include <fabricrpc/basic_event.hpp>
+#include <fabricrpc/codec.hpp>
+#include <fabricrpc/connection_context.hpp>
+#include <fabricrpc/metadata.hpp>
 #include <fabricrpc/parse.hpp>
+#include <fabricrpc/server_metrics.hpp>
 #include <fabricrpc/service.hpp>
+#include <fabricrpc_tool/alloc_stats.hpp>
+#include <fabricrpc_tool/request_span.hpp>
 #include <fabricrpc_tool/tool_transport_msg.hpp>
 #include <fabrictransport_.h>
 #include <winrt/base.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace fabricrpc {
 
 class middleware {
 public:
-  middleware() : svc_vec_() {}
+  middleware()
+      : svc_vec_(), compression_threshold_(compression_options().threshold),
+        max_uncompressed_size_(default_max_uncompressed_size), span_sink_(), client_stream_idle_timeout_(std::chrono::seconds(60)),
+        mtx_(), server_streams_(), client_streams_() {}
 
   void add_service(std::shared_ptr<service> svc) { svc_vec_.push_back(svc); }
 
-  net::awaitable<void> execute(IFabricTransportMessage *req,
-                               IFabricTransportMessage **resp) {
+  // unary replies at least this size are compressed with the codec the
+  // client accepts.
+  void set_compression_threshold(std::size_t threshold) {
+    compression_threshold_ = threshold;
+  }
+
+  // compressed requests claiming a larger body are rejected.
+  void set_max_uncompressed_size(std::size_t size) {
+    max_uncompressed_size_ = size;
+  }
+
+  // a client stream fails if the client sends no chunk for this long, i.e.
+  // it stopped without the end chunk, or if the handler does not take a
+  // chunk for this long. The handler computing the reply after the end chunk
+  // is not bounded, as for unary calls. Set before serving.
+  void set_client_stream_idle_timeout(std::chrono::milliseconds timeout) {
+    client_stream_idle_timeout_ = timeout;
+  }
+
+  // sink of the spans of unary requests. Spans are not marked without one.
+  // Set before serving.
+  void set_span_sink(std::shared_ptr<span_sink> sink) {
+    span_sink_ = std::move(sink);
+  }
+
+  // the span to pass to execute, nullptr if no sink is set.
+  request_span *span_of(request_span &span) const {
+    return span_sink_ ? &span : nullptr;
+  }
+
+  // hands a completed span to the sink.
+  void record_span(const request_span &span) {
+    if (span_sink_) {
+      span_sink_->record(span);
+    }
+  }
+
+  // conn is the connection the request came from. It is needed to send
+  // chunks of server streaming calls.
+  // conn_ctx is the state of the connection, i.e. metadata tables. Without
+  // it only static table and literal metadata is understood.
+  // span, if not nullptr, is marked with the stages of a unary request.
+  net::awaitable<void>
+  execute(IFabricTransportMessage *req, IFabricTransportMessage **resp,
+          IFabricTransportClientConnection *conn = nullptr,
+          connection_context *conn_ctx = nullptr,
+          request_span *span = nullptr) {
+    typedef request_span::clock clock;
+    // latency of the url starts at arrival if the transport marked it.
+    const clock::time_point start =
+        span != nullptr && span->has(span_point::arrival)
+            ? span->at(span_point::arrival)
+            : clock::now();
+    // scopes of allocation accounting end before each co_await.
+    fabricrpc::request_header header;
+    absl::Status st;
+    {
+      alloc_scope decode_scope(alloc_phase::server_decode);
+      st = fabricrpc::parse_request_header(fabricrpc::get_header(req), &header);
+    }
+    if (st.ok() && header.batch_item_sizes_size() > 0) {
+      add_server_metric(server_metric::accepted);
+      co_await execute_batch(header, req, resp);
+      co_return;
+    }
+    if (st.ok() && header.client_stream()) {
+      add_server_metric(server_metric::accepted);
+      co_await execute_client_stream(header, req, conn, resp);
+      co_return;
+    }
+    if (st.ok() && header.stream_id() != 0) {
+      add_server_metric(server_metric::accepted);
+      st = co_await start_stream(header, req, conn);
+      std::string resp_header;
+      [[maybe_unused]] absl::Status must_ok =
+          fabricrpc::serialize_reply_header(st, &resp_header);
+      assert(must_ok.ok());
+      winrt::com_ptr<IFabricTransportMessage> msg =
+          winrt::make<fabricrpc::tool_transport_msg>("",
+                                                     std::move(resp_header));
+      msg.copy_to(resp);
+      co_return;
+    }
+
+    mark_span(span, span_point::header_parsed);
+    std::string payload;
+    metadata_tables *tables =
+        conn_ctx != nullptr ? &conn_ctx->metadata : nullptr;
+    metadata_decoder local_decoder;
+    metadata_decoder *decoder =
+        tables != nullptr ? &tables->decoder : &local_decoder;
+    metadata_view request_md;
+    std::shared_ptr<service> svc;
+    {
+      alloc_scope decode_scope(alloc_phase::server_decode);
+      // route before reading the body, so unknown urls are not copied.
+      // Metadata is still decoded to keep the connection tables in sync.
+      absl::Status route_st = st;
+      if (st.ok()) {
+        route_st = find_service(header.url(), &svc);
+      }
+      mark_span(span, span_point::routed);
+      if (route_st.ok()) {
+        payload = fabricrpc::get_body(req);
+        if (header.codec() != body_codec::codec_none) {
+          std::string plain;
+          st = fabricrpc::decompress_body(header.codec(), payload,
+                                          header.uncompressed_size(),
+                                          max_uncompressed_size_, &plain);
+          payload = std::move(plain);
+        }
+      }
+      if (st.ok() && !header.metadata().empty()) {
+        st = decoder->decode(header.metadata(), &request_md);
+      }
+      if (tables != nullptr) {
+        tables->encoder.on_ack(header.metadata_ack(),
+                               header.metadata_ack_slots());
+      }
+      if (st.ok()) {
+        st = route_st;
+      }
+    }
+    mark_span(span, span_point::body_parsed);
+    metadata reply_md;
+    call_context ctx{&request_md, &reply_md};
     std::string resp_str;
-    absl::Status st = co_await execute_inner(req, &resp_str);
+    // only sync handlers are counted, async ones run across co_await.
+    bool done = !st.ok();
+    const bool handled = !done;
+    add_server_metric(handled ? server_metric::accepted
+                              : server_metric::rejected);
+    clock::time_point handler_start;
+    if (!done) {
+      handler_start = clock::now();
+      mark_span(span, span_point::handler_start, handler_start);
+      alloc_scope handler_scope(alloc_phase::server_handler);
+      done = svc->execute_sync(header.url(), payload, &resp_str, &st);
+    }
+    if (!done) {
+      st = co_await execute_inner(svc.get(), header.url(), payload, &resp_str,
+                                  &ctx);
+    }
+    clock::time_point handler_end;
+    if (handled) {
+      handler_end = clock::now();
+      mark_span(span, span_point::handler_end, handler_end);
+    }
+    alloc_scope encode_scope(alloc_phase::server_encode);
+    fabricrpc::reply_header reply_header;
+    if (st.ok()) {
+      compress_reply(header.accept_codec(), &resp_str, &reply_header);
+    }
+    if (tables != nullptr) {
+      if (!reply_md.empty()) {
+        tables->encoder.encode(reply_md, reply_header.mutable_metadata());
+      }
+      std::string ack_slots;
+      reply_header.set_metadata_ack(tables->decoder.ack(&ack_slots));
+      if (!ack_slots.empty()) {
+        reply_header.set_metadata_ack_slots(std::move(ack_slots));
+      }
+    }
+    if (header.protocol_version() != 0) {
+      // handshake of a new client
+      if (conn_ctx != nullptr) {
+        conn_ctx->peer.set(header.protocol_version(), header.capabilities());
+      }
+      reply_header.set_protocol_version(current_protocol_version);
+      reply_header.set_capabilities(local_capabilities);
+    }
     // return st to clients
     std::string resp_header;
     [[maybe_unused]] absl::Status must_ok =
-        fabricrpc::serialize_reply_header(st, &resp_header);
+        fabricrpc::serialize_reply_header(st, &reply_header, &resp_header);
     assert(must_ok.ok());
     winrt::com_ptr<IFabricTransportMessage> msg =
         winrt::make<fabricrpc::tool_transport_msg>(std::move(resp_str),
                                                    std::move(resp_header));
     msg.copy_to(resp);
+    const clock::time_point end = clock::now();
+    mark_span(span, span_point::reply_serialized, end);
+    // unknown methods of a known service are not recorded, they are not
+    // urls of the server.
+    if (handled && st.code() != absl::StatusCode::kUnimplemented) {
+      // the first call of a url adds its record, which is not encoding.
+      alloc_scope stats_scope(alloc_phase::none);
+      record_url_call(header.url(), !st.ok(), end - start,
+                      handler_end - handler_start);
+    }
+  }
+
+  // runs a one way request. There is no reply and errors are dropped.
+  // Batch and streaming requests are ignored.
+  // conn is the connection the request came from. Acks of server streams
+  // need it.
+  net::awaitable<void>
+  execute_one_way(IFabricTransportMessage *req,
+                  IFabricTransportClientConnection *conn = nullptr) {
+    fabricrpc::request_header header;
+    absl::Status st =
+        fabricrpc::parse_request_header(fabricrpc::get_header(req), &header);
+    if (st.ok() && header.stream_id() != 0 && header.stream_acked() != 0 &&
+        conn != nullptr) {
+      ack_stream(conn->get_ClientId(), header.stream_id(),
+                 header.stream_acked());
+      co_return;
+    }
+    if (!st.ok() || header.batch_item_sizes_size() > 0 ||
+        header.client_stream() || header.stream_id() != 0) {
+      co_return;
+    }
+    std::string payload = fabricrpc::get_body(req);
+    if (header.codec() != body_codec::codec_none) {
+      std::string plain;
+      st = fabricrpc::decompress_body(header.codec(), payload,
+                                      header.uncompressed_size(),
+                                      max_uncompressed_size_, &plain);
+      if (!st.ok()) {
+        co_return;
+      }
+      payload = std::move(plain);
+    }
+    std::string resp_str;
+    std::shared_ptr<service> svc;
+    st = find_service(header.url(), &svc);
+    if (!st.ok() || svc->execute_sync(header.url(), payload, &resp_str, &st)) {
+      co_return;
+    }
+    co_await execute_inner(svc.get(), header.url(), payload, &resp_str,
+                           nullptr);
+  }
+
+  // ends the streams of the connection of client_id, which is gone.
+  // Pending writes of its server streams fail, and handlers of its client
+  // streams read an error.
+  void disconnect(const std::wstring &client_id) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto it = server_streams_.lower_bound({client_id, 0});
+         it != server_streams_.end() && it->first.first == client_id; ++it) {
+      it->second->cancel();
+    }
+    for (auto it = client_streams_.lower_bound({client_id, 0});
+         it != client_streams_.end() && it->first.first == client_id;) {
+      stream_key key = it->first;
+      std::shared_ptr<client_stream_entry> entry = it->second;
+      // erased by fail_client_stream.
+      ++it;
+      fail_client_stream(key, entry, absl::UnavailableError("client is gone"));
+    }
   }
 
 private:
-  net::awaitable<absl::Status> execute_inner(IFabricTransportMessage *req,
-                                             std::string *resp_str) {
+  static void mark_span(request_span *span, span_point point) {
+    if (span != nullptr) {
+      span->mark(point);
+    }
+  }
+
+  static void mark_span(request_span *span, span_point point,
+                        request_span::clock::time_point time) {
+    if (span != nullptr) {
+      span->mark(point, time);
+    }
+  }
+
+  // find the service that owns the url
+  absl::Status find_service(const std::string &url,
+                            std::shared_ptr<service> *svc_ret) {
+    return fabricrpc::find_service(svc_vec_, url, svc_ret);
+  }
+
+  // runs the asynchronous handler of url in svc.
+  // ctx is nullptr for calls without metadata.
+  net::awaitable<absl::Status> execute_inner(service *svc,
+                                             const std::string &url,
+                                             const std::string &payload,
+                                             std::string *resp_str,
+                                             call_context *ctx) {
     absl::Status st;
-    // parse header
-    std::string url;
-    st = fabricrpc::parse_request_header(fabricrpc::get_header(req), url);
-    if (!st.ok()) {
-      co_return st;
+    if (ctx != nullptr) {
+      st = co_await svc->execute_with_context(url, payload, resp_str, ctx);
+    } else {
+      st = co_await svc->execute(url, payload, resp_str);
     }
-    std::string_view url_view = url;
-    if (url.size() == 0) {
-      co_return absl::InvalidArgumentError("url is empty");
+    co_return st;
+  }
+
+  // compresses the reply body in place if client accepts a codec and the body
+  // is large enough. The body is sent raw if compression fails.
+  void compress_reply(body_codec accept_codec, std::string *resp_str,
+                      fabricrpc::reply_header *reply_header) {
+    compression_options options;
+    options.codec = accept_codec;
+    options.threshold = compression_threshold_;
+    if (!fabricrpc::should_compress(options, *resp_str)) {
+      return;
     }
-    if (!url_view.starts_with("/")) {
-      co_return absl::InvalidArgumentError("invalid url");
+    std::string compressed;
+    if (!fabricrpc::compress_body(accept_codec, *resp_str, &compressed).ok()) {
+      return;
     }
+    reply_header->set_codec(accept_codec);
+    reply_header->set_uncompressed_size(
+        static_cast<std::uint32_t>(resp_str->size()));
+    *resp_str = std::move(compressed);
+  }
 
+  // runs all items of a batch request concurrently, and replies with one
+  // body per item.
+  net::awaitable<void> execute_batch(const fabricrpc::request_header &header,
+                                     IFabricTransportMessage *req,
+                                     IFabricTransportMessage **resp) {
+    const std::string &url = header.url();
+    std::size_t count = header.batch_item_sizes_size();
+    std::shared_ptr<service> svc;
+    absl::Status st = find_service(url, &svc);
+
+    // body blobs of all items are concatenated.
     std::string payload = fabricrpc::get_body(req);
-    // TODO: if use returns not found in service we may have routing problem.
-    // May need to parse an route by url path
-    st = absl::UnimplementedError("url not found");
-    for (auto svc = svc_vec_.begin(); svc != svc_vec_.end(); svc++) {
-      if (!url_view.substr(1).starts_with((*svc)->name())) {
+    std::vector<std::string_view> items;
+    if (st.ok()) {
+      std::size_t offset = 0;
+      for (std::uint32_t size : header.batch_item_sizes()) {
+        if (payload.size() - offset < size) {
+          st = absl::InvalidArgumentError("batch item sizes do not match body");
+          break;
+        }
+        items.push_back(std::string_view(payload).substr(offset, size));
+        offset += size;
+      }
+      if (st.ok() && offset != payload.size()) {
+        st = absl::InvalidArgumentError("batch item sizes do not match body");
+      }
+    }
+    if (!st.ok()) {
+      // fail the batch as a whole
+      std::string resp_header;
+      [[maybe_unused]] absl::Status must_ok =
+          fabricrpc::serialize_reply_header(st, &resp_header);
+      assert(must_ok.ok());
+      winrt::com_ptr<IFabricTransportMessage> msg =
+          winrt::make<fabricrpc::tool_transport_msg>("",
+                                                     std::move(resp_header));
+      msg.copy_to(resp);
+      co_return;
+    }
+
+    std::vector<std::string> bodies(count);
+    std::vector<absl::Status> sts(count);
+    auto executor = co_await net::this_coro::executor;
+    // event is used because items may complete on other threads.
+    std::atomic<std::size_t> pending(count);
+    basic_event<> done(executor);
+    auto complete = [&](std::size_t i, absl::Status item_st) {
+      if (!item_st.ok()) {
+        bodies[i].clear();
+      }
+      sts[i] = std::move(item_st);
+      if (pending.fetch_sub(1) == 1) {
+        done.set();
+      }
+    };
+    for (std::size_t i = 0; i < count; i++) {
+      absl::Status item_st;
+      if (svc->execute_sync(url, items[i], &bodies[i], &item_st)) {
+        complete(i, std::move(item_st));
         continue;
       }
-      // found the svc
-      st = co_await (*svc)->execute(url, payload, resp_str);
+      net::co_spawn(executor, svc->execute(url, items[i], &bodies[i]),
+                    [&, i](std::exception_ptr e, absl::Status item_st) {
+                      if (e) {
+                        item_st = absl::InternalError("handler has exception");
+                      }
+                      complete(i, std::move(item_st));
+                    });
+    }
+    co_await done.async_wait(net::use_awaitable);
+
+    std::string resp_header;
+    [[maybe_unused]] absl::Status must_ok =
+        fabricrpc::serialize_batch_reply_header(sts, bodies, &resp_header);
+    assert(must_ok.ok());
+    winrt::com_ptr<IFabricTransportMessage> msg =
+        winrt::make<fabricrpc::tool_transport_msg>(std::move(bodies),
+                                                   std::move(resp_header));
+    msg.copy_to(resp);
+  }
+
+  // streams are identified by connection and stream id.
+  typedef std::pair<std::wstring, std::uint64_t> stream_key;
+
+  // starts the handler of a server streaming call in the background.
+  // The request is replied once the stream is accepted, and chunks and the
+  // final status are sent on the callback channel by the writer.
+  net::awaitable<absl::Status>
+  start_stream(const fabricrpc::request_header &header,
+               IFabricTransportMessage *req,
+               IFabricTransportClientConnection *conn) {
+    if (conn == nullptr) {
+      co_return absl::UnimplementedError("streaming needs a connection");
+    }
+    std::shared_ptr<service> svc;
+    absl::Status st = find_service(header.url(), &svc);
+    if (!st.ok()) {
       co_return st;
     }
-    co_return st;
+    auto executor = co_await net::this_coro::executor;
+    stream_key key(conn->get_ClientId(), header.stream_id());
+    winrt::com_ptr<IFabricTransportClientConnection> conn_copy;
+    conn_copy.copy_from(conn);
+    auto writer = std::make_shared<server_writer>(
+        std::move(conn_copy), header.stream_id(), executor,
+        header.stream_window());
+    {
+      // registered for the acks of the client.
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto [it, inserted] = server_streams_.insert({key, writer});
+      if (!inserted) {
+        co_return absl::AlreadyExistsError("stream already exists");
+      }
+    }
+
+    auto handle_stream = [svc, url = header.url(),
+                          payload = fabricrpc::get_body(req),
+                          writer]() -> net::awaitable<absl::Status> {
+      co_return co_await svc->execute_stream(url, payload, writer.get());
+    };
+    net::co_spawn(executor, std::move(handle_stream),
+                  [this, key, writer](std::exception_ptr e, absl::Status st) {
+                    if (e) {
+                      st = absl::InternalError("handler has exception");
+                    }
+                    {
+                      std::lock_guard<std::mutex> lk(mtx_);
+                      server_streams_.erase(key);
+                    }
+                    // nothing to do if client is gone.
+                    writer->finish(st).IgnoreError();
+                  });
+    co_return absl::OkStatus();
+  }
+
+  // passes the ack of the client to the writer of the stream. Acks of
+  // streams that have ended are dropped.
+  void ack_stream(const std::wstring &client_id, std::uint64_t stream_id,
+                  std::uint64_t acked) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = server_streams_.find({client_id, stream_id});
+    if (it != server_streams_.end()) {
+      it->second->on_ack(acked);
+    }
+  }
+
+  // state of a client streaming call in progress.
+  struct client_stream_entry {
+    std::shared_ptr<server_reader> reader;
+    std::uint64_t next_sequence;
+    // set when handler returns.
+    std::shared_ptr<basic_event<>> done;
+    bool handler_done;
+    absl::Status status;
+    std::string resp;
+    // set while a chunk waits for the handler to take it, and otherwise the
+    // server waits for the next chunk. since is when it last changed.
+    bool in_server;
+    std::chrono::steady_clock::time_point since;
+    // set once the end chunk has arrived.
+    bool end_seen;
+    // set once the stream is removed from client_streams_, with the error
+    // if it failed.
+    bool ended;
+    absl::Status end_status;
+    // only used on the strand of the stream watcher.
+    std::shared_ptr<net::steady_timer> idle_timer;
+  };
+
+  // handles one chunk of a client streaming call.
+  // The handler is started on the first chunk. Each chunk is replied after
+  // the handler takes it, so that a client sending chunks in sequence only
+  // has one chunk in memory of the server. The last chunk is replied with
+  // the handler result.
+  net::awaitable<void>
+  execute_client_stream(const fabricrpc::request_header &header,
+                        IFabricTransportMessage *req,
+                        IFabricTransportClientConnection *conn,
+                        IFabricTransportMessage **resp) {
+    stream_key key(conn != nullptr ? conn->get_ClientId() : L"",
+                   header.stream_id());
+    auto executor = co_await net::this_coro::executor;
+    std::shared_ptr<client_stream_entry> entry;
+    absl::Status st;
+    if (header.sequence() == 0) {
+      st = start_client_stream(header.url(), key, executor, &entry);
+    } else {
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto it = client_streams_.find(key);
+      if (it == client_streams_.end()) {
+        st = absl::FailedPreconditionError("client stream not found");
+      } else if (it->second->next_sequence != header.sequence()) {
+        st = absl::InvalidArgumentError("client stream chunk out of order");
+      } else {
+        entry = it->second;
+        entry->next_sequence++;
+        entry->in_server = true;
+        entry->since = std::chrono::steady_clock::now();
+      }
+    }
+
+    std::string resp_str;
+    if (st.ok() && !header.end_of_stream()) {
+      auto consumed = std::make_shared<basic_event<>>(executor);
+      entry->reader->push({fabricrpc::get_body(req), false, consumed});
+      co_await consumed->async_wait(net::use_awaitable);
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (entry->handler_done && !entry->status.ok()) {
+        // stream is over, and the client gets the error on this chunk.
+        st = entry->status;
+        end_client_stream(key, entry);
+      } else if (entry->ended) {
+        // failed by a timeout or disconnect.
+        st = entry->end_status.ok()
+                 ? absl::FailedPreconditionError("client stream has ended")
+                 : entry->end_status;
+      }
+      entry->in_server = false;
+      entry->since = std::chrono::steady_clock::now();
+    } else if (st.ok()) {
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        entry->end_seen = true;
+      }
+      entry->reader->push({"", true, nullptr});
+      co_await entry->done->async_wait(net::use_awaitable);
+      std::lock_guard<std::mutex> lk(mtx_);
+      st = entry->status;
+      resp_str = std::move(entry->resp);
+      end_client_stream(key, entry);
+    }
+
+    std::string resp_header;
+    [[maybe_unused]] absl::Status must_ok =
+        fabricrpc::serialize_reply_header(st, &resp_header);
+    assert(must_ok.ok());
+    winrt::com_ptr<IFabricTransportMessage> msg =
+        winrt::make<fabricrpc::tool_transport_msg>(std::move(resp_str),
+                                                   std::move(resp_header));
+    msg.copy_to(resp);
+  }
+
+  // registers the client stream and starts its handler in the background.
+  absl::Status
+  start_client_stream(const std::string &url, const stream_key &key,
+                      const net::any_io_executor &executor,
+                      std::shared_ptr<client_stream_entry> *entry_ret) {
+    std::shared_ptr<service> svc;
+    absl::Status st = find_service(url, &svc);
+    if (!st.ok()) {
+      return st;
+    }
+    auto entry = std::make_shared<client_stream_entry>();
+    entry->reader = std::make_shared<server_reader>(executor);
+    entry->next_sequence = 1;
+    entry->done = std::make_shared<basic_event<>>(executor);
+    entry->handler_done = false;
+    entry->in_server = true;
+    entry->since = std::chrono::steady_clock::now();
+    entry->end_seen = false;
+    entry->ended = false;
+    auto watcher_strand = net::make_strand(executor);
+    entry->idle_timer = std::make_shared<net::steady_timer>(watcher_strand);
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      auto [it, inserted] = client_streams_.insert({key, entry});
+      if (!inserted) {
+        return absl::AlreadyExistsError("client stream already exists");
+      }
+    }
+
+    auto handle_stream = [svc, url, entry]() -> net::awaitable<absl::Status> {
+      co_return co_await svc->execute_client_stream(url, entry->reader.get(),
+                                                    &entry->resp);
+    };
+    net::co_spawn(executor, std::move(handle_stream),
+                  [this, entry](std::exception_ptr e, absl::Status st) {
+                    if (e) {
+                      st = absl::InternalError("handler has exception");
+                    }
+                    {
+                      std::lock_guard<std::mutex> lk(mtx_);
+                      entry->handler_done = true;
+                      entry->status = std::move(st);
+                    }
+                    // release chunks waiting for ack.
+                    entry->reader->close();
+                    entry->done->set();
+                  });
+    net::co_spawn(watcher_strand, watch_client_stream(key, entry),
+                  net::detached);
+    *entry_ret = entry;
+    return absl::OkStatus();
+  }
+
+  // fails the client stream once the client has sent no chunk for the idle
+  // timeout, or the handler has not taken a chunk for as long, so a client
+  // that stops without the end chunk or a handler that stops reading does
+  // not keep it.
+  net::awaitable<void>
+  watch_client_stream(stream_key key,
+                      std::shared_ptr<client_stream_entry> entry) {
+    typedef std::chrono::steady_clock clock;
+    for (;;) {
+      clock::time_point deadline;
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (entry->ended) {
+          co_return;
+        }
+        clock::time_point now = clock::now();
+        // after the end chunk, only checks if the stream has ended.
+        deadline = (entry->end_seen ? now : entry->since) +
+                   client_stream_idle_timeout_;
+        if (now >= deadline) {
+          fail_client_stream(
+              key, entry,
+              absl::DeadlineExceededError(
+                  entry->in_server ? "client stream handler is not reading"
+                                   : "client stream is idle"));
+          co_return;
+        }
+      }
+      entry->idle_timer->expires_at(deadline);
+      // cancelled by end_client_stream.
+      boost::system::error_code ec;
+      co_await entry->idle_timer->async_wait(
+          net::redirect_error(net::use_awaitable, ec));
+    }
+  }
+
+  // ends the client stream with st, which the handler and the pending chunk
+  // get. Needs mtx_.
+  void fail_client_stream(const stream_key &key,
+                          const std::shared_ptr<client_stream_entry> &entry,
+                          absl::Status st) {
+    if (entry->ended) {
+      return;
+    }
+    entry->end_status = st;
+    end_client_stream(key, entry);
+    entry->reader->fail(std::move(st));
+  }
+
+  // removes the client stream, and stops its watcher. Needs mtx_.
+  void end_client_stream(const stream_key &key,
+                         const std::shared_ptr<client_stream_entry> &entry) {
+    if (entry->ended) {
+      return;
+    }
+    entry->ended = true;
+    client_streams_.erase(key);
+    net::post(entry->idle_timer->get_executor(),
+              [timer = entry->idle_timer]() { timer->cancel(); });
   }
 
   std::vector<std::shared_ptr<service>> svc_vec_;
+  std::size_t compression_threshold_;
+  std::size_t max_uncompressed_size_;
+  std::shared_ptr<span_sink> span_sink_;
+  std::chrono::milliseconds client_stream_idle_timeout_;
+
+  std::mutex mtx_;
+  // writers of server streams in progress.
+  std::map<stream_key, std::shared_ptr<server_writer>> server_streams_;
+  std::map<stream_key, std::shared_ptr<client_stream_entry>>
+      client_streams_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fabricrpc/proto_forward.hpp"
+
+#include "absl/status/status.h"
+#include <fabrictransport_.h>
+
+#include <string>
+
+namespace fabricrpc {
+
+// makes the callback header and body of a server pushed notification.
+// Broadcasting serializes once and sends the result to each connection.
+absl::Status serialize_notification(const std::string &topic,
+                                    const google::protobuf::MessageLite &msg,
+                                    std::string *header, std::string *body);
+
+// sends a serialized notification on the connection callback channel.
+// fails if the client is gone.
+absl::Status send_notification(IFabricTransportClientConnection *conn,
+                               std::string header, std::string body);
+
+} // namespace fabricrpc
@@ -1,48 +1,151 @@
 #pragma once
 // helper to parse status and payload.
 
+#include "fabricrpc/method_descriptor.hpp"
 #include "fabricrpc/proto_forward.hpp"
 
 #include "absl/status/status.h"
 
 #include "boost/asio/awaitable.hpp"
 
+#include <cstdint>
+#include <vector>
+
 namespace fabricrpc {
 
 namespace net = boost::asio;
 
 class reply_header;
+class request_header;
 
 absl::Status parse_reply_header(const std::string &data);
 
+// same as above but also returns the whole header, i.e. to read the body
+// codec.
+absl::Status parse_reply_header(const std::string &data, reply_header *ret);
+
 absl::Status parse_proto_payload(const std::string_view data,
                                  google::protobuf::MessageLite *ret);
 
 absl::Status parse_request_header(const std::string &data,
                                   std::string &url_ret);
 
+// parse the whole request header
+absl::Status parse_request_header(const std::string &data,
+                                  request_header *ret);
+
 absl::Status serialize_proto_payload(const google::protobuf::MessageLite *data,
                                      std::string *ret);
 
 absl::Status serialize_reply_header(absl::Status st, std::string *ret);
 
-template <typename ReqProto, typename ReplyProto, typename HandlerFunc,
-          typename Service>
+// sets st into header that has other fields filled, and serializes it.
+absl::Status serialize_reply_header(absl::Status st, reply_header *header,
+                                    std::string *ret);
+
+// reply header for a batch request. The batch as a whole is ok, and each item
+// has its status and body size.
+absl::Status
+serialize_batch_reply_header(const std::vector<absl::Status> &sts,
+                             const std::vector<std::string> &bodies,
+                             std::string *ret);
+
+// returns the status of the batch as a whole. If ok, item_sts and item_sizes
+// are filled for each item.
+absl::Status parse_batch_reply_header(const std::string &data,
+                                      std::vector<absl::Status> *item_sts,
+                                      std::vector<std::uint32_t> *item_sizes);
+
+// Policy hooks are in method_policy.hpp.
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
 net::awaitable<absl::Status>
-codegen_handler_helper(const std::string_view req, std::string *resp,
+codegen_handler_helper(const method_descriptor &method,
+                       const std::string_view req, std::string *resp,
                        HandlerFunc fn, Service svc) {
+  Policy call(method);
   ReqProto p1;
   ReplyProto p2;
   absl::Status st = fabricrpc::parse_proto_payload(req, &p1);
+  call.parsed(st);
   if (!st.ok()) {
     co_return st;
   }
   st = co_await (svc->*fn)(&p1, &p2);
-
+  call.handled(st);
   if (!st.ok()) {
     co_return st;
   }
-  co_return fabricrpc::serialize_proto_payload(&p2, resp);
+  st = fabricrpc::serialize_proto_payload(&p2, resp);
+  call.serialized(st);
+  co_return st;
+}
+
+// same as codegen_handler_helper for handlers that do not suspend.
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
+absl::Status codegen_sync_handler_helper(const method_descriptor &method,
+                                         const std::string_view req,
+                                         std::string *resp, HandlerFunc fn,
+                                         Service svc) {
+  Policy call(method);
+  ReqProto p1;
+  ReplyProto p2;
+  absl::Status st = fabricrpc::parse_proto_payload(req, &p1);
+  call.parsed(st);
+  if (!st.ok()) {
+    return st;
+  }
+  st = (svc->*fn)(&p1, &p2);
+  call.handled(st);
+  if (!st.ok()) {
+    return st;
+  }
+  st = fabricrpc::serialize_proto_payload(&p2, resp);
+  call.serialized(st);
+  return st;
+}
+
+// same as codegen_handler_helper for calls in the same process. Protos are
+// passed through, so parsed and serialized always succeed. resp is nullptr
+// for one way calls.
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
+net::awaitable<absl::Status>
+codegen_inproc_handler_helper(const method_descriptor &method,
+                              google::protobuf::MessageLite *req,
+                              google::protobuf::MessageLite *resp,
+                              HandlerFunc fn, Service svc) {
+  Policy call(method);
+  call.parsed(absl::OkStatus());
+  ReplyProto dropped;
+  ReplyProto *p2 =
+      resp != nullptr ? static_cast<ReplyProto *>(resp) : &dropped;
+  absl::Status st = co_await (svc->*fn)(static_cast<ReqProto *>(req), p2);
+  call.handled(st);
+  if (st.ok()) {
+    call.serialized(st);
+  }
+  co_return st;
+}
+
+// same as codegen_inproc_handler_helper for handlers that do not suspend.
+template <typename Policy, typename ReqProto, typename ReplyProto,
+          typename HandlerFunc, typename Service>
+absl::Status codegen_inproc_sync_handler_helper(
+    const method_descriptor &method, google::protobuf::MessageLite *req,
+    google::protobuf::MessageLite *resp, HandlerFunc fn, Service svc) {
+  Policy call(method);
+  call.parsed(absl::OkStatus());
+  ReplyProto dropped;
+  ReplyProto *p2 =
+      resp != nullptr ? static_cast<ReplyProto *>(resp) : &dropped;
+  absl::Status st = (svc->*fn)(static_cast<ReqProto *>(req), p2);
+  call.handled(st);
+  if (st.ok()) {
+    call.serialized(st);
+  }
+  return st;
 }
 
 } // namespace fabricrpc
\ No newline at end of file
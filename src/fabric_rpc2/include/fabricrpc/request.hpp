@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fabricrpc/any_context.hpp"
+#include "fabricrpc_tool/request_span.hpp"
 #include <absl/status/status.h>
 #include <fabrictransport_.h>
 #include <winrt/base.h>
@@ -36,6 +37,12 @@ public:
 
   const std::wstring &get_conn_id() const { return id_; }
 
+  // one way requests have no callback and ctx, and are not replied.
+  bool is_one_way() const { return !ctx_; }
+
+  // arrival is marked on construction, and completed by complete.
+  request_span &span() { return span_; }
+
 private:
   // connection id
   const std::wstring id_;
@@ -45,6 +52,7 @@ private:
   winrt::com_ptr<IFabricAsyncOperationCallback> callback_;
   // ctx returned to user
   winrt::com_ptr<IFabricAsyncOperationContext> ctx_;
+  request_span span_;
 };
 
 // real payload used by acceptor
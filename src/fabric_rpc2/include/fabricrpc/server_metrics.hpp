@@ -0,0 +1,88 @@
+#pragma once
+// process wide metrics of the server runtime. Each thread adds into its own
+// slot without a lock, and slots are summed by collect_server_metrics.
+// Calls and latency per url are recorded by the middleware, and the failure
+// stages of generated methods are in method_policy.hpp.
+
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fabricrpc {
+
+enum class server_metric {
+  // gauges, that go down when the request moves on.
+  // requests taken from a connection queue and not yet replied.
+  in_flight = 0,
+  // requests waiting in connection queues.
+  queued,
+  // counters.
+  // requests passed to a handler.
+  accepted,
+  // requests replied with an error before reaching a handler, i.e. unknown
+  // url or a closed connection.
+  rejected,
+  // header and body bytes of requests and replies on transport.
+  bytes_in,
+  bytes_out,
+  count
+};
+
+const char *server_metric_name(server_metric metric);
+
+// adds n to metric in the slot of the calling thread. n is negative to take
+// a gauge down.
+void add_server_metric(server_metric metric, std::int64_t n = 1);
+
+struct server_metrics {
+  std::array<std::int64_t, static_cast<std::size_t>(server_metric::count)>
+      values{};
+
+  std::int64_t get(server_metric metric) const {
+    return values[static_cast<std::size_t>(metric)];
+  }
+};
+
+// sum of all threads, including exited ones. Slots are read while other
+// threads add, so gauges may be off by the requests that are moving at the
+// time.
+server_metrics collect_server_metrics();
+
+// number of live threads that have a slot. A slot is freed when its thread
+// exits.
+std::size_t server_metric_threads();
+
+// unary calls of one url that reached a service.
+struct url_stats {
+  std::string url;
+  std::uint64_t calls = 0;
+  // calls replied with an error.
+  std::uint64_t failed = 0;
+  // arrival, or the start of the middleware without a span, to the reply
+  // message.
+  latency_histogram latency;
+  // handler only.
+  latency_histogram handler_latency;
+};
+
+// adds a call of url. Urls past a fixed number are not recorded, so that
+// clients cannot grow the table without bound.
+void record_url_call(const std::string &url, bool failed,
+                     std::chrono::nanoseconds latency,
+                     std::chrono::nanoseconds handler_latency);
+
+// stats of all recorded urls. Sorted by url.
+std::vector<url_stats> collect_url_stats();
+
+// queue state of one server connection.
+struct connection_stats {
+  std::wstring client_id;
+  std::size_t queue_depth = 0;
+};
+
+} // namespace fabricrpc
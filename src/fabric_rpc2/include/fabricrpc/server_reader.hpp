@@ -0,0 +1,79 @@
+#pragma once
+
+#include "fabricrpc/basic_event.hpp"
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/proto_forward.hpp"
+
+#include "absl/status/status.h"
+#include "boost/asio/awaitable.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// one request msg of a client streaming call.
+struct client_stream_chunk {
+  std::string body;
+  bool end_of_stream;
+  // set when the handler takes the chunk, so that the chunk can be acked.
+  std::shared_ptr<basic_event<>> consumed;
+};
+
+// reads request msgs of a client streaming call in the handler.
+// Chunks are pushed by middleware as they arrive, so only the chunks not yet
+// read are held in memory.
+class server_reader {
+public:
+  server_reader(const net::any_io_executor &ex);
+
+  // reads the next msg.
+  // returns false at end of stream, or if the msg cannot be parsed, and
+  // status() has the error.
+  net::awaitable<bool> read(google::protobuf::MessageLite *msg);
+
+  // ok unless a msg failed to parse.
+  const absl::Status &status() const { return status_; }
+
+  // used by middleware to deliver a chunk.
+  void push(client_stream_chunk chunk);
+
+  // drops chunks not read and releases their senders.
+  // middleware calls this after the handler returns.
+  void close();
+
+  // same as close, and the pending and further reads return false with st,
+  // i.e. the client is gone before the end of stream.
+  void fail(absl::Status st);
+
+private:
+  std::mutex mtx_;
+  std::deque<client_stream_chunk> chunks_;
+  // set when chunks are pushed.
+  std::shared_ptr<basic_event<>> ev_;
+  bool done_;
+  absl::Status status_;
+};
+
+template <typename Policy, typename ReplyProto, typename HandlerFunc,
+          typename Service>
+net::awaitable<absl::Status>
+codegen_client_stream_handler_helper(const method_descriptor &method,
+                                     server_reader *reader, std::string *resp,
+                                     HandlerFunc fn, Service svc) {
+  Policy call(method);
+  ReplyProto p2;
+  absl::Status st = co_await (svc->*fn)(reader, &p2);
+  call.handled(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = fabricrpc::serialize_proto_payload(&p2, resp);
+  call.serialized(st);
+  co_return st;
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "fabricrpc/basic_event.hpp"
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/proto_forward.hpp"
+
+#include "absl/status/status.h"
+#include "boost/asio/awaitable.hpp"
+#include <fabrictransport_.h>
+#include <winrt/base.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace fabricrpc {
+
+namespace net = boost::asio;
+
+// sends reply chunks of a server streaming call to the client through the
+// connection callback channel.
+// At most window chunks are sent ahead of the chunks the client has acked,
+// so a slow reader slows the writer instead of piling up chunks. A window of
+// 0 is no limit.
+// write and finish are called from one coroutine at a time, the handler's
+// and then middleware's. on_ack and cancel may be called from any thread.
+class server_writer {
+public:
+  server_writer(winrt::com_ptr<IFabricTransportClientConnection> conn,
+                std::uint64_t stream_id, const net::any_io_executor &ex,
+                std::uint32_t window = 0);
+
+  // sends one reply chunk. Waits while the window is full.
+  // fails if the stream is finished or the client is gone, and handler should
+  // stop writing.
+  net::awaitable<absl::Status> write(const google::protobuf::MessageLite &msg);
+
+  // sends end of stream with the final status of the call.
+  // middleware calls this after the handler returns.
+  absl::Status finish(const absl::Status &st);
+
+  // used by middleware when the client has read acked chunks in total.
+  void on_ack(std::uint64_t acked);
+
+  // fails the pending and further writes. middleware calls this when the
+  // client is gone.
+  void cancel();
+
+  std::uint64_t get_stream_id() const { return stream_id_; }
+
+private:
+  absl::Status send(std::string body, bool end_of_stream,
+                    const absl::Status &st);
+
+  winrt::com_ptr<IFabricTransportClientConnection> conn_;
+  const std::uint64_t stream_id_;
+  const std::uint32_t window_;
+  // only used by write and finish.
+  bool finished_;
+
+  // guards the members below.
+  std::mutex mtx_;
+  // sequence of the next chunk, i.e. chunks sent.
+  std::uint64_t sequence_;
+  // chunks acked by the client. Not more than sequence_.
+  std::uint64_t acked_;
+  bool cancelled_;
+  // set when acked_ or cancelled_ changes.
+  std::shared_ptr<basic_event<>> ev_;
+};
+
+template <typename Policy, typename ReqProto, typename HandlerFunc,
+          typename Service>
+net::awaitable<absl::Status>
+codegen_stream_handler_helper(const method_descriptor &method,
+                              const std::string_view req,
+                              server_writer *writer, HandlerFunc fn,
+                              Service svc) {
+  Policy call(method);
+  ReqProto p1;
+  absl::Status st = fabricrpc::parse_proto_payload(req, &p1);
+  call.parsed(st);
+  if (!st.ok()) {
+    co_return st;
+  }
+  st = co_await (svc->*fn)(&p1, writer);
+  call.handled(st);
+  co_return st;
+}
+
+} // namespace fabricrpc
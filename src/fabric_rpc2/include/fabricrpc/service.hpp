@@ -2,11 +2,27 @@
 
 #include "absl/status/status.h"
 #include "boost/asio/awaitable.hpp"
+#include "fabricrpc/metadata.hpp"
+#include "fabricrpc/proto_forward.hpp"
+#include "fabricrpc/server_reader.hpp"
+#include "fabricrpc/server_writer.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace fabricrpc {
 
 namespace net = boost::asio;
 
+// per call data of a unary call beside the request and reply.
+struct call_context {
+  // never nullptr
+  const metadata_view *request_metadata;
+  // entries added are sent back with the reply.
+  metadata *reply_metadata;
+};
+
 class service {
 public:
   // returns the first part of the route
@@ -15,6 +31,81 @@ public:
   virtual net::awaitable<absl::Status> execute(const std::string &url,
                                                const std::string_view req,
                                                std::string *resp) = 0;
+
+  // same as execute, for methods that need request metadata or send reply
+  // metadata. Server calls this for unary calls.
+  virtual net::awaitable<absl::Status>
+  execute_with_context(const std::string &url, const std::string_view req,
+                       std::string *resp, call_context *) {
+    co_return co_await execute(url, req, resp);
+  }
+
+  // unary methods whose handler does not suspend, called before execute
+  // without a coroutine frame. Returns false if url is not such a method.
+  // Otherwise st is the status of the call.
+  virtual bool execute_sync(const std::string &, const std::string_view,
+                            std::string *, absl::Status *) {
+    return false;
+  }
+
+  // server streaming methods. Reply chunks are written to writer, and the
+  // returned status ends the stream.
+  virtual net::awaitable<absl::Status>
+  execute_stream(const std::string &url, const std::string_view,
+                 server_writer *) {
+    co_return absl::UnimplementedError("streaming not supported: " + url);
+  }
+
+  // client streaming methods. Request msgs are read from reader as they
+  // arrive, and the single reply is written to resp.
+  virtual net::awaitable<absl::Status>
+  execute_client_stream(const std::string &url, server_reader *,
+                        std::string *) {
+    co_return absl::UnimplementedError("streaming not supported: " + url);
+  }
+
+  // unary methods called in the same process, see inproc_channel.hpp.
+  // req and resp are the protos of the method, and resp is nullptr for one
+  // way calls.
+  virtual net::awaitable<absl::Status>
+  execute_inproc(const std::string &url, google::protobuf::MessageLite *,
+                 google::protobuf::MessageLite *) {
+    co_return absl::UnimplementedError("in process not supported: " + url);
+  }
+
+  // same as execute_inproc, for methods that need request metadata or send
+  // reply metadata. The channel calls this for calls with metadata.
+  virtual net::awaitable<absl::Status>
+  execute_inproc_with_context(const std::string &url,
+                              google::protobuf::MessageLite *req,
+                              google::protobuf::MessageLite *resp,
+                              call_context *) {
+    co_return co_await execute_inproc(url, req, resp);
+  }
 };
 
+// finds the service in svcs that owns the url /<service>/<method>
+inline absl::Status
+find_service(const std::vector<std::shared_ptr<service>> &svcs,
+             const std::string &url, std::shared_ptr<service> *svc_ret) {
+  std::string_view url_view = url;
+  if (url.size() == 0) {
+    return absl::InvalidArgumentError("url is empty");
+  }
+  if (!url_view.starts_with("/")) {
+    return absl::InvalidArgumentError("invalid url");
+  }
+  std::string_view path = url_view.substr(1);
+  for (const std::shared_ptr<service> &svc : svcs) {
+    std::string_view name = svc->name();
+    if (!path.starts_with(name) || path.size() <= name.size() ||
+        path[name.size()] != '/') {
+      continue;
+    }
+    *svc_ret = svc;
+    return absl::OkStatus();
+  }
+  return absl::UnimplementedError("url not found");
+}
+
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "fabricrpc/admin_service.hpp"
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc/method_policy.hpp"
+#include "fabricrpc/parse.hpp"
+
+#include <winrt/base.h>
+
+#include <map>
+#include <string>
+
+namespace fabricrpc {
+
+namespace {
+
+std::uint64_t to_us(std::chrono::nanoseconds d) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+} // namespace
+
+admin_service::admin_service(connection_source connections)
+    : connections_(std::move(connections)) {}
+
+net::awaitable<absl::Status> admin_service::execute(const std::string &url,
+                                                    const std::string_view,
+                                                    std::string *) {
+  co_return absl::UnimplementedError("method not found: " + url);
+}
+
+bool admin_service::execute_sync(const std::string &url,
+                                 const std::string_view req,
+                                 std::string *resp, absl::Status *st) {
+  if (url != "/fabricrpc.Admin/GetStats") {
+    return false;
+  }
+  stats_request request;
+  *st = parse_proto_payload(req, &request);
+  if (!st->ok()) {
+    return true;
+  }
+  stats_reply reply;
+  get_stats(&reply);
+  *st = serialize_proto_payload(&reply, resp);
+  return true;
+}
+
+void admin_service::get_stats(stats_reply *reply) const {
+  server_metrics metrics = collect_server_metrics();
+  for (std::size_t i = 0; i < metrics.values.size(); i++) {
+    metric_value *v = reply->add_metrics();
+    v->set_name(server_metric_name(static_cast<server_metric>(i)));
+    v->set_value(metrics.values[i]);
+  }
+  // urls recorded by the middleware, and the policy stats of the same path.
+  std::map<std::string, method_metrics> methods;
+  for (const url_stats &stats : collect_url_stats()) {
+    method_metrics &m = methods[stats.url];
+    m.set_path(stats.url);
+    m.set_calls(stats.calls);
+    m.set_failed(stats.failed);
+    m.set_latency_p50_us(to_us(stats.latency.percentile(0.5)));
+    m.set_latency_p99_us(to_us(stats.latency.percentile(0.99)));
+    m.set_handler_p50_us(to_us(stats.handler_latency.percentile(0.5)));
+    m.set_handler_p99_us(to_us(stats.handler_latency.percentile(0.99)));
+  }
+  for (const method_stats &stats : collect_method_stats()) {
+    std::string path(stats.method->path);
+    auto [it, added] = methods.try_emplace(path);
+    method_metrics &m = it->second;
+    m.set_parse_failed(stats.parse_failed);
+    m.set_handler_failed(stats.handler_failed);
+    m.set_serialize_failed(stats.serialize_failed);
+    if (!added) {
+      continue;
+    }
+    m.set_path(path);
+    m.set_calls(stats.calls);
+    m.set_failed(stats.parse_failed + stats.handler_failed +
+                 stats.serialize_failed);
+    m.set_latency_p50_us(to_us(stats.latency.percentile(0.5)));
+    m.set_latency_p99_us(to_us(stats.latency.percentile(0.99)));
+    m.set_handler_p50_us(to_us(stats.handler_latency.percentile(0.5)));
+    m.set_handler_p99_us(to_us(stats.handler_latency.percentile(0.99)));
+  }
+  for (auto &[path, m] : methods) {
+    *reply->add_methods() = std::move(m);
+  }
+  if (!connections_) {
+    return;
+  }
+  for (const connection_stats &conn : connections_()) {
+    connection_metrics *c = reply->add_connections();
+    c->set_client_id(winrt::to_string(conn.client_id));
+    c->set_queue_depth(conn.queue_depth);
+  }
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,107 @@
+#include "fabricrpc/codec.hpp"
+
+#include <lz4.h>
+#include <zstd.h>
+
+#include <limits>
+
+namespace fabricrpc {
+
+// zstd level that favors speed. Higher levels cost too much cpu for rpc.
+constexpr int zstd_level = 3;
+
+bool should_compress(const compression_options &options,
+                     const std::string_view body) {
+  return options.codec != body_codec::codec_none &&
+         body.size() >= options.threshold &&
+         body.size() <= std::numeric_limits<std::uint32_t>::max();
+}
+
+absl::Status compress_body(body_codec codec, const std::string_view in,
+                           std::string *ret) {
+  if (ret == nullptr) {
+    return absl::InvalidArgumentError("compress_body has nullptr");
+  }
+  switch (codec) {
+  case body_codec::codec_none:
+    ret->assign(in);
+    return absl::OkStatus();
+  case body_codec::codec_lz4: {
+    if (in.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+      return absl::InvalidArgumentError("body too large for lz4");
+    }
+    int in_size = static_cast<int>(in.size());
+    ret->resize(LZ4_compressBound(in_size));
+    int len = LZ4_compress_default(in.data(), ret->data(), in_size,
+                                   static_cast<int>(ret->size()));
+    if (len <= 0) {
+      return absl::InternalError("lz4 compress failed");
+    }
+    ret->resize(len);
+    return absl::OkStatus();
+  }
+  case body_codec::codec_zstd: {
+    ret->resize(ZSTD_compressBound(in.size()));
+    std::size_t len = ZSTD_compress(ret->data(), ret->size(), in.data(),
+                                    in.size(), zstd_level);
+    if (ZSTD_isError(len)) {
+      return absl::InternalError("zstd compress failed");
+    }
+    ret->resize(len);
+    return absl::OkStatus();
+  }
+  default:
+    return absl::InvalidArgumentError("unknown body codec");
+  }
+}
+
+absl::Status decompress_body(body_codec codec, const std::string_view in,
+                             std::uint32_t uncompressed_size,
+                             std::size_t max_size, std::string *ret) {
+  if (ret == nullptr) {
+    return absl::InvalidArgumentError("decompress_body has nullptr");
+  }
+  if (codec != body_codec::codec_none && uncompressed_size > max_size) {
+    return absl::ResourceExhaustedError("uncompressed body is too large");
+  }
+  switch (codec) {
+  case body_codec::codec_none:
+    ret->assign(in);
+    return absl::OkStatus();
+  case body_codec::codec_lz4: {
+    if (in.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE) ||
+        uncompressed_size > static_cast<std::uint32_t>(LZ4_MAX_INPUT_SIZE)) {
+      return absl::InvalidArgumentError("body too large for lz4");
+    }
+    ret->resize(uncompressed_size);
+    int len = LZ4_decompress_safe(in.data(), ret->data(),
+                                  static_cast<int>(in.size()),
+                                  static_cast<int>(uncompressed_size));
+    if (len < 0 || static_cast<std::uint32_t>(len) != uncompressed_size) {
+      return absl::DataLossError("lz4 decompress failed");
+    }
+    return absl::OkStatus();
+  }
+  case body_codec::codec_zstd: {
+    // the frame has the size too, so a lying header fails before allocation.
+    unsigned long long frame_size =
+        ZSTD_getFrameContentSize(in.data(), in.size());
+    if (frame_size == ZSTD_CONTENTSIZE_ERROR ||
+        (frame_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+         frame_size != uncompressed_size)) {
+      return absl::DataLossError("zstd frame size does not match");
+    }
+    ret->resize(uncompressed_size);
+    std::size_t len =
+        ZSTD_decompress(ret->data(), ret->size(), in.data(), in.size());
+    if (ZSTD_isError(len) || len != uncompressed_size) {
+      return absl::DataLossError("zstd decompress failed");
+    }
+    return absl::OkStatus();
+  }
+  default:
+    return absl::InvalidArgumentError("unknown body codec");
+  }
+}
+
+} // namespace fabricrpc
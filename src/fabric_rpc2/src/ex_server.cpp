@@ -4,27 +4,61 @@
 #include "boost/asio/co_spawn.hpp"
 #include "boost/asio/detached.hpp"
 #include "boost/asio/use_awaitable.hpp"
+#include "fabricrpc/admin_service.hpp"
 #include "fabricrpc/basic_acceptor.hpp"
 #include "fabricrpc/endpoint.hpp"
 
 namespace fabricrpc {
 
-ex_server::ex_server() : md_(), ioc_() {}
+ex_server::ex_server() : md_(), ioc_(), mgr_mtx_(), mgr_() {}
 
 void ex_server::add_service(std::shared_ptr<service> svc) {
   md_.add_service(svc);
 }
 
+void ex_server::set_compression_threshold(std::size_t threshold) {
+  md_.set_compression_threshold(threshold);
+}
+
+void ex_server::set_max_uncompressed_size(std::size_t size) {
+  md_.set_max_uncompressed_size(size);
+}
+
+void ex_server::set_client_stream_idle_timeout(
+    std::chrono::milliseconds timeout) {
+  md_.set_client_stream_idle_timeout(timeout);
+}
+
+void ex_server::set_span_sink(std::shared_ptr<span_sink> sink) {
+  md_.set_span_sink(std::move(sink));
+}
+
+void ex_server::add_admin_service() {
+  // handlers run on ioc_ while mgr_ is set.
+  md_.add_service(std::make_shared<admin_service>([this]() {
+    std::shared_ptr<manager_type> mgr = get_manager();
+    return mgr ? mgr->get_connection_stats()
+               : std::vector<connection_stats>();
+  }));
+}
+
 absl::Status ex_server::serve(int port) {
   fabricrpc::endpoint ep(L"localhost", port);
   fabricrpc::basic_acceptor<net::io_context::executor_type> acceptor(
       ioc_.get_executor(), ep);
+  // streams of a gone client are not acked any more.
+  acceptor.get_connection_manager()->set_on_disconnect(
+      [this](std::wstring const &id) { md_.disconnect(id); });
   boost::system::error_code ec = {};
   std::wstring addr;
   ec = acceptor.open(&addr);
   if (ec) {
     return absl::AbortedError("failed to open acceptor");
   }
+  {
+    std::lock_guard<std::mutex> lk(mgr_mtx_);
+    mgr_ = acceptor.get_connection_manager();
+  }
   // assert(addr == L"localhost:12345+/");
   std::wcout << L"Listening on: " << addr << std::endl;
 
@@ -38,6 +72,11 @@ absl::Status ex_server::serve(int port) {
 
       auto handle_conn = [c = std::move(conn),
                           this]() mutable -> net::awaitable<void> {
+        // used by streaming calls to send chunks back.
+        winrt::com_ptr<IFabricTransportClientConnection> tconn =
+            c.get_transport_conn();
+        // state of the connection shared by its requests.
+        auto conn_ctx = std::make_shared<fabricrpc::connection_context>();
         for (;;) {
           auto executor = co_await net::this_coro::executor;
           // accept request in loop
@@ -45,13 +84,23 @@ absl::Status ex_server::serve(int port) {
               co_await c.async_accept(net::use_awaitable);
           // std::cout << "acceptor.async_accept finish" << std::endl;
 
-          auto handle_request = [pl = std::move(pl),
+          auto handle_request = [pl = std::move(pl), tconn, conn_ctx,
                                  this]() mutable -> net::awaitable<void> {
+            pl->span().mark(span_point::dequeue);
+            add_server_metric(server_metric::in_flight);
             winrt::com_ptr<IFabricTransportMessage> req;
             pl->get_request_msg(req.put());
+            if (pl->is_one_way()) {
+              co_await md_.execute_one_way(req.get(), tconn.get());
+              add_server_metric(server_metric::in_flight, -1);
+              co_return;
+            }
             winrt::com_ptr<IFabricTransportMessage> reply;
-            co_await md_.execute(req.get(), reply.put());
+            co_await md_.execute(req.get(), reply.put(), tconn.get(),
+                                 conn_ctx.get(), md_.span_of(pl->span()));
             pl->complete(S_OK, reply);
+            add_server_metric(server_metric::in_flight, -1);
+            md_.record_span(pl->span());
           };
           // handle each request
           net::co_spawn(executor, std::move(handle_request), net::detached);
@@ -64,9 +113,38 @@ absl::Status ex_server::serve(int port) {
 
   net::co_spawn(ioc_, listener, net::detached);
   ioc_.run();
+  {
+    std::lock_guard<std::mutex> lk(mgr_mtx_);
+    mgr_.reset();
+  }
   return absl::OkStatus();
 }
 
 void ex_server::shutdown() { ioc_.stop(); }
 
+std::shared_ptr<ex_server::manager_type> ex_server::get_manager() {
+  std::lock_guard<std::mutex> lk(mgr_mtx_);
+  return mgr_;
+}
+
+absl::Status ex_server::push(std::wstring const &client_id,
+                             const std::string &topic,
+                             const google::protobuf::MessageLite &msg) {
+  // the copy keeps the manager while serve returns.
+  std::shared_ptr<manager_type> mgr = get_manager();
+  if (!mgr) {
+    return absl::FailedPreconditionError("server is not serving");
+  }
+  return mgr->push(client_id, topic, msg);
+}
+
+std::size_t ex_server::broadcast(const std::string &topic,
+                                 const google::protobuf::MessageLite &msg) {
+  std::shared_ptr<manager_type> mgr = get_manager();
+  if (!mgr) {
+    return 0;
+  }
+  return mgr->broadcast(topic, msg);
+}
+
 } // namespace fabricrpc
\ No newline at end of file
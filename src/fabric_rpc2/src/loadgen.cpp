@@ -0,0 +1,205 @@
+#include "fabricrpc/loadgen.hpp"
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+
+#include <google/protobuf/message_lite.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace fabricrpc {
+
+absl::Status parse_loadgen_arrival(std::string_view value,
+                                   loadgen_arrival *ret) {
+  if (value == "closed") {
+    *ret = loadgen_arrival::closed;
+  } else if (value == "fixed") {
+    *ret = loadgen_arrival::fixed;
+  } else if (value == "poisson") {
+    *ret = loadgen_arrival::poisson;
+  } else {
+    return absl::InvalidArgumentError(absl::StrCat("bad arrival: ", value));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status parse_loadgen_args(int argc, char **argv, loadgen_options *ret) {
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--help") {
+      ret->help = true;
+      continue;
+    }
+    std::size_t eq = arg.find('=');
+    if (!arg.starts_with("--") || eq == std::string_view::npos) {
+      return absl::InvalidArgumentError(absl::StrCat("bad arg: ", arg));
+    }
+    std::string_view key = arg.substr(2, eq - 2);
+    std::string_view value = arg.substr(eq + 1);
+    std::uint64_t n = 0;
+    bool ok = true;
+    if (key == "host") {
+      ret->host = std::wstring(value.begin(), value.end());
+    } else if (key == "method") {
+      ret->method = value;
+    } else if (key == "requests") {
+      ret->requests = value;
+    } else if (key == "rate") {
+      ok = absl::SimpleAtod(value, &ret->rate) && ret->rate >= 0;
+    } else if (key == "arrival") {
+      ok = parse_loadgen_arrival(value, &ret->arrival).ok();
+    } else if (key == "ramp_step") {
+      ok = absl::SimpleAtod(value, &ret->ramp_step) && ret->ramp_step >= 0;
+    } else if (absl::SimpleAtoi(value, &n)) {
+      if (key == "port") {
+        ret->port = static_cast<std::uint32_t>(n);
+      } else if (key == "connections") {
+        ret->connections = n;
+      } else if (key == "concurrency") {
+        ret->concurrency = n;
+      } else if (key == "duration_sec") {
+        ret->duration = std::chrono::seconds(n);
+      } else if (key == "threads") {
+        ret->threads = n;
+      } else if (key == "ramp_steps") {
+        ret->ramp_steps = n;
+      } else {
+        return absl::InvalidArgumentError(absl::StrCat("unknown arg: ", key));
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      return absl::InvalidArgumentError(absl::StrCat("bad value: ", arg));
+    }
+  }
+  if (ret->connections == 0 || ret->concurrency == 0 || ret->threads == 0) {
+    return absl::InvalidArgumentError(
+        "connections, concurrency and threads need to be positive");
+  }
+  if (ret->arrival != loadgen_arrival::closed && ret->rate == 0) {
+    return absl::InvalidArgumentError("open loop arrival needs a rate");
+  }
+  if (ret->ramp_steps != 0 && ret->arrival == loadgen_arrival::closed) {
+    return absl::InvalidArgumentError("ramp needs open loop arrival");
+  }
+  return absl::OkStatus();
+}
+
+std::string loadgen_usage() {
+  return "options:\n"
+         "  --host=localhost     server host\n"
+         "  --port=12345         server port\n"
+         "  --method=<path>      method to run, i.e. /pkg.Service/Method. "
+         "All if not set\n"
+         "  --requests=<dir>     dir of <pkg.Service>.<Method>.bin sample "
+         "requests\n"
+         "  --connections=1      client connections\n"
+         "  --concurrency=1      requests in flight per connection\n"
+         "  --rate=0             total requests per second. 0 is unlimited\n"
+         "  --arrival=closed     closed, or open loop fixed or poisson. Open "
+         "loop\n"
+         "                       latency is from the intended send time\n"
+         "  --ramp_steps=0       open loop runs of increasing rate to find "
+         "the knee\n"
+         "  --ramp_step=<rate>   rate increase of each ramp step\n"
+         "  --duration_sec=5     seconds to run each method\n"
+         "  --threads=1          threads running the clients\n";
+}
+
+bool loadgen_selected(const loadgen_options &options,
+                      const method_descriptor &method) {
+  return options.method.empty() || options.method == method.path;
+}
+
+absl::Status load_sample_request(const loadgen_options &options,
+                                 const method_descriptor &method,
+                                 google::protobuf::MessageLite *ret) {
+  if (options.requests.empty()) {
+    return absl::NotFoundError("no requests dir");
+  }
+  std::string path = absl::StrCat(options.requests, "/", method.service, ".",
+                                  method.name, ".bin");
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return absl::NotFoundError(absl::StrCat("cannot open ", path));
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  if (!ret->ParseFromString(ss.str())) {
+    return absl::InvalidArgumentError(absl::StrCat("cannot parse ", path));
+  }
+  return absl::OkStatus();
+}
+
+void loadgen_stats::merge(const loadgen_stats &other) {
+  if (failed == 0 && other.failed != 0) {
+    first_error = other.first_error;
+  }
+  ok += other.ok;
+  failed += other.failed;
+  latency.merge(other.latency);
+}
+
+bool loadgen_saturated(loadgen_result &first, loadgen_result &step) {
+  double seconds = step.elapsed.count();
+  if (seconds <= 0 || step.stats.ok / seconds < 0.95 * step.offered_rate) {
+    return true;
+  }
+  return step.stats.latency.percentile(0.99) >
+         10 * first.stats.latency.percentile(0.99);
+}
+
+void print_loadgen_result(std::string_view method, loadgen_result &result,
+                          std::ostream &os) {
+  os << "method " << method << std::endl;
+  if (!result.status.ok()) {
+    os << "  failed to start: " << result.status.ToString() << std::endl;
+    return;
+  }
+  loadgen_stats &stats = result.stats;
+  double seconds = result.elapsed.count();
+  os << "  ok " << stats.ok << " failed " << stats.failed << " in " << seconds
+     << " s" << std::endl;
+  if (stats.failed != 0) {
+    os << "  first error: " << stats.first_error.ToString() << std::endl;
+  }
+  if (seconds > 0) {
+    os << "  req/s: " << stats.ok / seconds << std::endl;
+  }
+  if (result.offered_rate > 0) {
+    os << "  offered req/s: " << result.offered_rate << " max in flight "
+       << result.max_outstanding << std::endl;
+  }
+  auto us = [&](double q) {
+    return std::chrono::duration<double, std::micro>(
+               stats.latency.percentile(q))
+        .count();
+  };
+  os << "  latency us: p50 " << us(0.5) << " p90 " << us(0.9) << " p99 "
+     << us(0.99) << " p999 " << us(0.999) << " max " << us(1) << std::endl;
+}
+
+void print_loadgen_ramp_result(std::string_view method,
+                               loadgen_ramp_result &result,
+                               std::ostream &os) {
+  os << "method " << method << " ramp" << std::endl;
+  for (loadgen_result &step : result.steps) {
+    double seconds = step.elapsed.count();
+    os << "  offered req/s " << step.offered_rate << " done req/s "
+       << (seconds > 0 ? step.stats.ok / seconds : 0) << " failed "
+       << step.stats.failed << " p99 us "
+       << std::chrono::duration<double, std::micro>(
+              step.stats.latency.percentile(0.99))
+              .count()
+       << " max in flight " << step.max_outstanding << std::endl;
+  }
+  if (!result.status.ok()) {
+    os << "  failed: " << result.status.ToString() << std::endl;
+    return;
+  }
+  os << "  knee req/s: " << result.knee_rate << std::endl;
+}
+
+} // namespace fabricrpc
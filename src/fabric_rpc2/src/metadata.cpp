@@ -0,0 +1,344 @@
+#include "fabricrpc/metadata.hpp"
+
+#include <array>
+
+namespace fabricrpc {
+
+namespace {
+
+// well known keys. Index in the table is position + 1.
+// Only append to this list, since peers need to agree on it.
+constexpr std::array<std::string_view, 20> static_table = {
+    "authorization", "trace-id",      "span-id",        "parent-span-id",
+    "traceparent",   "tracestate",    "baggage",        "request-id",
+    "tenant",        "user-id",       "session-id",     "user-agent",
+    "client-version", "content-type", "accept-language", "locale",
+    "deadline",      "retry-attempt", "idempotency-key", "priority"};
+
+// representations, by the high bits of the first byte.
+constexpr std::uint8_t indexed_pair = 0x80;
+constexpr std::uint8_t literal_insert = 0x40;
+constexpr std::uint8_t literal = 0x00;
+
+// pairs seen once are forgotten after this many.
+constexpr std::size_t max_seen = 256;
+
+std::size_t entry_size(std::string_view key, std::string_view value) {
+  return key.size() + value.size() + metadata_entry_overhead;
+}
+
+// integer with an n bit prefix in the first byte, as in HPACK.
+void write_int(std::uint32_t value, int prefix_bits, std::uint8_t flags,
+               std::string *ret) {
+  std::uint32_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    ret->push_back(static_cast<char>(flags | value));
+    return;
+  }
+  ret->push_back(static_cast<char>(flags | max_prefix));
+  value -= max_prefix;
+  while (value >= 0x80) {
+    ret->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  ret->push_back(static_cast<char>(value));
+}
+
+absl::Status read_int(std::string_view in, std::size_t *pos, int prefix_bits,
+                      std::uint32_t *ret) {
+  if (*pos >= in.size()) {
+    return absl::InvalidArgumentError("metadata is truncated");
+  }
+  std::uint32_t max_prefix = (1u << prefix_bits) - 1;
+  std::uint32_t value = static_cast<std::uint8_t>(in[*pos]) & max_prefix;
+  (*pos)++;
+  if (value < max_prefix) {
+    *ret = value;
+    return absl::OkStatus();
+  }
+  for (int shift = 0;; shift += 7) {
+    if (*pos >= in.size()) {
+      return absl::InvalidArgumentError("metadata is truncated");
+    }
+    if (shift > 21) {
+      return absl::InvalidArgumentError("metadata integer is too large");
+    }
+    std::uint8_t b = static_cast<std::uint8_t>(in[*pos]);
+    (*pos)++;
+    value += static_cast<std::uint32_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      break;
+    }
+  }
+  *ret = value;
+  return absl::OkStatus();
+}
+
+void write_string(std::string_view s, std::string *ret) {
+  write_int(static_cast<std::uint32_t>(s.size()), 8, 0, ret);
+  ret->append(s);
+}
+
+// literal pair, with the key string if name index is 0.
+void write_literal(std::uint8_t flags, std::uint32_t name,
+                   std::string_view key, std::string_view value,
+                   std::string *ret) {
+  write_int(name, 6, flags, ret);
+  if (name == 0) {
+    write_string(key, ret);
+  }
+  write_string(value, ret);
+}
+
+absl::Status read_string(std::string_view in, std::size_t *pos,
+                         std::string_view *ret) {
+  std::uint32_t size = 0;
+  absl::Status st = read_int(in, pos, 8, &size);
+  if (!st.ok()) {
+    return st;
+  }
+  if (in.size() - *pos < size) {
+    return absl::InvalidArgumentError("metadata is truncated");
+  }
+  *ret = in.substr(*pos, size);
+  *pos += size;
+  return absl::OkStatus();
+}
+
+} // namespace
+
+std::optional<std::string_view> metadata::get(std::string_view key) const {
+  for (const entry &e : entries_) {
+    if (e.first == key) {
+      return e.second;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string_view>
+metadata_view::get(std::string_view key) const {
+  for (const entry &e : entries_) {
+    if (e.first == key) {
+      return e.second;
+    }
+  }
+  return std::nullopt;
+}
+
+void metadata_view::copy_to(metadata *ret) const {
+  for (const entry &e : entries_) {
+    ret->add(std::string(e.first), std::string(e.second));
+  }
+}
+
+std::uint32_t metadata_static_index(std::string_view key) {
+  for (std::size_t i = 0; i < static_table.size(); i++) {
+    if (static_table[i] == key) {
+      return static_cast<std::uint32_t>(i + 1);
+    }
+  }
+  return 0;
+}
+
+std::uint32_t metadata_static_size() {
+  return static_cast<std::uint32_t>(static_table.size());
+}
+
+metadata_encoder::metadata_encoder()
+    : mtx_(), slots_(), key_slots_(), seen_(), next_slot_(0), table_size_(0),
+      acked_(), acked_count_(0) {}
+
+std::uint32_t metadata_encoder::name_index(const std::string &key) {
+  std::uint32_t index = metadata_static_index(key);
+  if (index != 0) {
+    return index;
+  }
+  auto it = key_slots_.find(key);
+  if (it != key_slots_.end() && acked_[it->second]) {
+    return metadata_static_size() + 1 + it->second;
+  }
+  return 0;
+}
+
+void metadata_encoder::encode(const metadata &md, std::string *ret) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  for (const metadata::entry &e : md.entries()) {
+    const std::string &key = e.first;
+    const std::string &value = e.second;
+    std::uint32_t static_index = metadata_static_index(key);
+    if (value.empty() && static_index != 0) {
+      write_int(static_index, 7, indexed_pair, ret);
+      continue;
+    }
+    auto it = slots_.find(e);
+    if (it != slots_.end() && acked_[it->second]) {
+      write_int(metadata_static_size() + 1 + it->second, 7, indexed_pair,
+                ret);
+      continue;
+    }
+    std::uint32_t name = name_index(key);
+    if (it != slots_.end()) {
+      // peer does not have the slot yet, or the insert was lost. Peer takes
+      // the same insert again.
+      write_literal(literal_insert, name, key, value, ret);
+      write_int(it->second, 8, 0, ret);
+      continue;
+    }
+    if (seen_.contains(e) && next_slot_ < metadata_table_max_entries &&
+        table_size_ + entry_size(key, value) <= metadata_table_max_size) {
+      // second time of the pair, insert it.
+      std::uint32_t slot = next_slot_++;
+      table_size_ += entry_size(key, value);
+      slots_.insert({e, slot});
+      key_slots_.try_emplace(key, slot);
+      seen_.erase(e);
+      write_literal(literal_insert, name, key, value, ret);
+      write_int(slot, 8, 0, ret);
+      continue;
+    }
+    if (seen_.size() >= max_seen) {
+      seen_.clear();
+    }
+    seen_.insert(e);
+    // pair is not in the table.
+    write_literal(literal, name, key, value, ret);
+  }
+}
+
+void metadata_encoder::on_ack(std::uint32_t count, std::string_view slots) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (count > next_slot_) {
+    // peer cannot have slots not sent.
+    return;
+  }
+  for (; acked_count_ < count; acked_count_++) {
+    acked_.set(acked_count_);
+  }
+  for (std::size_t i = 0; i < slots.size(); i++) {
+    std::uint8_t bits = static_cast<std::uint8_t>(slots[i]);
+    for (std::uint32_t b = 0; bits != 0; b++, bits >>= 1) {
+      std::size_t slot = count + 1 + i * 8 + b;
+      if ((bits & 1) != 0 && slot < next_slot_) {
+        acked_.set(slot);
+      }
+    }
+  }
+}
+
+metadata_decoder::metadata_decoder()
+    : mtx_(), slots_(), table_size_(0), acked_(0) {}
+
+absl::Status metadata_decoder::lookup(std::uint32_t index,
+                                      std::string_view *key,
+                                      std::string_view *value) {
+  if (index == 0) {
+    return absl::InvalidArgumentError("metadata index is 0");
+  }
+  if (index <= metadata_static_size()) {
+    *key = static_table[index - 1];
+    *value = std::string_view();
+    return absl::OkStatus();
+  }
+  std::size_t slot = index - metadata_static_size() - 1;
+  if (slot >= slots_.size() || !slots_[slot].has_value()) {
+    return absl::InvalidArgumentError("metadata index not in table");
+  }
+  *key = slots_[slot]->first;
+  *value = slots_[slot]->second;
+  return absl::OkStatus();
+}
+
+absl::Status metadata_decoder::decode(std::string_view in,
+                                      metadata_view *ret) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  std::size_t pos = 0;
+  while (pos < in.size()) {
+    std::uint8_t first = static_cast<std::uint8_t>(in[pos]);
+    std::string_view key;
+    std::string_view value;
+    absl::Status st;
+    if (first & indexed_pair) {
+      std::uint32_t index = 0;
+      st = read_int(in, &pos, 7, &index);
+      if (st.ok()) {
+        st = lookup(index, &key, &value);
+      }
+      if (!st.ok()) {
+        return st;
+      }
+      ret->add(key, value);
+      continue;
+    }
+    bool insert = (first & literal_insert) != 0;
+    std::uint32_t name = 0;
+    st = read_int(in, &pos, 6, &name);
+    if (st.ok() && name == 0) {
+      st = read_string(in, &pos, &key);
+    } else if (st.ok()) {
+      std::string_view ignored;
+      st = lookup(name, &key, &ignored);
+    }
+    if (st.ok()) {
+      st = read_string(in, &pos, &value);
+    }
+    if (!st.ok()) {
+      return st;
+    }
+    if (!insert) {
+      ret->add(key, value);
+      continue;
+    }
+    std::uint32_t slot = 0;
+    st = read_int(in, &pos, 8, &slot);
+    if (!st.ok()) {
+      return st;
+    }
+    if (slot >= metadata_table_max_entries) {
+      return absl::InvalidArgumentError("metadata slot out of range");
+    }
+    if (slot < slots_.size() && slots_[slot].has_value()) {
+      // peer sends an insert again until it is acked.
+      if (slots_[slot]->first != key || slots_[slot]->second != value) {
+        return absl::InvalidArgumentError("metadata slot already in use");
+      }
+      ret->add(slots_[slot]->first, slots_[slot]->second);
+      continue;
+    }
+    if (table_size_ + entry_size(key, value) > metadata_table_max_size) {
+      return absl::InvalidArgumentError("metadata table is full");
+    }
+    if (slot >= slots_.size()) {
+      slots_.resize(slot + 1);
+    }
+    slots_[slot].emplace(std::string(key), std::string(value));
+    table_size_ += entry_size(key, value);
+    while (acked_ < slots_.size() && slots_[acked_].has_value()) {
+      acked_++;
+    }
+    // views point into the table copy.
+    ret->add(slots_[slot]->first, slots_[slot]->second);
+  }
+  return absl::OkStatus();
+}
+
+std::uint32_t metadata_decoder::ack(std::string *slots) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (slots != nullptr) {
+    slots->clear();
+    for (std::size_t slot = acked_ + 1; slot < slots_.size(); slot++) {
+      if (!slots_[slot].has_value()) {
+        continue;
+      }
+      std::size_t i = slot - acked_ - 1;
+      if (slots->size() <= i / 8) {
+        slots->resize(i / 8 + 1);
+      }
+      (*slots)[i / 8] = static_cast<char>(
+          static_cast<std::uint8_t>((*slots)[i / 8]) | (1u << (i % 8)));
+    }
+  }
+  return acked_;
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,105 @@
+#include "fabricrpc/method_policy.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace fabricrpc {
+
+void method_stats::merge(const method_stats &other) {
+  calls += other.calls;
+  parse_failed += other.parse_failed;
+  handler_failed += other.handler_failed;
+  serialize_failed += other.serialize_failed;
+  latency.merge(other.latency);
+  handler_latency.merge(other.handler_latency);
+}
+
+namespace {
+
+// stats recorded by one thread. The lock is only contended while stats are
+// collected.
+struct thread_slot {
+  std::mutex mtx;
+  std::unordered_map<const method_descriptor *, method_stats> stats;
+};
+
+// slots of all threads. Slots of exited threads are kept so that their
+// stats are not lost.
+class slot_registry {
+public:
+  std::shared_ptr<thread_slot> add() {
+    std::shared_ptr<thread_slot> slot = std::make_shared<thread_slot>();
+    std::lock_guard<std::mutex> lock(mtx_);
+    slots_.push_back(slot);
+    return slot;
+  }
+
+  std::vector<method_stats> collect() {
+    std::map<std::string_view, method_stats> merged;
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const std::shared_ptr<thread_slot> &slot : slots_) {
+      std::lock_guard<std::mutex> slot_lock(slot->mtx);
+      for (const auto &[method, stats] : slot->stats) {
+        method_stats &m = merged[method->path];
+        m.method = method;
+        m.merge(stats);
+      }
+    }
+    std::vector<method_stats> ret;
+    for (auto &[path, stats] : merged) {
+      ret.push_back(std::move(stats));
+    }
+    return ret;
+  }
+
+private:
+  std::mutex mtx_;
+  std::vector<std::shared_ptr<thread_slot>> slots_;
+};
+
+slot_registry &registry() {
+  static slot_registry r;
+  return r;
+}
+
+thread_slot &local_slot() {
+  thread_local std::shared_ptr<thread_slot> slot = registry().add();
+  return *slot;
+}
+
+} // namespace
+
+namespace details {
+
+void record_method_call(const method_descriptor &method,
+                        const method_call_sample &sample) {
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  thread_slot &slot = local_slot();
+  std::lock_guard<std::mutex> lock(slot.mtx);
+  method_stats &stats = slot.stats[&method];
+  stats.calls++;
+  stats.latency.record(end - sample.start);
+  if (sample.parse_failed) {
+    stats.parse_failed++;
+    return;
+  }
+  // handler did not return if the call was cancelled.
+  if (sample.handled >= sample.parsed) {
+    stats.handler_latency.record(sample.handled - sample.parsed);
+  }
+  if (sample.handler_failed) {
+    stats.handler_failed++;
+  } else if (sample.serialize_failed) {
+    stats.serialize_failed++;
+  }
+}
+
+} // namespace details
+
+std::vector<method_stats> collect_method_stats() {
+  return registry().collect();
+}
+
+} // namespace fabricrpc
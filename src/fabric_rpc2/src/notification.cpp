@@ -0,0 +1,41 @@
+#include "fabricrpc/notification.hpp"
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+
+namespace fabricrpc {
+
+absl::Status serialize_notification(const std::string &topic,
+                                    const google::protobuf::MessageLite &msg,
+                                    std::string *header, std::string *body) {
+  if (header == nullptr || body == nullptr) {
+    return absl::InvalidArgumentError("serialize_notification has nullptr");
+  }
+  if (topic.empty()) {
+    return absl::InvalidArgumentError("notification topic is empty");
+  }
+  fabricrpc::callback_header h;
+  h.set_topic(topic);
+  if (!h.SerializeToString(header)) {
+    return absl::InternalError("cannot serialize notification header");
+  }
+  if (!msg.SerializeToString(body)) {
+    return absl::InternalError("cannot serialize notification");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status send_notification(IFabricTransportClientConnection *conn,
+                               std::string header, std::string body) {
+  winrt::com_ptr<IFabricTransportMessage> msg =
+      winrt::make<fabricrpc::tool_transport_msg>(std::move(body),
+                                                 std::move(header));
+  // send is one way. Transport owns the message after this.
+  HRESULT hr = conn->Send(msg.get());
+  if (hr != S_OK) {
+    return absl::UnavailableError("failed to send notification");
+  }
+  return absl::OkStatus();
+}
+
+} // namespace fabricrpc
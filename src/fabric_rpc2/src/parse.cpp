@@ -5,12 +5,7 @@
 
 namespace fabricrpc {
 // convert
-absl::Status status_from_header(const reply_header *h) {
-  if (h == nullptr) {
-    return absl::InvalidArgumentError("parse_from_header has nullptr");
-  }
-
-  int ec_raw = h->status_code();
+absl::Status status_from_code(int ec_raw, const std::string &message) {
   absl::StatusCode ec = static_cast<absl::StatusCode>(ec_raw);
   if (ec > absl::StatusCode::
                kDoNotUseReservedForFutureExpansionUseDefaultInSwitchInstead_ ||
@@ -18,10 +13,16 @@ absl::Status status_from_header(const reply_header *h) {
     return absl::InvalidArgumentError(
         absl::StrCat("reply_header has unknown statuscode: ", ec_raw));
   }
-  const std::string &message = h->status_message();
   return absl::Status(ec, message);
 }
 
+absl::Status status_from_header(const reply_header *h) {
+  if (h == nullptr) {
+    return absl::InvalidArgumentError("parse_from_header has nullptr");
+  }
+  return status_from_code(h->status_code(), h->status_message());
+}
+
 // public api
 absl::Status parse_reply_header(const std::string &data) {
   reply_header h;
@@ -33,6 +34,17 @@ absl::Status parse_reply_header(const std::string &data) {
   return ec;
 }
 
+absl::Status parse_reply_header(const std::string &data, reply_header *ret) {
+  if (ret == nullptr) {
+    return absl::InvalidArgumentError("parse_reply_header has nullptr");
+  }
+  absl::Status ec = parse_proto_payload(data, ret);
+  if (!ec.ok()) {
+    return ec;
+  }
+  return status_from_header(ret);
+}
+
 absl::Status parse_proto_payload(const std::string_view data,
                                  google::protobuf::MessageLite *ret) {
   if (ret == nullptr) {
@@ -71,6 +83,18 @@ absl::Status parse_request_header(const std::string &data,
   return absl::OkStatus();
 }
 
+absl::Status parse_request_header(const std::string &data,
+                                  request_header *ret) {
+  if (ret == nullptr) {
+    return absl::InvalidArgumentError("parse_request_header has nullptr");
+  }
+  bool ok = ret->ParseFromString(data);
+  if (!ok) {
+    return absl::InvalidArgumentError("cannot parse request header");
+  }
+  return absl::OkStatus();
+}
+
 absl::Status serialize_reply_header(absl::Status st, std::string *ret) {
   // make the transport msg
   fabricrpc::reply_header header;
@@ -79,4 +103,60 @@ absl::Status serialize_reply_header(absl::Status st, std::string *ret) {
   return serialize_proto_payload(&header, ret);
 }
 
+absl::Status serialize_reply_header(absl::Status st, reply_header *header,
+                                    std::string *ret) {
+  if (header == nullptr) {
+    return absl::InvalidArgumentError("serialize_reply_header has nullptr");
+  }
+  header->set_status_code(st.raw_code());
+  header->set_status_message(st.message());
+  return serialize_proto_payload(header, ret);
+}
+
+absl::Status
+serialize_batch_reply_header(const std::vector<absl::Status> &sts,
+                             const std::vector<std::string> &bodies,
+                             std::string *ret) {
+  if (sts.size() != bodies.size()) {
+    return absl::InvalidArgumentError(
+        "serialize_batch_reply_header size mismatch");
+  }
+  fabricrpc::reply_header header;
+  absl::Status ok = absl::OkStatus();
+  header.set_status_code(ok.raw_code());
+  header.set_status_message(ok.message());
+  for (std::size_t i = 0; i < sts.size(); i++) {
+    fabricrpc::batch_item_status *item = header.add_batch_status();
+    item->set_status_code(sts[i].raw_code());
+    item->set_status_message(sts[i].message());
+    item->set_body_size(static_cast<std::uint32_t>(bodies[i].size()));
+  }
+  return serialize_proto_payload(&header, ret);
+}
+
+absl::Status parse_batch_reply_header(const std::string &data,
+                                      std::vector<absl::Status> *item_sts,
+                                      std::vector<std::uint32_t> *item_sizes) {
+  if (item_sts == nullptr || item_sizes == nullptr) {
+    return absl::InvalidArgumentError("parse_batch_reply_header has nullptr");
+  }
+  reply_header h;
+  absl::Status ec = parse_proto_payload(data, &h);
+  if (!ec.ok()) {
+    return ec;
+  }
+  ec = status_from_header(&h);
+  if (!ec.ok()) {
+    return ec;
+  }
+  item_sts->clear();
+  item_sizes->clear();
+  for (const fabricrpc::batch_item_status &item : h.batch_status()) {
+    item_sts->push_back(
+        status_from_code(item.status_code(), item.status_message()));
+    item_sizes->push_back(item.body_size());
+  }
+  return absl::OkStatus();
+}
+
 } // namespace fabricrpc
\ No newline at end of file
@@ -8,7 +8,9 @@ namespace fabricrpc {
 request::request(std::wstring id, winrt::com_ptr<IFabricTransportMessage> msg,
                  winrt::com_ptr<IFabricAsyncOperationCallback> callback,
                  winrt::com_ptr<IFabricAsyncOperationContext> ctx)
-    : id_(id), msg_(msg), callback_(callback), ctx_(ctx) {}
+    : id_(id), msg_(msg), callback_(callback), ctx_(ctx), span_() {
+  span_.mark(span_point::arrival);
+}
 
 request_context *request::get_request_context() {
   request_context *res = dynamic_cast<request_context *>(this->ctx_.get());
@@ -19,6 +21,10 @@ request_context *request::get_request_context() {
 // raw complete. lowest level
 void request::complete(HRESULT hr,
                        winrt::com_ptr<IFabricTransportMessage> reply_msg) {
+  if (this->is_one_way()) {
+    // nobody waits for the reply.
+    return;
+  }
   if (hr == S_OK) {
     assert(reply_msg);
   }
@@ -33,6 +39,7 @@ void request::complete(HRESULT hr,
   // EndProcessRequest will be invoked by transport and msg will be extracted
   // there.
   ctx->complete();
+  span_.mark(span_point::completed);
 }
 
 void request::complete_rpc_error(absl::Status st) {
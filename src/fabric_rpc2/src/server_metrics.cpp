@@ -0,0 +1,218 @@
+#include "fabricrpc/server_metrics.hpp"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fabricrpc {
+
+namespace {
+
+constexpr std::size_t metric_count =
+    static_cast<std::size_t>(server_metric::count);
+
+// values added by one thread. Only the owning thread writes, so adds need no
+// lock or read-modify-write.
+struct metric_slot {
+  std::array<std::atomic<std::int64_t>, metric_count> values{};
+};
+
+// slots of live threads. A thread folds its slot into retired_ when it
+// exits, so that gauges it moved still add up and slots do not pile up.
+class metric_slot_registry {
+public:
+  metric_slot *add() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    slots_.push_back(std::make_unique<metric_slot>());
+    return slots_.back().get();
+  }
+
+  void retire(metric_slot *slot) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (std::size_t i = 0; i < metric_count; i++) {
+      retired_[i] += slot->values[i].load(std::memory_order_relaxed);
+    }
+    std::erase_if(slots_, [slot](const std::unique_ptr<metric_slot> &s) {
+      return s.get() == slot;
+    });
+  }
+
+  server_metrics collect() {
+    server_metrics ret;
+    std::lock_guard<std::mutex> lock(mtx_);
+    ret.values = retired_;
+    for (const std::unique_ptr<metric_slot> &slot : slots_) {
+      for (std::size_t i = 0; i < metric_count; i++) {
+        ret.values[i] += slot->values[i].load(std::memory_order_relaxed);
+      }
+    }
+    return ret;
+  }
+
+  std::size_t slot_count() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return slots_.size();
+  }
+
+private:
+  std::mutex mtx_;
+  std::vector<std::unique_ptr<metric_slot>> slots_;
+  std::array<std::int64_t, metric_count> retired_{};
+};
+
+// never destroyed, since threads that exit during static destruction, i.e.
+// transport workers, still retire their slots.
+metric_slot_registry &registry() {
+  static metric_slot_registry *r = new metric_slot_registry();
+  return *r;
+}
+
+// slot of the calling thread, retired when the thread exits.
+class local_slot_holder {
+public:
+  local_slot_holder() : slot_(registry().add()) {}
+  ~local_slot_holder() { registry().retire(slot_); }
+
+  local_slot_holder(const local_slot_holder &) = delete;
+  local_slot_holder &operator=(const local_slot_holder &) = delete;
+
+  metric_slot &get() { return *slot_; }
+
+private:
+  metric_slot *slot_;
+};
+
+metric_slot &local_slot() {
+  thread_local local_slot_holder holder;
+  return holder.get();
+}
+
+// urls kept by url_registry.
+constexpr std::size_t max_urls = 256;
+
+// stats of one url, shared by all threads. Counters and histograms are
+// updated without a lock.
+struct url_record {
+  std::atomic<std::uint64_t> calls{0};
+  std::atomic<std::uint64_t> failed{0};
+  latency_histogram latency;
+  latency_histogram handler_latency;
+};
+
+// records of recorded urls, kept for the life of the process.
+class url_registry {
+public:
+  // nullptr if the registry is full.
+  url_record *get(const std::string &url) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mtx_);
+      auto it = records_.find(url);
+      if (it != records_.end()) {
+        return it->second.get();
+      }
+    }
+    std::lock_guard<std::shared_mutex> lock(mtx_);
+    auto it = records_.find(url);
+    if (it != records_.end()) {
+      return it->second.get();
+    }
+    if (records_.size() >= max_urls) {
+      return nullptr;
+    }
+    return records_.emplace(url, std::make_unique<url_record>())
+        .first->second.get();
+  }
+
+  std::vector<url_stats> collect() {
+    std::vector<url_stats> ret;
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    for (const auto &[url, record] : records_) {
+      url_stats &s = ret.emplace_back();
+      s.url = url;
+      s.calls = record->calls.load(std::memory_order_relaxed);
+      s.failed = record->failed.load(std::memory_order_relaxed);
+      s.latency = record->latency;
+      s.handler_latency = record->handler_latency;
+    }
+    return ret;
+  }
+
+private:
+  std::shared_mutex mtx_;
+  std::map<std::string, std::unique_ptr<url_record>> records_;
+};
+
+// never destroyed like registry(), since threads cache its records.
+url_registry &urls() {
+  static url_registry *r = new url_registry();
+  return *r;
+}
+
+// records seen by the calling thread, so that calls do not take the registry
+// lock.
+url_record *local_url_record(const std::string &url) {
+  thread_local std::unordered_map<std::string, url_record *> cache;
+  auto it = cache.find(url);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  url_record *record = urls().get(url);
+  if (record != nullptr) {
+    cache.emplace(url, record);
+  }
+  return record;
+}
+
+} // namespace
+
+const char *server_metric_name(server_metric metric) {
+  switch (metric) {
+  case server_metric::in_flight:
+    return "in_flight";
+  case server_metric::queued:
+    return "queued";
+  case server_metric::accepted:
+    return "accepted";
+  case server_metric::rejected:
+    return "rejected";
+  case server_metric::bytes_in:
+    return "bytes_in";
+  case server_metric::bytes_out:
+    return "bytes_out";
+  default:
+    return "unknown";
+  }
+}
+
+void add_server_metric(server_metric metric, std::int64_t n) {
+  std::atomic<std::int64_t> &v =
+      local_slot().values[static_cast<std::size_t>(metric)];
+  v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+server_metrics collect_server_metrics() { return registry().collect(); }
+
+std::size_t server_metric_threads() { return registry().slot_count(); }
+
+void record_url_call(const std::string &url, bool failed,
+                     std::chrono::nanoseconds latency,
+                     std::chrono::nanoseconds handler_latency) {
+  url_record *record = local_url_record(url);
+  if (record == nullptr) {
+    return;
+  }
+  record->calls.fetch_add(1, std::memory_order_relaxed);
+  if (failed) {
+    record->failed.fetch_add(1, std::memory_order_relaxed);
+  }
+  record->latency.record(latency);
+  record->handler_latency.record(handler_latency);
+}
+
+std::vector<url_stats> collect_url_stats() { return urls().collect(); }
+
+} // namespace fabricrpc
@@ -0,0 +1,88 @@
+#include "fabricrpc/server_reader.hpp"
+
+#include "boost/asio/use_awaitable.hpp"
+
+#include <cassert>
+
+namespace fabricrpc {
+
+server_reader::server_reader(const net::any_io_executor &ex)
+    : mtx_(), chunks_(), ev_(std::make_shared<basic_event<>>(ex)),
+      done_(false), status_() {}
+
+net::awaitable<bool> server_reader::read(google::protobuf::MessageLite *msg) {
+  client_stream_chunk chunk;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (done_) {
+        co_return false;
+      }
+      if (!chunks_.empty()) {
+        chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        break;
+      }
+      // push sets the event after this.
+      ev_->reset();
+    }
+    co_await ev_->async_wait(net::use_awaitable);
+  }
+
+  // sender can be acked now.
+  if (chunk.consumed) {
+    chunk.consumed->set();
+  }
+  if (chunk.end_of_stream) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    done_ = true;
+    co_return false;
+  }
+  absl::Status st = fabricrpc::parse_proto_payload(chunk.body, msg);
+  if (!st.ok()) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    done_ = true;
+    status_ = st;
+    co_return false;
+  }
+  co_return true;
+}
+
+void server_reader::push(client_stream_chunk chunk) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (done_) {
+    // handler does not read any more.
+    if (chunk.consumed) {
+      chunk.consumed->set();
+    }
+    return;
+  }
+  chunks_.push_back(std::move(chunk));
+  ev_->set();
+}
+
+void server_reader::close() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  done_ = true;
+  for (client_stream_chunk &chunk : chunks_) {
+    if (chunk.consumed) {
+      chunk.consumed->set();
+    }
+  }
+  chunks_.clear();
+  // wakes a pending read.
+  ev_->set();
+}
+
+void server_reader::fail(absl::Status st) {
+  assert(!st.ok());
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!done_) {
+      status_ = std::move(st);
+    }
+  }
+  this->close();
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,100 @@
+#include "fabricrpc/server_writer.hpp"
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+
+#include "boost/asio/use_awaitable.hpp"
+
+#include <algorithm>
+
+namespace fabricrpc {
+
+server_writer::server_writer(
+    winrt::com_ptr<IFabricTransportClientConnection> conn,
+    std::uint64_t stream_id, const net::any_io_executor &ex,
+    std::uint32_t window)
+    : conn_(conn), stream_id_(stream_id), window_(window), finished_(false),
+      mtx_(), sequence_(0), acked_(0), cancelled_(false),
+      ev_(std::make_shared<basic_event<>>(ex)) {}
+
+net::awaitable<absl::Status>
+server_writer::write(const google::protobuf::MessageLite &msg) {
+  if (finished_) {
+    co_return absl::FailedPreconditionError("stream is finished");
+  }
+  std::string body;
+  if (!msg.SerializeToString(&body)) {
+    co_return absl::InternalError("cannot serialize stream chunk");
+  }
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (cancelled_) {
+        finished_ = true;
+        co_return absl::UnavailableError("client is gone");
+      }
+      if (window_ == 0 || sequence_ - acked_ < window_) {
+        break;
+      }
+      // on_ack sets the event after this.
+      ev_->reset();
+    }
+    co_await ev_->async_wait(net::use_awaitable);
+  }
+  co_return this->send(std::move(body), false, absl::OkStatus());
+}
+
+absl::Status server_writer::finish(const absl::Status &st) {
+  if (finished_) {
+    return absl::FailedPreconditionError("stream is finished");
+  }
+  finished_ = true;
+  return this->send("", true, st);
+}
+
+void server_writer::on_ack(std::uint64_t acked) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  // client cannot have read chunks not sent. A larger ack would wrap the
+  // window check in write.
+  acked = std::min(acked, sequence_);
+  // acks may arrive out of order.
+  if (acked > acked_) {
+    acked_ = acked;
+    ev_->set();
+  }
+}
+
+void server_writer::cancel() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  cancelled_ = true;
+  ev_->set();
+}
+
+absl::Status server_writer::send(std::string body, bool end_of_stream,
+                                 const absl::Status &st) {
+  std::uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    sequence = sequence_++;
+  }
+  fabricrpc::callback_header header;
+  header.set_stream_id(stream_id_);
+  header.set_sequence(sequence);
+  header.set_end_of_stream(end_of_stream);
+  header.set_status_code(st.raw_code());
+  header.set_status_message(std::string(st.message()));
+
+  winrt::com_ptr<IFabricTransportMessage> msg =
+      winrt::make<fabricrpc::tool_transport_msg>(std::move(body),
+                                                 header.SerializeAsString());
+  // send is one way. Transport owns the message after this.
+  HRESULT hr = conn_->Send(msg.get());
+  if (hr != S_OK) {
+    // client is gone. no more chunks can be delivered.
+    finished_ = true;
+    return absl::UnavailableError("failed to send stream chunk");
+  }
+  return absl::OkStatus();
+}
+
+} // namespace fabricrpc
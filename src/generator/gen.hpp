@@ -7,6 +7,8 @@
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/descriptor.h>
 
+#include "fabricrpc_options.pb.h"
+
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 
@@ -25,6 +27,111 @@ std::string getProtoNameNoExt(std::string const &filename) {
   return proto_name;
 }
 
+// method is annotated with option (fabricrpc.one_way)
+bool isOneWay(const pb::MethodDescriptor *method) {
+  return method->options().GetExtension(fabricrpc::one_way);
+}
+
+// returns false and sets error if the one way option is misused.
+bool checkOneWay(const pb::FileDescriptor *file, std::string *error) {
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    for (int j = 0; j < service->method_count(); ++j) {
+      const pb::MethodDescriptor *method = service->method(j);
+      if (!isOneWay(method)) {
+        continue;
+      }
+      if (method->client_streaming() || method->server_streaming() ||
+          method->output_type()->full_name() != "google.protobuf.Empty") {
+        *error = "one_way method " + method->full_name() +
+                 " must be unary and return google.protobuf.Empty";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// fabricrpc::MethodKind of the method.
+std::string methodKind(const pb::MethodDescriptor *method) {
+  if (method->client_streaming() && method->server_streaming()) {
+    return "fabricrpc::MethodKind::BidiStreaming";
+  } else if (method->client_streaming()) {
+    return "fabricrpc::MethodKind::ClientStreaming";
+  } else if (method->server_streaming()) {
+    return "fabricrpc::MethodKind::ServerStreaming";
+  }
+  return "fabricrpc::MethodKind::Unary";
+}
+
+// generator parameters, i.e. protoc --grpc_opt=lite=true
+struct generatorOptions {
+  // messages are generated for libprotobuf-lite.
+  bool lite = false;
+};
+
+// parses comma separated key=value pairs into ret.
+bool parseOptions(const std::string &parameter, generatorOptions *ret,
+                  std::string *error) {
+  if (parameter.empty()) {
+    return true;
+  }
+  std::vector<std::string> pairs;
+  boost::split(pairs, parameter, boost::is_any_of(","));
+  for (const std::string &pair : pairs) {
+    std::size_t eq = pair.find('=');
+    std::string key = pair.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : pair.substr(eq + 1);
+    if (value != "true" && value != "false") {
+      *error = "parameter " + key + " needs to be true or false";
+      return false;
+    }
+    if (key == "lite") {
+      ret->lite = value == "true";
+    } else if (key == "arena") {
+      // request protos are owned by the begin operation of the runtime.
+      *error = "arena is only supported by fabric_rpc2_cpp_plugin";
+      return false;
+    } else {
+      *error = "unknown parameter " + key;
+      return false;
+    }
+  }
+  return true;
+}
+
+// with lite the messages of every method need to be generated with
+// optimize_for = LITE_RUNTIME, or the stubs pull in full protobuf.
+bool checkLite(const pb::FileDescriptor *file, const generatorOptions &options,
+               std::string *error) {
+  if (!options.lite) {
+    return true;
+  }
+  auto isLite = [](const pb::FileDescriptor *f) {
+    return f->options().optimize_for() == pb::FileOptions::LITE_RUNTIME;
+  };
+  if (!isLite(file)) {
+    *error = "lite=true needs option optimize_for = LITE_RUNTIME in " +
+             file->name();
+    return false;
+  }
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    for (int j = 0; j < service->method_count(); ++j) {
+      const pb::MethodDescriptor *method = service->method(j);
+      for (const pb::Descriptor *message :
+           {method->input_type(), method->output_type()}) {
+        if (!isLite(message->file())) {
+          *error = "lite=true but " + message->full_name() + " in " +
+                   message->file()->name() + " is not LITE_RUNTIME";
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 class printer {
 public:
   printer(std::string &output) : indent_(0), output_(output) {}
@@ -113,9 +220,14 @@ public:
           "#include <atlbase.h>\n"
           "#include <atlcom.h>\n"
           "#include \"fabricrpc/Operation.hpp\"\n"
+          "#include \"fabricrpc/Capabilities.hpp\"\n"
+          "#include \"fabricrpc/InProcChannel.hpp\"\n"
           "#include \"fabricrpc/FRPCHeader.hpp\"\n" // TODO: see if possible to
                                                     // get rid of this.
-    );
+          "#include <functional>\n"
+          "#include <memory>\n"
+          "#include <span>\n"
+          "#include <vector>\n");
 
     std::string services_code = GetHeaderServices(file_);
 
@@ -168,13 +280,27 @@ public:
     p.Add(vars, "static constexpr char const* service_full_name() {\n"
                 "  return \"$Package$$Service$\";\n"
                 "}\n");
+    for (int i = 0; i < service->method_count(); ++i) {
+      const pb::MethodDescriptor *method = service->method(i);
+      vars["Method"] = method->name();
+      vars["Kind"] = methodKind(method);
+      vars["OneWay"] = isOneWay(method) ? "true" : "false";
+      vars["Index"] = std::to_string(i);
+      p.Add(vars, "static constexpr fabricrpc::MethodDescriptor "
+                  "$Method$Descriptor = {\n"
+                  "    \"$Package$$Service$\", \"$Method$\", "
+                  "\"/$Package$$Service$/$Method$\",\n"
+                  "    $Kind$, $OneWay$, $Index$};\n");
+    }
 
-    // Server side - base
-    p.Add("class Service : public fabricrpc::MiddleWare {\n"
+    // Server side - base. Policy hooks each request, see
+    // fabricrpc/MethodPolicy.hpp.
+    p.Add("template <typename Policy = fabricrpc::NullMethodPolicy>\n"
+          "class BasicService : public fabricrpc::MiddleWare {\n"
           "  public:\n");
     p.Indent();
-    p.Add("Service() {};\n");
-    p.Add("virtual ~Service() {};\n");
+    p.Add("BasicService() {};\n");
+    p.Add("virtual ~BasicService() {};\n");
 
     // methods that user needs to implement
     for (int i = 0; i < service->method_count(); ++i) {
@@ -182,13 +308,11 @@ public:
     }
 
     // generated Routing method.
-    p.AddLn(vars,
-            "virtual fabricrpc::Status Route(const std::string & url, "
-            "std::unique_ptr<fabricrpc::IBeginOperation> & beginOp, "
-            "std::unique_ptr<fabricrpc::IEndOperation> & endOp) override;");
+    PrintRoute(p, service, vars);
 
     p.Outdent();
     p.Add("};\n");
+    p.Add("typedef BasicService<> Service;\n");
 
     p.Outdent();
     p.AddLn("};");
@@ -217,18 +341,14 @@ public:
     }
   }
 
-  // CC generation methods
-
-  void PrintCCService(printer &p,
-                      const google::protobuf::ServiceDescriptor *service,
-                      std::map<std::string, std::string> vars) {
-    // generate routing code.
-    vars["Service"] = service->name();
-
+  // routing code, in the header since the service is a template.
+  void PrintRoute(printer &p,
+                  const google::protobuf::ServiceDescriptor *service,
+                  std::map<std::string, std::string> vars) {
     p.AddLn(vars,
-            "fabricrpc::Status $Service$::Service::Route(const std::string & "
+            "fabricrpc::Status Route(const std::string & "
             "url, std::unique_ptr<fabricrpc::IBeginOperation> & beginOp, "
-            "std::unique_ptr<fabricrpc::IEndOperation> & endOp) {");
+            "std::unique_ptr<fabricrpc::IEndOperation> & endOp) override {");
     p.Indent();
     for (int i = 0; i < service->method_count(); ++i) {
       const google::protobuf::MethodDescriptor *method = service->method(i);
@@ -241,17 +361,19 @@ public:
       p.Add(vars, "if (url == \"/$Package$$Service$/$Method$\") {\n");
       p.Indent();
       p.Add(vars,
-            "auto bo = std::bind(&Service::Begin$Method$, this, "
+            "auto bo = std::bind(&BasicService::Begin$Method$, this, "
             "std::placeholders::_1,\n"
             "              std::placeholders::_2, std::placeholders::_3, "
             "std::placeholders::_4);\n"
-            "auto eo = std::bind(&Service::End$Method$, this, "
+            "auto eo = std::bind(&BasicService::End$Method$, this, "
             "std::placeholders::_1,\n"
             "              std::placeholders::_2);\n"
-            "beginOp = "
-            "std::make_unique<fabricrpc::BeginOperation<$Request$>>(bo);\n"
-            "endOp = "
-            "std::make_unique<fabricrpc::EndOperation<$Response$>>(eo);\n");
+            "beginOp = std::make_unique<\n"
+            "    fabricrpc::BeginOperation<$Request$, Policy>>(\n"
+            "    $Method$Descriptor, bo);\n"
+            "endOp = std::make_unique<\n"
+            "    fabricrpc::EndOperation<$Response$, Policy>>(\n"
+            "    $Method$Descriptor, eo);\n");
       p.Outdent();
       p.Add("}"); // TODO: the new line is ugly
     }
@@ -284,11 +406,6 @@ public:
 
     p.AddLn(vars, "namespace $Namespace$ {");
 
-    // printServiceRoutingCode(p, vars);
-    for (int i = 0; i < file->service_count(); ++i) {
-      PrintCCService(p, file->service(i), vars);
-    }
-
     // create the request handler
     p.AddLn("void CreateFabricRPCRequestHandler(const "
             "std::vector<std::shared_ptr<fabricrpc::MiddleWare>> & svcList,\n"
@@ -349,7 +466,11 @@ public:
     vars["Response"] = method->output_type()->name();
     bool no_streaming =
         !(method->client_streaming() || method->server_streaming());
-    if (no_streaming) {
+    if (isOneWay(method)) {
+      // server does not reply.
+      p.AddLn(vars,
+              "fabricrpc::Status Send$Method$(const $Request$* request);");
+    } else if (no_streaming) {
       p.AddLn(vars, "fabricrpc::Status Begin$Method$("
                     "const $Request$* request, "
                     "DWORD timeoutMilliseconds, "
@@ -358,6 +479,16 @@ public:
       p.AddLn(vars, "fabricrpc::Status End$Method$("
                     "IFabricAsyncOperationContext *context, /*out*/$Response$* "
                     "response);");
+      // batch sends all requests in one transport message.
+      p.AddLn(vars, "fabricrpc::Status BeginBatch$Method$("
+                    "std::span<const $Request$> requests, "
+                    "DWORD timeoutMilliseconds, "
+                    "IFabricAsyncOperationCallback *callback, /*out*/ "
+                    "IFabricAsyncOperationContext **context);");
+      p.AddLn(vars, "fabricrpc::Status EndBatch$Method$("
+                    "IFabricAsyncOperationContext *context, "
+                    "/*out*/std::vector<$Response$>* responses, "
+                    "/*out*/std::vector<fabricrpc::Status>* statuses);");
     } else {
       p.AddLn("// Streamingfor method $Method$ request $Request$ response "
               "$Response$ not supported ");
@@ -373,6 +504,13 @@ public:
                 "public:\n");
     p.Indent();
     p.AddLn(vars, "$Service$Client(IFabricTransportClient * client);");
+    p.AddLn(vars, "// calls services in the same process. Batch is not "
+                  "supported.\n"
+                  "$Service$Client("
+                  "std::shared_ptr<fabricrpc::InProcChannel> channel);");
+    p.AddLn("// compress request bodies of unary calls once the server is known\n"
+            "// to support it, and accept compressed replies.\n"
+            "void SetCompression(fabricrpc::CompressionOptions compression);");
     for (int i = 0; i < service->method_count(); ++i) {
       PrintHeaderClientMethodSync(p, service->method(i), vars);
     }
@@ -380,7 +518,11 @@ public:
     p.Add("private:\n");
     p.Add(
         "  CComPtr<IFabricTransportClient> client_;\n"
-        "  std::shared_ptr<fabricrpc::IFabricRPCHeaderProtoConverter> cv_;\n");
+        "  std::shared_ptr<fabricrpc::IFabricRPCHeaderProtoConverter> cv_;\n"
+        "  fabricrpc::CompressionOptions compression_;\n"
+        "  // capabilities of the server, learned from replies.\n"
+        "  std::shared_ptr<fabricrpc::PeerCapabilities> peer_;\n"
+        "  std::shared_ptr<fabricrpc::InProcChannel> inProc_;\n");
     p.Add("};\n");
   }
 
@@ -423,9 +565,19 @@ public:
           "fabricrpc::FabricRPCHeaderProtoConverter<fabricrpc::request_header, "
           "fabricrpc::reply_header>;\n"
           "$Service$Client::$Service$Client(IFabricTransportClient *client)\n"
-          "  : client_(), cv_(std::make_shared<privateconverter>()) {\n"
+          "  : client_(), cv_(std::make_shared<privateconverter>()),\n"
+          "    compression_(),\n"
+          "    peer_(std::make_shared<fabricrpc::PeerCapabilities>()),\n"
+          "    inProc_() {\n"
           "  client->AddRef();\n"
           "  client_.Attach(client);\n"
+          "}\n"
+          "$Service$Client::$Service$Client(\n"
+          "    std::shared_ptr<fabricrpc::InProcChannel> channel)\n"
+          "  : client_(), cv_(), compression_(), peer_(), inProc_(channel) {}\n"
+          "void $Service$Client::SetCompression(\n"
+          "    fabricrpc::CompressionOptions compression) {\n"
+          "  compression_ = compression;\n"
           "}\n");
     for (int i = 0; i < service->method_count(); ++i) {
       const google::protobuf::MethodDescriptor *method = service->method(i);
@@ -434,7 +586,19 @@ public:
       vars["Response"] = method->output_type()->name();
       bool no_streaming =
           !(method->client_streaming() || method->server_streaming());
-      if (no_streaming) {
+      if (isOneWay(method)) {
+        p.AddLn(vars, "fabricrpc::Status $Service$Client::Send$Method$("
+                      "const $Request$* request){\n"
+                      "  if (inProc_) {\n"
+                      "    return inProc_->Send("
+                      "\"/$Package$$Service$/$Method$\", request);\n"
+                      "  }\n"
+                      "  return fabricrpc::ExecClientSend(client_, cv_, "
+                      "peer_.get(),\n"
+                      "             \"/$Package$$Service$/$Method$\", request,\n"
+                      "             compression_);"
+                      "}\n");
+      } else if (no_streaming) {
         p.AddLn(
             vars,
             "fabricrpc::Status $Service$Client::Begin$Method$("
@@ -442,15 +606,49 @@ public:
             "DWORD timeoutMilliseconds, "
             "IFabricAsyncOperationCallback *callback, /*out*/ "
             "IFabricAsyncOperationContext **context){\n"
-            "  return fabricrpc::ExecClientBegin(client_, cv_, "
-            "timeoutMilliseconds, \"/$Package$$Service$/$Method$\", request,\n"
-            "             callback, context);"
+            "  if (inProc_) {\n"
+            "    return inProc_->BeginRequest("
+            "\"/$Package$$Service$/$Method$\", request,\n"
+            "             timeoutMilliseconds, callback, context);\n"
+            "  }\n"
+            "  return fabricrpc::ExecClientBegin(client_, cv_, peer_.get(),\n"
+            "             timeoutMilliseconds, \"/$Package$$Service$/$Method$\", request,\n"
+            "             callback, context, compression_);"
             "}\n");
         p.AddLn(vars, "fabricrpc::Status $Service$Client::End$Method$("
                       "IFabricAsyncOperationContext *context, "
                       "/*out*/$Response$* response){\n"
+                      "  if (inProc_) {\n"
+                      "    return inProc_->EndRequest(context, response);\n"
+                      "  }\n"
                       "  return fabricrpc::ExecClientEnd(client_, cv_, "
-                      "context, response);"
+                      "peer_.get(), context,\n"
+                      "             response);"
+                      "}\n");
+        p.AddLn(
+            vars,
+            "fabricrpc::Status $Service$Client::BeginBatch$Method$("
+            "std::span<const $Request$> requests, "
+            "DWORD timeoutMilliseconds, "
+            "IFabricAsyncOperationCallback *callback, /*out*/ "
+            "IFabricAsyncOperationContext **context){\n"
+            "  if (inProc_) {\n"
+            "    return fabricrpc::Status(fabricrpc::StatusCode::UNKNOWN,\n"
+            "             \"batch is not supported in process\");\n"
+            "  }\n"
+            "  return fabricrpc::ExecClientBatchBegin(client_, cv_, "
+            "peer_.get(),\n"
+            "             timeoutMilliseconds, \"/$Package$$Service$/$Method$\", "
+            "requests,\n"
+            "             callback, context);"
+            "}\n");
+        p.AddLn(vars, "fabricrpc::Status $Service$Client::EndBatch$Method$("
+                      "IFabricAsyncOperationContext *context, "
+                      "/*out*/std::vector<$Response$>* responses, "
+                      "/*out*/std::vector<fabricrpc::Status>* statuses){\n"
+                      "  return fabricrpc::ExecClientBatchEnd(client_, cv_, "
+                      "peer_.get(),\n"
+                      "             context, responses, statuses);"
                       "}\n");
       } else {
         p.AddLn("// Streamingfor method $Method$ request $Request$ response "
@@ -501,6 +699,11 @@ public:
     // usually input file name is myapp.proto
     // out file should be myapp.fabricrpc.h
     // and myapp.fabricrpc.cc
+    generatorOptions options;
+    if (!parseOptions(parameter, &options, error) ||
+        !checkLite(file, options, error) || !checkOneWay(file, error)) {
+      return false;
+    }
     std::string proto_name = getProtoNameNoExt(file->name());
     // generate header
     std::string out_header_file_name = proto_name + ".fabricrpc.h";
@@ -3,7 +3,14 @@
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/descriptor.h>
 
+#include "fabricrpc_options.pb.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/string/replace.hpp>
+
+#include <cstdint>
 #include <fstream>
+#include <set>
 #include <vector>
 
 namespace pb = google::protobuf;
@@ -18,10 +25,226 @@ std::string getProtoNameNoExt(std::string const &filename) {
   return proto_name;
 }
 
+// bidirectional streaming is not supported.
+bool IsServerStreaming(const pb::MethodDescriptor *method) {
+  return method->server_streaming() && !method->client_streaming();
+}
+
+bool IsClientStreaming(const pb::MethodDescriptor *method) {
+  return method->client_streaming() && !method->server_streaming();
+}
+
+bool IsUnary(const pb::MethodDescriptor *method) {
+  return !(method->client_streaming() || method->server_streaming());
+}
+
+// unary method annotated with option (fabricrpc.one_way).
+// Server handles it as a unary method and the reply is dropped.
+bool IsOneWay(const pb::MethodDescriptor *method) {
+  return method->options().GetExtension(fabricrpc::one_way);
+}
+
+// c++ namespace of a proto package, i.e. a.b is a::b
+std::string PackageToNamespace(const std::string &package) {
+  if (package.empty()) {
+    return "fabricrpc2";
+  }
+  return boost::replace_all_copy(package, ".", "::");
+}
+
+// fully qualified c++ class of a message, i.e. ::helloworld::FabricRequest.
+// Nested messages are Outer_Inner as in protobuf generated code.
+std::string ClassName(const pb::Descriptor *message) {
+  std::string name = message->name();
+  for (const pb::Descriptor *outer = message->containing_type();
+       outer != nullptr; outer = outer->containing_type()) {
+    name = outer->name() + "_" + name;
+  }
+  const std::string &package = message->file()->package();
+  if (package.empty()) {
+    return "::" + name;
+  }
+  return "::" + PackageToNamespace(package) + "::" + name;
+}
+
+std::string MethodKind(const pb::MethodDescriptor *method) {
+  if (IsUnary(method)) {
+    return "fabricrpc::method_kind::unary";
+  } else if (IsServerStreaming(method)) {
+    return "fabricrpc::method_kind::server_streaming";
+  } else if (IsClientStreaming(method)) {
+    return "fabricrpc::method_kind::client_streaming";
+  }
+  return "fabricrpc::method_kind::bidi_streaming";
+}
+
+std::string MethodPath(const pb::MethodDescriptor *method) {
+  return "/" + method->service()->full_name() + "/" + method->name();
+}
+
+// Copy of fabricrpc::method_hash, which generated code uses for case labels.
+// If they differ the generated code has duplicate case labels and does not
+// compile, rather than misroute.
+std::uint64_t MethodHash(const std::string &path) {
+  std::uint64_t h = 14695981039346656037ull;
+  for (char c : path) {
+    h ^= static_cast<std::uint8_t>(c);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// smallest table size that gives each method of the service its own slot,
+// so that dispatch switch is dense and compiles to a jump table.
+// returns 0 if there is none within limit.
+std::uint64_t DispatchSize(const pb::ServiceDescriptor *service) {
+  const std::uint64_t limit = 65536;
+  std::uint64_t size =
+      service->method_count() > 0 ? service->method_count() : 1;
+  for (; size <= limit; size++) {
+    std::set<std::uint64_t> slots;
+    for (int i = 0; i < service->method_count(); ++i) {
+      slots.insert(MethodHash(MethodPath(service->method(i))) % size);
+    }
+    if (slots.size() == static_cast<std::size_t>(service->method_count())) {
+      return size;
+    }
+  }
+  return 0;
+}
+
+// returns false and sets error if a service cannot be dispatched.
+bool CheckDispatch(const pb::FileDescriptor *file, std::string *error) {
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    if (DispatchSize(service) == 0) {
+      *error = "method paths of " + service->full_name() + " have same hash";
+      return false;
+    }
+  }
+  return true;
+}
+
+// unary method annotated with option (fabricrpc.sync_handler).
+// Server handler is a plain function instead of a coroutine.
+bool IsSyncHandler(const pb::MethodDescriptor *method) {
+  return method->options().GetExtension(fabricrpc::sync_handler);
+}
+
+// returns false and sets error if the sync handler option is misused.
+bool CheckSyncHandler(const pb::FileDescriptor *file, std::string *error) {
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    for (int j = 0; j < service->method_count(); ++j) {
+      const pb::MethodDescriptor *method = service->method(j);
+      if (IsSyncHandler(method) && !IsUnary(method)) {
+        *error = "sync_handler method " + method->full_name() +
+                 " must be unary";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// returns false and sets error if the one way option is misused.
+bool CheckOneWay(const pb::FileDescriptor *file, std::string *error) {
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    for (int j = 0; j < service->method_count(); ++j) {
+      const pb::MethodDescriptor *method = service->method(j);
+      if (!IsOneWay(method)) {
+        continue;
+      }
+      if (!IsUnary(method) ||
+          method->output_type()->full_name() != "google.protobuf.Empty") {
+        *error = "one_way method " + method->full_name() +
+                 " must be unary and return google.protobuf.Empty";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// generator parameters, i.e. protoc --grpc_opt=lite=true,arena=true
+struct GeneratorOptions {
+  // messages are generated for libprotobuf-lite.
+  bool lite = false;
+  // server handlers allocate request and reply protos on a per call arena.
+  bool arena = false;
+  // also generates a load generator main for all services.
+  bool loadgen = false;
+};
+
+// parses comma separated key=value pairs into ret.
+bool ParseOptions(const std::string &parameter, GeneratorOptions *ret,
+                  std::string *error) {
+  if (parameter.empty()) {
+    return true;
+  }
+  std::vector<std::string> pairs;
+  boost::split(pairs, parameter, boost::is_any_of(","));
+  for (const std::string &pair : pairs) {
+    std::size_t eq = pair.find('=');
+    std::string key = pair.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : pair.substr(eq + 1);
+    if (value != "true" && value != "false") {
+      *error = "parameter " + key + " needs to be true or false";
+      return false;
+    }
+    if (key == "lite") {
+      ret->lite = value == "true";
+    } else if (key == "arena") {
+      ret->arena = value == "true";
+    } else if (key == "loadgen") {
+      ret->loadgen = value == "true";
+    } else {
+      *error = "unknown parameter " + key;
+      return false;
+    }
+  }
+  return true;
+}
+
+// with lite the messages of every method need to be generated with
+// optimize_for = LITE_RUNTIME, or the stubs pull in full protobuf.
+bool CheckLite(const pb::FileDescriptor *file, const GeneratorOptions &options,
+               std::string *error) {
+  if (!options.lite) {
+    return true;
+  }
+  auto is_lite = [](const pb::FileDescriptor *f) {
+    return f->options().optimize_for() == pb::FileOptions::LITE_RUNTIME;
+  };
+  if (!is_lite(file)) {
+    *error = "lite=true needs option optimize_for = LITE_RUNTIME in " +
+             file->name();
+    return false;
+  }
+  for (int i = 0; i < file->service_count(); ++i) {
+    const pb::ServiceDescriptor *service = file->service(i);
+    for (int j = 0; j < service->method_count(); ++j) {
+      const pb::MethodDescriptor *method = service->method(j);
+      for (const pb::Descriptor *message :
+           {method->input_type(), method->output_type()}) {
+        if (!is_lite(message->file())) {
+          *error = "lite=true but " + message->full_name() + " in " +
+                   message->file()->name() + " is not LITE_RUNTIME";
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 // generates include etc for header file.
 class pbGenMetaHeader {
 public:
-  pbGenMetaHeader(const pb::FileDescriptor *file) : file_(file) {}
+  pbGenMetaHeader(const pb::FileDescriptor *file,
+                  const GeneratorOptions &options)
+      : file_(file), options_(options) {}
 
   std::string GenerateContent() {
 
@@ -43,15 +266,130 @@ public:
 
     // fabric rpc required headers
     p.Add("#include \"fabrictransport_.h\"\n"
-          "#include \"fabricrpc/fabricrpc2.hpp\"\n");
+          "#include \"fabricrpc/fabricrpc2.hpp\"\n"
+          "#include <array>\n"
+          "#include <cstdint>\n"
+          "#include <span>\n"
+          "#include <string_view>\n"
+          "#include <vector>\n");
+    if (options_.arena) {
+      p.AddLn("#include \"fabricrpc/arena.hpp\"");
+    }
 
     return p.GetOutput();
   }
 
 private:
   const pb::FileDescriptor *file_;
+  GeneratorOptions options_;
 };
 
+// constexpr descriptors of each service and method. Client and server code
+// refer to these.
+class pbGenDescriptorHeader {
+public:
+  pbGenDescriptorHeader(const pb::FileDescriptor *file) : file_(file) {}
+
+  void PrintService(printer &p, const pb::ServiceDescriptor *service,
+                    std::map<std::string, std::string> vars) {
+    vars["Service"] = service->name();
+    vars["ServiceFullName"] = service->full_name();
+    vars["Count"] = std::to_string(service->method_count());
+    vars["DispatchSize"] = std::to_string(DispatchSize(service));
+    p.AddLn(vars, "namespace $Service$_descriptor {");
+    p.AddLn(vars, "inline constexpr std::string_view service_name = "
+                  "\"$ServiceFullName$\";");
+    std::string methods;
+    for (int i = 0; i < service->method_count(); ++i) {
+      const pb::MethodDescriptor *method = service->method(i);
+      vars["Method"] = method->name();
+      vars["Path"] = MethodPath(method);
+      vars["Kind"] = MethodKind(method);
+      vars["OneWay"] = IsOneWay(method) ? "true" : "false";
+      vars["Sync"] = IsSyncHandler(method) ? "true" : "false";
+      vars["Index"] = std::to_string(i);
+      p.Add(vars, "inline constexpr fabricrpc::method_descriptor $Method$ = {\n"
+                  "    service_name, \"$Method$\", \"$Path$\",\n"
+                  "    $Kind$, $OneWay$, $Sync$, $Index$};\n");
+      if (i != 0) {
+        methods += ", ";
+      }
+      methods += method->name();
+    }
+    vars["Methods"] = methods;
+    p.AddLn(vars, "inline constexpr std::array<fabricrpc::method_descriptor, "
+                  "$Count$>\n"
+                  "    methods = {$Methods$};");
+    p.AddLn(vars, "// method_hash(path) % dispatch_size is different for each "
+                  "method.\n"
+                  "inline constexpr std::uint64_t dispatch_size = "
+                  "$DispatchSize$;");
+    p.AddLn(vars, "} // namespace $Service$_descriptor");
+  }
+
+  std::string GenerateContent() {
+    std::string output;
+    printer p(output);
+    std::map<std::string, std::string> vars;
+    vars["Namespace"] = PackageToNamespace(file_->package());
+
+    p.AddLn(vars, "// Descriptors");
+    p.AddLn(vars, "namespace $Namespace$ {");
+    for (int i = 0; i < file_->service_count(); ++i) {
+      PrintService(p, file_->service(i), vars);
+    }
+    p.AddLn(vars, "} // namespace $Namespace$");
+    return p.GetOutput();
+  }
+
+private:
+  const pb::FileDescriptor *file_;
+};
+
+const std::string kNotFound =
+    "co_return absl::UnimplementedError(\n"
+    "    absl::StrCat(\"url: \", url, \" not found\"));";
+
+// switch on the method hash of url for methods matching pred. call is
+// the handler invocation, and is printed for each method with $Method$,
+// $Request$ and $Response$ set. sync_call is used instead for sync handler
+// methods if not empty. not_found is printed after the switch.
+void PrintDispatch(printer &p, const pb::ServiceDescriptor *service,
+                   std::map<std::string, std::string> vars,
+                   bool (*pred)(const pb::MethodDescriptor *),
+                   const std::string &call,
+                   const std::string &sync_call = "",
+                   const std::string &not_found = kNotFound) {
+  p.AddLn(vars, "switch (fabricrpc::method_hash(url) %\n"
+                "        $Service$_descriptor::dispatch_size) {");
+  for (int i = 0; i < service->method_count(); ++i) {
+    const pb::MethodDescriptor *method = service->method(i);
+    if (!pred(method)) {
+      continue;
+    }
+    vars["Method"] = method->name();
+    vars["Request"] = ClassName(method->input_type());
+    vars["Response"] = ClassName(method->output_type());
+    p.AddLn(vars, "case fabricrpc::method_hash($Service$_descriptor::$Method$."
+                  "path) %\n"
+                  "    $Service$_descriptor::dispatch_size:");
+    p.Indent();
+    // other urls can have the same slot.
+    p.AddLn(vars, "if (url == $Service$_descriptor::$Method$.path) {");
+    p.Indent();
+    bool sync = IsSyncHandler(method) && !sync_call.empty();
+    p.AddLn(vars, sync ? sync_call : call);
+    p.Outdent();
+    p.AddLn("}");
+    p.AddLn("break;");
+    p.Outdent();
+  }
+  p.AddLn("default:");
+  p.AddLn("  break;");
+  p.AddLn("}"); // close switch
+  p.AddLn(not_found);
+}
+
 // generator for a single pb file. For client header.
 class pbGenClientHeader {
 public:
@@ -63,23 +401,76 @@ public:
                               const google::protobuf::MethodDescriptor *method,
                               std::map<std::string, std::string> &vars) {
     vars["Method"] = method->name();
-    vars["Request"] = method->input_type()->name();
-    vars["Response"] = method->output_type()->name();
+    vars["Request"] = ClassName(method->input_type());
+    vars["Response"] = ClassName(method->output_type());
     bool no_streaming =
         !(method->client_streaming() || method->server_streaming());
-    if (no_streaming) {
+    if (IsOneWay(method)) {
+      // server does not reply, so there is nothing to wait for.
+      p.AddLn(vars,
+              "// returns whether the request is handed to transport.\n"
+              "absl::Status $Method$(const $Request$ *request) {\n"
+              "static const std::string url(\n"
+              "$Service$_descriptor::$Method$.path);\n"
+              "return conn_.send_one_way(url, request);\n"
+              "}");
+    } else if (no_streaming) {
       p.AddLn(
           vars,
           "// handler void(ec, absl::Status)\n"
           "template <typename Token>\n"
-          "auto SayHello($Request$ *request,\n"
+          "auto $Method$($Request$ *request,\n"
           "/*out*/$Response$ *reply, Token &&token) {\n"
-          "static const std::string url = \"/$Package$$Service$/$Method$\";\n"
+          "static const std::string url(\n"
+              "$Service$_descriptor::$Method$.path);\n"
           "return conn_.async_send(url, request, reply, std::move(token));\n"
           "}");
+      // batch sends all requests in one transport message.
+      p.AddLn(vars,
+              "// handler void(ec, absl::Status). statuses has the status of "
+              "each request.\n"
+              "template <typename Token>\n"
+              "auto Batch$Method$(std::span<const $Request$> requests,\n"
+              "/*out*/std::vector<$Response$> *replies,\n"
+              "/*out*/std::vector<absl::Status> *statuses, Token &&token) {\n"
+              "static const std::string url(\n"
+              "$Service$_descriptor::$Method$.path);\n"
+              "replies->resize(requests.size());\n"
+              "std::vector<const google::protobuf::MessageLite *> req_ptrs;\n"
+              "std::vector<google::protobuf::MessageLite *> reply_ptrs;\n"
+              "for (std::size_t i = 0; i < requests.size(); i++) {\n"
+              "req_ptrs.push_back(&requests[i]);\n"
+              "reply_ptrs.push_back(&(*replies)[i]);\n"
+              "}\n"
+              "return conn_.async_send_batch(url, std::move(req_ptrs),\n"
+              "std::move(reply_ptrs), statuses, std::move(token));\n"
+              "}");
+    } else if (IsServerStreaming(method)) {
+      // replies are read from reader after the stream is opened.
+      p.AddLn(vars,
+              "// handler void(ec, absl::Status)\n"
+              "template <typename Token>\n"
+              "auto $Method$($Request$ *request,\n"
+              "fabricrpc::basic_stream_reader<executor_type> *reader,\n"
+              "Token &&token) {\n"
+              "static const std::string url(\n"
+              "$Service$_descriptor::$Method$.path);\n"
+              "return conn_.async_open_stream(url, request, reader, "
+              "std::move(token));\n"
+              "}");
+    } else if (IsClientStreaming(method)) {
+      // requests are written to the returned writer.
+      p.AddLn(vars,
+              "// writer sends $Request$ msgs and finishes with $Response$\n"
+              "fabricrpc::basic_client_stream_writer<executor_type> "
+              "$Method$() {\n"
+              "static const std::string url(\n"
+              "$Service$_descriptor::$Method$.path);\n"
+              "return conn_.open_client_stream(url);\n"
+              "}");
     } else {
-      p.AddLn("// Streamingfor method $Method$ request $Request$ response "
-              "$Response$ not supported ");
+      p.AddLn(vars, "// Streaming for method $Method$ request $Request$ "
+                    "response $Response$ not supported ");
     }
   }
 
@@ -111,15 +502,7 @@ public:
     printer p(output);
     std::map<std::string, std::string> vars;
 
-    vars["Package"] = file_->package();
-    if (!file_->package().empty()) {
-      vars["Package"].append(".");
-    }
-
-    vars["Namespace"] = file_->package();
-    if (vars["Namespace"].empty()) {
-      vars["Namespace"] = "fabricrpc2";
-    }
+    vars["Namespace"] = PackageToNamespace(file_->package());
 
     p.AddLn(vars, "// Client code");
 
@@ -154,25 +537,147 @@ private:
 
 class pbGenServerHeader {
 public:
-  pbGenServerHeader(const pb::FileDescriptor *file) : file_(file) {}
+  pbGenServerHeader(const pb::FileDescriptor *file,
+                    const GeneratorOptions &options)
+      : file_(file), options_(options) {}
 
   void
   PrintHeaderServerMethodSync(printer &p,
                               const google::protobuf::MethodDescriptor *method,
                               std::map<std::string, std::string> &vars) {
     vars["Method"] = method->name();
-    vars["Request"] = method->input_type()->name();
-    vars["Response"] = method->output_type()->name();
+    vars["Request"] = ClassName(method->input_type());
+    vars["Response"] = ClassName(method->output_type());
     bool no_streaming =
         !(method->client_streaming() || method->server_streaming());
-    if (no_streaming) {
-      p.AddLn("virtual net::awaitable<absl::Status> "
-              "SayHello(helloworld::FabricRequest *request,"
-              "helloworld::FabricResponse *resp) = 0;");
+    if (no_streaming && IsSyncHandler(method)) {
+      // must not block, since it runs on the request loop.
+      p.AddLn(vars, "virtual absl::Status "
+                    "$Method$($Request$ *request,"
+                    "$Response$ *resp) = 0;");
+    } else if (no_streaming) {
+      p.AddLn(vars, "virtual net::awaitable<absl::Status> "
+                    "$Method$($Request$ *request,"
+                    "$Response$ *resp) = 0;");
+    } else if (IsServerStreaming(method)) {
+      // each reply is written to writer. returned status ends the stream.
+      p.AddLn(vars, "virtual net::awaitable<absl::Status> "
+                    "$Method$($Request$ *request,"
+                    "fabricrpc::server_writer *writer) = 0;");
+    } else if (IsClientStreaming(method)) {
+      // each request is read from reader.
+      p.AddLn(vars, "virtual net::awaitable<absl::Status> "
+                    "$Method$(fabricrpc::server_reader *reader,"
+                    "$Response$ *resp) = 0;");
     } else {
-      p.AddLn("// Streaming for method $Method$ request $Request$ response "
-              "$Response$ not supported ");
+      p.AddLn(vars, "// Streaming for method $Method$ request $Request$ "
+                    "response $Response$ not supported ");
+    }
+  }
+
+  // routing of client streaming methods.
+  void PrintHeaderServiceClientStreamRouting(
+      printer &p, const google::protobuf::ServiceDescriptor *service,
+      std::map<std::string, std::string> &vars) {
+    bool has_stream = false;
+    for (int i = 0; i < service->method_count(); ++i) {
+      has_stream = has_stream || IsClientStreaming(service->method(i));
+    }
+    if (!has_stream) {
+      return;
+    }
+    p.Add(vars, "net::awaitable<absl::Status> execute_client_stream(\n"
+                "const std::string &url, fabricrpc::server_reader *reader,\n"
+                "std::string *resp) override {\n");
+    p.Indent();
+    PrintDispatch(
+        p, service, vars, IsClientStreaming,
+        "co_return co_await fabricrpc::$Helper$_client_stream_handler_helper<\n"
+        "Policy, $Response$, decltype(&$Class$::$Method$), decltype(this)>(\n"
+        "$Service$_descriptor::$Method$, reader, resp, &$Class$::$Method$,\n"
+        "this);");
+    p.Outdent();
+    p.AddLn("}"); // close execute_client_stream
+  }
+
+  // routing of sync handler methods, which middleware tries before execute.
+  void PrintHeaderServiceSyncRouting(
+      printer &p, const google::protobuf::ServiceDescriptor *service,
+      std::map<std::string, std::string> &vars, const std::string &sync_call) {
+    bool has_sync = false;
+    for (int i = 0; i < service->method_count(); ++i) {
+      has_sync = has_sync || IsSyncHandler(service->method(i));
+    }
+    if (!has_sync) {
+      return;
+    }
+    p.Add(vars, "bool execute_sync(const std::string &url,\n"
+                "const std::string_view req, std::string *resp,\n"
+                "absl::Status *st) override {\n");
+    p.Indent();
+    PrintDispatch(p, service, vars, IsSyncHandler,
+                  "*st = " + sync_call + ";\nreturn true;", "",
+                  "return false;");
+    p.Outdent();
+    p.AddLn("}"); // close execute_sync
+  }
+
+  // routing of unary methods called in the same process. Protos are passed
+  // through, so the arena option does not apply.
+  void PrintHeaderServiceInProcRouting(
+      printer &p, const google::protobuf::ServiceDescriptor *service,
+      std::map<std::string, std::string> &vars) {
+    bool has_unary = false;
+    for (int i = 0; i < service->method_count(); ++i) {
+      has_unary = has_unary || IsUnary(service->method(i));
     }
+    if (!has_unary) {
+      return;
+    }
+    p.Add(vars, "net::awaitable<absl::Status> execute_inproc(\n"
+                "const std::string &url, google::protobuf::MessageLite *req,\n"
+                "google::protobuf::MessageLite *resp) override {\n");
+    p.Indent();
+    PrintDispatch(p, service, vars, IsUnary,
+                  "co_return co_await fabricrpc::codegen_inproc_handler_helper<"
+                  "\n"
+                  "Policy, $Request$, $Response$,\n"
+                  "decltype(&$Class$::$Method$), decltype(this)>(\n"
+                  "$Service$_descriptor::$Method$, req, resp,\n"
+                  "&$Class$::$Method$, this);",
+                  "co_return fabricrpc::codegen_inproc_sync_handler_helper<\n"
+                  "Policy, $Request$, $Response$,\n"
+                  "decltype(&$Class$::$Method$), decltype(this)>(\n"
+                  "$Service$_descriptor::$Method$, req, resp,\n"
+                  "&$Class$::$Method$, this);");
+    p.Outdent();
+    p.AddLn("}"); // close execute_inproc
+  }
+
+  // routing of server streaming methods.
+  void PrintHeaderServiceStreamRouting(
+      printer &p, const google::protobuf::ServiceDescriptor *service,
+      std::map<std::string, std::string> &vars) {
+    bool has_stream = false;
+    for (int i = 0; i < service->method_count(); ++i) {
+      has_stream = has_stream || IsServerStreaming(service->method(i));
+    }
+    if (!has_stream) {
+      return;
+    }
+    p.Add(vars, "net::awaitable<absl::Status> execute_stream(\n"
+                "const std::string &url, const std::string_view req,\n"
+                "fabricrpc::server_writer *writer) override {\n");
+    p.Indent();
+    PrintDispatch(p, service, vars, IsServerStreaming,
+                  "co_return co_await "
+                  "fabricrpc::$Helper$_stream_handler_helper<\n"
+                  "Policy, $Request$, decltype(&$Class$::$Method$),\n"
+                  "decltype(this)>(\n"
+                  "$Service$_descriptor::$Method$, req, writer,\n"
+                  "&$Class$::$Method$, this);");
+    p.Outdent();
+    p.AddLn("}"); // close execute_stream
   }
 
   void PrintHeaderService(printer &p,
@@ -180,45 +685,52 @@ public:
                           std::map<std::string, std::string> vars) {
     vars["Service"] = service->name();
 
-    p.Add(vars, "class $Service$ : public fabricrpc::service {\n"
+    vars["Class"] = "Basic" + service->name();
+    // Policy hooks each call, see fabricrpc/method_policy.hpp.
+    p.Add(vars, "template <typename Policy = fabricrpc::null_method_policy>\n"
+                "class $Class$ : public fabricrpc::service {\n"
                 "  public:\n");
     p.Indent();
 
     // Service metadata
-    p.Add(vars, "const std::string_view name() override { return "
-                "\"helloworld.FabricHello\"; }\n");
+    p.Add(vars, "const std::string_view name() override {\n"
+                "  return $Service$_descriptor::service_name;\n"
+                "}\n");
 
     // routing
+    bool has_unary = false;
+    for (int i = 0; i < service->method_count(); ++i) {
+      has_unary = has_unary || IsUnary(service->method(i));
+    }
+    // unused parameters are warnings.
+    vars["Req"] = has_unary ? "req" : "/*req*/";
+    vars["Resp"] = has_unary ? "resp" : "/*resp*/";
     p.Add(vars, "net::awaitable<absl::Status> execute(const std::string &url,\n"
-                "const std::string_view req,\n"
-                "std::string *resp) override {\n");
+                "const std::string_view $Req$,\n"
+                "std::string *$Resp$) override {\n");
     p.Indent();
-    p.AddLn(vars, "absl::Status st;");
-    for (int i = 0; i < service->method_count(); ++i) {
-      const google::protobuf::MethodDescriptor *method = service->method(i);
-      vars["Method"] = method->name();
-      vars["Request"] = method->input_type()->name();
-      vars["Response"] = method->output_type()->name();
-      if (i != 0) {
-        p.Add("else ");
-      }
-      p.Add(vars, "if (url == \"/$Package$$Service$/$Method$\") {\n");
-      p.Indent();
-      p.Add(vars, "st = co_await fabricrpc::codegen_handler_helper<\n"
-                  "$Request$, $Response$,\n"
-                  "decltype(&$Service$::$Method$), decltype(this)>(\n"
-                  "req, resp, &$Service$::$Method$, this);\n");
-      p.Outdent();
-      p.AddLn("}"); // close if
-    }
-    p.Add("else {\n"
-          "  st = absl::UnimplementedError(absl::StrCat(\"url: \", url, \" not "
-          "found\"));\n"
-          "}\n");
-    p.AddLn("co_return st;");
+    const std::string sync_call =
+        "fabricrpc::$Helper$_sync_handler_helper<\n"
+        "Policy, $Request$, $Response$,\n"
+        "decltype(&$Class$::$Method$), decltype(this)>(\n"
+        "$Service$_descriptor::$Method$, req, resp, &$Class$::$Method$,\n"
+        "this)";
+    PrintDispatch(p, service, vars, IsUnary,
+                  "co_return co_await fabricrpc::$Helper$_handler_helper<\n"
+                  "Policy, $Request$, $Response$,\n"
+                  "decltype(&$Class$::$Method$), decltype(this)>(\n"
+                  "$Service$_descriptor::$Method$, req, resp,\n"
+                  "&$Class$::$Method$, this);",
+                  "co_return " + sync_call + ";");
     p.Outdent();
     p.AddLn("}"); // close execute
 
+    PrintHeaderServiceSyncRouting(p, service, vars, sync_call);
+    PrintHeaderServiceInProcRouting(p, service, vars);
+
+    PrintHeaderServiceStreamRouting(p, service, vars);
+    PrintHeaderServiceClientStreamRouting(p, service, vars);
+
     // methods that user needs to implement
     for (int i = 0; i < service->method_count(); ++i) {
       PrintHeaderServerMethodSync(p, service->method(i), vars);
@@ -226,6 +738,7 @@ public:
 
     p.Outdent();
     p.AddLn("};"); // close class
+    p.AddLn(vars, "typedef $Class$<> $Service$;");
   }
 
   std::string GenerateContent() {
@@ -233,15 +746,8 @@ public:
     printer p(output);
     std::map<std::string, std::string> vars;
 
-    vars["Package"] = file_->package();
-    if (!file_->package().empty()) {
-      vars["Package"].append(".");
-    }
-
-    vars["Namespace"] = file_->package();
-    if (vars["Namespace"].empty()) {
-      vars["Namespace"] = "fabricrpc2";
-    }
+    vars["Namespace"] = PackageToNamespace(file_->package());
+    vars["Helper"] = options_.arena ? "codegen_arena" : "codegen";
 
     p.AddLn(vars, "// Server code");
 
@@ -261,6 +767,7 @@ public:
 
 private:
   const pb::FileDescriptor *file_;
+  GeneratorOptions options_;
 };
 
 class pbGenServerCC {
@@ -273,6 +780,114 @@ private:
   const pb::FileDescriptor *file_;
 };
 
+// load generator main. Runs each unary method with fabricrpc::run_loadgen,
+// or run_loadgen_ramp with --ramp_steps, and prints the results.
+class pbGenLoadgen {
+public:
+  pbGenLoadgen(const pb::FileDescriptor *file) : file_(file) {}
+
+  void PrintMethod(printer &p, const pb::MethodDescriptor *method,
+                   std::map<std::string, std::string> vars) {
+    vars["Method"] = method->name();
+    vars["Request"] = ClassName(method->input_type());
+    vars["Response"] = ClassName(method->output_type());
+    if (!IsUnary(method) || IsOneWay(method)) {
+      // streaming and one way calls have no per call latency to measure.
+      p.AddLn(vars, "// $Method$ is skipped.");
+      return;
+    }
+    p.AddLn(vars, "if (fabricrpc::loadgen_selected(options, "
+                  "$Namespace$::$Service$_descriptor::$Method$)) {");
+    p.Indent();
+    p.AddLn(vars, "$Request$ request;\n"
+                  "absl::Status st = fabricrpc::load_sample_request(\n"
+                  "    options, $Namespace$::$Service$_descriptor::$Method$, "
+                  "&request);\n"
+                  "if (!st.ok() && !absl::IsNotFound(st)) {\n"
+                  "  std::cerr << st.ToString() << std::endl;\n"
+                  "  return 1;\n"
+                  "}");
+    // request is shared by all workers and only read.
+    p.AddLn(vars,
+            "auto call = [&request](fabricrpc::rpc_client<executor_type> &rc)\n"
+            "    -> net::awaitable<absl::Status> {\n"
+            "  $Namespace$::$Service$Client<executor_type> client(rc);\n"
+            "  $Response$ reply;\n"
+            "  co_return co_await client.$Method$(&request, &reply,\n"
+            "                                     net::use_awaitable);\n"
+            "};\n"
+            "if (options.ramp_steps != 0) {\n"
+            "  fabricrpc::loadgen_ramp_result ramp =\n"
+            "      fabricrpc::run_loadgen_ramp(options, call);\n"
+            "  fabricrpc::print_loadgen_ramp_result(\n"
+            "      $Namespace$::$Service$_descriptor::$Method$.path, ramp,\n"
+            "      std::cout);\n"
+            "  if (!ramp.status.ok()) {\n"
+            "    return 1;\n"
+            "  }\n"
+            "} else {\n"
+            "  fabricrpc::loadgen_result result =\n"
+            "      fabricrpc::run_loadgen(options, call);\n"
+            "  fabricrpc::print_loadgen_result(\n"
+            "      $Namespace$::$Service$_descriptor::$Method$.path, result,\n"
+            "      std::cout);\n"
+            "  if (!result.status.ok()) {\n"
+            "    return 1;\n"
+            "  }\n"
+            "}");
+    p.Outdent();
+    p.AddLn("}");
+  }
+
+  std::string GenerateContent() {
+    std::string output;
+    printer p(output);
+    std::map<std::string, std::string> vars;
+    vars["filename"] = file_->name();
+    vars["filename_base"] = getProtoNameNoExt(file_->name());
+    vars["Namespace"] = PackageToNamespace(file_->package());
+
+    p.AddLn("// Generated by fabric_rpc2_cpp_plugin. Do not Edit.");
+    p.AddLn(vars, "// source: $filename$");
+    p.AddLn(vars, "// Template of a load generator. Sample requests are "
+                  "read from --requests.");
+    p.AddLn(vars, "#include \"$filename_base$.fabricrpc2.h\"");
+    p.Add("#include \"fabricrpc/loadgen.hpp\"\n"
+          "#include <iostream>\n");
+
+    p.AddLn("namespace net = boost::asio;");
+    p.AddLn("typedef net::io_context::executor_type executor_type;");
+    p.AddLn("int main(int argc, char **argv) {");
+    p.Indent();
+    p.AddLn("fabricrpc::loadgen_options options;\n"
+            "absl::Status parsed = "
+            "fabricrpc::parse_loadgen_args(argc, argv, &options);\n"
+            "if (!parsed.ok()) {\n"
+            "  std::cerr << parsed.ToString() << std::endl\n"
+            "            << fabricrpc::loadgen_usage();\n"
+            "  return 1;\n"
+            "}\n"
+            "if (options.help) {\n"
+            "  std::cerr << fabricrpc::loadgen_usage();\n"
+            "  return 0;\n"
+            "}");
+    for (int i = 0; i < file_->service_count(); ++i) {
+      const pb::ServiceDescriptor *service = file_->service(i);
+      vars["Service"] = service->name();
+      for (int j = 0; j < service->method_count(); ++j) {
+        PrintMethod(p, service->method(j), vars);
+      }
+    }
+    p.AddLn("return 0;");
+    p.Outdent();
+    p.AddLn("}");
+    return p.GetOutput();
+  }
+
+private:
+  const pb::FileDescriptor *file_;
+};
+
 // this generator implements protobufs
 // <google/protobuf/compiler/code_generator.h> interface
 
@@ -284,13 +899,23 @@ public:
     // usually input file name is myapp.proto
     // out file should be myapp.fabricrpc.h
     // and myapp.fabricrpc.cc
+    GeneratorOptions options;
+    if (!ParseOptions(parameter, &options, error) ||
+        !CheckLite(file, options, error) || !CheckOneWay(file, error) ||
+        !CheckSyncHandler(file, error) || !CheckDispatch(file, error)) {
+      return false;
+    }
     std::string proto_name = getProtoNameNoExt(file->name());
     // generate header
     std::string out_header_file_name = proto_name + ".fabricrpc2.h";
     std::ofstream o_header(out_header_file_name.c_str());
 
     {
-      pbGenMetaHeader gen(file);
+      pbGenMetaHeader gen(file, options);
+      o_header << gen.GenerateContent();
+    }
+    {
+      pbGenDescriptorHeader gen(file);
       o_header << gen.GenerateContent();
     }
     {
@@ -298,7 +923,7 @@ public:
       o_header << gen.GenerateContent();
     }
     {
-      pbGenServerHeader gen(file);
+      pbGenServerHeader gen(file, options);
       o_header << gen.GenerateContent();
     }
 
@@ -319,6 +944,14 @@ public:
 
     o_cc.close();
 
+    if (options.loadgen) {
+      std::string out_loadgen_file_name = proto_name + ".fabricrpc2.loadgen.cc";
+      std::ofstream o_loadgen(out_loadgen_file_name.c_str());
+      pbGenLoadgen gen(file);
+      o_loadgen << gen.GenerateContent();
+      o_loadgen.close();
+    }
+
     return true;
   }
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace fabricrpc {
+
+// phases of an rpc that heap allocations are counted in.
+enum class alloc_phase {
+  none = 0,
+  // server parses the header and body of a request.
+  server_decode,
+  // server runs the user handler synchronously.
+  server_handler,
+  // server makes the reply message.
+  server_encode,
+  // client makes the request message.
+  client_encode,
+  // client parses the reply message.
+  client_decode,
+  count
+};
+
+const char *alloc_phase_name(alloc_phase phase);
+
+struct alloc_counts {
+  std::uint64_t allocs = 0;
+  std::uint64_t bytes = 0;
+};
+
+// Allocation accounting is built with the FABRICRPC_ALLOC_STATS cmake option.
+// It replaces the global operator new and delete, and counts each allocation
+// in the phase of the innermost alloc_scope of the allocating thread. Without
+// the option scopes compile to nothing and the counts stay 0.
+constexpr bool alloc_stats_enabled() {
+#ifdef FABRICRPC_ALLOC_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// counts of phase since the last reset, summed over all threads.
+alloc_counts get_alloc_counts(alloc_phase phase);
+
+void reset_alloc_counts();
+
+// marks allocations of this thread as phase until destruction. Scopes nest,
+// and alloc_phase::none stops counting, i.e. around a transport call.
+// Coroutines must not keep a scope across co_await, since they may resume on
+// another thread.
+#ifdef FABRICRPC_ALLOC_STATS
+class alloc_scope {
+public:
+  explicit alloc_scope(alloc_phase phase);
+  ~alloc_scope();
+  alloc_scope(const alloc_scope &) = delete;
+  alloc_scope &operator=(const alloc_scope &) = delete;
+
+private:
+  alloc_phase prev_;
+};
+#else
+class alloc_scope {
+public:
+  explicit alloc_scope(alloc_phase) {}
+  alloc_scope(const alloc_scope &) = delete;
+  alloc_scope &operator=(const alloc_scope &) = delete;
+};
+#endif
+
+} // namespace fabricrpc
@@ -0,0 +1,56 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace fabricrpc {
+
+// thread safe histogram of durations with a fixed memory, in the style of
+// HdrHistogram. Values are nanoseconds. Buckets are log linear: values below
+// 64ns are exact, and each following power of 2 range is split into 64
+// linear buckets, so percentiles are within 1.6% of the recorded value.
+// Values above 2^42ns (73 minutes) are recorded in the last bucket.
+// Records are lock free and may run concurrently with reads and merges.
+class latency_histogram {
+public:
+  latency_histogram() = default;
+  // copies a snapshot of other.
+  latency_histogram(const latency_histogram &other);
+  latency_histogram &operator=(const latency_histogram &other);
+
+  void record(std::chrono::nanoseconds d);
+  void merge(const latency_histogram &other);
+  void reset();
+
+  std::uint64_t count() const;
+  // 0 if there is no record.
+  std::chrono::nanoseconds min() const;
+  std::chrono::nanoseconds max() const;
+  std::chrono::nanoseconds mean() const;
+  // highest value of the bucket that q of the records are at or below, and
+  // not above max. q is in [0, 1]. 0 if there is no record.
+  std::chrono::nanoseconds percentile(double q) const;
+
+private:
+  static constexpr int sub_bits = 6;
+  static constexpr int top_bits = 42;
+  static constexpr std::size_t bucket_count =
+      static_cast<std::size_t>(top_bits - sub_bits + 1) << sub_bits;
+
+  std::array<std::atomic<std::uint64_t>, bucket_count> buckets_{};
+  std::atomic<std::uint64_t> count_{0};
+  std::atomic<std::uint64_t> sum_{0};
+  std::atomic<std::uint64_t> min_{UINT64_MAX};
+  std::atomic<std::uint64_t> max_{0};
+};
+
+} // namespace fabricrpc
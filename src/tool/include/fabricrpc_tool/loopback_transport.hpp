@@ -0,0 +1,30 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabricrpc_tool/transport_factory.hpp"
+
+#include <cstddef>
+
+namespace fabricrpc {
+
+// In process transport with the interfaces of FabricTransport. Clients
+// connect to listeners of the same process by address, i.e.
+// localhost:12345+/, and messages are copied from sender to receiver without
+// network. Tests and benchmarks use it to run without the Service Fabric
+// transport, and to measure the framework apart from the transport.
+// Handlers and completions run on a pool of worker threads, as on transport
+// threads. Opens and closes complete synchronously. Timeouts, security and
+// the message size limits of settings are ignored.
+// Use it with set_transport(loopback_transport()).
+transport_factory loopback_transport();
+
+// threads of the worker pool, 2 by default. Takes effect if set before the
+// first listener or client is created.
+void set_loopback_worker_threads(std::size_t count);
+
+} // namespace fabricrpc
@@ -0,0 +1,97 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+namespace fabricrpc {
+
+// points a request passes on the server, in order.
+enum class span_point {
+  // transport hands the request to the server.
+  arrival = 0,
+  // a server task picks the request from the queue. fabric_rpc has no queue.
+  dequeue,
+  header_parsed,
+  // service of the url is found.
+  routed,
+  // body is read and decompressed. Generated handlers parse the body proto
+  // as part of the handler.
+  body_parsed,
+  handler_start,
+  handler_end,
+  // reply message is made.
+  reply_serialized,
+  // reply is handed to transport.
+  completed,
+  count
+};
+
+const char *span_point_name(span_point point);
+
+// monotonic timestamps of one request. Fixed size, and points not reached
+// are not recorded.
+class request_span {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  void mark(span_point point) { mark(point, clock::now()); }
+  void mark(span_point point, clock::time_point time) {
+    times_[static_cast<std::size_t>(point)] = time;
+  }
+
+  bool has(span_point point) const {
+    return times_[static_cast<std::size_t>(point)] != clock::time_point();
+  }
+
+  clock::time_point at(span_point point) const {
+    return times_[static_cast<std::size_t>(point)];
+  }
+
+private:
+  std::array<clock::time_point, static_cast<std::size_t>(span_point::count)>
+      times_{};
+};
+
+// receives the span of each replied request once it is completed, on the
+// completing thread. Needs to be thread safe.
+class span_sink {
+public:
+  virtual ~span_sink() = default;
+  virtual void record(const request_span &span) = 0;
+};
+
+// sink that attributes latency to stages. The stage of a point is the time
+// from the previous recorded point of the request, so i.e. dequeue is the
+// time in queue, and handler_end the time in the handler.
+class span_stats : public span_sink {
+public:
+  void record(const request_span &span) override;
+
+  // stage that ends at point. arrival has no stage.
+  const latency_histogram &stage(span_point point) const {
+    return stages_[static_cast<std::size_t>(point)];
+  }
+
+  // arrival to completed.
+  const latency_histogram &total() const { return total_; }
+
+  // prints a line per stage with count and percentiles in microseconds.
+  void print(std::ostream &os) const;
+
+private:
+  std::array<latency_histogram, static_cast<std::size_t>(span_point::count)>
+      stages_;
+  latency_histogram total_;
+};
+
+} // namespace fabricrpc
@@ -10,15 +10,28 @@
 #include "fabrictransport_.h"
 #include <winrt/base.h>
 
+#include <functional>
+
 namespace fabricrpc {
 
-// server handle request
+// client handle msgs sent by server on the callback channel
 class tool_client_notification_handler
     : public winrt::implements<tool_client_notification_handler,
                                IFabricTransportCallbackMessageHandler> {
 public:
+  typedef std::function<void(IFabricTransportMessage *)> sink_type;
+
+  // msgs are dropped.
+  tool_client_notification_handler();
+
+  // msgs are passed to sink. sink is invoked on transport threads.
+  tool_client_notification_handler(sink_type sink);
+
   virtual HRESULT STDMETHODCALLTYPE HandleOneWay(
       /* [in] */ IFabricTransportMessage *message) override;
+
+private:
+  sink_type sink_;
 };
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -9,10 +9,39 @@
 #include <fabrictransport_.h>
 #include <winrt/base.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 namespace fabricrpc {
 
+// one body buffer of an outgoing msg.
+// Transport sends all segments of a msg without concatenating them.
+class body_segment {
+public:
+  // msg owns the data.
+  static body_segment owned(std::string data);
+
+  // data needs to be valid until transport disposes the msg.
+  static body_segment borrowed(std::string_view data);
+
+  // msg keeps a reference to data, i.e. for a cached part shared by replies.
+  static body_segment shared(std::shared_ptr<const std::string> data);
+
+  std::string_view view() const;
+
+private:
+  body_segment(std::variant<std::string, std::string_view,
+                            std::shared_ptr<const std::string>>
+                   data);
+
+  std::variant<std::string, std::string_view,
+               std::shared_ptr<const std::string>>
+      data_;
+};
+
 // adapted from service-fabric-cpp
 
 class tool_transport_msg
@@ -20,6 +49,12 @@ class tool_transport_msg
 public:
   tool_transport_msg(std::string body, std::string headers);
 
+  // each body is returned as a separate body buffer.
+  tool_transport_msg(std::vector<std::string> bodies, std::string headers);
+
+  // each segment is returned as a separate body buffer.
+  tool_transport_msg(std::vector<body_segment> segments, std::string headers);
+
   void STDMETHODCALLTYPE GetHeaderAndBodyBuffer(
       /* [out] */ const FABRIC_TRANSPORT_MESSAGE_BUFFER **headerBuffer,
       /* [out] */ ULONG *msgBufferCount,
@@ -28,8 +63,8 @@ public:
   void STDMETHODCALLTYPE Dispose(void) override;
 
 private:
-  std::string body_;
-  FABRIC_TRANSPORT_MESSAGE_BUFFER body_ret_;
+  std::vector<body_segment> bodies_;
+  std::vector<FABRIC_TRANSPORT_MESSAGE_BUFFER> bodies_ret_;
   std::string headers_;
   FABRIC_TRANSPORT_MESSAGE_BUFFER headers_ret_;
 };
@@ -37,5 +72,7 @@ private:
 std::string get_header(IFabricTransportMessage *message);
 // concat all body chunks to one
 std::string get_body(IFabricTransportMessage *message);
+// bytes of the header and all body chunks.
+std::size_t get_message_size(IFabricTransportMessage *message);
 
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,41 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabrictransport_.h"
+
+namespace fabricrpc {
+
+// creates listeners and clients of a transport. Args are the same as
+// CreateFabricTransportListener and CreateFabricTransportClient.
+struct transport_factory {
+  HRESULT (*create_listener)(
+      REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings,
+      FABRIC_TRANSPORT_LISTEN_ADDRESS *address,
+      IFabricTransportMessageHandler *request_handler,
+      IFabricTransportConnectionHandler *connection_handler,
+      IFabricTransportMessageDisposer *disposer,
+      IFabricTransportListener **listener);
+
+  HRESULT (*create_client)(
+      REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings, LPCWSTR address,
+      IFabricTransportCallbackMessageHandler *notification_handler,
+      IFabricTransportClientEventHandler *event_handler,
+      IFabricTransportMessageDisposer *disposer,
+      IFabricTransportClient **client);
+};
+
+// the Service Fabric transport.
+transport_factory fabric_transport();
+
+// transport of fabric_rpc2 acceptors and connections, and of the test
+// helpers. fabric_transport() by default.
+// Not thread safe. Set it before any listener or client is created.
+const transport_factory &get_transport();
+void set_transport(const transport_factory &factory);
+
+} // namespace fabricrpc
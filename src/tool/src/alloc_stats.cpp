@@ -0,0 +1,130 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc_tool/alloc_stats.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace fabricrpc {
+
+namespace {
+
+constexpr std::size_t phase_count = static_cast<std::size_t>(alloc_phase::count);
+
+struct phase_counter {
+  std::atomic<std::uint64_t> allocs{0};
+  std::atomic<std::uint64_t> bytes{0};
+};
+
+phase_counter counters[phase_count];
+
+#ifdef FABRICRPC_ALLOC_STATS
+// constant initialized, so it is safe to read from operator new at any time.
+thread_local alloc_phase current_phase = alloc_phase::none;
+#endif
+
+} // namespace
+
+const char *alloc_phase_name(alloc_phase phase) {
+  switch (phase) {
+  case alloc_phase::none:
+    return "none";
+  case alloc_phase::server_decode:
+    return "server_decode";
+  case alloc_phase::server_handler:
+    return "server_handler";
+  case alloc_phase::server_encode:
+    return "server_encode";
+  case alloc_phase::client_encode:
+    return "client_encode";
+  case alloc_phase::client_decode:
+    return "client_decode";
+  default:
+    return "unknown";
+  }
+}
+
+alloc_counts get_alloc_counts(alloc_phase phase) {
+  alloc_counts ret;
+  std::size_t i = static_cast<std::size_t>(phase);
+  if (i < phase_count) {
+    ret.allocs = counters[i].allocs.load(std::memory_order_relaxed);
+    ret.bytes = counters[i].bytes.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+void reset_alloc_counts() {
+  for (phase_counter &c : counters) {
+    c.allocs.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+  }
+}
+
+#ifdef FABRICRPC_ALLOC_STATS
+alloc_scope::alloc_scope(alloc_phase phase) : prev_(current_phase) {
+  current_phase = phase;
+}
+
+alloc_scope::~alloc_scope() { current_phase = prev_; }
+#endif
+
+} // namespace fabricrpc
+
+#ifdef FABRICRPC_ALLOC_STATS
+namespace {
+
+void *counted_alloc(std::size_t size) noexcept {
+  fabricrpc::alloc_phase phase = fabricrpc::current_phase;
+  if (phase != fabricrpc::alloc_phase::none) {
+    fabricrpc::phase_counter &c =
+        fabricrpc::counters[static_cast<std::size_t>(phase)];
+    c.allocs.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+} // namespace
+
+// aligned forms are not replaced, and keep their own allocator.
+void *operator new(std::size_t size) {
+  void *p = counted_alloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+#endif
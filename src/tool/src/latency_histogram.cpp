@@ -0,0 +1,157 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace fabricrpc {
+
+namespace {
+
+constexpr int sub_bits = 6;
+constexpr int top_bits = 42;
+constexpr std::uint64_t sub_count = 1ull << sub_bits;
+constexpr std::uint64_t highest = (1ull << top_bits) - 1;
+
+// values below sub_count are exact. Each following power of 2 range is split
+// into sub_count linear buckets.
+std::size_t index_of(std::uint64_t value) {
+  value = std::min(value, highest);
+  if (value < sub_count) {
+    return static_cast<std::size_t>(value);
+  }
+  int shift = std::bit_width(value) - sub_bits - 1;
+  std::uint64_t sub = value >> shift;
+  return static_cast<std::size_t>(sub_count + shift * sub_count +
+                                  (sub - sub_count));
+}
+
+std::uint64_t highest_in(std::size_t index) {
+  if (index < sub_count) {
+    return index;
+  }
+  std::uint64_t rest = index - sub_count;
+  int shift = static_cast<int>(rest / sub_count);
+  std::uint64_t sub = sub_count + rest % sub_count;
+  return ((sub + 1) << shift) - 1;
+}
+
+void store_min(std::atomic<std::uint64_t> &m, std::uint64_t value) {
+  std::uint64_t prev = m.load(std::memory_order_relaxed);
+  while (prev > value &&
+         !m.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+  }
+}
+
+void store_max(std::atomic<std::uint64_t> &m, std::uint64_t value) {
+  std::uint64_t prev = m.load(std::memory_order_relaxed);
+  while (prev < value &&
+         !m.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace
+
+latency_histogram::latency_histogram(const latency_histogram &other) {
+  merge(other);
+}
+
+latency_histogram &
+latency_histogram::operator=(const latency_histogram &other) {
+  if (this != &other) {
+    reset();
+    merge(other);
+  }
+  return *this;
+}
+
+void latency_histogram::record(std::chrono::nanoseconds d) {
+  std::uint64_t value =
+      static_cast<std::uint64_t>(std::max<std::int64_t>(d.count(), 0));
+  buckets_[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  store_min(min_, value);
+  store_max(max_, value);
+}
+
+void latency_histogram::merge(const latency_histogram &other) {
+  for (std::size_t i = 0; i < bucket_count; i++) {
+    std::uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+    if (n != 0) {
+      buckets_[i].fetch_add(n, std::memory_order_relaxed);
+    }
+  }
+  count_.fetch_add(other.count_.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  store_min(min_, other.min_.load(std::memory_order_relaxed));
+  store_max(max_, other.max_.load(std::memory_order_relaxed));
+}
+
+void latency_histogram::reset() {
+  for (std::atomic<std::uint64_t> &b : buckets_) {
+    b.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(UINT64_MAX, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t latency_histogram::count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds latency_histogram::min() const {
+  if (count() == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  return std::chrono::nanoseconds(
+      static_cast<std::int64_t>(min_.load(std::memory_order_relaxed)));
+}
+
+std::chrono::nanoseconds latency_histogram::max() const {
+  return std::chrono::nanoseconds(
+      static_cast<std::int64_t>(max_.load(std::memory_order_relaxed)));
+}
+
+std::chrono::nanoseconds latency_histogram::mean() const {
+  std::uint64_t total = count();
+  if (total == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  return std::chrono::nanoseconds(static_cast<std::int64_t>(
+      sum_.load(std::memory_order_relaxed) / total));
+}
+
+std::chrono::nanoseconds latency_histogram::percentile(double q) const {
+  std::uint64_t total = count();
+  if (total == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  q = std::clamp(q, 0.0, 1.0);
+  std::uint64_t rank = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(q * static_cast<double>(total) + 0.5));
+  std::uint64_t max_value = max_.load(std::memory_order_relaxed);
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < bucket_count; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // the last bucket also has the values past the range.
+      std::uint64_t bound =
+          i + 1 == bucket_count ? max_value : highest_in(i);
+      return std::chrono::nanoseconds(
+          static_cast<std::int64_t>(std::min(bound, max_value)));
+    }
+  }
+  return max();
+}
+
+} // namespace fabricrpc
@@ -0,0 +1,669 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc_tool/loopback_transport.hpp"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+#include "fabricrpc_tool/waitable_callback.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fabricrpc {
+
+namespace {
+
+std::size_t worker_threads = 2;
+
+// runs posted work on a fixed number of threads. Work posted before
+// destruction still runs.
+class worker_pool {
+public:
+  explicit worker_pool(std::size_t count) : mtx_(), cv_(), work_(), stopped_() {
+    for (std::size_t i = 0; i < count; i++) {
+      threads_.emplace_back([this]() { run(); });
+    }
+  }
+
+  ~worker_pool() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &th : threads_) {
+      th.join();
+    }
+  }
+
+  void post(std::function<void()> work) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      work_.push_back(std::move(work));
+    }
+    cv_.notify_one();
+  }
+
+private:
+  void run() {
+    for (;;) {
+      std::function<void()> work;
+      {
+        std::unique_lock<std::mutex> lk(mtx_);
+        cv_.wait(lk, [this]() { return stopped_ || !work_.empty(); });
+        if (work_.empty()) {
+          return;
+        }
+        work = std::move(work_.front());
+        work_.pop_front();
+      }
+      work();
+    }
+  }
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> work_;
+  bool stopped_;
+  std::vector<std::thread> threads_;
+};
+
+worker_pool &workers() {
+  static worker_pool pool(worker_threads);
+  return pool;
+}
+
+// runs posted work one at a time in post order on the worker pool. Work of
+// different queues still runs concurrently.
+class serial_queue : public std::enable_shared_from_this<serial_queue> {
+public:
+  serial_queue() : mtx_(), work_(), running_(false) {}
+
+  void post(std::function<void()> work) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      work_.push_back(std::move(work));
+      if (running_) {
+        return;
+      }
+      running_ = true;
+    }
+    schedule();
+  }
+
+private:
+  // runs the next work, and gives the worker back between works so that a
+  // busy queue does not hold it.
+  void schedule() {
+    workers().post([self = shared_from_this()]() {
+      std::function<void()> work;
+      {
+        std::lock_guard<std::mutex> lk(self->mtx_);
+        work = std::move(self->work_.front());
+        self->work_.pop_front();
+      }
+      work();
+      {
+        std::lock_guard<std::mutex> lk(self->mtx_);
+        if (self->work_.empty()) {
+          self->running_ = false;
+          return;
+        }
+      }
+      self->schedule();
+    });
+  }
+
+  std::mutex mtx_;
+  std::deque<std::function<void()>> work_;
+  bool running_;
+};
+
+class func_callback
+    : public winrt::implements<func_callback, IFabricAsyncOperationCallback> {
+public:
+  typedef std::function<void(IFabricAsyncOperationContext *)> func_type;
+
+  explicit func_callback(func_type func) : func_(std::move(func)) {}
+
+  void STDMETHODCALLTYPE
+  Invoke(/* [in] */ IFabricAsyncOperationContext *context) override {
+    func_(context);
+  }
+
+private:
+  func_type func_;
+};
+
+// context of loopback operations. Keeps the result until End is called.
+class loopback_context
+    : public winrt::implements<loopback_context,
+                               IFabricAsyncOperationContext> {
+public:
+  loopback_context(IFabricAsyncOperationCallback *callback, bool sync)
+      : callback_(), sync_(sync), completed_(false), hr_(S_OK), reply_() {
+    callback_.copy_from(callback);
+  }
+
+  // sets the result and invokes the callback.
+  void complete(HRESULT hr,
+                winrt::com_ptr<IFabricTransportMessage> reply = nullptr) {
+    hr_ = hr;
+    reply_ = std::move(reply);
+    completed_.store(true);
+    if (callback_) {
+      callback_->Invoke(this);
+    }
+  }
+
+  HRESULT get_result(IFabricTransportMessage **reply) {
+    if (hr_ == S_OK && reply != nullptr) {
+      reply_.copy_to(reply);
+    }
+    return hr_;
+  }
+
+  BOOLEAN STDMETHODCALLTYPE IsCompleted() override {
+    return completed_.load();
+  }
+  BOOLEAN STDMETHODCALLTYPE CompletedSynchronously() override {
+    return sync_;
+  }
+  HRESULT STDMETHODCALLTYPE get_Callback(
+      /* [retval][out] */ IFabricAsyncOperationCallback **callback) override {
+    callback_.copy_to(callback);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE Cancel() override { return S_OK; }
+
+private:
+  winrt::com_ptr<IFabricAsyncOperationCallback> callback_;
+  bool sync_;
+  std::atomic<bool> completed_;
+  HRESULT hr_;
+  winrt::com_ptr<IFabricTransportMessage> reply_;
+};
+
+HRESULT end_context(IFabricAsyncOperationContext *context,
+                    IFabricTransportMessage **reply) {
+  loopback_context *ctx = dynamic_cast<loopback_context *>(context);
+  if (ctx == nullptr) {
+    return E_INVALIDARG;
+  }
+  return ctx->get_result(reply);
+}
+
+// completes an operation before Begin returns.
+void complete_sync(IFabricAsyncOperationCallback *callback, HRESULT hr,
+                   IFabricAsyncOperationContext **context) {
+  winrt::com_ptr<loopback_context> ctx =
+      winrt::make_self<loopback_context>(callback, true);
+  winrt::com_ptr<IFabricAsyncOperationContext> ret = ctx;
+  ret.copy_to(context);
+  ctx->complete(hr);
+}
+
+// copy of msg that the receiver owns, as if it came over network. The
+// sender's disposer then gets msg.
+winrt::com_ptr<IFabricTransportMessage>
+copy_msg(IFabricTransportMessage *msg,
+         IFabricTransportMessageDisposer *disposer) {
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *headerbuf = {};
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *msgbuf = {};
+  ULONG msgcount = 0;
+  msg->GetHeaderAndBodyBuffer(&headerbuf, &msgcount, &msgbuf);
+  std::string header;
+  if (headerbuf != nullptr) {
+    header.assign(headerbuf->Buffer,
+                  headerbuf->Buffer + headerbuf->BufferSize);
+  }
+  std::vector<std::string> bodies;
+  for (ULONG i = 0; i < msgcount; i++) {
+    bodies.emplace_back(msgbuf[i].Buffer,
+                        msgbuf[i].Buffer + msgbuf[i].BufferSize);
+  }
+  winrt::com_ptr<IFabricTransportMessage> ret =
+      winrt::make<tool_transport_msg>(std::move(bodies), std::move(header));
+  if (disposer != nullptr) {
+    disposer->Dispose(1, &msg);
+  }
+  return ret;
+}
+
+class loopback_string
+    : public winrt::implements<loopback_string, IFabricStringResult> {
+public:
+  explicit loopback_string(std::wstring str) : str_(std::move(str)) {}
+  LPCWSTR STDMETHODCALLTYPE get_String() override { return str_.c_str(); }
+
+private:
+  std::wstring str_;
+};
+
+struct listener_state {
+  std::wstring address;
+  winrt::com_ptr<IFabricTransportMessageHandler> request_handler;
+  winrt::com_ptr<IFabricTransportConnectionHandler> connection_handler;
+  winrt::com_ptr<IFabricTransportMessageDisposer> disposer;
+  std::atomic<bool> open = false;
+};
+
+// open listeners by address.
+class listener_registry {
+public:
+  listener_registry() : mtx_(), listeners_(), next_port_(40000) {}
+
+  // port 0 picks an unused one. Returns the address, or empty if it is
+  // taken.
+  std::wstring add(const std::wstring &host, ULONG port,
+                   const std::wstring &path,
+                   std::shared_ptr<listener_state> state) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::wstring address;
+    do {
+      ULONG p = port != 0 ? port : next_port_++;
+      address = host + L":" + std::to_wstring(p) + L"+" + path;
+    } while (port == 0 && listeners_.contains(address));
+    if (!listeners_.emplace(address, std::move(state)).second) {
+      return L"";
+    }
+    return address;
+  }
+
+  void remove(const std::wstring &address) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    listeners_.erase(address);
+  }
+
+  std::shared_ptr<listener_state> find(const std::wstring &address) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = listeners_.find(address);
+    return it == listeners_.end() ? nullptr : it->second;
+  }
+
+private:
+  std::mutex mtx_;
+  std::map<std::wstring, std::shared_ptr<listener_state>> listeners_;
+  ULONG next_port_;
+};
+
+listener_registry &listeners() {
+  static listener_registry registry;
+  return registry;
+}
+
+// a connected client, shared by the client and the listener side connection.
+struct link_state {
+  std::wstring client_id;
+  std::shared_ptr<listener_state> listener;
+  winrt::com_ptr<IFabricTransportCallbackMessageHandler> notification_handler;
+  std::atomic<bool> connected = false;
+  // one way msgs of each direction arrive in send order, as on a real
+  // connection.
+  std::shared_ptr<serial_queue> to_listener = std::make_shared<serial_queue>();
+  std::shared_ptr<serial_queue> to_client = std::make_shared<serial_queue>();
+
+  bool usable() const { return connected.load() && listener->open.load(); }
+};
+
+// listener side of a connection. Send pushes msgs to the client.
+class loopback_client_connection
+    : public winrt::implements<loopback_client_connection,
+                               IFabricTransportClientConnection> {
+public:
+  explicit loopback_client_connection(std::shared_ptr<link_state> link)
+      : link_(std::move(link)) {}
+
+  HRESULT STDMETHODCALLTYPE
+  Send(/* [in] */ IFabricTransportMessage *message) override {
+    if (!link_->usable()) {
+      return FABRIC_E_CONNECTION_CLOSED_BY_REMOTE_END;
+    }
+    winrt::com_ptr<IFabricTransportMessage> copy =
+        copy_msg(message, link_->listener->disposer.get());
+    link_->to_client->post([link = link_, copy]() {
+      if (link->connected.load() && link->notification_handler) {
+        link->notification_handler->HandleOneWay(copy.get());
+      }
+    });
+    return S_OK;
+  }
+
+  COMMUNICATION_CLIENT_ID STDMETHODCALLTYPE get_ClientId() override {
+    return link_->client_id.c_str();
+  }
+
+private:
+  std::shared_ptr<link_state> link_;
+};
+
+class loopback_listener
+    : public winrt::implements<loopback_listener, IFabricTransportListener> {
+public:
+  loopback_listener(std::shared_ptr<listener_state> state, std::wstring host,
+                    ULONG port, std::wstring path)
+      : state_(std::move(state)), host_(std::move(host)), port_(port),
+        path_(std::move(path)) {}
+
+  ~loopback_listener() { Abort(); }
+
+  HRESULT STDMETHODCALLTYPE
+  BeginOpen(/* [in] */ IFabricAsyncOperationCallback *callback,
+            /* [retval][out] */ IFabricAsyncOperationContext **context)
+      override {
+    HRESULT hr = S_OK;
+    if (state_->open.load()) {
+      hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    } else {
+      std::wstring address = listeners().add(host_, port_, path_, state_);
+      if (address.empty()) {
+        hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+      } else {
+        state_->address = address;
+        state_->open.store(true);
+      }
+    }
+    complete_sync(callback, hr, context);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndOpen(/* [in] */ IFabricAsyncOperationContext *context,
+          /* [retval][out] */ IFabricStringResult **listenAddress) override {
+    HRESULT hr = end_context(context, nullptr);
+    if (hr != S_OK) {
+      return hr;
+    }
+    winrt::com_ptr<IFabricStringResult> str =
+        winrt::make<loopback_string>(state_->address);
+    str.copy_to(listenAddress);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  BeginClose(/* [in] */ IFabricAsyncOperationCallback *callback,
+             /* [retval][out] */ IFabricAsyncOperationContext **context)
+      override {
+    Abort();
+    complete_sync(callback, S_OK, context);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndClose(/* [in] */ IFabricAsyncOperationContext *context) override {
+    return end_context(context, nullptr);
+  }
+
+  // connected clients fail their next calls.
+  void STDMETHODCALLTYPE Abort() override {
+    if (state_->open.exchange(false)) {
+      listeners().remove(state_->address);
+    }
+  }
+
+private:
+  std::shared_ptr<listener_state> state_;
+  std::wstring host_;
+  ULONG port_;
+  std::wstring path_;
+};
+
+std::atomic<std::uint64_t> next_client_id = 0;
+
+class loopback_client
+    : public winrt::implements<loopback_client, IFabricTransportClient> {
+public:
+  loopback_client(std::wstring address,
+                  IFabricTransportCallbackMessageHandler *notification_handler,
+                  IFabricTransportClientEventHandler *event_handler,
+                  IFabricTransportMessageDisposer *disposer)
+      : address_(std::move(address)), notification_handler_(),
+        event_handler_(), disposer_(), mtx_(), link_() {
+    notification_handler_.copy_from(notification_handler);
+    event_handler_.copy_from(event_handler);
+    disposer_.copy_from(disposer);
+  }
+
+  ~loopback_client() { Abort(); }
+
+  HRESULT STDMETHODCALLTYPE
+  BeginRequest(/* [in] */ IFabricTransportMessage *message,
+               /* [in] */ DWORD timeoutMilliseconds,
+               /* [in] */ IFabricAsyncOperationCallback *callback,
+               /* [retval][out] */ IFabricAsyncOperationContext **context)
+      override {
+    std::shared_ptr<link_state> link = get_link();
+    if (!link || !link->usable()) {
+      return FABRIC_E_CONNECTION_CLOSED_BY_REMOTE_END;
+    }
+    winrt::com_ptr<IFabricTransportMessage> copy =
+        copy_msg(message, disposer_.get());
+    winrt::com_ptr<loopback_context> ctx =
+        winrt::make_self<loopback_context>(callback, false);
+    winrt::com_ptr<IFabricAsyncOperationContext> ret = ctx;
+    ret.copy_to(context);
+    workers().post([link, copy, timeoutMilliseconds, ctx]() {
+      std::shared_ptr<listener_state> listener = link->listener;
+      // reply is copied back to the client, and completes on a worker.
+      winrt::com_ptr<IFabricAsyncOperationCallback> done =
+          winrt::make<func_callback>(
+              [listener, ctx](IFabricAsyncOperationContext *inner) {
+                winrt::com_ptr<IFabricTransportMessage> reply;
+                HRESULT hr = listener->request_handler->EndProcessRequest(
+                    inner, reply.put());
+                winrt::com_ptr<IFabricTransportMessage> reply_copy;
+                if (hr == S_OK && !reply) {
+                  hr = E_POINTER;
+                }
+                if (hr == S_OK) {
+                  reply_copy = copy_msg(reply.get(), listener->disposer.get());
+                }
+                workers().post(
+                    [ctx, hr, reply_copy]() { ctx->complete(hr, reply_copy); });
+              });
+      winrt::com_ptr<IFabricAsyncOperationContext> inner;
+      HRESULT hr = listener->request_handler->BeginProcessRequest(
+          link->client_id.c_str(), copy.get(), timeoutMilliseconds, done.get(),
+          inner.put());
+      if (hr != S_OK) {
+        ctx->complete(hr);
+      }
+    });
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndRequest(/* [in] */ IFabricAsyncOperationContext *context,
+             /* [retval][out] */ IFabricTransportMessage **reply) override {
+    return end_context(context, reply);
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  Send(/* [in] */ IFabricTransportMessage *message) override {
+    std::shared_ptr<link_state> link = get_link();
+    if (!link || !link->usable()) {
+      return FABRIC_E_CONNECTION_CLOSED_BY_REMOTE_END;
+    }
+    winrt::com_ptr<IFabricTransportMessage> copy =
+        copy_msg(message, disposer_.get());
+    link->to_listener->post([link, copy]() {
+      link->listener->request_handler->HandleOneWay(link->client_id.c_str(),
+                                                    copy.get());
+    });
+    return S_OK;
+  }
+
+  // the listener accepts the connection before open completes.
+  HRESULT STDMETHODCALLTYPE
+  BeginOpen(/* [in] */ DWORD timeoutMilliseconds,
+            /* [in] */ IFabricAsyncOperationCallback *callback,
+            /* [retval][out] */ IFabricAsyncOperationContext **context)
+      override {
+    HRESULT hr = S_OK;
+    std::shared_ptr<listener_state> listener = listeners().find(address_);
+    if (get_link()) {
+      hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    } else if (!listener) {
+      hr = FABRIC_E_CANNOT_CONNECT;
+    } else {
+      auto link = std::make_shared<link_state>();
+      link->client_id = L"loopback-" + std::to_wstring(next_client_id++);
+      link->listener = listener;
+      link->notification_handler = notification_handler_;
+      winrt::com_ptr<IFabricTransportClientConnection> conn =
+          winrt::make<loopback_client_connection>(link);
+      if (listener->connection_handler) {
+        winrt::com_ptr<IWaitableCallback> wait =
+            winrt::make<waitable_callback>();
+        winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+        hr = listener->connection_handler->BeginProcessConnect(
+            conn.get(), timeoutMilliseconds, wait.get(), ctx.put());
+        if (hr == S_OK) {
+          wait->Wait();
+          hr = listener->connection_handler->EndProcessConnect(ctx.get());
+        }
+      }
+      if (hr == S_OK) {
+        link->connected.store(true);
+        std::lock_guard<std::mutex> lk(mtx_);
+        link_ = link;
+      }
+    }
+    if (hr == S_OK && event_handler_) {
+      event_handler_->OnConnected(address_.c_str());
+    }
+    complete_sync(callback, hr, context);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndOpen(/* [in] */ IFabricAsyncOperationContext *context) override {
+    return end_context(context, nullptr);
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  BeginClose(/* [in] */ DWORD timeoutMilliseconds,
+             /* [in] */ IFabricAsyncOperationCallback *callback,
+             /* [retval][out] */ IFabricAsyncOperationContext **context)
+      override {
+    disconnect(timeoutMilliseconds);
+    complete_sync(callback, S_OK, context);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndClose(/* [in] */ IFabricAsyncOperationContext *context) override {
+    return end_context(context, nullptr);
+  }
+
+  void STDMETHODCALLTYPE Abort() override { disconnect(0); }
+
+private:
+  std::shared_ptr<link_state> get_link() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return link_;
+  }
+
+  // the connection handler of the listener is told, even if the listener is
+  // closed, so it drops the connection it keeps.
+  void disconnect(DWORD timeoutMilliseconds) {
+    std::shared_ptr<link_state> link;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      link.swap(link_);
+    }
+    if (!link || !link->connected.exchange(false)) {
+      return;
+    }
+    std::shared_ptr<listener_state> listener = link->listener;
+    if (listener->connection_handler) {
+      winrt::com_ptr<IWaitableCallback> wait =
+          winrt::make<waitable_callback>();
+      winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+      HRESULT hr = listener->connection_handler->BeginProcessDisconnect(
+          link->client_id.c_str(), timeoutMilliseconds, wait.get(),
+          ctx.put());
+      if (hr == S_OK) {
+        wait->Wait();
+        listener->connection_handler->EndProcessDisconnect(ctx.get());
+      }
+    }
+    if (event_handler_) {
+      event_handler_->OnDisconnected(address_.c_str(), S_OK);
+    }
+  }
+
+  std::wstring address_;
+  winrt::com_ptr<IFabricTransportCallbackMessageHandler> notification_handler_;
+  winrt::com_ptr<IFabricTransportClientEventHandler> event_handler_;
+  winrt::com_ptr<IFabricTransportMessageDisposer> disposer_;
+  std::mutex mtx_;
+  // set while connected.
+  std::shared_ptr<link_state> link_;
+};
+
+HRESULT loopback_create_listener(
+    REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings,
+    FABRIC_TRANSPORT_LISTEN_ADDRESS *address,
+    IFabricTransportMessageHandler *request_handler,
+    IFabricTransportConnectionHandler *connection_handler,
+    IFabricTransportMessageDisposer *disposer,
+    IFabricTransportListener **listener) {
+  UNREFERENCED_PARAMETER(riid);
+  UNREFERENCED_PARAMETER(settings);
+  if (address == nullptr || request_handler == nullptr ||
+      listener == nullptr) {
+    return E_POINTER;
+  }
+  auto state = std::make_shared<listener_state>();
+  state->request_handler.copy_from(request_handler);
+  state->connection_handler.copy_from(connection_handler);
+  state->disposer.copy_from(disposer);
+  winrt::com_ptr<IFabricTransportListener> ret =
+      winrt::make<loopback_listener>(
+          std::move(state),
+          address->IPAddressOrFQDN != nullptr ? address->IPAddressOrFQDN
+                                              : L"localhost",
+          address->Port, address->Path != nullptr ? address->Path : L"");
+  *listener = ret.detach();
+  return S_OK;
+}
+
+HRESULT loopback_create_client(
+    REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings, LPCWSTR address,
+    IFabricTransportCallbackMessageHandler *notification_handler,
+    IFabricTransportClientEventHandler *event_handler,
+    IFabricTransportMessageDisposer *disposer,
+    IFabricTransportClient **client) {
+  UNREFERENCED_PARAMETER(riid);
+  UNREFERENCED_PARAMETER(settings);
+  if (address == nullptr || client == nullptr) {
+    return E_POINTER;
+  }
+  winrt::com_ptr<IFabricTransportClient> ret = winrt::make<loopback_client>(
+      address, notification_handler, event_handler, disposer);
+  *client = ret.detach();
+  return S_OK;
+}
+
+} // namespace
+
+transport_factory loopback_transport() {
+  return {loopback_create_listener, loopback_create_client};
+}
+
+void set_loopback_worker_threads(std::size_t count) {
+  worker_threads = count == 0 ? 1 : count;
+}
+
+} // namespace fabricrpc
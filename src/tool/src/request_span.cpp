@@ -0,0 +1,84 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc_tool/request_span.hpp"
+
+#include <iomanip>
+
+namespace fabricrpc {
+
+namespace {
+
+double to_us(std::chrono::nanoseconds d) {
+  return static_cast<double>(d.count()) / 1000;
+}
+
+} // namespace
+
+const char *span_point_name(span_point point) {
+  switch (point) {
+  case span_point::arrival:
+    return "arrival";
+  case span_point::dequeue:
+    return "dequeue";
+  case span_point::header_parsed:
+    return "header_parsed";
+  case span_point::routed:
+    return "routed";
+  case span_point::body_parsed:
+    return "body_parsed";
+  case span_point::handler_start:
+    return "handler_start";
+  case span_point::handler_end:
+    return "handler_end";
+  case span_point::reply_serialized:
+    return "reply_serialized";
+  case span_point::completed:
+    return "completed";
+  default:
+    return "unknown";
+  }
+}
+
+void span_stats::record(const request_span &span) {
+  const std::size_t count = static_cast<std::size_t>(span_point::count);
+  std::size_t prev = count;
+  for (std::size_t i = 0; i < count; i++) {
+    span_point point = static_cast<span_point>(i);
+    if (!span.has(point)) {
+      continue;
+    }
+    if (prev != count) {
+      stages_[i].record(span.at(point) - span.at(static_cast<span_point>(prev)));
+    }
+    prev = i;
+  }
+  if (span.has(span_point::arrival) && span.has(span_point::completed)) {
+    total_.record(span.at(span_point::completed) -
+                  span.at(span_point::arrival));
+  }
+}
+
+void span_stats::print(std::ostream &os) const {
+  os << std::fixed << std::setprecision(1);
+  os << std::left << std::setw(18) << "stage" << std::right << std::setw(10)
+     << "count" << std::setw(10) << "p50_us" << std::setw(10) << "p99_us"
+     << std::setw(10) << "max_us" << std::endl;
+  auto line = [&os](const char *name, const latency_histogram &h) {
+    os << std::left << std::setw(18) << name << std::right << std::setw(10)
+       << h.count() << std::setw(10) << to_us(h.percentile(0.5))
+       << std::setw(10) << to_us(h.percentile(0.99)) << std::setw(10)
+       << to_us(h.max()) << std::endl;
+  };
+  for (std::size_t i = 1; i < stages_.size(); i++) {
+    if (stages_[i].count() != 0) {
+      line(span_point_name(static_cast<span_point>(i)), stages_[i]);
+    }
+  }
+  line("total", total_);
+}
+
+} // namespace fabricrpc
@@ -8,9 +8,18 @@
 
 namespace fabricrpc {
 
+tool_client_notification_handler::tool_client_notification_handler()
+    : sink_() {}
+
+tool_client_notification_handler::tool_client_notification_handler(
+    sink_type sink)
+    : sink_(std::move(sink)) {}
+
 HRESULT STDMETHODCALLTYPE tool_client_notification_handler::HandleOneWay(
     /* [in] */ IFabricTransportMessage *message) {
-  UNREFERENCED_PARAMETER(message);
+  if (sink_) {
+    sink_(message);
+  }
   return S_OK;
 }
 
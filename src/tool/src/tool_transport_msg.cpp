@@ -8,8 +8,57 @@
 
 namespace fabricrpc {
 
+body_segment::body_segment(
+    std::variant<std::string, std::string_view,
+                 std::shared_ptr<const std::string>>
+        data)
+    : data_(std::move(data)) {}
+
+body_segment body_segment::owned(std::string data) {
+  return body_segment(std::move(data));
+}
+
+body_segment body_segment::borrowed(std::string_view data) {
+  return body_segment(data);
+}
+
+body_segment body_segment::shared(std::shared_ptr<const std::string> data) {
+  return body_segment(std::move(data));
+}
+
+std::string_view body_segment::view() const {
+  if (auto s = std::get_if<std::string>(&data_)) {
+    return *s;
+  }
+  if (auto s = std::get_if<std::string_view>(&data_)) {
+    return *s;
+  }
+  const auto &p = std::get<std::shared_ptr<const std::string>>(data_);
+  return p ? std::string_view(*p) : std::string_view();
+}
+
 tool_transport_msg::tool_transport_msg(std::string body, std::string headers)
-    : body_(body), headers_(headers), body_ret_(), headers_ret_() {}
+    : bodies_(), bodies_ret_(), headers_(headers), headers_ret_() {
+  bodies_.push_back(body_segment::owned(std::move(body)));
+  bodies_ret_.resize(bodies_.size());
+}
+
+tool_transport_msg::tool_transport_msg(std::vector<std::string> bodies,
+                                       std::string headers)
+    : bodies_(), bodies_ret_(), headers_(headers), headers_ret_() {
+  bodies_.reserve(bodies.size());
+  for (std::string &body : bodies) {
+    bodies_.push_back(body_segment::owned(std::move(body)));
+  }
+  bodies_ret_.resize(bodies_.size());
+}
+
+tool_transport_msg::tool_transport_msg(std::vector<body_segment> segments,
+                                       std::string headers)
+    : bodies_(std::move(segments)), bodies_ret_(), headers_(headers),
+      headers_ret_() {
+  bodies_ret_.resize(bodies_.size());
+}
 
 void STDMETHODCALLTYPE tool_transport_msg::GetHeaderAndBodyBuffer(
     /* [out] */ const FABRIC_TRANSPORT_MESSAGE_BUFFER **headerBuffer,
@@ -22,12 +71,15 @@ void STDMETHODCALLTYPE tool_transport_msg::GetHeaderAndBodyBuffer(
   // prepare return
   headers_ret_.Buffer = (BYTE *)headers_.c_str();
   headers_ret_.BufferSize = static_cast<ULONG>(headers_.size());
-  body_ret_.Buffer = (BYTE *)body_.c_str();
-  body_ret_.BufferSize = static_cast<ULONG>(body_.size());
+  for (std::size_t i = 0; i < bodies_.size(); i++) {
+    std::string_view body = bodies_[i].view();
+    bodies_ret_[i].Buffer = (BYTE *)body.data();
+    bodies_ret_[i].BufferSize = static_cast<ULONG>(body.size());
+  }
 
   *headerBuffer = &headers_ret_;
-  *msgBufferCount = 1;
-  *MsgBuffers = &body_ret_;
+  *msgBufferCount = static_cast<ULONG>(bodies_ret_.size());
+  *MsgBuffers = bodies_ret_.data();
 }
 
 void STDMETHODCALLTYPE tool_transport_msg::Dispose(void) {}
@@ -66,4 +118,19 @@ std::string get_body(IFabricTransportMessage *message) {
   return body;
 }
 
+std::size_t get_message_size(IFabricTransportMessage *message) {
+  if (message == nullptr) {
+    return 0;
+  }
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *headerbuf = {};
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *msgbuf = {};
+  ULONG msgcount = 0;
+  message->GetHeaderAndBodyBuffer(&headerbuf, &msgcount, &msgbuf);
+  std::size_t size = headerbuf != nullptr ? headerbuf->BufferSize : 0;
+  for (std::size_t i = 0; i < msgcount; i++) {
+    size += msgbuf[i].BufferSize;
+  }
+  return size;
+}
+
 } // namespace fabricrpc
\ No newline at end of file
@@ -0,0 +1,53 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include "fabricrpc_tool/transport_factory.hpp"
+
+namespace fabricrpc {
+
+namespace {
+
+HRESULT fabric_create_listener(
+    REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings,
+    FABRIC_TRANSPORT_LISTEN_ADDRESS *address,
+    IFabricTransportMessageHandler *request_handler,
+    IFabricTransportConnectionHandler *connection_handler,
+    IFabricTransportMessageDisposer *disposer,
+    IFabricTransportListener **listener) {
+  return CreateFabricTransportListener(riid, settings, address,
+                                       request_handler, connection_handler,
+                                       disposer, listener);
+}
+
+HRESULT fabric_create_client(
+    REFIID riid, FABRIC_TRANSPORT_SETTINGS *settings, LPCWSTR address,
+    IFabricTransportCallbackMessageHandler *notification_handler,
+    IFabricTransportClientEventHandler *event_handler,
+    IFabricTransportMessageDisposer *disposer,
+    IFabricTransportClient **client) {
+  return CreateFabricTransportClient(riid, settings, address,
+                                     notification_handler, event_handler,
+                                     disposer, client);
+}
+
+transport_factory &current_transport() {
+  static transport_factory factory = fabric_transport();
+  return factory;
+}
+
+} // namespace
+
+transport_factory fabric_transport() {
+  return {fabric_create_listener, fabric_create_client};
+}
+
+const transport_factory &get_transport() { return current_transport(); }
+
+void set_transport(const transport_factory &factory) {
+  current_transport() = factory;
+}
+
+} // namespace fabricrpc
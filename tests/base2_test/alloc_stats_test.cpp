@@ -0,0 +1,172 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/alloc_stats.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;
+
+namespace {
+
+// Budgets of one unary call with a payload of payload_size bytes.
+// Bytes are budgeted as multiples of the payload, so one more copy of the
+// body fails the test. Lower a budget when an allocation is removed, and
+// only raise it on purpose.
+constexpr std::size_t payload_size = 4096;
+constexpr std::size_t small_bytes = 1024;
+
+struct budget {
+  fabricrpc::alloc_phase phase;
+  std::uint64_t allocs;
+  std::uint64_t bytes;
+};
+
+// get_body concats the body from a temporary copy of each buffer.
+const budget server_budgets[] = {
+    {fabricrpc::alloc_phase::server_decode, 8, 2 * payload_size + small_bytes},
+    {fabricrpc::alloc_phase::server_handler, 2, payload_size + small_bytes},
+    // the reply body is moved into the message.
+    {fabricrpc::alloc_phase::server_encode, 8, small_bytes},
+};
+
+const budget client_budgets[] = {
+    {fabricrpc::alloc_phase::client_encode, 12, payload_size + small_bytes},
+    {fabricrpc::alloc_phase::client_decode, 8, 3 * payload_size + small_bytes},
+};
+
+void check_budget(const budget &b, std::uint64_t calls) {
+  fabricrpc::alloc_counts c = fabricrpc::get_alloc_counts(b.phase);
+  BOOST_TEST_MESSAGE(fabricrpc::alloc_phase_name(b.phase)
+                     << ": " << c.allocs / calls << " allocs "
+                     << c.bytes / calls << " bytes per call");
+  BOOST_CHECK_MESSAGE(c.allocs <= b.allocs * calls,
+                      fabricrpc::alloc_phase_name(b.phase)
+                          << " allocs " << c.allocs / calls << " over budget "
+                          << b.allocs);
+  BOOST_CHECK_MESSAGE(c.bytes <= b.bytes * calls,
+                      fabricrpc::alloc_phase_name(b.phase)
+                          << " bytes " << c.bytes / calls << " over budget "
+                          << b.bytes);
+}
+
+// replies the request as is, without leaving the calling thread.
+class echo_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Alloc"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+  bool execute_sync(const std::string &, const std::string_view req,
+                    std::string *resp, absl::Status *st) override {
+    resp->assign(req);
+    *st = absl::OkStatus();
+    return true;
+  }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(alloc_stats_test,
+                      *boost::unit_test::enable_if<
+                          fabricrpc::alloc_stats_enabled()>())
+
+BOOST_AUTO_TEST_CASE(scope_test) {
+  fabricrpc::reset_alloc_counts();
+  {
+    fabricrpc::alloc_scope decode(fabricrpc::alloc_phase::server_decode);
+    std::vector<char> counted(100);
+    {
+      fabricrpc::alloc_scope none(fabricrpc::alloc_phase::none);
+      std::vector<char> skipped(1000);
+    }
+    std::vector<char> counted_again(100);
+  }
+  std::vector<char> outside(1000);
+  fabricrpc::alloc_counts c =
+      fabricrpc::get_alloc_counts(fabricrpc::alloc_phase::server_decode);
+  BOOST_CHECK_EQUAL(c.allocs, 2u);
+  BOOST_CHECK_EQUAL(c.bytes, 200u);
+  BOOST_CHECK_EQUAL(
+      fabricrpc::get_alloc_counts(fabricrpc::alloc_phase::none).allocs, 0u);
+
+  fabricrpc::reset_alloc_counts();
+  BOOST_CHECK_EQUAL(
+      fabricrpc::get_alloc_counts(fabricrpc::alloc_phase::server_decode).allocs,
+      0u);
+}
+
+BOOST_AUTO_TEST_CASE(server_budget_test) {
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+  fabricrpc::request_header header;
+  header.set_url("/test.Alloc/Echo");
+  const std::string payload(payload_size, 'a');
+
+  constexpr std::uint64_t calls = 16;
+  fabricrpc::reset_alloc_counts();
+  for (std::uint64_t i = 0; i < calls; i++) {
+    net::io_context ioc;
+    winrt::com_ptr<IFabricTransportMessage> req =
+        winrt::make<fabricrpc::tool_transport_msg>(payload,
+                                                   header.SerializeAsString());
+    winrt::com_ptr<IFabricTransportMessage> reply;
+    net::co_spawn(ioc, md.execute(req.get(), reply.put()), net::detached);
+    ioc.run();
+    BOOST_REQUIRE(fabricrpc::parse_reply_header(
+                      fabricrpc::get_header(reply.get()))
+                      .ok());
+  }
+  for (const budget &b : server_budgets) {
+    check_budget(b, calls);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(client_budget_test) {
+  // any message works as the payload.
+  fabricrpc::request_header request;
+  request.set_url(std::string(payload_size, 'a'));
+  std::string reply_header;
+  BOOST_REQUIRE(
+      fabricrpc::serialize_reply_header(absl::OkStatus(), &reply_header).ok());
+
+  constexpr std::uint64_t calls = 16;
+  fabricrpc::reset_alloc_counts();
+  for (std::uint64_t i = 0; i < calls; i++) {
+    fabricrpc::connection_context ctx;
+    winrt::com_ptr<IFabricTransportMessage> req;
+    absl::Status st;
+    {
+      fabricrpc::alloc_scope scope(fabricrpc::alloc_phase::client_encode);
+      st = fabricrpc::make_unary_request("/test.Alloc/Echo", request, {},
+                                         nullptr, &ctx, &req);
+    }
+    BOOST_REQUIRE(st.ok());
+
+    // the server echoes the body.
+    winrt::com_ptr<IFabricTransportMessage> reply =
+        winrt::make<fabricrpc::tool_transport_msg>(
+            fabricrpc::get_body(req.get()), reply_header);
+    fabricrpc::request_header parsed;
+    {
+      fabricrpc::alloc_scope scope(fabricrpc::alloc_phase::client_decode);
+      st = fabricrpc::parse_unary_reply(reply.get(), &parsed, &ctx, nullptr);
+    }
+    BOOST_REQUIRE(st.ok());
+    BOOST_REQUIRE_EQUAL(parsed.url().size(), payload_size);
+  }
+  for (const budget &b : client_budgets) {
+    check_budget(b, calls);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
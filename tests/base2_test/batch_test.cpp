@@ -0,0 +1,120 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// echoes request_header items, and fails the ones with url "bad".
+class echo_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Batch"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view req,
+                                       std::string *resp) override {
+    fabricrpc::request_header item;
+    absl::Status st = fabricrpc::parse_proto_payload(req, &item);
+    if (!st.ok()) {
+      co_return st;
+    }
+    if (item.url() == "bad") {
+      co_return absl::InvalidArgumentError("bad item");
+    }
+    *resp = std::string(req);
+    co_return absl::OkStatus();
+  }
+};
+
+winrt::com_ptr<IFabricTransportMessage>
+run_batch(fabricrpc::middleware &md, IFabricTransportMessage *req) {
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::io_context ioc;
+  net::co_spawn(ioc, md.execute(req, reply.put()), net::detached);
+  ioc.run();
+  return reply;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(batch_test)
+
+BOOST_AUTO_TEST_CASE(middleware_batch_test) {
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+
+  std::vector<fabricrpc::request_header> requests(3);
+  requests[0].set_url("a");
+  requests[1].set_url("bad");
+  requests[2].set_url("c");
+  std::vector<const google::protobuf::MessageLite *> request_ptrs;
+  for (const fabricrpc::request_header &r : requests) {
+    request_ptrs.push_back(&r);
+  }
+  winrt::com_ptr<IFabricTransportMessage> reply = run_batch(
+      md, fabricrpc::make_batch_request("/test.Batch/Echo", request_ptrs)
+              .get());
+
+  std::vector<fabricrpc::request_header> replies(3);
+  std::vector<google::protobuf::MessageLite *> reply_ptrs;
+  for (fabricrpc::request_header &r : replies) {
+    reply_ptrs.push_back(&r);
+  }
+  std::vector<absl::Status> statuses;
+  absl::Status st =
+      fabricrpc::parse_batch_reply(reply.get(), reply_ptrs, &statuses);
+  BOOST_REQUIRE(st.ok());
+  BOOST_REQUIRE_EQUAL(statuses.size(), 3);
+  BOOST_CHECK(statuses[0].ok());
+  BOOST_CHECK_EQUAL(replies[0].url(), "a");
+  BOOST_CHECK_EQUAL(statuses[1].code(), absl::StatusCode::kInvalidArgument);
+  BOOST_CHECK(statuses[2].ok());
+  BOOST_CHECK_EQUAL(replies[2].url(), "c");
+
+  // a short or long reply is not accepted.
+  for (std::size_t count : {2, 4}) {
+    std::vector<fabricrpc::request_header> other(count);
+    std::vector<google::protobuf::MessageLite *> other_ptrs;
+    for (fabricrpc::request_header &r : other) {
+      other_ptrs.push_back(&r);
+    }
+    st = fabricrpc::parse_batch_reply(reply.get(), other_ptrs, &statuses);
+    BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kUnknown);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(middleware_batch_error_test) {
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+  fabricrpc::request_header item;
+  item.set_url("a");
+  std::vector<const google::protobuf::MessageLite *> request_ptrs = {&item};
+  std::vector<google::protobuf::MessageLite *> reply_ptrs = {&item};
+  std::vector<absl::Status> statuses;
+
+  // unknown url fails the batch as a whole.
+  winrt::com_ptr<IFabricTransportMessage> reply = run_batch(
+      md, fabricrpc::make_batch_request("/test.None/Echo", request_ptrs)
+              .get());
+  absl::Status st =
+      fabricrpc::parse_batch_reply(reply.get(), reply_ptrs, &statuses);
+  BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kUnimplemented);
+
+  // item sizes that do not add up to the body.
+  fabricrpc::request_header header;
+  header.set_url("/test.Batch/Echo");
+  header.add_batch_item_sizes(100);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>(item.SerializeAsString(),
+                                                 header.SerializeAsString());
+  reply = run_batch(md, req.get());
+  st = fabricrpc::parse_batch_reply(reply.get(), reply_ptrs, &statuses);
+  BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kInvalidArgument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
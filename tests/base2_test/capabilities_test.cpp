@@ -0,0 +1,84 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+class empty_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Empty"; }
+
+  net::awaitable<absl::Status> execute(const std::string &,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::OkStatus();
+  }
+};
+
+// runs the request in md and returns the reply header.
+fabricrpc::reply_header run(fabricrpc::middleware &md,
+                            const fabricrpc::request_header &header,
+                            fabricrpc::connection_context *conn_ctx) {
+  net::io_context ioc;
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>("",
+                                                 header.SerializeAsString());
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put(), nullptr, conn_ctx),
+                net::detached);
+  ioc.run();
+  fabricrpc::reply_header reply_header;
+  BOOST_REQUIRE(reply_header.ParseFromString(
+      fabricrpc::get_header(reply.get())));
+  return reply_header;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(capabilities_test)
+
+BOOST_AUTO_TEST_CASE(peer_capabilities_test) {
+  fabricrpc::peer_capabilities peer;
+  BOOST_CHECK(!peer.known());
+  BOOST_CHECK(!peer.has(fabricrpc::capability::capability_batch));
+  BOOST_CHECK(peer.may_have(fabricrpc::capability::capability_batch));
+
+  // old peer
+  peer.set(0, 0);
+  BOOST_CHECK(peer.known());
+  BOOST_CHECK(!peer.may_have(fabricrpc::capability::capability_batch));
+
+  peer.set(1, fabricrpc::capability::capability_batch);
+  BOOST_CHECK(peer.has(fabricrpc::capability::capability_batch));
+  BOOST_CHECK(!peer.has(fabricrpc::capability::capability_compression));
+}
+
+BOOST_AUTO_TEST_CASE(middleware_handshake_test) {
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<empty_service>());
+  fabricrpc::connection_context conn_ctx;
+
+  // old client does not get capabilities.
+  fabricrpc::request_header header;
+  header.set_url("/test.Empty/Call");
+  fabricrpc::reply_header reply = run(md, header, &conn_ctx);
+  BOOST_CHECK_EQUAL(reply.protocol_version(), 0);
+  BOOST_CHECK(!conn_ctx.peer.known());
+
+  header.set_protocol_version(fabricrpc::current_protocol_version);
+  header.set_capabilities(fabricrpc::capability::capability_compression);
+  reply = run(md, header, &conn_ctx);
+  BOOST_CHECK_EQUAL(reply.protocol_version(),
+                    fabricrpc::current_protocol_version);
+  BOOST_CHECK_EQUAL(reply.capabilities(), fabricrpc::local_capabilities);
+  BOOST_CHECK(conn_ctx.peer.has(fabricrpc::capability::capability_compression));
+  BOOST_CHECK(!conn_ctx.peer.has(fabricrpc::capability::capability_batch));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,161 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// replies the request body as is.
+class echo_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Echo"; }
+
+  net::awaitable<absl::Status> execute(const std::string &,
+                                       const std::string_view req,
+                                       std::string *resp) override {
+    resp->assign(req);
+    co_return absl::OkStatus();
+  }
+};
+
+std::string make_body(std::size_t size) {
+  std::string body(size, 'a');
+  for (std::size_t i = 0; i < body.size(); i += 7) {
+    body[i] = static_cast<char>('a' + i % 26);
+  }
+  return body;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(codec_test)
+
+BOOST_AUTO_TEST_CASE(codec_roundtrip_test) {
+  std::string body = make_body(4096);
+  for (fabricrpc::body_codec codec :
+       {fabricrpc::codec_none, fabricrpc::codec_lz4, fabricrpc::codec_zstd}) {
+    std::string compressed;
+    BOOST_REQUIRE(fabricrpc::compress_body(codec, body, &compressed).ok());
+    if (codec != fabricrpc::codec_none) {
+      BOOST_CHECK_LT(compressed.size(), body.size());
+    }
+    std::string plain;
+    BOOST_REQUIRE(fabricrpc::decompress_body(
+                      codec, compressed,
+                      static_cast<std::uint32_t>(body.size()),
+                      fabricrpc::default_max_uncompressed_size, &plain)
+                      .ok());
+    BOOST_CHECK_EQUAL(plain, body);
+  }
+  std::string plain;
+  BOOST_CHECK(!fabricrpc::decompress_body(
+                   fabricrpc::codec_lz4, "garbage", 100,
+                   fabricrpc::default_max_uncompressed_size, &plain)
+                   .ok());
+
+  fabricrpc::compression_options options;
+  BOOST_CHECK(!fabricrpc::should_compress(options, body));
+  options.codec = fabricrpc::codec_zstd;
+  BOOST_CHECK(fabricrpc::should_compress(options, body));
+  BOOST_CHECK(!fabricrpc::should_compress(options, "small"));
+}
+
+// a few bytes claiming a huge body fail before the body is allocated.
+BOOST_AUTO_TEST_CASE(codec_oversized_test) {
+  std::string body = make_body(4096);
+  const std::uint32_t huge = 0xFFFFFFFF;
+  for (fabricrpc::body_codec codec :
+       {fabricrpc::codec_lz4, fabricrpc::codec_zstd}) {
+    std::string compressed;
+    BOOST_REQUIRE(fabricrpc::compress_body(codec, body, &compressed).ok());
+    std::string plain;
+    absl::Status st = fabricrpc::decompress_body(
+        codec, compressed, huge, fabricrpc::default_max_uncompressed_size,
+        &plain);
+    BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kResourceExhausted);
+    BOOST_CHECK(plain.empty());
+    // the limit is the configured one.
+    st = fabricrpc::decompress_body(codec, compressed,
+                                    static_cast<std::uint32_t>(body.size()),
+                                    body.size() - 1, &plain);
+    BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kResourceExhausted);
+  }
+  // zstd frames carry the size, so a header below the limit still has to
+  // match it.
+  std::string compressed;
+  BOOST_REQUIRE(
+      fabricrpc::compress_body(fabricrpc::codec_zstd, body, &compressed).ok());
+  std::string plain;
+  absl::Status st = fabricrpc::decompress_body(
+      fabricrpc::codec_zstd, compressed, 1024 * 1024,
+      fabricrpc::default_max_uncompressed_size, &plain);
+  BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kDataLoss);
+  BOOST_CHECK(plain.empty());
+
+  // middleware rejects the request.
+  net::io_context ioc;
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+  fabricrpc::request_header header;
+  header.set_url("/test.Echo/Echo");
+  header.set_codec(fabricrpc::codec_zstd);
+  header.set_uncompressed_size(huge);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>(compressed,
+                                                 header.SerializeAsString());
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put()), net::detached);
+  ioc.run();
+  BOOST_REQUIRE(reply);
+  BOOST_CHECK_EQUAL(
+      fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get())).code(),
+      absl::StatusCode::kResourceExhausted);
+}
+
+// middleware decompresses the request and compresses the reply with the
+// codec client accepts.
+BOOST_AUTO_TEST_CASE(middleware_compression_test) {
+  net::io_context ioc;
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+  md.set_compression_threshold(1024);
+
+  std::string body = make_body(4096);
+  std::string compressed;
+  BOOST_REQUIRE(
+      fabricrpc::compress_body(fabricrpc::codec_lz4, body, &compressed).ok());
+
+  fabricrpc::request_header header;
+  header.set_url("/test.Echo/Echo");
+  header.set_codec(fabricrpc::codec_lz4);
+  header.set_uncompressed_size(static_cast<std::uint32_t>(body.size()));
+  header.set_accept_codec(fabricrpc::codec_zstd);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>(compressed,
+                                                 header.SerializeAsString());
+
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put()), net::detached);
+  ioc.run();
+  BOOST_REQUIRE(reply);
+
+  fabricrpc::reply_header reply_header;
+  BOOST_REQUIRE(fabricrpc::parse_reply_header(
+                    fabricrpc::get_header(reply.get()), &reply_header)
+                    .ok());
+  BOOST_REQUIRE_EQUAL(reply_header.codec(), fabricrpc::codec_zstd);
+  std::string plain;
+  BOOST_REQUIRE(fabricrpc::decompress_body(
+                    reply_header.codec(), fabricrpc::get_body(reply.get()),
+                    reply_header.uncompressed_size(),
+                    fabricrpc::default_max_uncompressed_size, &plain)
+                    .ok());
+  BOOST_CHECK_EQUAL(plain, body);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,256 @@
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// Echo copies the request url to the reply and marks the request. Fail
+// fills the reply and fails. Barrier waits until all calls of a batch have
+// started. Tenant echoes the tenant metadata.
+class inproc_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.InProc"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+  net::awaitable<absl::Status>
+  execute_inproc_with_context(const std::string &url,
+                              google::protobuf::MessageLite *req,
+                              google::protobuf::MessageLite *resp,
+                              fabricrpc::call_context *ctx) override {
+    if (url != "/test.InProc/Tenant") {
+      co_return co_await execute_inproc(url, req, resp);
+    }
+    std::optional<std::string_view> tenant =
+        ctx->request_metadata->get("tenant");
+    if (!tenant) {
+      co_return absl::InvalidArgumentError("tenant is missing");
+    }
+    ctx->reply_metadata->add("tenant", std::string(*tenant));
+    co_return absl::OkStatus();
+  }
+
+  net::awaitable<absl::Status>
+  execute_inproc(const std::string &url, google::protobuf::MessageLite *req,
+                 google::protobuf::MessageLite *resp) override {
+    if (url == "/test.InProc/Barrier") {
+      started++;
+      net::steady_timer timer(co_await net::this_coro::executor);
+      for (int i = 0; i < 1000 && started < 2; i++) {
+        timer.expires_after(std::chrono::milliseconds(1));
+        co_await timer.async_wait(net::use_awaitable);
+      }
+      co_return started >= 2 ? absl::OkStatus()
+                             : absl::DeadlineExceededError("alone");
+    }
+    calls++;
+    auto *request = static_cast<fabricrpc::request_header *>(req);
+    request->set_sequence(1);
+    if (resp != nullptr) {
+      static_cast<fabricrpc::request_header *>(resp)->set_url(request->url());
+    }
+    co_return url == "/test.InProc/Echo" ? absl::OkStatus()
+                                         : absl::AbortedError(url);
+  }
+
+  int calls = 0;
+  int started = 0;
+};
+
+absl::Status run(fabricrpc::rpc_client<net::io_context::executor_type> &client,
+                 net::io_context &ioc, const std::string &url,
+                 fabricrpc::request_header *req,
+                 fabricrpc::request_header *reply) {
+  absl::Status ret = absl::UnknownError("not completed");
+  client.async_send(url, req, reply,
+                    [&ret](boost::system::error_code ec, absl::Status st) {
+                      BOOST_CHECK(!ec.failed());
+                      ret = st;
+                    });
+  ioc.run();
+  ioc.restart();
+  return ret;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(inproc_channel_test)
+
+BOOST_AUTO_TEST_CASE(unary_test) {
+  net::io_context ioc;
+  fabricrpc::basic_inproc_channel<net::io_context::executor_type> channel(
+      ioc.get_executor());
+  auto svc = std::make_shared<inproc_service>();
+  channel.add_service(svc);
+  fabricrpc::rpc_client<net::io_context::executor_type> client(channel);
+
+  fabricrpc::request_header req;
+  req.set_url("hello");
+  fabricrpc::request_header reply;
+  BOOST_CHECK(run(client, ioc, "/test.InProc/Echo", &req, &reply).ok());
+  BOOST_CHECK_EQUAL(reply.url(), "hello");
+  // handler has the caller's request.
+  BOOST_CHECK_EQUAL(req.sequence(), 1u);
+
+  // errors are returned as is, and the reply is cleared.
+  absl::Status st = run(client, ioc, "/test.InProc/Fail", &req, &reply);
+  BOOST_CHECK(absl::IsAborted(st));
+  BOOST_CHECK(reply.url().empty());
+
+  st = run(client, ioc, "/test.Other/Echo", &req, &reply);
+  BOOST_CHECK(absl::IsUnimplemented(st));
+  BOOST_CHECK_EQUAL(svc->calls, 2);
+}
+
+BOOST_AUTO_TEST_CASE(copy_request_test) {
+  net::io_context ioc;
+  fabricrpc::basic_inproc_channel<net::io_context::executor_type> channel(
+      ioc.get_executor());
+  channel.add_service(std::make_shared<inproc_service>());
+  channel.set_copy_requests(true);
+  fabricrpc::rpc_client<net::io_context::executor_type> client(channel);
+
+  fabricrpc::request_header req;
+  req.set_url("hello");
+  fabricrpc::request_header reply;
+  BOOST_CHECK(run(client, ioc, "/test.InProc/Echo", &req, &reply).ok());
+  BOOST_CHECK_EQUAL(reply.url(), "hello");
+  BOOST_CHECK_EQUAL(req.sequence(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(one_way_and_batch_test) {
+  net::io_context ioc;
+  fabricrpc::basic_inproc_channel<net::io_context::executor_type> channel(
+      ioc.get_executor());
+  auto svc = std::make_shared<inproc_service>();
+  channel.add_service(svc);
+  fabricrpc::rpc_client<net::io_context::executor_type> client(channel);
+
+  fabricrpc::request_header req;
+  req.set_url("hello");
+  BOOST_CHECK(client.send_one_way("/test.InProc/Echo", &req).ok());
+  ioc.run();
+  ioc.restart();
+  BOOST_CHECK_EQUAL(svc->calls, 1);
+  // one way requests are copied.
+  BOOST_CHECK_EQUAL(req.sequence(), 0u);
+
+  fabricrpc::request_header reply1;
+  fabricrpc::request_header reply2;
+  std::vector<absl::Status> statuses;
+  absl::Status ret = absl::UnknownError("not completed");
+  client.async_send_batch("/test.InProc/Echo", {&req, &req},
+                          {&reply1, &reply2}, &statuses,
+                          [&ret](boost::system::error_code ec,
+                                 absl::Status st) {
+                            BOOST_CHECK(!ec.failed());
+                            ret = st;
+                          });
+  ioc.run();
+  BOOST_CHECK(ret.ok());
+  BOOST_REQUIRE_EQUAL(statuses.size(), 2u);
+  BOOST_CHECK(statuses[0].ok());
+  BOOST_CHECK(statuses[1].ok());
+  BOOST_CHECK_EQUAL(reply2.url(), "hello");
+  BOOST_CHECK_EQUAL(svc->calls, 3);
+}
+
+// calls that need a connection fail instead of using one.
+BOOST_AUTO_TEST_CASE(no_connection_test) {
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::basic_inproc_channel<executor_type> channel(ioc.get_executor());
+  channel.add_service(std::make_shared<inproc_service>());
+  fabricrpc::rpc_client<executor_type> client(channel);
+
+  auto writer = client.open_client_stream("/test.InProc/Echo");
+  fabricrpc::request_header req;
+  std::vector<absl::Status> statuses;
+  auto on_done = [&statuses](boost::system::error_code ec, absl::Status st) {
+    BOOST_CHECK(!ec.failed());
+    statuses.push_back(st);
+  };
+  writer.async_write(&req, on_done);
+  fabricrpc::request_header reply;
+  writer.async_finish(&reply, on_done);
+
+  fabricrpc::basic_subscription<executor_type> sub(ioc.get_executor());
+  BOOST_CHECK_EQUAL(client.subscribe("news", &sub).code(),
+                    absl::StatusCode::kUnimplemented);
+  sub.async_read(&reply, on_done);
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(statuses.size(), 3u);
+  BOOST_CHECK_EQUAL(statuses[0].code(), absl::StatusCode::kUnimplemented);
+  BOOST_CHECK_EQUAL(statuses[1].code(), absl::StatusCode::kUnimplemented);
+  BOOST_CHECK_EQUAL(statuses[2].code(),
+                    absl::StatusCode::kFailedPrecondition);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_test) {
+  net::io_context ioc;
+  fabricrpc::basic_inproc_channel<net::io_context::executor_type> channel(
+      ioc.get_executor());
+  channel.add_service(std::make_shared<inproc_service>());
+  fabricrpc::rpc_client<net::io_context::executor_type> client(channel);
+
+  fabricrpc::request_header req;
+  fabricrpc::request_header reply;
+  fabricrpc::metadata request_md;
+  request_md.add("tenant", "contoso");
+  fabricrpc::metadata reply_md;
+  absl::Status ret = absl::UnknownError("not completed");
+  auto handler = [&ret](boost::system::error_code ec, absl::Status st) {
+    BOOST_CHECK(!ec.failed());
+    ret = st;
+  };
+  client.async_send("/test.InProc/Tenant", &req, &reply, &request_md,
+                    &reply_md, handler);
+  ioc.run();
+  ioc.restart();
+  BOOST_CHECK(ret.ok());
+  BOOST_CHECK(reply_md.get("tenant") == "contoso");
+
+  // the handler sees no metadata when there is none.
+  client.async_send("/test.InProc/Tenant", &req, &reply, nullptr, &reply_md,
+                    handler);
+  ioc.run();
+  BOOST_CHECK(absl::IsInvalidArgument(ret));
+}
+
+BOOST_AUTO_TEST_CASE(batch_concurrent_test) {
+  net::io_context ioc;
+  fabricrpc::basic_inproc_channel<net::io_context::executor_type> channel(
+      ioc.get_executor());
+  channel.add_service(std::make_shared<inproc_service>());
+  fabricrpc::rpc_client<net::io_context::executor_type> client(channel);
+
+  // each item waits for the other, so items in sequence time out.
+  fabricrpc::request_header req;
+  fabricrpc::request_header reply1;
+  fabricrpc::request_header reply2;
+  std::vector<absl::Status> statuses;
+  absl::Status ret = absl::UnknownError("not completed");
+  client.async_send_batch("/test.InProc/Barrier", {&req, &req},
+                          {&reply1, &reply2}, &statuses,
+                          [&ret](boost::system::error_code ec,
+                                 absl::Status st) {
+                            BOOST_CHECK(!ec.failed());
+                            ret = st;
+                          });
+  ioc.run();
+  BOOST_CHECK(ret.ok());
+  BOOST_REQUIRE_EQUAL(statuses.size(), 2u);
+  BOOST_CHECK(statuses[0].ok());
+  BOOST_CHECK(statuses[1].ok());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
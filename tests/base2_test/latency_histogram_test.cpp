@@ -0,0 +1,92 @@
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc_tool/latency_histogram.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+BOOST_AUTO_TEST_SUITE(latency_histogram_test)
+
+BOOST_AUTO_TEST_CASE(percentile_test) {
+  fabricrpc::latency_histogram h;
+  BOOST_CHECK_EQUAL(h.count(), 0u);
+  BOOST_CHECK(h.percentile(0.5) == 0ns);
+  BOOST_CHECK(h.min() == 0ns);
+  BOOST_CHECK(h.mean() == 0ns);
+
+  // small values are exact.
+  for (int i = 1; i <= 10; i++) {
+    h.record(std::chrono::nanoseconds(i));
+  }
+  BOOST_CHECK(h.percentile(0) == 1ns);
+  BOOST_CHECK(h.percentile(0.5) == 5ns);
+  BOOST_CHECK(h.percentile(1) == 10ns);
+  BOOST_CHECK(h.mean() == 5ns);
+
+  // 1ms to 100ms are within 1.6% above the exact value.
+  h.reset();
+  for (int i = 1; i <= 100000; i++) {
+    h.record(std::chrono::microseconds(i));
+  }
+  BOOST_CHECK_EQUAL(h.count(), 100000u);
+  BOOST_CHECK(h.min() == 1us);
+  BOOST_CHECK(h.max() == 100ms);
+  BOOST_CHECK_CLOSE(static_cast<double>(h.percentile(0.5).count()), 50e6,
+                    1.6);
+  BOOST_CHECK_CLOSE(static_cast<double>(h.percentile(0.99).count()), 99e6,
+                    1.6);
+  BOOST_CHECK(h.percentile(0.999) >= 99.9ms);
+  BOOST_CHECK(h.percentile(1) == 100ms);
+
+  // negative is 0, and values past the range keep the max.
+  h.reset();
+  h.record(-1ns);
+  h.record(std::chrono::hours(100));
+  BOOST_CHECK(h.min() == 0ns);
+  BOOST_CHECK(h.max() == std::chrono::hours(100));
+  BOOST_CHECK(h.percentile(1) == std::chrono::hours(100));
+}
+
+BOOST_AUTO_TEST_CASE(merge_test) {
+  fabricrpc::latency_histogram h;
+  fabricrpc::latency_histogram other;
+  for (int i = 100; i >= 1; i--) {
+    (i % 2 == 0 ? h : other).record(std::chrono::nanoseconds(i));
+  }
+  h.merge(other);
+  BOOST_CHECK_EQUAL(h.count(), 100u);
+  BOOST_CHECK(h.min() == 1ns);
+  BOOST_CHECK(h.max() == 100ns);
+
+  // copies are snapshots.
+  fabricrpc::latency_histogram copy = h;
+  h.record(1s);
+  BOOST_CHECK_EQUAL(copy.count(), 100u);
+  BOOST_CHECK(copy.max() == 100ns);
+  copy = h;
+  BOOST_CHECK_EQUAL(copy.count(), 101u);
+  BOOST_CHECK(copy.max() == 1s);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_test) {
+  fabricrpc::latency_histogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&h, t]() {
+      for (int i = 0; i < 10000; i++) {
+        h.record(std::chrono::microseconds(t + 1));
+      }
+    });
+  }
+  for (std::thread &th : threads) {
+    th.join();
+  }
+  BOOST_CHECK_EQUAL(h.count(), 40000u);
+  BOOST_CHECK(h.min() == 1us);
+  BOOST_CHECK(h.max() == 4us);
+  BOOST_CHECK(h.mean() == 2500ns);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
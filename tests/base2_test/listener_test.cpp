@@ -36,6 +36,28 @@ BOOST_AUTO_TEST_CASE(event_test) {
   th.join();
 }
 
+BOOST_AUTO_TEST_CASE(segment_msg_test) {
+  std::string borrowed = "borrowed";
+  auto shared = std::make_shared<const std::string>("shared");
+  std::vector<fabricrpc::body_segment> segments;
+  segments.push_back(fabricrpc::body_segment::owned("owned"));
+  segments.push_back(fabricrpc::body_segment::borrowed(borrowed));
+  segments.push_back(fabricrpc::body_segment::shared(shared));
+  winrt::com_ptr<IFabricTransportMessage> msg =
+      winrt::make<fabricrpc::tool_transport_msg>(std::move(segments),
+                                                 "header");
+
+  // each segment is a buffer, and borrowed and shared data is not copied.
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *headerbuf = {};
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *msgbuf = {};
+  ULONG msgcount = 0;
+  msg->GetHeaderAndBodyBuffer(&headerbuf, &msgcount, &msgbuf);
+  BOOST_REQUIRE_EQUAL(msgcount, 3);
+  BOOST_CHECK(msgbuf[1].Buffer == (BYTE *)borrowed.data());
+  BOOST_CHECK(msgbuf[2].Buffer == (BYTE *)shared->data());
+  BOOST_CHECK_EQUAL(fabricrpc::get_body(msg.get()), "ownedborrowedshared");
+}
+
 BOOST_AUTO_TEST_CASE(msg_queue_test) {
 
   net::io_context ioc;
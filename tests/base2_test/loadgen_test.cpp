@@ -0,0 +1,112 @@
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc/loadgen.hpp>
+
+BOOST_AUTO_TEST_SUITE(loadgen_test)
+
+BOOST_AUTO_TEST_CASE(args_test) {
+  const char *args[] = {"loadgen",         "--method=/test.Echo/Echo",
+                        "--connections=2", "--concurrency=8",
+                        "--rate=1000.5",   "--duration_sec=3"};
+  fabricrpc::loadgen_options options;
+  absl::Status st = fabricrpc::parse_loadgen_args(
+      6, const_cast<char **>(args), &options);
+  BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+  BOOST_CHECK_EQUAL(options.method, "/test.Echo/Echo");
+  BOOST_CHECK_EQUAL(options.connections, 2u);
+  BOOST_CHECK_EQUAL(options.concurrency, 8u);
+  BOOST_CHECK_EQUAL(options.rate, 1000.5);
+  BOOST_CHECK_EQUAL(options.duration.count(), 3);
+  BOOST_CHECK(!options.help);
+
+  constexpr fabricrpc::method_descriptor echo{
+      "test.Echo", "Echo", "/test.Echo/Echo", fabricrpc::method_kind::unary,
+      false, false, 0};
+  constexpr fabricrpc::method_descriptor echo2{
+      "test.Echo", "Echo2", "/test.Echo/Echo2", fabricrpc::method_kind::unary,
+      false, false, 1};
+  BOOST_CHECK(fabricrpc::loadgen_selected(options, echo));
+  BOOST_CHECK(!fabricrpc::loadgen_selected(options, echo2));
+
+  const char *bad[] = {"loadgen", "--concurrency=0"};
+  fabricrpc::loadgen_options bad_options;
+  BOOST_CHECK(absl::IsInvalidArgument(fabricrpc::parse_loadgen_args(
+      2, const_cast<char **>(bad), &bad_options)));
+  const char *unknown[] = {"loadgen", "--speed=1"};
+  BOOST_CHECK(absl::IsInvalidArgument(fabricrpc::parse_loadgen_args(
+      2, const_cast<char **>(unknown), &bad_options)));
+}
+
+BOOST_AUTO_TEST_CASE(open_loop_args_test) {
+  const char *args[] = {"loadgen", "--arrival=poisson", "--rate=100",
+                        "--ramp_steps=5", "--ramp_step=50"};
+  fabricrpc::loadgen_options options;
+  absl::Status st = fabricrpc::parse_loadgen_args(
+      5, const_cast<char **>(args), &options);
+  BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+  BOOST_CHECK(options.arrival == fabricrpc::loadgen_arrival::poisson);
+  BOOST_CHECK_EQUAL(options.ramp_steps, 5u);
+  BOOST_CHECK_EQUAL(options.ramp_step, 50);
+
+  // open loop needs a rate, and ramp needs open loop.
+  const char *no_rate[] = {"loadgen", "--arrival=fixed"};
+  fabricrpc::loadgen_options bad_options;
+  BOOST_CHECK(absl::IsInvalidArgument(fabricrpc::parse_loadgen_args(
+      2, const_cast<char **>(no_rate), &bad_options)));
+  const char *closed_ramp[] = {"loadgen", "--rate=10", "--ramp_steps=2"};
+  bad_options = {};
+  BOOST_CHECK(absl::IsInvalidArgument(fabricrpc::parse_loadgen_args(
+      3, const_cast<char **>(closed_ramp), &bad_options)));
+  const char *bad_arrival[] = {"loadgen", "--arrival=burst"};
+  bad_options = {};
+  BOOST_CHECK(absl::IsInvalidArgument(fabricrpc::parse_loadgen_args(
+      2, const_cast<char **>(bad_arrival), &bad_options)));
+}
+
+BOOST_AUTO_TEST_CASE(saturated_test) {
+  fabricrpc::loadgen_result first;
+  first.offered_rate = 100;
+  first.elapsed = std::chrono::seconds(1);
+  first.stats.ok = 100;
+  for (int i = 0; i < 100; i++) {
+    first.stats.latency.record(std::chrono::milliseconds(1));
+  }
+  BOOST_CHECK(!fabricrpc::loadgen_saturated(first, first));
+
+  // keeps up, with a bounded latency.
+  fabricrpc::loadgen_result step = first;
+  step.offered_rate = 200;
+  step.stats.ok = 196;
+  BOOST_CHECK(!fabricrpc::loadgen_saturated(first, step));
+  // falls behind the offered rate.
+  step.stats.ok = 150;
+  BOOST_CHECK(fabricrpc::loadgen_saturated(first, step));
+  // keeps up, but latency grows.
+  step.stats.ok = 200;
+  for (int i = 0; i < 10; i++) {
+    step.stats.latency.record(std::chrono::milliseconds(20));
+  }
+  BOOST_CHECK(fabricrpc::loadgen_saturated(first, step));
+}
+
+BOOST_AUTO_TEST_CASE(stats_merge_test) {
+  fabricrpc::loadgen_stats stats;
+  BOOST_CHECK_EQUAL(stats.latency.percentile(0.5).count(), 0);
+  fabricrpc::loadgen_stats other;
+  // exact below 64ns.
+  for (int i = 1; i <= 60; i++) {
+    (i % 2 == 0 ? stats : other).latency.record(std::chrono::nanoseconds(i));
+  }
+  stats.ok = 60;
+  other.failed = 1;
+  other.first_error = absl::UnavailableError("gone");
+  stats.merge(other);
+  BOOST_CHECK_EQUAL(stats.ok, 60u);
+  BOOST_CHECK_EQUAL(stats.failed, 1u);
+  BOOST_CHECK_EQUAL(stats.first_error.code(), absl::StatusCode::kUnavailable);
+  BOOST_CHECK_EQUAL(stats.latency.count(), 60u);
+  BOOST_CHECK_EQUAL(stats.latency.percentile(0).count(), 1);
+  BOOST_CHECK_EQUAL(stats.latency.percentile(0.5).count(), 30);
+  BOOST_CHECK_EQUAL(stats.latency.max().count(), 60);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
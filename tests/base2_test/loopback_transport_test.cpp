@@ -0,0 +1,314 @@
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc/any_context.hpp>
+#include <fabricrpc/endpoint.hpp>
+#include <fabricrpc_tool/loopback_transport.hpp>
+#include <fabricrpc_tool/msg_disposer.hpp>
+#include <fabricrpc_tool/tool_client_connection_handler.hpp>
+#include <fabricrpc_tool/tool_client_notification_handler.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+#include <fabricrpc_tool/waitable_callback.hpp>
+
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef fabricrpc::any_context<winrt::com_ptr<IFabricTransportMessage>>
+    reply_context;
+
+// replies the request as is. Keeps one way msgs and the connection.
+class echo_handler
+    : public winrt::implements<echo_handler, IFabricTransportMessageHandler,
+                               IFabricTransportConnectionHandler> {
+public:
+  echo_handler() : one_way_sem(0) {}
+
+  HRESULT STDMETHODCALLTYPE BeginProcessRequest(
+      COMMUNICATION_CLIENT_ID clientId, IFabricTransportMessage *message,
+      DWORD timeoutMilliseconds, IFabricAsyncOperationCallback *callback,
+      IFabricAsyncOperationContext **context) override {
+    winrt::com_ptr<reply_context> ctx =
+        winrt::make_self<reply_context>(callback);
+    ctx->set_content(winrt::make<fabricrpc::tool_transport_msg>(
+        fabricrpc::get_body(message), fabricrpc::get_header(message)));
+    winrt::com_ptr<IFabricAsyncOperationContext> ret = ctx;
+    ret.copy_to(context);
+    ctx->complete();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndProcessRequest(IFabricAsyncOperationContext *context,
+                    IFabricTransportMessage **reply) override {
+    reply_context *ctx = dynamic_cast<reply_context *>(context);
+    ctx->get_content().copy_to(reply);
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  HandleOneWay(COMMUNICATION_CLIENT_ID clientId,
+               IFabricTransportMessage *message) override {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      one_way.push_back(fabricrpc::get_body(message));
+    }
+    one_way_sem.release();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE BeginProcessConnect(
+      IFabricTransportClientConnection *clientConnection,
+      DWORD timeoutMilliseconds, IFabricAsyncOperationCallback *callback,
+      IFabricAsyncOperationContext **context) override {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      conn.copy_from(clientConnection);
+    }
+    winrt::com_ptr<reply_context> ctx =
+        winrt::make_self<reply_context>(callback);
+    winrt::com_ptr<IFabricAsyncOperationContext> ret = ctx;
+    ret.copy_to(context);
+    ctx->complete();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndProcessConnect(IFabricAsyncOperationContext *) override {
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE BeginProcessDisconnect(
+      COMMUNICATION_CLIENT_ID clientId, DWORD timeoutMilliseconds,
+      IFabricAsyncOperationCallback *callback,
+      IFabricAsyncOperationContext **context) override {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      disconnected = true;
+      conn = nullptr;
+    }
+    winrt::com_ptr<reply_context> ctx =
+        winrt::make_self<reply_context>(callback);
+    winrt::com_ptr<IFabricAsyncOperationContext> ret = ctx;
+    ret.copy_to(context);
+    ctx->complete();
+    return S_OK;
+  }
+
+  HRESULT STDMETHODCALLTYPE
+  EndProcessDisconnect(IFabricAsyncOperationContext *) override {
+    return S_OK;
+  }
+
+  std::mutex mtx;
+  std::vector<std::string> one_way;
+  std::counting_semaphore<> one_way_sem;
+  winrt::com_ptr<IFabricTransportClientConnection> conn;
+  bool disconnected = false;
+};
+
+// opens a loopback listener on a free port, and returns its address.
+winrt::com_ptr<IFabricTransportListener>
+open_listener(echo_handler *handler, std::wstring *addr) {
+  fabricrpc::transport_factory loopback = fabricrpc::loopback_transport();
+  fabricrpc::endpoint ep(L"localhost", 0);
+  winrt::com_ptr<IFabricTransportMessageDisposer> disposer =
+      winrt::make<fabricrpc::msg_disposer>();
+  winrt::com_ptr<IFabricTransportListener> listener;
+  HRESULT hr = loopback.create_listener(
+      IID_IFabricTransportListener,
+      (FABRIC_TRANSPORT_SETTINGS *)ep.get_settings(),
+      (FABRIC_TRANSPORT_LISTEN_ADDRESS *)ep.get_addr(), handler, handler,
+      disposer.get(), listener.put());
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+  BOOST_REQUIRE_EQUAL(listener->BeginOpen(callback.get(), ctx.put()), S_OK);
+  callback->Wait();
+  BOOST_CHECK(ctx->CompletedSynchronously());
+  winrt::com_ptr<IFabricStringResult> str;
+  BOOST_REQUIRE_EQUAL(listener->EndOpen(ctx.get(), str.put()), S_OK);
+  *addr = str->get_String();
+  return listener;
+}
+
+HRESULT open_client(const std::wstring &addr,
+                    fabricrpc::tool_client_notification_handler::sink_type sink,
+                    winrt::com_ptr<IFabricTransportClient> *ret) {
+  fabricrpc::transport_factory loopback = fabricrpc::loopback_transport();
+  fabricrpc::endpoint ep(L"localhost", 0);
+  winrt::com_ptr<IFabricTransportCallbackMessageHandler> notify_h =
+      winrt::make<fabricrpc::tool_client_notification_handler>(sink);
+  winrt::com_ptr<IFabricTransportClientEventHandler> event_h =
+      winrt::make<fabricrpc::tool_client_connection_handler>();
+  winrt::com_ptr<IFabricTransportMessageDisposer> disposer =
+      winrt::make<fabricrpc::msg_disposer>();
+  winrt::com_ptr<IFabricTransportClient> client;
+  HRESULT hr = loopback.create_client(
+      IID_IFabricTransportClient,
+      (FABRIC_TRANSPORT_SETTINGS *)ep.get_settings(), addr.c_str(),
+      notify_h.get(), event_h.get(), disposer.get(), client.put());
+  if (hr != S_OK) {
+    return hr;
+  }
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+  hr = client->BeginOpen(1000, callback.get(), ctx.put());
+  if (hr != S_OK) {
+    return hr;
+  }
+  callback->Wait();
+  hr = client->EndOpen(ctx.get());
+  *ret = client;
+  return hr;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(loopback_transport_test)
+
+BOOST_AUTO_TEST_CASE(request_test) {
+  winrt::com_ptr<echo_handler> handler = winrt::make_self<echo_handler>();
+  std::wstring addr;
+  winrt::com_ptr<IFabricTransportListener> listener =
+      open_listener(handler.get(), &addr);
+
+  std::binary_semaphore pushed(0);
+  std::string pushed_body;
+  winrt::com_ptr<IFabricTransportClient> client;
+  HRESULT hr = open_client(
+      addr,
+      [&](IFabricTransportMessage *msg) {
+        pushed_body = fabricrpc::get_body(msg);
+        pushed.release();
+      },
+      &client);
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+  // bodies of a request arrive as they are sent.
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>(
+          std::vector<std::string>{"hello ", "world"}, "header");
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+  BOOST_REQUIRE_EQUAL(
+      client->BeginRequest(req.get(), 1000, callback.get(), ctx.put()), S_OK);
+  callback->Wait();
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  BOOST_REQUIRE_EQUAL(client->EndRequest(ctx.get(), reply.put()), S_OK);
+  BOOST_CHECK_EQUAL(fabricrpc::get_body(reply.get()), "hello world");
+  BOOST_CHECK_EQUAL(fabricrpc::get_header(reply.get()), "header");
+
+  // one way from client, and push from server.
+  BOOST_REQUIRE_EQUAL(client->Send(req.get()), S_OK);
+  handler->one_way_sem.acquire();
+  {
+    std::lock_guard<std::mutex> lk(handler->mtx);
+    BOOST_REQUIRE_EQUAL(handler->one_way.size(), 1u);
+    BOOST_CHECK_EQUAL(handler->one_way[0], "hello world");
+    BOOST_REQUIRE(handler->conn);
+    BOOST_CHECK_EQUAL(handler->conn->Send(req.get()), S_OK);
+  }
+  pushed.acquire();
+  BOOST_CHECK_EQUAL(pushed_body, "hello world");
+
+  // close tells the listener.
+  callback = winrt::make<fabricrpc::waitable_callback>();
+  BOOST_REQUIRE_EQUAL(client->BeginClose(1000, callback.get(), ctx.put()),
+                      S_OK);
+  callback->Wait();
+  BOOST_CHECK_EQUAL(client->EndClose(ctx.get()), S_OK);
+  BOOST_CHECK(handler->disconnected);
+  BOOST_CHECK_EQUAL(client->Send(req.get()),
+                    FABRIC_E_CONNECTION_CLOSED_BY_REMOTE_END);
+  listener->Abort();
+}
+
+BOOST_AUTO_TEST_CASE(one_way_order_test) {
+  winrt::com_ptr<echo_handler> handler = winrt::make_self<echo_handler>();
+  std::wstring addr;
+  winrt::com_ptr<IFabricTransportListener> listener =
+      open_listener(handler.get(), &addr);
+
+  std::mutex pushed_mtx;
+  std::vector<std::string> pushed;
+  std::counting_semaphore<> pushed_sem(0);
+  winrt::com_ptr<IFabricTransportClient> client;
+  HRESULT hr = open_client(
+      addr,
+      [&](IFabricTransportMessage *msg) {
+        {
+          std::lock_guard<std::mutex> lk(pushed_mtx);
+          pushed.push_back(fabricrpc::get_body(msg));
+        }
+        pushed_sem.release();
+      },
+      &client);
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+  winrt::com_ptr<IFabricTransportClientConnection> conn;
+  {
+    std::lock_guard<std::mutex> lk(handler->mtx);
+    conn = handler->conn;
+  }
+  BOOST_REQUIRE(conn);
+
+  // msgs of one connection arrive in send order in both directions.
+  const int count = 200;
+  std::vector<std::string> expected;
+  for (int i = 0; i < count; i++) {
+    expected.push_back(std::to_string(i));
+    winrt::com_ptr<IFabricTransportMessage> msg =
+        winrt::make<fabricrpc::tool_transport_msg>(expected.back(), "header");
+    BOOST_REQUIRE_EQUAL(client->Send(msg.get()), S_OK);
+    BOOST_REQUIRE_EQUAL(conn->Send(msg.get()), S_OK);
+  }
+  for (int i = 0; i < count; i++) {
+    handler->one_way_sem.acquire();
+    pushed_sem.acquire();
+  }
+  {
+    std::lock_guard<std::mutex> lk(handler->mtx);
+    BOOST_CHECK_EQUAL_COLLECTIONS(handler->one_way.begin(),
+                                  handler->one_way.end(), expected.begin(),
+                                  expected.end());
+  }
+  {
+    std::lock_guard<std::mutex> lk(pushed_mtx);
+    BOOST_CHECK_EQUAL_COLLECTIONS(pushed.begin(), pushed.end(),
+                                  expected.begin(), expected.end());
+  }
+  client->Abort();
+  listener->Abort();
+}
+
+BOOST_AUTO_TEST_CASE(closed_listener_test) {
+  winrt::com_ptr<echo_handler> handler = winrt::make_self<echo_handler>();
+  std::wstring addr;
+  winrt::com_ptr<IFabricTransportListener> listener =
+      open_listener(handler.get(), &addr);
+  winrt::com_ptr<IFabricTransportClient> client;
+  BOOST_REQUIRE_EQUAL(open_client(addr, nullptr, &client), S_OK);
+
+  listener->Abort();
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>("body", "header");
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+  BOOST_CHECK_EQUAL(
+      client->BeginRequest(req.get(), 1000, callback.get(), ctx.put()),
+      FABRIC_E_CONNECTION_CLOSED_BY_REMOTE_END);
+  client->Abort();
+
+  // no listener at the address.
+  winrt::com_ptr<IFabricTransportClient> other;
+  BOOST_CHECK_EQUAL(open_client(addr, nullptr, &other),
+                    FABRIC_E_CANNOT_CONNECT);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// replies the tenant of the request in reply metadata.
+class tenant_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Tenant"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+  net::awaitable<absl::Status>
+  execute_with_context(const std::string &, const std::string_view,
+                       std::string *,
+                       fabricrpc::call_context *ctx) override {
+    std::optional<std::string_view> tenant =
+        ctx->request_metadata->get("tenant");
+    if (!tenant) {
+      co_return absl::InvalidArgumentError("tenant is missing");
+    }
+    ctx->reply_metadata->add("tenant", std::string(*tenant));
+    co_return absl::OkStatus();
+  }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(metadata_test)
+
+BOOST_AUTO_TEST_CASE(metadata_roundtrip_test) {
+  fabricrpc::metadata_encoder encoder;
+  fabricrpc::metadata_decoder decoder;
+
+  fabricrpc::metadata md;
+  md.add("tenant", "contoso");
+  md.add("x-custom", "value");
+  md.add("priority", "");
+
+  std::vector<std::size_t> sizes;
+  for (int i = 0; i < 3; i++) {
+    std::string encoded;
+    encoder.encode(md, &encoded);
+    sizes.push_back(encoded.size());
+    fabricrpc::metadata_view view;
+    BOOST_REQUIRE(decoder.decode(encoded, &view).ok());
+    BOOST_REQUIRE_EQUAL(view.entries().size(), 3);
+    BOOST_CHECK_EQUAL(*view.get("tenant"), "contoso");
+    BOOST_CHECK_EQUAL(*view.get("x-custom"), "value");
+    BOOST_CHECK_EQUAL(*view.get("priority"), "");
+    BOOST_CHECK(!view.get("trace-id").has_value());
+    encoder.on_ack(decoder.ack());
+  }
+  // pairs are inserted on the second time, and indexed once acked.
+  BOOST_CHECK_EQUAL(decoder.ack(), 2);
+  BOOST_CHECK_EQUAL(sizes[2], 3);
+  BOOST_CHECK_LT(sizes[2], sizes[0]);
+}
+
+BOOST_AUTO_TEST_CASE(metadata_unacked_test) {
+  fabricrpc::metadata_encoder encoder;
+  fabricrpc::metadata md;
+  md.add("tenant", "contoso");
+
+  // inserts arrive at a decoder out of order.
+  std::string first;
+  encoder.encode(md, &first);
+  std::string insert;
+  encoder.encode(md, &insert);
+  std::string unacked;
+  encoder.encode(md, &unacked);
+  // not indexed until acked, and the insert is sent again.
+  BOOST_CHECK_EQUAL(unacked, insert);
+
+  fabricrpc::metadata_decoder decoder;
+  fabricrpc::metadata_view view;
+  BOOST_REQUIRE(decoder.decode(first, &view).ok());
+  BOOST_CHECK_EQUAL(decoder.ack(), 0);
+  BOOST_REQUIRE(decoder.decode(unacked, &view).ok());
+  BOOST_CHECK_EQUAL(decoder.ack(), 1);
+  BOOST_REQUIRE(decoder.decode(insert, &view).ok());
+  BOOST_CHECK_EQUAL(decoder.ack(), 1);
+  BOOST_REQUIRE_EQUAL(view.entries().size(), 3);
+  BOOST_CHECK_EQUAL(view.entries()[2].second, "contoso");
+
+  // bad input
+  fabricrpc::metadata_view bad;
+  BOOST_CHECK(!decoder.decode("\xff", &bad).ok());
+  BOOST_CHECK(!decoder.decode(std::string(1, '\x80'), &bad).ok());
+}
+
+// the request with an insert is lost, i.e. it timed out in transport.
+BOOST_AUTO_TEST_CASE(metadata_lost_insert_test) {
+  fabricrpc::metadata_encoder encoder;
+  fabricrpc::metadata_decoder decoder;
+  fabricrpc::metadata tenant;
+  tenant.add("tenant", "contoso");
+  fabricrpc::metadata custom;
+  custom.add("x-custom", "value");
+
+  auto send = [&](const fabricrpc::metadata &md, bool lost) -> std::size_t {
+    std::string encoded;
+    encoder.encode(md, &encoded);
+    if (!lost) {
+      fabricrpc::metadata_view view;
+      BOOST_REQUIRE(decoder.decode(encoded, &view).ok());
+      BOOST_REQUIRE_EQUAL(view.entries().size(), 1);
+      BOOST_CHECK_EQUAL(view.entries()[0].second, md.entries()[0].second);
+    }
+    std::string slots;
+    std::uint32_t count = decoder.ack(&slots);
+    encoder.on_ack(count, slots);
+    return encoded.size();
+  };
+
+  // slot 0 is lost, and slot 1 arrives.
+  send(tenant, false);
+  send(tenant, true);
+  send(custom, false);
+  send(custom, false);
+  std::string slots;
+  BOOST_CHECK_EQUAL(decoder.ack(&slots), 0);
+  BOOST_CHECK_EQUAL(slots, std::string(1, '\x01'));
+
+  // slot 1 is usable behind the gap.
+  BOOST_CHECK_EQUAL(send(custom, false), 1);
+  // slot 0 is inserted again on the next use.
+  BOOST_CHECK_GT(send(tenant, false), 1);
+  BOOST_CHECK_EQUAL(decoder.ack(&slots), 2);
+  BOOST_CHECK(slots.empty());
+  BOOST_CHECK_EQUAL(send(tenant, false), 1);
+}
+
+BOOST_AUTO_TEST_CASE(middleware_metadata_test) {
+  net::io_context ioc;
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<tenant_service>());
+  fabricrpc::connection_context server_ctx;
+  fabricrpc::metadata_tables client_tables;
+
+  fabricrpc::metadata request_md;
+  request_md.add("tenant", "contoso");
+
+  for (int i = 0; i < 2; i++) {
+    fabricrpc::request_header header;
+    header.set_url("/test.Tenant/Get");
+    client_tables.encoder.encode(request_md, header.mutable_metadata());
+    header.set_metadata_ack(client_tables.decoder.ack());
+    winrt::com_ptr<IFabricTransportMessage> req =
+        winrt::make<fabricrpc::tool_transport_msg>("",
+                                                   header.SerializeAsString());
+    winrt::com_ptr<IFabricTransportMessage> reply;
+    net::co_spawn(ioc,
+                  md.execute(req.get(), reply.put(), nullptr, &server_ctx),
+                  net::detached);
+    ioc.run();
+    ioc.restart();
+
+    fabricrpc::reply_header reply_header;
+    absl::Status st = fabricrpc::parse_reply_header(
+        fabricrpc::get_header(reply.get()), &reply_header);
+    BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+    client_tables.encoder.on_ack(reply_header.metadata_ack());
+    fabricrpc::metadata_view view;
+    BOOST_REQUIRE(
+        client_tables.decoder.decode(reply_header.metadata(), &view).ok());
+    BOOST_CHECK_EQUAL(*view.get("tenant"), "contoso");
+  }
+  // second request inserted the pair.
+  BOOST_CHECK_EQUAL(server_ctx.metadata.decoder.ack(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,58 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+class echo_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Echo"; }
+
+  net::awaitable<absl::Status> execute(const std::string &,
+                                       const std::string_view req,
+                                       std::string *resp) override {
+    resp->assign(req);
+    co_return absl::OkStatus();
+  }
+};
+
+// generated code uses the hash in case labels.
+static_assert(fabricrpc::method_hash("") == 14695981039346656037ull);
+static_assert(fabricrpc::method_hash("/test.Echo/Echo") !=
+              fabricrpc::method_hash("/test.Echo/Echo2"));
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(method_descriptor_test)
+
+// service name matches a whole url segment, not a prefix of it.
+BOOST_AUTO_TEST_CASE(middleware_route_test) {
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+
+  for (std::string url : {"/test.Echo/Echo", "/test.EchoMore/Echo",
+                          "/test.Echo"}) {
+    net::io_context ioc;
+    fabricrpc::request_header header;
+    header.set_url(url);
+    winrt::com_ptr<IFabricTransportMessage> req =
+        winrt::make<fabricrpc::tool_transport_msg>("body",
+                                                   header.SerializeAsString());
+    winrt::com_ptr<IFabricTransportMessage> reply;
+    net::co_spawn(ioc, md.execute(req.get(), reply.put(), nullptr, nullptr),
+                  net::detached);
+    ioc.run();
+    fabricrpc::reply_header reply_header;
+    absl::Status st = fabricrpc::parse_reply_header(
+        fabricrpc::get_header(reply.get()), &reply_header);
+    BOOST_CHECK_EQUAL(st.ok(), url == "/test.Echo/Echo");
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
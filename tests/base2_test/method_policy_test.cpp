@@ -0,0 +1,95 @@
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+constexpr fabricrpc::method_descriptor echo_method = {
+    "test.Policy", "Echo", "/test.Policy/Echo", fabricrpc::method_kind::unary,
+    false, true, 0};
+
+constexpr fabricrpc::method_descriptor threads_method = {
+    "test.Policy", "Threads", "/test.Policy/Threads",
+    fabricrpc::method_kind::unary, false, true, 1};
+
+// echos the url of the request into the reply message.
+class echo_handler {
+public:
+  absl::Status echo(fabricrpc::request_header *req,
+                    fabricrpc::reply_header *resp) {
+    if (req->url().empty()) {
+      return absl::InvalidArgumentError("no url");
+    }
+    resp->set_status_message(req->url());
+    return absl::OkStatus();
+  }
+};
+
+absl::Status call(const std::string &req) {
+  echo_handler h;
+  std::string resp;
+  return fabricrpc::codegen_sync_handler_helper<
+      fabricrpc::metrics_method_policy, fabricrpc::request_header,
+      fabricrpc::reply_header, decltype(&echo_handler::echo), echo_handler *>(
+      echo_method, req, &resp, &echo_handler::echo, &h);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(method_policy_test)
+
+BOOST_AUTO_TEST_CASE(metrics_policy_test) {
+  fabricrpc::request_header req;
+  req.set_url("/a/b");
+  BOOST_CHECK(call(req.SerializeAsString()).ok());
+  BOOST_CHECK(call(req.SerializeAsString()).ok());
+  BOOST_CHECK(absl::IsInvalidArgument(call("")));
+  BOOST_CHECK(!call("\xff").ok());
+
+  std::vector<fabricrpc::method_stats> stats =
+      fabricrpc::collect_method_stats();
+  auto it = std::find_if(stats.begin(), stats.end(),
+                         [](const fabricrpc::method_stats &s) {
+                           return s.method == &echo_method;
+                         });
+  BOOST_REQUIRE(it != stats.end());
+  BOOST_CHECK_EQUAL(it->calls, 4u);
+  BOOST_CHECK_EQUAL(it->parse_failed, 1u);
+  BOOST_CHECK_EQUAL(it->handler_failed, 1u);
+  BOOST_CHECK_EQUAL(it->serialize_failed, 0u);
+  BOOST_CHECK_EQUAL(it->latency.count(), 4u);
+  BOOST_CHECK_EQUAL(it->handler_latency.count(), 3u);
+}
+
+// calls of each thread go to its own slot, and are merged when collected.
+BOOST_AUTO_TEST_CASE(threads_merge_test) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([]() {
+      for (int j = 0; j < 10; j++) {
+        fabricrpc::metrics_method_policy call(threads_method);
+        call.parsed(absl::OkStatus());
+        call.handled(absl::OkStatus());
+        call.serialized(absl::OkStatus());
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  std::vector<fabricrpc::method_stats> stats =
+      fabricrpc::collect_method_stats();
+  auto it = std::find_if(stats.begin(), stats.end(),
+                         [](const fabricrpc::method_stats &s) {
+                           return s.method == &threads_method;
+                         });
+  BOOST_REQUIRE(it != stats.end());
+  BOOST_CHECK_EQUAL(it->calls, 40u);
+  BOOST_CHECK_EQUAL(it->latency.count(), 40u);
+  BOOST_CHECK_EQUAL(it->handler_latency.count(), 40u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
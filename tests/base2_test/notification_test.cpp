@@ -0,0 +1,156 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/ex_server.hpp>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+#include <chrono>
+#include <thread>
+
+namespace net = boost::asio;
+
+namespace {
+
+// make a notification msg as pushed by server.
+// reply_header is used as a payload proto
+winrt::com_ptr<IFabricTransportMessage> make_notification(std::string topic,
+                                                          int value) {
+  fabricrpc::reply_header payload;
+  payload.set_status_code(value);
+  std::string header;
+  std::string body;
+  absl::Status st =
+      fabricrpc::serialize_notification(topic, payload, &header, &body);
+  BOOST_REQUIRE(st.ok());
+  return winrt::make<fabricrpc::tool_transport_msg>(std::move(body),
+                                                    std::move(header));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(notification_test)
+
+BOOST_AUTO_TEST_CASE(serialize_notification_test) {
+  fabricrpc::reply_header payload;
+  std::string header;
+  std::string body;
+  absl::Status st =
+      fabricrpc::serialize_notification("", payload, &header, &body);
+  BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kInvalidArgument);
+
+  st = fabricrpc::serialize_notification("news", payload, &header, &body);
+  BOOST_REQUIRE(st.ok());
+  fabricrpc::callback_header parsed;
+  BOOST_REQUIRE(parsed.ParseFromString(header));
+  BOOST_CHECK_EQUAL(parsed.topic(), "news");
+}
+
+BOOST_AUTO_TEST_CASE(subscription_dispatch_test) {
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+
+  auto registry = std::make_shared<
+      fabricrpc::basic_subscription_registry<executor_type>>();
+  auto state =
+      std::make_shared<fabricrpc::basic_subscription_state<executor_type>>();
+  std::uint64_t id = registry->add("news", state);
+
+  fabricrpc::basic_subscription<executor_type> sub(ioc.get_executor());
+  sub.attach(registry, id, state);
+
+  // msgs of other topics are not received.
+  auto dispatch = [&](std::string topic, int value) {
+    winrt::com_ptr<IFabricTransportMessage> msg =
+        make_notification(topic, value);
+    fabricrpc::callback_header header;
+    BOOST_REQUIRE(header.ParseFromString(fabricrpc::get_header(msg.get())));
+    registry->dispatch(header, msg.get());
+  };
+  dispatch("news", 1);
+  dispatch("weather", 100);
+  dispatch("news", 2);
+
+  std::vector<int> values;
+  auto f = [&]() -> net::awaitable<void> {
+    for (int i = 0; i < 2; i++) {
+      fabricrpc::reply_header msg;
+      absl::Status st = co_await sub.async_read(&msg, net::use_awaitable);
+      BOOST_REQUIRE(st.ok());
+      values.push_back(msg.status_code());
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(values.size(), 2);
+  BOOST_CHECK_EQUAL(values[0], 1);
+  BOOST_CHECK_EQUAL(values[1], 2);
+}
+
+// the server pushes to a subscribed client over transport.
+BOOST_AUTO_TEST_CASE(server_push_test) {
+  fabricrpc::ex_server svr;
+  svr.add_admin_service();
+  fabricrpc::reply_header payload;
+  BOOST_CHECK_EQUAL(svr.push(L"none", "news", payload).code(),
+                    absl::StatusCode::kFailedPrecondition);
+  std::thread th([&]() { svr.serve(12351).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12351);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  std::vector<int> values;
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    fabricrpc::basic_subscription<executor_type> sub(ioc.get_executor());
+    BOOST_REQUIRE(rc.subscribe("news", &sub).ok());
+
+    // the server knows the client by the id of its connection.
+    fabricrpc::stats_request stats_req;
+    fabricrpc::stats_reply stats;
+    absl::Status st = co_await rc.async_send(
+        "/fabricrpc.Admin/GetStats", &stats_req, &stats, net::use_awaitable);
+    BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+    BOOST_REQUIRE_EQUAL(stats.connections_size(), 1);
+    const std::string &id = stats.connections(0).client_id();
+    std::wstring client_id(id.begin(), id.end());
+
+    payload.set_status_code(1);
+    st = svr.push(client_id, "news", payload);
+    BOOST_CHECK_MESSAGE(st.ok(), st.ToString());
+    payload.set_status_code(100);
+    BOOST_CHECK(svr.push(client_id, "weather", payload).ok());
+    payload.set_status_code(2);
+    BOOST_CHECK_EQUAL(svr.broadcast("news", payload), 1);
+    BOOST_CHECK_EQUAL(svr.push(L"none", "news", payload).code(),
+                      absl::StatusCode::kNotFound);
+
+    for (int i = 0; i < 2; i++) {
+      fabricrpc::reply_header msg;
+      st = co_await sub.async_read(&msg, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      values.push_back(msg.status_code());
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(values.size(), 2);
+  BOOST_CHECK_EQUAL(values[0], 1);
+  BOOST_CHECK_EQUAL(values[1], 2);
+
+  svr.shutdown();
+  th.join();
+  BOOST_CHECK_EQUAL(svr.broadcast("news", payload), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// counts calls of each url.
+class count_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Count"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view req,
+                                       std::string *) override {
+    calls[url].append(req);
+    co_return absl::OkStatus();
+  }
+
+  std::map<std::string, std::string> calls;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(one_way_test)
+
+BOOST_AUTO_TEST_CASE(middleware_one_way_test) {
+  net::io_context ioc;
+  fabricrpc::middleware md;
+  auto svc = std::make_shared<count_service>();
+  md.add_service(svc);
+
+  fabricrpc::request_header header;
+  header.set_url("/test.Count/Emit");
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>("event",
+                                                 header.SerializeAsString());
+  // unknown url is dropped
+  header.set_url("/test.Unknown/Emit");
+  winrt::com_ptr<IFabricTransportMessage> bad_req =
+      winrt::make<fabricrpc::tool_transport_msg>("event",
+                                                 header.SerializeAsString());
+
+  net::co_spawn(ioc, md.execute_one_way(req.get()), net::detached);
+  net::co_spawn(ioc, md.execute_one_way(bad_req.get()), net::detached);
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(svc->calls.size(), 1);
+  BOOST_CHECK_EQUAL(svc->calls["/test.Count/Emit"], "event");
+}
+
+BOOST_AUTO_TEST_CASE(one_way_request_test) {
+  winrt::com_ptr<IFabricTransportMessage> msg =
+      winrt::make<fabricrpc::tool_transport_msg>("", "");
+  fabricrpc::request req(L"client", msg, nullptr, nullptr);
+  BOOST_CHECK(req.is_one_way());
+  // no-op since nobody waits for the reply.
+  req.complete(S_OK, nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
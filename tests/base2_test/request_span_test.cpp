@@ -0,0 +1,119 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/request_span.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+#include <chrono>
+#include <string>
+
+namespace net = boost::asio;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+class echo_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Span"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+  bool execute_sync(const std::string &, const std::string_view req,
+                    std::string *resp, absl::Status *st) override {
+    resp->assign(req);
+    *st = absl::OkStatus();
+    return true;
+  }
+};
+
+// runs one unary request through md and returns the reply status.
+absl::Status run_request(fabricrpc::middleware &md, const std::string &url,
+                         fabricrpc::request_span *span) {
+  fabricrpc::request_header header;
+  header.set_url(url);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>("hello",
+                                                 header.SerializeAsString());
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::io_context ioc;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put(), nullptr, nullptr, span),
+                net::detached);
+  ioc.run();
+  return fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get()));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(request_span_test)
+
+BOOST_AUTO_TEST_CASE(stats_test) {
+  using fabricrpc::span_point;
+  auto t0 = fabricrpc::request_span::clock::now();
+  fabricrpc::request_span span;
+  span.mark(span_point::arrival, t0);
+  span.mark(span_point::header_parsed, t0 + 2us);
+  span.mark(span_point::handler_start, t0 + 3us);
+  span.mark(span_point::handler_end, t0 + 10us);
+  span.mark(span_point::completed, t0 + 12us);
+
+  fabricrpc::span_stats stats;
+  stats.record(span);
+  BOOST_CHECK(stats.total().max() == 12us);
+  BOOST_CHECK_EQUAL(stats.stage(span_point::arrival).count(), 0u);
+  // points not marked have no stage, and the next point takes their time.
+  BOOST_CHECK_EQUAL(stats.stage(span_point::dequeue).count(), 0u);
+  BOOST_CHECK_EQUAL(stats.stage(span_point::routed).count(), 0u);
+  BOOST_CHECK(stats.stage(span_point::header_parsed).max() == 2us);
+  BOOST_CHECK(stats.stage(span_point::handler_start).max() == 1us);
+  BOOST_CHECK(stats.stage(span_point::handler_end).max() == 7us);
+  BOOST_CHECK(stats.stage(span_point::completed).max() == 2us);
+}
+
+BOOST_AUTO_TEST_CASE(middleware_test) {
+  using fabricrpc::span_point;
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<echo_service>());
+  // no sink, no span.
+  fabricrpc::request_span span;
+  BOOST_CHECK(md.span_of(span) == nullptr);
+  auto stats = std::make_shared<fabricrpc::span_stats>();
+  md.set_span_sink(stats);
+  BOOST_REQUIRE(md.span_of(span) == &span);
+
+  span.mark(span_point::arrival);
+  BOOST_REQUIRE(run_request(md, "/test.Span/Echo", &span).ok());
+  span.mark(span_point::completed);
+  const span_point marked[] = {
+      span_point::arrival,       span_point::header_parsed,
+      span_point::routed,        span_point::body_parsed,
+      span_point::handler_start, span_point::handler_end,
+      span_point::reply_serialized, span_point::completed};
+  for (std::size_t i = 0; i < std::size(marked); i++) {
+    BOOST_CHECK_MESSAGE(span.has(marked[i]),
+                        fabricrpc::span_point_name(marked[i]));
+    if (i > 0) {
+      BOOST_CHECK(span.at(marked[i - 1]) <= span.at(marked[i]));
+    }
+  }
+  md.record_span(span);
+  BOOST_CHECK_EQUAL(stats->total().count(), 1u);
+  BOOST_CHECK_EQUAL(stats->stage(span_point::handler_end).count(), 1u);
+
+  // unknown services are not handled.
+  fabricrpc::request_span unknown;
+  BOOST_CHECK_EQUAL(run_request(md, "/test.None/Echo", &unknown).code(),
+                    absl::StatusCode::kUnimplemented);
+  BOOST_CHECK(unknown.has(span_point::routed));
+  BOOST_CHECK(!unknown.has(span_point::handler_start));
+  BOOST_CHECK(!unknown.has(span_point::handler_end));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
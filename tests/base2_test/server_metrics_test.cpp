@@ -0,0 +1,136 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+#include <string>
+#include <thread>
+
+namespace net = boost::asio;
+
+namespace {
+
+// runs one unary request through md and returns the reply status and body.
+absl::Status run_request(fabricrpc::middleware &md, const std::string &url,
+                         const std::string &body, std::string *reply_body) {
+  fabricrpc::request_header header;
+  header.set_url(url);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>(body,
+                                                 header.SerializeAsString());
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::io_context ioc;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put()), net::detached);
+  ioc.run();
+  *reply_body = fabricrpc::get_body(reply.get());
+  return fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get()));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(server_metrics_test)
+
+BOOST_AUTO_TEST_CASE(collect_test) {
+  using fabricrpc::server_metric;
+  fabricrpc::server_metrics before = fabricrpc::collect_server_metrics();
+  fabricrpc::add_server_metric(server_metric::bytes_in, 0);
+  std::size_t threads = fabricrpc::server_metric_threads();
+  // a gauge moved up and down by different threads adds up to 0.
+  std::thread t1([]() {
+    for (int i = 0; i < 1000; i++) {
+      fabricrpc::add_server_metric(server_metric::bytes_in, 2);
+      fabricrpc::add_server_metric(server_metric::in_flight);
+    }
+  });
+  std::thread t2([]() {
+    for (int i = 0; i < 1000; i++) {
+      fabricrpc::add_server_metric(server_metric::bytes_in, 3);
+    }
+  });
+  t1.join();
+  t2.join();
+  fabricrpc::add_server_metric(server_metric::in_flight, -1000);
+  // values of exited threads are kept, and their slots are freed.
+  BOOST_CHECK_EQUAL(fabricrpc::server_metric_threads(), threads);
+  fabricrpc::server_metrics after = fabricrpc::collect_server_metrics();
+  BOOST_CHECK_EQUAL(after.get(server_metric::bytes_in) -
+                        before.get(server_metric::bytes_in),
+                    5000);
+  BOOST_CHECK_EQUAL(after.get(server_metric::in_flight),
+                    before.get(server_metric::in_flight));
+  BOOST_CHECK_EQUAL(
+      fabricrpc::server_metric_name(server_metric::rejected),
+      std::string("rejected"));
+}
+
+BOOST_AUTO_TEST_CASE(admin_test) {
+  using fabricrpc::server_metric;
+  fabricrpc::middleware md;
+  md.add_service(std::make_shared<fabricrpc::admin_service>([]() {
+    return std::vector<fabricrpc::connection_stats>{{L"client1", 3}};
+  }));
+
+  fabricrpc::server_metrics before = fabricrpc::collect_server_metrics();
+  std::string body;
+  BOOST_CHECK_EQUAL(
+      run_request(md, "/fabricrpc.None/GetStats", "", &body).code(),
+      absl::StatusCode::kUnimplemented);
+  BOOST_CHECK_EQUAL(
+      run_request(md, "/fabricrpc.Admin/None", "", &body).code(),
+      absl::StatusCode::kUnimplemented);
+
+  fabricrpc::stats_request request;
+  BOOST_REQUIRE(run_request(md, "/fabricrpc.Admin/GetStats",
+                            request.SerializeAsString(), &body)
+                    .ok());
+  fabricrpc::stats_reply reply;
+  BOOST_REQUIRE(reply.ParseFromString(body));
+
+  BOOST_REQUIRE_EQUAL(reply.metrics_size(),
+                      static_cast<int>(server_metric::count));
+  for (int i = 0; i < reply.metrics_size(); i++) {
+    server_metric metric = static_cast<server_metric>(i);
+    BOOST_CHECK_EQUAL(reply.metrics(i).name(),
+                      fabricrpc::server_metric_name(metric));
+  }
+  // the unknown service is rejected. The unknown admin method reaches the
+  // service, and GetStats counts itself.
+  const fabricrpc::metric_value &rejected =
+      reply.metrics(static_cast<int>(server_metric::rejected));
+  BOOST_CHECK_EQUAL(rejected.value() - before.get(server_metric::rejected),
+                    1);
+  const fabricrpc::metric_value &accepted =
+      reply.metrics(static_cast<int>(server_metric::accepted));
+  BOOST_CHECK_EQUAL(accepted.value() - before.get(server_metric::accepted),
+                    2);
+
+  // latency is recorded per url for any service. The unknown admin method
+  // is not a url of the server.
+  for (const fabricrpc::method_metrics &m : reply.methods()) {
+    BOOST_CHECK_NE(m.path(), "/fabricrpc.Admin/None");
+  }
+  // the first GetStats is recorded after its reply.
+  BOOST_REQUIRE(run_request(md, "/fabricrpc.Admin/GetStats",
+                            request.SerializeAsString(), &body)
+                    .ok());
+  BOOST_REQUIRE(reply.ParseFromString(body));
+  const fabricrpc::method_metrics *stats = nullptr;
+  for (const fabricrpc::method_metrics &m : reply.methods()) {
+    if (m.path() == "/fabricrpc.Admin/GetStats") {
+      stats = &m;
+    }
+  }
+  BOOST_REQUIRE(stats != nullptr);
+  BOOST_CHECK_GE(stats->calls(), 1u);
+  BOOST_CHECK_EQUAL(stats->failed(), 0u);
+  BOOST_CHECK_GE(stats->latency_p99_us(), stats->handler_p99_us());
+
+  BOOST_REQUIRE_EQUAL(reply.connections_size(), 1);
+  BOOST_CHECK_EQUAL(reply.connections(0).client_id(), "client1");
+  BOOST_CHECK_EQUAL(reply.connections(0).queue_depth(), 3u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
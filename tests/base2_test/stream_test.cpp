@@ -0,0 +1,511 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/ex_server.hpp>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+#include <atomic>
+#include <thread>
+
+namespace net = boost::asio;
+
+namespace {
+
+// make a callback msg as sent by server_writer
+winrt::com_ptr<IFabricTransportMessage>
+make_chunk(std::uint64_t stream_id, std::uint64_t sequence, int value,
+           bool end_of_stream) {
+  fabricrpc::callback_header header;
+  header.set_stream_id(stream_id);
+  header.set_sequence(sequence);
+  header.set_end_of_stream(end_of_stream);
+  std::string body;
+  if (!end_of_stream) {
+    // reply_header is used as a payload proto
+    fabricrpc::reply_header payload;
+    payload.set_status_code(value);
+    body = payload.SerializeAsString();
+  }
+  return winrt::make<fabricrpc::tool_transport_msg>(
+      std::move(body), header.SerializeAsString());
+}
+
+// connection that counts the chunks sent to the client.
+class counting_connection
+    : public winrt::implements<counting_connection,
+                               IFabricTransportClientConnection> {
+public:
+  HRESULT STDMETHODCALLTYPE Send(IFabricTransportMessage *) override {
+    sent++;
+    return S_OK;
+  }
+
+  COMMUNICATION_CLIENT_ID STDMETHODCALLTYPE get_ClientId() override {
+    return L"counting";
+  }
+
+  int sent = 0;
+};
+
+// replies count chunks with values 0 to count - 1.
+// count is passed in status_code of request.
+class stream_service : public fabricrpc::service {
+public:
+  stream_service()
+      : written(0), sums_done(0), sum_code(absl::StatusCode::kOk) {}
+
+  // chunks written by the last Count call.
+  std::atomic<int> written;
+  // Sum calls returned, and the code of the last one.
+  std::atomic<int> sums_done;
+  std::atomic<absl::StatusCode> sum_code;
+
+  const std::string_view name() override { return "test.Stream"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+  net::awaitable<absl::Status>
+  execute_stream(const std::string &url, const std::string_view req,
+                 fabricrpc::server_writer *writer) override {
+    if (url != "/test.Stream/Count") {
+      co_return absl::UnimplementedError(url);
+    }
+    fabricrpc::reply_header request;
+    absl::Status st = fabricrpc::parse_proto_payload(req, &request);
+    if (!st.ok()) {
+      co_return st;
+    }
+    written = 0;
+    for (int i = 0; i < request.status_code(); i++) {
+      fabricrpc::reply_header chunk;
+      chunk.set_status_code(i);
+      st = co_await writer->write(chunk);
+      if (!st.ok()) {
+        co_return st;
+      }
+      written++;
+    }
+    co_return absl::OkStatus();
+  }
+
+  // Sum replies the sum of values of all requests. Stuck does not read for
+  // a second.
+  net::awaitable<absl::Status>
+  execute_client_stream(const std::string &url,
+                        fabricrpc::server_reader *reader,
+                        std::string *resp) override {
+    if (url == "/test.Stream/Stuck") {
+      net::steady_timer timer(co_await net::this_coro::executor);
+      timer.expires_after(std::chrono::seconds(1));
+      boost::system::error_code ec;
+      co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+      co_return absl::OkStatus();
+    }
+    if (url != "/test.Stream/Sum") {
+      co_return absl::UnimplementedError(url);
+    }
+    fabricrpc::reply_header msg;
+    int sum = 0;
+    while (co_await reader->read(&msg)) {
+      sum += msg.status_code();
+    }
+    absl::Status st = reader->status();
+    if (st.ok()) {
+      fabricrpc::reply_header reply;
+      reply.set_status_code(sum);
+      st = fabricrpc::serialize_proto_payload(&reply, resp);
+    }
+    sum_code = st.code();
+    sums_done++;
+    co_return st;
+  }
+};
+
+// waits up to 1s for n Sum calls to return.
+net::awaitable<void> wait_sums_done(stream_service *svc, int n) {
+  net::steady_timer timer(co_await net::this_coro::executor);
+  for (int i = 0; i < 100 && svc->sums_done.load() < n; i++) {
+    timer.expires_after(std::chrono::milliseconds(10));
+    co_await timer.async_wait(net::use_awaitable);
+  }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(stream_test)
+
+BOOST_AUTO_TEST_CASE(stream_reorder_test) {
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+
+  auto registry =
+      std::make_shared<fabricrpc::basic_stream_registry<executor_type>>();
+  auto state = std::make_shared<fabricrpc::basic_stream_state<executor_type>>();
+  std::uint64_t id = registry->add(state);
+
+  fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor());
+  reader.attach(registry, id, state);
+
+  // chunks arrive out of order, with a duplicate and a msg of another stream.
+  registry->dispatch(make_chunk(id, 1, 1, false).get());
+  registry->dispatch(make_chunk(id + 1, 0, 100, false).get());
+  registry->dispatch(make_chunk(id, 3, 0, true).get());
+  registry->dispatch(make_chunk(id, 0, 0, false).get());
+  registry->dispatch(make_chunk(id, 1, 1, false).get());
+  registry->dispatch(make_chunk(id, 2, 2, false).get());
+
+  std::vector<int> values;
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::reply_header msg;
+    while (co_await reader.async_read(&msg, net::use_awaitable)) {
+      values.push_back(msg.status_code());
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(values.size(), 3);
+  BOOST_CHECK_EQUAL(values[0], 0);
+  BOOST_CHECK_EQUAL(values[1], 1);
+  BOOST_CHECK_EQUAL(values[2], 2);
+  BOOST_CHECK(reader.status().ok());
+}
+
+BOOST_AUTO_TEST_CASE(server_stream_test) {
+  fabricrpc::ex_server svr;
+  svr.add_service(std::make_shared<stream_service>());
+  std::thread th([&]() { svr.serve(12346).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12346);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    // stream with chunks
+    {
+      fabricrpc::reply_header request;
+      request.set_status_code(5);
+      fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor());
+      absl::Status st = co_await rc.async_open_stream(
+          "/test.Stream/Count", &request, &reader, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      fabricrpc::reply_header msg;
+      int count = 0;
+      while (co_await reader.async_read(&msg, net::use_awaitable)) {
+        BOOST_CHECK_EQUAL(msg.status_code(), count);
+        count++;
+      }
+      BOOST_CHECK_EQUAL(count, 5);
+      BOOST_CHECK_MESSAGE(reader.status().ok(), reader.status().ToString());
+    }
+    // handler error ends the stream
+    {
+      fabricrpc::reply_header request;
+      fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor());
+      absl::Status st = co_await rc.async_open_stream(
+          "/test.Stream/NotFound", &request, &reader, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      fabricrpc::reply_header msg;
+      bool has_msg = co_await reader.async_read(&msg, net::use_awaitable);
+      BOOST_CHECK(!has_msg);
+      BOOST_CHECK_EQUAL(reader.status().code(),
+                        absl::StatusCode::kUnimplemented);
+    }
+    // unknown service fails to open
+    {
+      fabricrpc::reply_header request;
+      fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor());
+      absl::Status st = co_await rc.async_open_stream(
+          "/test.Other/Count", &request, &reader, net::use_awaitable);
+      BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kUnimplemented);
+      fabricrpc::reply_header msg;
+      bool has_msg = co_await reader.async_read(&msg, net::use_awaitable);
+      BOOST_CHECK(!has_msg);
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  svr.shutdown();
+  th.join();
+}
+
+// the writer waits for a slow reader once the window is full.
+BOOST_AUTO_TEST_CASE(stream_window_test) {
+  fabricrpc::ex_server svr;
+  auto svc = std::make_shared<stream_service>();
+  svr.add_service(svc);
+  std::thread th([&]() { svr.serve(12348).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12348);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  constexpr int count = 40;
+  constexpr std::uint32_t window = 4;
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    net::steady_timer timer(ioc);
+    // the reader stops after one msg, which is not acked yet.
+    {
+      fabricrpc::reply_header request;
+      request.set_status_code(count);
+      fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor(),
+                                                           window);
+      absl::Status st = co_await rc.async_open_stream(
+          "/test.Stream/Count", &request, &reader, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      fabricrpc::reply_header msg;
+      BOOST_REQUIRE(co_await reader.async_read(&msg, net::use_awaitable));
+      timer.expires_after(std::chrono::milliseconds(200));
+      co_await timer.async_wait(net::use_awaitable);
+      BOOST_CHECK_EQUAL(svc->written.load(), window);
+
+      int read = 1;
+      while (co_await reader.async_read(&msg, net::use_awaitable)) {
+        BOOST_CHECK_EQUAL(msg.status_code(), read);
+        read++;
+      }
+      BOOST_CHECK_EQUAL(read, count);
+      BOOST_CHECK_MESSAGE(reader.status().ok(), reader.status().ToString());
+      BOOST_CHECK_EQUAL(svc->written.load(), count);
+    }
+    // without a window the writer does not wait.
+    {
+      fabricrpc::reply_header request;
+      request.set_status_code(count);
+      fabricrpc::basic_stream_reader<executor_type> reader(ioc.get_executor(),
+                                                           0);
+      absl::Status st = co_await rc.async_open_stream(
+          "/test.Stream/Count", &request, &reader, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      fabricrpc::reply_header msg;
+      BOOST_REQUIRE(co_await reader.async_read(&msg, net::use_awaitable));
+      timer.expires_after(std::chrono::milliseconds(200));
+      co_await timer.async_wait(net::use_awaitable);
+      BOOST_CHECK_EQUAL(svc->written.load(), count);
+      while (co_await reader.async_read(&msg, net::use_awaitable)) {
+      }
+      BOOST_CHECK_MESSAGE(reader.status().ok(), reader.status().ToString());
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  svr.shutdown();
+  th.join();
+}
+
+// acks of chunks not sent yet do not wrap the window.
+BOOST_AUTO_TEST_CASE(stream_ack_clamp_test) {
+  net::io_context ioc;
+  winrt::com_ptr<counting_connection> conn =
+      winrt::make_self<counting_connection>();
+  fabricrpc::server_writer writer(conn.as<IFabricTransportClientConnection>(),
+                                  1, ioc.get_executor(), 2);
+  writer.on_ack(100);
+
+  int written = 0;
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::reply_header chunk;
+    for (int i = 0; i < 4; i++) {
+      absl::Status st = co_await writer.write(chunk);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      written++;
+      if (written == 2) {
+        // same as an ack of the 2 chunks sent.
+        writer.on_ack(UINT64_MAX);
+      }
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run_for(std::chrono::seconds(1));
+  BOOST_CHECK_EQUAL(written, 4);
+  BOOST_CHECK_EQUAL(conn->sent, 4);
+}
+
+BOOST_AUTO_TEST_CASE(client_stream_test) {
+  fabricrpc::ex_server svr;
+  svr.add_service(std::make_shared<stream_service>());
+  std::thread th([&]() { svr.serve(12347).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12347);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    // each msg is sent in its own transport msg
+    {
+      auto writer = rc.open_client_stream("/test.Stream/Sum");
+      for (int i = 1; i <= 10; i++) {
+        fabricrpc::reply_header msg;
+        msg.set_status_code(i);
+        absl::Status st = co_await writer.async_write(&msg, net::use_awaitable);
+        BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      }
+      fabricrpc::reply_header reply;
+      absl::Status st =
+          co_await writer.async_finish(&reply, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      BOOST_CHECK_EQUAL(reply.status_code(), 55);
+    }
+    // empty stream
+    {
+      auto writer = rc.open_client_stream("/test.Stream/Sum");
+      fabricrpc::reply_header reply;
+      absl::Status st =
+          co_await writer.async_finish(&reply, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      BOOST_CHECK_EQUAL(reply.status_code(), 0);
+    }
+    // unknown service fails on the first msg
+    {
+      auto writer = rc.open_client_stream("/test.Other/Sum");
+      fabricrpc::reply_header msg;
+      absl::Status st = co_await writer.async_write(&msg, net::use_awaitable);
+      BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kUnimplemented);
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  svr.shutdown();
+  th.join();
+}
+
+// the handler reads an error once the client disconnects in the middle of
+// the stream, and the server drops the stream.
+BOOST_AUTO_TEST_CASE(client_stream_disconnect_test) {
+  fabricrpc::ex_server svr;
+  auto svc = std::make_shared<stream_service>();
+  svr.add_service(svc);
+  std::thread th([&]() { svr.serve(12349).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12349);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    auto writer = rc.open_client_stream("/test.Stream/Sum");
+    for (int i = 1; i <= 2; i++) {
+      fabricrpc::reply_header msg;
+      msg.set_status_code(i);
+      absl::Status st = co_await writer.async_write(&msg, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+    }
+    BOOST_CHECK_EQUAL(svc->sums_done.load(), 0);
+    // no end of stream is sent.
+    boost::system::error_code ec = conn.close();
+    BOOST_CHECK(!ec.failed());
+    co_await wait_sums_done(svc.get(), 1);
+    BOOST_CHECK_EQUAL(svc->sums_done.load(), 1);
+    BOOST_CHECK(svc->sum_code.load() == absl::StatusCode::kUnavailable);
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  svr.shutdown();
+  th.join();
+}
+
+// the handler reads an error once the client sends nothing for the idle
+// timeout, and later msgs of the stream fail. A chunk the handler does not
+// take fails after the same timeout.
+BOOST_AUTO_TEST_CASE(client_stream_idle_test) {
+  fabricrpc::ex_server svr;
+  auto svc = std::make_shared<stream_service>();
+  svr.add_service(svc);
+  svr.set_client_stream_idle_timeout(std::chrono::milliseconds(50));
+  std::thread th([&]() { svr.serve(12350).IgnoreError(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  net::io_context ioc;
+  typedef net::io_context::executor_type executor_type;
+  fabricrpc::endpoint ep(L"localhost", 12350);
+  fabricrpc::basic_client_connection<executor_type> conn(ioc.get_executor());
+  boost::system::error_code ec = conn.open(ep);
+  BOOST_REQUIRE(!ec.failed());
+
+  auto f = [&]() -> net::awaitable<void> {
+    fabricrpc::rpc_client<executor_type> rc(conn);
+    // msgs within the timeout keep the stream.
+    {
+      auto writer = rc.open_client_stream("/test.Stream/Sum");
+      net::steady_timer timer(ioc);
+      for (int i = 1; i <= 4; i++) {
+        fabricrpc::reply_header msg;
+        msg.set_status_code(i);
+        absl::Status st =
+            co_await writer.async_write(&msg, net::use_awaitable);
+        BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+        timer.expires_after(std::chrono::milliseconds(20));
+        co_await timer.async_wait(net::use_awaitable);
+      }
+      fabricrpc::reply_header reply;
+      absl::Status st =
+          co_await writer.async_finish(&reply, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      BOOST_CHECK_EQUAL(reply.status_code(), 10);
+    }
+    // the client stops sending.
+    {
+      auto writer = rc.open_client_stream("/test.Stream/Sum");
+      fabricrpc::reply_header msg;
+      msg.set_status_code(1);
+      absl::Status st = co_await writer.async_write(&msg, net::use_awaitable);
+      BOOST_REQUIRE_MESSAGE(st.ok(), st.ToString());
+      co_await wait_sums_done(svc.get(), 2);
+      BOOST_CHECK_EQUAL(svc->sums_done.load(), 2);
+      BOOST_CHECK(svc->sum_code.load() ==
+                  absl::StatusCode::kDeadlineExceeded);
+      st = co_await writer.async_write(&msg, net::use_awaitable);
+      BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kFailedPrecondition);
+    }
+    // the handler does not take the chunk.
+    {
+      auto writer = rc.open_client_stream("/test.Stream/Stuck");
+      fabricrpc::reply_header msg;
+      auto start = std::chrono::steady_clock::now();
+      absl::Status st = co_await writer.async_write(&msg, net::use_awaitable);
+      BOOST_CHECK_EQUAL(st.code(), absl::StatusCode::kDeadlineExceeded);
+      BOOST_CHECK(std::chrono::steady_clock::now() - start <
+                  std::chrono::milliseconds(500));
+    }
+  };
+  net::co_spawn(ioc, f, net::detached);
+  ioc.run();
+
+  svr.shutdown();
+  th.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,75 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fabricrpc.pb.h>
+#include <fabricrpc/fabricrpc2.hpp>
+#include <fabricrpc_tool/tool_transport_msg.hpp>
+
+namespace net = boost::asio;
+
+namespace {
+
+// Echo is a sync handler, and Slow is not.
+class sync_service : public fabricrpc::service {
+public:
+  const std::string_view name() override { return "test.Sync"; }
+
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view req,
+                                       std::string *resp) override {
+    async_calls++;
+    resp->assign(req);
+    co_return url == "/test.Sync/Slow" ? absl::OkStatus()
+                                       : absl::UnimplementedError(url);
+  }
+
+  bool execute_sync(const std::string &url, const std::string_view req,
+                    std::string *resp, absl::Status *st) override {
+    if (url != "/test.Sync/Echo") {
+      return false;
+    }
+    sync_calls++;
+    resp->assign(req);
+    *st = absl::OkStatus();
+    return true;
+  }
+
+  int sync_calls = 0;
+  int async_calls = 0;
+};
+
+absl::Status run(fabricrpc::middleware &md, const std::string &url) {
+  net::io_context ioc;
+  fabricrpc::request_header header;
+  header.set_url(url);
+  winrt::com_ptr<IFabricTransportMessage> req =
+      winrt::make<fabricrpc::tool_transport_msg>("body",
+                                                 header.SerializeAsString());
+  winrt::com_ptr<IFabricTransportMessage> reply;
+  net::co_spawn(ioc, md.execute(req.get(), reply.put()), net::detached);
+  ioc.run();
+  BOOST_CHECK_EQUAL(fabricrpc::get_body(reply.get()), "body");
+  return fabricrpc::parse_reply_header(fabricrpc::get_header(reply.get()));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(sync_handler_test)
+
+BOOST_AUTO_TEST_CASE(middleware_sync_test) {
+  fabricrpc::middleware md;
+  auto svc = std::make_shared<sync_service>();
+  md.add_service(svc);
+
+  BOOST_CHECK(run(md, "/test.Sync/Echo").ok());
+  BOOST_CHECK_EQUAL(svc->sync_calls, 1);
+  BOOST_CHECK_EQUAL(svc->async_calls, 0);
+
+  // other methods fall back to execute.
+  BOOST_CHECK(run(md, "/test.Sync/Slow").ok());
+  BOOST_CHECK_EQUAL(svc->sync_calls, 1);
+  BOOST_CHECK_EQUAL(svc->async_calls, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
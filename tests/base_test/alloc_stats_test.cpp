@@ -0,0 +1,205 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include <boost/test/unit_test.hpp>
+
+#include <atlbase.h>
+#include <atlcom.h>
+
+#include <fabricrpc/exp/AsyncAnyContext.hpp>
+#include <fabricrpc_tool/alloc_stats.hpp>
+#include <fabricrpc_tool/loopback_transport.hpp>
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc/FRPCTransportMessage.hpp"
+#include "fabricrpc_test_helpers.hpp"
+#include "helloworld.fabricrpc.h"
+
+#include <string>
+
+namespace {
+
+// Budgets of one v1 unary call with a name of payload_size bytes. Bytes are
+// budgeted as multiples of the payload, so one more copy of the body fails
+// the test. Lower a budget when an allocation is removed, and only raise it
+// on purpose.
+constexpr std::size_t payload_size = 4096;
+constexpr std::size_t small_bytes = 1024;
+
+struct budget {
+  fabricrpc::alloc_phase phase;
+  std::uint64_t allocs;
+  std::uint64_t bytes;
+};
+
+// get_body concats the body from a temporary copy of each buffer, and the
+// handler takes one more copy of the body. Allocations are mostly the COM
+// objects and operations of the call.
+const budget server_budgets[] = {
+    {fabricrpc::alloc_phase::server_decode, 24, 3 * payload_size + small_bytes},
+    // the request proto, the copy of the name, the reply proto and its bytes.
+    {fabricrpc::alloc_phase::server_handler, 8, 4 * payload_size + small_bytes},
+    // the reply body is moved into the message.
+    {fabricrpc::alloc_phase::server_encode, 8, small_bytes},
+};
+
+// the reply is copied out of the transport message as on the server, and
+// the body is copied again before the reply proto is parsed.
+const budget client_budgets[] = {
+    {fabricrpc::alloc_phase::client_encode, 12, payload_size + small_bytes},
+    {fabricrpc::alloc_phase::client_decode, 12, 4 * payload_size + small_bytes},
+};
+
+void check_budget(const budget &b, std::uint64_t calls) {
+  fabricrpc::alloc_counts c = fabricrpc::get_alloc_counts(b.phase);
+  BOOST_TEST_MESSAGE(fabricrpc::alloc_phase_name(b.phase)
+                     << ": " << c.allocs / calls << " allocs "
+                     << c.bytes / calls << " bytes per call");
+  BOOST_CHECK_MESSAGE(c.allocs <= b.allocs * calls,
+                      fabricrpc::alloc_phase_name(b.phase)
+                          << " allocs " << c.allocs / calls << " over budget "
+                          << b.allocs);
+  BOOST_CHECK_MESSAGE(c.bytes <= b.bytes * calls,
+                      fabricrpc::alloc_phase_name(b.phase)
+                          << " bytes " << c.bytes / calls << " over budget "
+                          << b.bytes);
+}
+
+// replies the name as is, and completes synchronously.
+class Service_Impl_Echo : public helloworld::FabricHello::Service {
+public:
+  fabricrpc::Status
+  BeginSayHello(const ::helloworld::FabricRequest *request,
+                DWORD timeoutMilliseconds,
+                IFabricAsyncOperationCallback *callback,
+                /*out*/ IFabricAsyncOperationContext **context) override {
+    CComPtr<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>> ctxPtr(
+        new CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>());
+    std::string name = request->fabricname();
+    ctxPtr->SetContent(std::move(name));
+    ctxPtr->Initialize(callback);
+    callback->Invoke(ctxPtr);
+    *context = ctxPtr.Detach();
+    return fabricrpc::Status();
+  }
+
+  fabricrpc::Status
+  EndSayHello(IFabricAsyncOperationContext *context,
+              /*out*/ ::helloworld::FabricResponse *response) override {
+    CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *ctx =
+        dynamic_cast<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *>(
+            context);
+    response->set_fabricmessage(ctx->GetContent());
+    return fabricrpc::Status();
+  }
+};
+
+winrt::com_ptr<IFabricTransportMessageHandler> MakeEchoHandler() {
+  std::shared_ptr<fabricrpc::MiddleWare> svc =
+      std::make_shared<Service_Impl_Echo>();
+  winrt::com_ptr<IFabricTransportMessageHandler> handler;
+  helloworld::CreateFabricRPCRequestHandler({svc}, handler.put());
+  return handler;
+}
+
+using testconverter =
+    fabricrpc::FabricRPCHeaderProtoConverter<fabricrpc::request_header,
+                                             fabricrpc::reply_header>;
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(test_alloc_stats,
+                      *boost::unit_test::enable_if<
+                          fabricrpc::alloc_stats_enabled()>())
+
+// drives the request handler with messages, as transport does.
+BOOST_AUTO_TEST_CASE(server_budget_test) {
+  winrt::com_ptr<IFabricTransportMessageHandler> handler = MakeEchoHandler();
+  testconverter cv;
+
+  fabricrpc::FabricRPCRequestHeader header("/helloworld.FabricHello/SayHello");
+  std::string header_str;
+  BOOST_REQUIRE(cv.SerializeRequestHeader(&header, &header_str));
+  helloworld::FabricRequest req;
+  req.set_fabricname(std::string(payload_size, 'a'));
+  const std::string body_str = req.SerializeAsString();
+
+  constexpr std::uint64_t calls = 16;
+  fabricrpc::reset_alloc_counts();
+  for (std::uint64_t i = 0; i < calls; i++) {
+    CComPtr<CComObjectNoLock<fabricrpc::FRPCTransportMessage>> msg(
+        new CComObjectNoLock<fabricrpc::FRPCTransportMessage>());
+    msg->Initialize(header_str, body_str);
+
+    winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+        winrt::make<fabricrpc::waitable_callback>();
+    winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+    HRESULT hr =
+        handler->BeginProcessRequest(0, msg, 1000, callback.get(), ctx.put());
+    BOOST_REQUIRE_EQUAL(hr, S_OK);
+    callback->Wait();
+    winrt::com_ptr<IFabricTransportMessage> reply;
+    hr = handler->EndProcessRequest(ctx.get(), reply.put());
+    BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+    CComPtr<CComObjectNoLock<fabricrpc::FRPCTransportMessage>> replyMsg(
+        new CComObjectNoLock<fabricrpc::FRPCTransportMessage>());
+    replyMsg->CopyMsg(reply.get());
+    fabricrpc::FabricRPCReplyHeader replyHeader;
+    BOOST_REQUIRE(cv.DeserializeReplyHeader(&replyMsg->GetHeader(),
+                                            &replyHeader));
+    BOOST_REQUIRE_EQUAL(replyHeader.GetStatusCode(), 0);
+  }
+  for (const budget &b : server_budgets) {
+    check_budget(b, calls);
+  }
+}
+
+// calls the generated client over the loopback transport. Allocations of
+// the transport are not counted.
+BOOST_AUTO_TEST_CASE(client_budget_test) {
+  fabricrpc::set_transport(fabricrpc::loopback_transport());
+  winrt::com_ptr<IFabricTransportMessageHandler> handler = MakeEchoHandler();
+
+  constexpr ULONG maxMessageSize = 4 * payload_size;
+  myserver s;
+  HRESULT hr = s.StartServer(handler.get(), maxMessageSize);
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+  myclient c;
+  hr = c.Open(s.GetAddr(), maxMessageSize);
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+  helloworld::FabricHelloClient client(c.GetClient());
+  helloworld::FabricRequest req;
+  req.set_fabricname(std::string(payload_size, 'a'));
+
+  constexpr std::uint64_t calls = 16;
+  fabricrpc::reset_alloc_counts();
+  for (std::uint64_t i = 0; i < calls; i++) {
+    winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+        winrt::make<fabricrpc::waitable_callback>();
+    winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+    fabricrpc::Status err =
+        client.BeginSayHello(&req, 1000, callback.get(), ctx.put());
+    BOOST_REQUIRE(!err);
+    callback->Wait();
+    helloworld::FabricResponse resp;
+    err = client.EndSayHello(ctx.get(), &resp);
+    BOOST_REQUIRE(!err);
+    BOOST_REQUIRE_EQUAL(resp.fabricmessage().size(), payload_size);
+  }
+  for (const budget &b : client_budgets) {
+    check_budget(b, calls);
+  }
+
+  hr = c.Close();
+  BOOST_CHECK_EQUAL(hr, S_OK);
+  hr = s.CloseServer();
+  BOOST_CHECK_EQUAL(hr, S_OK);
+  fabricrpc::set_transport(fabricrpc::fabric_transport());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
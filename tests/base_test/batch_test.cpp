@@ -0,0 +1,108 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include <boost/test/unit_test.hpp>
+
+#include <atlbase.h>
+#include <atlcom.h>
+
+#include <fabricrpc/exp/AsyncAnyContext.hpp>
+#include <fabricrpc_tool/loopback_transport.hpp>
+
+#include "fabricrpc_test_helpers.hpp"
+#include "helloworld.fabricrpc.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// replies hello to the name, and fails requests without a name.
+class Service_Impl_Batch : public helloworld::FabricHello::Service {
+public:
+  fabricrpc::Status
+  BeginSayHello(const ::helloworld::FabricRequest *request,
+                DWORD timeoutMilliseconds,
+                IFabricAsyncOperationCallback *callback,
+                /*out*/ IFabricAsyncOperationContext **context) override {
+    UNREFERENCED_PARAMETER(timeoutMilliseconds);
+    if (request->fabricname().empty()) {
+      return fabricrpc::Status(fabricrpc::StatusCode::INVALID_ARGUMENT,
+                               "no name");
+    }
+    CComPtr<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>> ctxPtr(
+        new CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>());
+    ctxPtr->SetContent("hello " + request->fabricname());
+    ctxPtr->Initialize(callback);
+    callback->Invoke(ctxPtr);
+    *context = ctxPtr.Detach();
+    return fabricrpc::Status();
+  }
+
+  fabricrpc::Status
+  EndSayHello(IFabricAsyncOperationContext *context,
+              /*out*/ ::helloworld::FabricResponse *response) override {
+    CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *ctx =
+        dynamic_cast<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *>(
+            context);
+    response->set_fabricmessage(ctx->GetContent());
+    return fabricrpc::Status();
+  }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(test_batch)
+
+// the context of BeginBatch keeps the request count for EndBatch.
+BOOST_AUTO_TEST_CASE(client_batch_test) {
+  fabricrpc::set_transport(fabricrpc::loopback_transport());
+  std::shared_ptr<fabricrpc::MiddleWare> svc =
+      std::make_shared<Service_Impl_Batch>();
+  winrt::com_ptr<IFabricTransportMessageHandler> handler;
+  helloworld::CreateFabricRPCRequestHandler({svc}, handler.put());
+
+  myserver s;
+  HRESULT hr = s.StartServer(handler.get());
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+  myclient c;
+  hr = c.Open(s.GetAddr());
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+  helloworld::FabricHelloClient client(c.GetClient());
+  std::vector<helloworld::FabricRequest> reqs(3);
+  reqs[0].set_fabricname("a");
+  reqs[2].set_fabricname("c");
+  // twice, so the second batch is sent after the handshake.
+  for (int i = 0; i < 2; i++) {
+    winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+        winrt::make<fabricrpc::waitable_callback>();
+    winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+    fabricrpc::Status err =
+        client.BeginBatchSayHello(reqs, 1000, callback.get(), ctx.put());
+    BOOST_REQUIRE(!err);
+    callback->Wait();
+    std::vector<helloworld::FabricResponse> resps;
+    std::vector<fabricrpc::Status> statuses;
+    err = client.EndBatchSayHello(ctx.get(), &resps, &statuses);
+    BOOST_REQUIRE_MESSAGE(!err, err.GetErrorMessage());
+    BOOST_REQUIRE_EQUAL(statuses.size(), 3);
+    BOOST_CHECK(!statuses[0]);
+    BOOST_CHECK_EQUAL(resps[0].fabricmessage(), "hello a");
+    BOOST_CHECK_EQUAL(statuses[1].GetErrorCode(),
+                      fabricrpc::StatusCode::INVALID_ARGUMENT);
+    BOOST_CHECK(!statuses[2]);
+    BOOST_CHECK_EQUAL(resps[2].fabricmessage(), "hello c");
+  }
+
+  hr = c.Close();
+  BOOST_CHECK_EQUAL(hr, S_OK);
+  hr = s.CloseServer();
+  BOOST_CHECK_EQUAL(hr, S_OK);
+  fabricrpc::set_transport(fabricrpc::fabric_transport());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -83,6 +83,34 @@ BOOST_AUTO_TEST_CASE(message) {
   msgPtr12.Attach(msgPtr.Detach());
 }
 
+BOOST_AUTO_TEST_CASE(message_segments) {
+  std::string borrowed = "borrowed";
+  auto shared = std::make_shared<const std::string>("shared");
+  std::vector<fabricrpc::BodySegment> segments;
+  segments.push_back(fabricrpc::BodySegment::Owned("owned"));
+  segments.push_back(fabricrpc::BodySegment::Borrowed(borrowed));
+  segments.push_back(fabricrpc::BodySegment::Shared(shared));
+
+  CComPtr<CComObjectNoLock<fabricrpc::FRPCTransportMessage>> msgPtr(
+      new CComObjectNoLock<fabricrpc::FRPCTransportMessage>());
+  msgPtr->Initialize("myheader", std::move(segments));
+
+  // each segment is a buffer, and borrowed and shared data is not copied.
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *headerbuf = {};
+  const FABRIC_TRANSPORT_MESSAGE_BUFFER *msgbuf = {};
+  ULONG msgcount = 0;
+  msgPtr->GetHeaderAndBodyBuffer(&headerbuf, &msgcount, &msgbuf);
+  BOOST_REQUIRE_EQUAL(msgcount, 3);
+  BOOST_CHECK(msgbuf[1].Buffer == (BYTE *)borrowed.data());
+  BOOST_CHECK(msgbuf[2].Buffer == (BYTE *)shared->data());
+
+  // copy concats all segments.
+  CComPtr<CComObjectNoLock<fabricrpc::FRPCTransportMessage>> msgPtr2(
+      new CComObjectNoLock<fabricrpc::FRPCTransportMessage>());
+  msgPtr2->CopyMsg(msgPtr);
+  BOOST_CHECK_EQUAL(msgPtr2->GetBody(), "ownedborrowedshared");
+}
+
 BOOST_AUTO_TEST_CASE(statustest) {
   fabricrpc::Status s;
   BOOST_CHECK_EQUAL(s.GetErrorCode(), fabricrpc::StatusCode::OK);
@@ -100,6 +128,22 @@ BOOST_AUTO_TEST_CASE(statustest) {
   s = fabricrpc::Status(fabricrpc::StatusCode::INTERNAL, "Internal");
   BOOST_CHECK_EQUAL(s.GetErrorCode(), fabricrpc::StatusCode::INTERNAL);
   BOOST_CHECK_EQUAL(s.GetErrorMessage(), "Internal");
+
+  // copies own the message.
+  fabricrpc::Status s5 = s;
+  s = fabricrpc::Status();
+  BOOST_CHECK_EQUAL(s5.GetErrorMessage(), "Internal");
+
+  // code only status uses the code name.
+  fabricrpc::Status s6(fabricrpc::StatusCode::NOT_FOUND);
+  BOOST_CHECK(s6);
+  BOOST_CHECK_EQUAL(s6.GetErrorMessage(), "NOT_FOUND");
+
+  // static message is not copied.
+  static const std::string msg = "static message";
+  fabricrpc::Status s7(fabricrpc::StatusCode::INVALID_ARGUMENT, &msg);
+  BOOST_CHECK_EQUAL(&s7.GetErrorMessage(), &msg);
+  BOOST_CHECK_EQUAL(s7.GetTransportErrorCode(), S_OK);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -8,6 +8,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include "fabricrpc.pb.h"
+#include "fabricrpc/Capabilities.hpp"
+#include "fabricrpc/ClientHelpers.hpp"
+#include "fabricrpc/Codec.hpp"
 #include "fabricrpc/FRPCHeader.hpp"
 #include <memory>
 
@@ -57,4 +60,214 @@ BOOST_AUTO_TEST_CASE(test_reply_header_convert) {
   BOOST_CHECK_EQUAL(reply2.GetStatusMessage(), "mymessage");
 }
 
+BOOST_AUTO_TEST_CASE(test_batch_header_convert) {
+  testconverter cv;
+
+  fabricrpc::FabricRPCRequestHeader req("myurl");
+  BOOST_CHECK(!req.IsBatch());
+  req.SetBatchItemSizes({3, 0, 5});
+  std::string data;
+  BOOST_REQUIRE(cv.SerializeRequestHeader(&req, &data));
+
+  fabricrpc::FabricRPCRequestHeader req2;
+  BOOST_REQUIRE(cv.DeserializeRequestHeader(&data, &req2));
+  BOOST_CHECK(req2.IsBatch());
+  std::vector<std::uint32_t> expected = {3, 0, 5};
+  BOOST_CHECK_EQUAL_COLLECTIONS(req2.GetBatchItemSizes().begin(),
+                                req2.GetBatchItemSizes().end(),
+                                expected.begin(), expected.end());
+
+  fabricrpc::FabricRPCReplyHeader reply(0, "OK");
+  reply.AddBatchItemStatus(fabricrpc::FabricRPCBatchItemStatus(0, "OK", 3));
+  reply.AddBatchItemStatus(fabricrpc::FabricRPCBatchItemStatus(5, "bad", 0));
+  data.clear();
+  BOOST_REQUIRE(cv.SerializeReplyHeader(&reply, &data));
+
+  fabricrpc::FabricRPCReplyHeader reply2;
+  BOOST_REQUIRE(cv.DeserializeReplyHeader(&data, &reply2));
+  BOOST_CHECK_EQUAL(reply2.GetStatusCode(), 0);
+  const auto &items = reply2.GetBatchItemStatus();
+  BOOST_REQUIRE_EQUAL(items.size(), 2);
+  BOOST_CHECK_EQUAL(items[0].GetStatusCode(), 0);
+  BOOST_CHECK_EQUAL(items[0].GetBodySize(), 3);
+  BOOST_CHECK_EQUAL(items[1].GetStatusCode(), 5);
+  BOOST_CHECK_EQUAL(items[1].GetStatusMessage(), "bad");
+  BOOST_CHECK_EQUAL(items[1].GetBodySize(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_reply_size) {
+  testconverter cv;
+
+  // reply of 2 items, each body is a request_header.
+  fabricrpc::request_header body;
+  body.set_url("item");
+  std::string body_str = body.SerializeAsString();
+  fabricrpc::FabricRPCReplyHeader reply(0, "OK");
+  reply.AddBatchItemStatus(fabricrpc::FabricRPCBatchItemStatus(
+      0, "OK", static_cast<std::uint32_t>(body_str.size())));
+  reply.AddBatchItemStatus(fabricrpc::FabricRPCBatchItemStatus(5, "bad", 0));
+  std::string header_str;
+  BOOST_REQUIRE(cv.SerializeReplyHeader(&reply, &header_str));
+  CComPtr<CComObjectNoLock<fabricrpc::FRPCTransportMessage>> msg(
+      new CComObjectNoLock<fabricrpc::FRPCTransportMessage>());
+  msg->Initialize(header_str, body_str);
+
+  std::vector<fabricrpc::request_header> responses;
+  std::vector<fabricrpc::Status> statuses;
+  fabricrpc::PeerCapabilities peer;
+  fabricrpc::Status ec = fabricrpc::ParseClientBatchReply(
+      &cv, &peer, msg, 2, &responses, &statuses);
+  BOOST_REQUIRE(!ec);
+  BOOST_REQUIRE_EQUAL(statuses.size(), 2);
+  BOOST_CHECK(!statuses[0]);
+  BOOST_CHECK_EQUAL(responses[0].url(), "item");
+  BOOST_CHECK(statuses[1]);
+
+  // a short or long reply is not accepted.
+  for (std::size_t count : {1, 3}) {
+    ec = fabricrpc::ParseClientBatchReply(&cv, &peer, msg, count,
+                                          &responses, &statuses);
+    BOOST_CHECK(ec);
+    BOOST_CHECK(ec.GetErrorCode() == fabricrpc::StatusCode::UNKNOWN);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_codec_header_convert) {
+  testconverter cv;
+
+  fabricrpc::FabricRPCRequestHeader req("myurl");
+  req.SetCodec(fabricrpc::BodyCodec::Lz4);
+  req.SetUncompressedSize(2048);
+  req.SetAcceptCodec(fabricrpc::BodyCodec::Zstd);
+  std::string data;
+  BOOST_REQUIRE(cv.SerializeRequestHeader(&req, &data));
+
+  fabricrpc::FabricRPCRequestHeader req2;
+  BOOST_REQUIRE(cv.DeserializeRequestHeader(&data, &req2));
+  BOOST_CHECK(req2.GetCodec() == fabricrpc::BodyCodec::Lz4);
+  BOOST_CHECK_EQUAL(req2.GetUncompressedSize(), 2048);
+  BOOST_CHECK(req2.GetAcceptCodec() == fabricrpc::BodyCodec::Zstd);
+
+  fabricrpc::FabricRPCReplyHeader reply(0, "OK");
+  reply.SetCodec(fabricrpc::BodyCodec::Zstd);
+  reply.SetUncompressedSize(4096);
+  data.clear();
+  BOOST_REQUIRE(cv.SerializeReplyHeader(&reply, &data));
+
+  fabricrpc::FabricRPCReplyHeader reply2;
+  BOOST_REQUIRE(cv.DeserializeReplyHeader(&data, &reply2));
+  BOOST_CHECK(reply2.GetCodec() == fabricrpc::BodyCodec::Zstd);
+  BOOST_CHECK_EQUAL(reply2.GetUncompressedSize(), 4096);
+}
+
+BOOST_AUTO_TEST_CASE(test_handshake_header_convert) {
+  testconverter cv;
+
+  fabricrpc::FabricRPCRequestHeader req("myurl");
+  req.SetProtocolVersion(fabricrpc::ProtocolVersion);
+  req.SetCapabilities(fabricrpc::LocalCapabilities);
+  std::string data;
+  BOOST_REQUIRE(cv.SerializeRequestHeader(&req, &data));
+
+  fabricrpc::FabricRPCRequestHeader req2;
+  BOOST_REQUIRE(cv.DeserializeRequestHeader(&data, &req2));
+  BOOST_CHECK_EQUAL(req2.GetProtocolVersion(), fabricrpc::ProtocolVersion);
+  BOOST_CHECK_EQUAL(req2.GetCapabilities(), fabricrpc::LocalCapabilities);
+
+  // old peers do not set it.
+  fabricrpc::FabricRPCReplyHeader reply(0, "OK");
+  data.clear();
+  BOOST_REQUIRE(cv.SerializeReplyHeader(&reply, &data));
+  fabricrpc::FabricRPCReplyHeader reply2;
+  BOOST_REQUIRE(cv.DeserializeReplyHeader(&data, &reply2));
+  BOOST_CHECK_EQUAL(reply2.GetProtocolVersion(), 0);
+  BOOST_CHECK_EQUAL(reply2.GetCapabilities(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_client_handshake) {
+  std::string body(4096, 'a');
+  fabricrpc::CompressionOptions options;
+  options.Codec = fabricrpc::BodyCodec::Lz4;
+
+  // server is unknown: ask for it, and do not compress.
+  fabricrpc::PeerCapabilities peer;
+  fabricrpc::FabricRPCRequestHeader req("myurl");
+  fabricrpc::SetClientHandshake(&peer, &req);
+  BOOST_CHECK_EQUAL(req.GetProtocolVersion(), fabricrpc::ProtocolVersion);
+  BOOST_CHECK_EQUAL(req.GetCapabilities(), fabricrpc::LocalCapabilities);
+  std::string data = body;
+  BOOST_REQUIRE(!fabricrpc::CompressClientBody(&peer, options, &req, &data));
+  BOOST_CHECK(req.GetCodec() == fabricrpc::BodyCodec::None);
+  BOOST_CHECK_EQUAL(data, body);
+  BOOST_CHECK(peer.MayHave(fabricrpc::Capability::Batch));
+
+  // an old server ignores the handshake.
+  fabricrpc::PeerCapabilities old;
+  fabricrpc::LearnServerCapabilities(
+      &old, fabricrpc::FabricRPCReplyHeader(
+                fabricrpc::StatusCode::NOT_FOUND, "not found"));
+  BOOST_CHECK(!old.Known());
+  fabricrpc::LearnServerCapabilities(&old,
+                                     fabricrpc::FabricRPCReplyHeader(0, "OK"));
+  BOOST_CHECK(old.Known());
+  BOOST_CHECK_EQUAL(old.GetVersion(), 0);
+  BOOST_CHECK(!old.MayHave(fabricrpc::Capability::Batch));
+  BOOST_REQUIRE(!fabricrpc::CompressClientBody(&old, options, &req, &data));
+  BOOST_CHECK_EQUAL(data, body);
+
+  // a new server replies with its capabilities.
+  fabricrpc::FabricRPCReplyHeader reply(0, "OK");
+  reply.SetProtocolVersion(fabricrpc::ProtocolVersion);
+  reply.SetCapabilities(fabricrpc::LocalCapabilities);
+  fabricrpc::LearnServerCapabilities(&peer, reply);
+  BOOST_CHECK(peer.Has(fabricrpc::Capability::Compression));
+  fabricrpc::FabricRPCRequestHeader req2("myurl");
+  fabricrpc::SetClientHandshake(&peer, &req2);
+  BOOST_CHECK_EQUAL(req2.GetProtocolVersion(), 0);
+  BOOST_REQUIRE(!fabricrpc::CompressClientBody(&peer, options, &req2, &data));
+  BOOST_CHECK(req2.GetCodec() == fabricrpc::BodyCodec::Lz4);
+  BOOST_CHECK_EQUAL(req2.GetUncompressedSize(), body.size());
+  BOOST_CHECK_LT(data.size(), body.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_codec_roundtrip) {
+  std::string body(4096, 'a');
+  for (std::size_t i = 0; i < body.size(); i += 7) {
+    body[i] = static_cast<char>('a' + i % 26);
+  }
+  for (fabricrpc::BodyCodec codec :
+       {fabricrpc::BodyCodec::Lz4, fabricrpc::BodyCodec::Zstd}) {
+    std::string compressed;
+    BOOST_REQUIRE(!fabricrpc::CompressBody(codec, body, &compressed));
+    BOOST_CHECK_LT(compressed.size(), body.size());
+
+    std::string plain;
+    BOOST_REQUIRE(!fabricrpc::DecompressBody(
+        codec, compressed, static_cast<std::uint32_t>(body.size()),
+        fabricrpc::kDefaultMaxUncompressedSize, &plain));
+    BOOST_CHECK_EQUAL(plain, body);
+
+    // size in header does not match
+    BOOST_CHECK(fabricrpc::DecompressBody(
+        codec, compressed, static_cast<std::uint32_t>(body.size() + 1),
+        fabricrpc::kDefaultMaxUncompressedSize, &plain));
+
+    // a few bytes claiming a huge body fail before the body is allocated.
+    std::string huge;
+    BOOST_CHECK(fabricrpc::DecompressBody(
+        codec, compressed, 0xFFFFFFFF,
+        fabricrpc::kDefaultMaxUncompressedSize, &huge));
+    BOOST_CHECK(huge.empty());
+    BOOST_CHECK(fabricrpc::DecompressBody(
+        codec, compressed, static_cast<std::uint32_t>(body.size()),
+        body.size() - 1, &huge));
+  }
+
+  fabricrpc::CompressionOptions options;
+  BOOST_CHECK(!fabricrpc::ShouldCompress(options, body));
+  options.Codec = fabricrpc::BodyCodec::Lz4;
+  BOOST_CHECK(fabricrpc::ShouldCompress(options, body));
+  BOOST_CHECK(!fabricrpc::ShouldCompress(options, "small"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
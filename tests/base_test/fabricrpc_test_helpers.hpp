@@ -17,15 +17,19 @@
 #include "fabricrpc_tool/tool_client_notification_handler.hpp"
 
 #include "fabricrpc_tool/tool_server_connection_handler.hpp"
+#include "fabricrpc_tool/transport_factory.hpp"
 
 // common functions
 
 // open a server and client
+// maxMessageSize and maxConcurrentCalls are transport settings. Defaults fit
+// small test messages.
 
 class myserver {
 public:
   HRESULT
-  StartServer(IFabricTransportMessageHandler *req_handler) {
+  StartServer(IFabricTransportMessageHandler *req_handler,
+              ULONG maxMessageSize = 100, ULONG maxConcurrentCalls = 10) {
     if (listener_) {
       return ERROR_ALREADY_EXISTS;
     }
@@ -35,8 +39,8 @@ public:
 
     FABRIC_TRANSPORT_SETTINGS settings = {};
     settings.KeepAliveTimeoutInSeconds = 10;
-    settings.MaxConcurrentCalls = 10;
-    settings.MaxMessageSize = 100;
+    settings.MaxConcurrentCalls = maxConcurrentCalls;
+    settings.MaxMessageSize = maxMessageSize;
     settings.MaxQueueSize = 100;
     settings.OperationTimeoutInSeconds = 30;
     settings.SecurityCredentials = &cred;
@@ -53,7 +57,7 @@ public:
     winrt::com_ptr<IFabricTransportListener> listener;
 
     // create listener
-    HRESULT hr = CreateFabricTransportListener(
+    HRESULT hr = fabricrpc::get_transport().create_listener(
         IID_IFabricTransportListener, &settings, &addr, req_handler,
         conn_handler.get(), msg_disposer.get(), listener.put());
 
@@ -114,7 +118,8 @@ private:
 
 class myclient {
 public:
-  HRESULT Open(const std::wstring &addr) {
+  HRESULT Open(const std::wstring &addr, ULONG maxMessageSize = 100,
+               ULONG maxConcurrentCalls = 10) {
     if (client_) {
       return ERROR_ALREADY_EXISTS;
     }
@@ -125,8 +130,8 @@ public:
 
     FABRIC_TRANSPORT_SETTINGS settings = {};
     settings.KeepAliveTimeoutInSeconds = 10;
-    settings.MaxConcurrentCalls = 10;
-    settings.MaxMessageSize = 100;
+    settings.MaxConcurrentCalls = maxConcurrentCalls;
+    settings.MaxMessageSize = maxMessageSize;
     settings.MaxQueueSize = 100;
     settings.OperationTimeoutInSeconds = 30;
     settings.SecurityCredentials = &cred;
@@ -144,7 +149,7 @@ public:
     winrt::com_ptr<IFabricTransportClient> client;
 
     // open client
-    hr = CreateFabricTransportClient(
+    hr = fabricrpc::get_transport().create_client(
         /* [in] */ IID_IFabricTransportClient,
         /* [in] */ &settings,
         /* [in] */ addr.c_str(),
@@ -0,0 +1,148 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#include <boost/test/unit_test.hpp>
+
+#include <atlbase.h>
+#include <atlcom.h>
+
+#include <fabricrpc/InProcChannel.hpp>
+#include <fabricrpc/exp/AsyncAnyContext.hpp>
+#include <fabricrpc_tool/waitable_callback.hpp>
+
+#include "helloworld.fabricrpc.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// completes each call on a thread of its own after the delay.
+class Service_Impl_Delay : public helloworld::FabricHello::Service {
+public:
+  ~Service_Impl_Delay() {
+    for (std::thread &th : threads_) {
+      th.join();
+    }
+  }
+
+  fabricrpc::Status
+  BeginSayHello(const ::helloworld::FabricRequest *request,
+                DWORD timeoutMilliseconds,
+                IFabricAsyncOperationCallback *callback,
+                /*out*/ IFabricAsyncOperationContext **context) override {
+    calls_++;
+    CComPtr<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>> ctxPtr(
+        new CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>());
+    ctxPtr->SetContent("hello " + request->fabricname());
+    ctxPtr->Initialize(callback);
+    CComPtr<IFabricAsyncOperationCallback> callbackPtr = callback;
+    std::lock_guard<std::mutex> lk(mtx_);
+    threads_.emplace_back([ctxPtr, callbackPtr, delay = delayMs_]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+      callbackPtr->Invoke(ctxPtr);
+    });
+    ctxPtr.CopyTo(context);
+    return fabricrpc::Status();
+  }
+
+  fabricrpc::Status
+  EndSayHello(IFabricAsyncOperationContext *context,
+              /*out*/ ::helloworld::FabricResponse *response) override {
+    ends_++;
+    CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *ctx =
+        dynamic_cast<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *>(
+            context);
+    response->set_fabricmessage(ctx->GetContent());
+    return fabricrpc::Status();
+  }
+
+  void SetDelayMs(DWORD ms) { delayMs_ = ms; }
+
+  // joins the threads of completed calls.
+  void Join() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (std::thread &th : threads_) {
+      th.join();
+    }
+    threads_.clear();
+  }
+
+  int Calls() const { return calls_; }
+  int Ends() const { return ends_; }
+
+private:
+  std::mutex mtx_;
+  std::vector<std::thread> threads_;
+  DWORD delayMs_ = 0;
+  std::atomic<int> calls_ = 0;
+  std::atomic<int> ends_ = 0;
+};
+
+namespace {
+
+fabricrpc::Status CallSayHello(helloworld::FabricHelloClient &client,
+                               DWORD timeoutMilliseconds,
+                               helloworld::FabricResponse *resp) {
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+  helloworld::FabricRequest req;
+  req.set_fabricname("fabric");
+  fabricrpc::Status err = client.BeginSayHello(&req, timeoutMilliseconds,
+                                               callback.get(), ctx.put());
+  if (err) {
+    return err;
+  }
+  callback->Wait();
+  return client.EndSayHello(ctx.get(), resp);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(test_inproc_channel)
+
+BOOST_AUTO_TEST_CASE(inproc_timeout) {
+  std::shared_ptr<Service_Impl_Delay> svc =
+      std::make_shared<Service_Impl_Delay>();
+  std::shared_ptr<fabricrpc::InProcChannel> channel =
+      std::make_shared<fabricrpc::InProcChannel>(
+          std::vector<std::shared_ptr<fabricrpc::MiddleWare>>{svc});
+  helloworld::FabricHelloClient client(channel);
+
+  // completes in time
+  helloworld::FabricResponse resp;
+  fabricrpc::Status err = CallSayHello(client, 1000, &resp);
+  BOOST_REQUIRE(!err);
+  BOOST_CHECK_EQUAL(resp.fabricmessage(), "hello fabric");
+  err = CallSayHello(client, INFINITE, &resp);
+  BOOST_REQUIRE(!err);
+
+  // the caller does not wait for a late service, and the late reply is
+  // dropped.
+  svc->SetDelayMs(500);
+  auto start = std::chrono::steady_clock::now();
+  err = CallSayHello(client, 50, &resp);
+  BOOST_CHECK(std::chrono::steady_clock::now() - start <
+              std::chrono::milliseconds(400));
+  BOOST_REQUIRE(err);
+  BOOST_REQUIRE(err.IsTransportError());
+  BOOST_CHECK(err.GetErrorCode() ==
+              fabricrpc::StatusCode::FABRIC_TRANSPORT_ERROR);
+  BOOST_CHECK_EQUAL(err.GetTransportErrorCode(), FABRIC_E_TIMEOUT);
+  svc->Join();
+  // the service still ends its late operation.
+  BOOST_CHECK_EQUAL(svc->Ends(), 3);
+
+  // 0 timeout fails without reaching the service.
+  err = CallSayHello(client, 0, &resp);
+  BOOST_REQUIRE(err);
+  BOOST_CHECK_EQUAL(err.GetTransportErrorCode(), FABRIC_E_TIMEOUT);
+  BOOST_CHECK_EQUAL(svc->Calls(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
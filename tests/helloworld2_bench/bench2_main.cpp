@@ -0,0 +1,224 @@
+// benchmark of the fabric_rpc2 runtime.
+// Runs the same workload as helloworld_bench: connections * concurrency
+// callers send SayHello back to back, and the summary row has the same
+// columns, so the two runtimes can be compared side by side.
+// --arrival=fixed or poisson with --rate runs open loop instead, and
+// --ramp_steps looks for the throughput knee. --loopback takes the transport
+// out of the numbers. --spans prints where the server spends the time of a
+// request.
+
+#define BOOST_TEST_MODULE bench2_test
+#include <boost/test/unit_test.hpp>
+
+#include "absl/status/status.h"
+#include "boost/asio/awaitable.hpp"
+#include "boost/asio/use_awaitable.hpp"
+#include "fabricrpc/ex_server.hpp"
+#include "fabricrpc/fabricrpc2.hpp"
+#include "fabricrpc/loadgen.hpp"
+#include "fabricrpc_tool/loopback_transport.hpp"
+#include "fabricrpc_tool/request_span.hpp"
+#include "helloworld.fabricrpc2.h"
+
+#include "bench_report.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <thread>
+
+namespace net = boost::asio;
+namespace po = boost::program_options;
+
+class fabric_hello_impl : public helloworld::FabricHello {
+public:
+  net::awaitable<absl::Status>
+  SayHello(helloworld::FabricRequest *request,
+           helloworld::FabricResponse *resp) override {
+    resp->set_fabricmessage("hello " + request->fabricname());
+    co_return absl::OkStatus();
+  }
+};
+
+// global fixture to tear down protobuf
+// protobuf has internal memories that needs to be freed before exit program
+struct MyGlobalFixture {
+  MyGlobalFixture() { BOOST_TEST_MESSAGE("ctor fixture"); }
+  void setup() {
+    BOOST_TEST_MESSAGE("setup fixture: parsing cmd args");
+    po::options_description desc("Allowed options");
+    desc.add_options()("help", "produce help message")(
+        "concurrency", po::value(&glb.concurrency)->default_value(2),
+        "number concurrent request per client")(
+        "connections", po::value(&glb.connections)->default_value(2),
+        "number of client connection")(
+        "test_sec", po::value(&glb.test_sec)->default_value(1),
+        "number of seconds to run")(
+        "port", po::value(&glb.port)->default_value(12346),
+        "port of the server")(
+        "arrival", po::value(&glb.arrival)->default_value("closed"),
+        "closed, or open loop fixed or poisson")(
+        "rate", po::value(&glb.rate)->default_value(0),
+        "total requests per second. Needed by open loop")(
+        "ramp_steps", po::value(&glb.ramp_steps)->default_value(0),
+        "open loop steps of increasing rate")(
+        "loopback", po::bool_switch(&glb.loopback),
+        "use the in process loopback transport instead of FabricTransport")(
+        "spans", po::bool_switch(&glb.spans),
+        "print server latency per request stage");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(
+                  boost::unit_test::framework::master_test_suite().argc,
+                  boost::unit_test::framework::master_test_suite().argv, desc),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::stringstream ss;
+      ss << std::endl;
+      desc.print(ss);
+      BOOST_REQUIRE_MESSAGE(false, ss.str());
+    }
+    if (glb.loopback) {
+      fabricrpc::set_transport(fabricrpc::loopback_transport());
+    }
+  }
+  void teardown() { BOOST_TEST_MESSAGE("teardown fixture"); }
+  ~MyGlobalFixture() {
+    google::protobuf::ShutdownProtobufLibrary();
+    BOOST_TEST_MESSAGE("dtor fixture");
+  }
+  static MyGlobalFixture glb;
+
+  int concurrency;
+  int connections;
+  int test_sec;
+  int port;
+  std::string arrival;
+  double rate;
+  std::size_t ramp_steps;
+  bool loopback;
+  bool spans;
+};
+
+MyGlobalFixture MyGlobalFixture::glb;
+
+BOOST_TEST_GLOBAL_FIXTURE(MyGlobalFixture);
+
+BOOST_AUTO_TEST_SUITE(bench2_suite)
+
+// serve returns before listening only on error, so probe until a connection
+// opens.
+bool wait_for_server(int port) {
+  net::io_context ioc;
+  net::io_context::executor_type ex = ioc.get_executor();
+  fabricrpc::endpoint ep(L"localhost", port);
+  for (int i = 0; i < 50; i++) {
+    fabricrpc::basic_client_connection<net::io_context::executor_type> conn(
+        ex);
+    if (!conn.open(ep).failed()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return false;
+}
+
+BOOST_AUTO_TEST_CASE(test_1) {
+  int port = MyGlobalFixture::glb.port;
+
+  // server runs on its own thread, clients on the loadgen io_context.
+  fabricrpc::ex_server svr;
+  svr.add_service(std::make_shared<fabric_hello_impl>());
+  std::shared_ptr<fabricrpc::span_stats> spans;
+  if (MyGlobalFixture::glb.spans) {
+    spans = std::make_shared<fabricrpc::span_stats>();
+    svr.set_span_sink(spans);
+  }
+  absl::Status serve_st;
+  std::jthread server([&svr, &serve_st, port]() {
+    serve_st = svr.serve(port);
+  });
+  bool up = wait_for_server(port);
+  if (!up) {
+    // the server thread needs to stop before the test fails.
+    svr.shutdown();
+    server.join();
+  }
+  BOOST_REQUIRE_MESSAGE(up, "server is not up: " + serve_st.ToString());
+
+  fabricrpc::loadgen_options options;
+  options.port = port;
+  options.connections = MyGlobalFixture::glb.connections;
+  options.concurrency = MyGlobalFixture::glb.concurrency;
+  options.duration = std::chrono::seconds(MyGlobalFixture::glb.test_sec);
+  options.rate = MyGlobalFixture::glb.rate;
+  options.ramp_steps = MyGlobalFixture::glb.ramp_steps;
+  absl::Status arrival_st = fabricrpc::parse_loadgen_arrival(
+      MyGlobalFixture::glb.arrival, &options.arrival);
+
+  typedef net::io_context::executor_type executor_type;
+  auto call = [](fabricrpc::rpc_client<executor_type> &client)
+      -> net::awaitable<absl::Status> {
+    helloworld::FabricHelloClient<executor_type> hc(client);
+    helloworld::FabricRequest req;
+    req.set_fabricname("myname");
+    helloworld::FabricResponse resp;
+    absl::Status st = co_await hc.SayHello(&req, &resp, net::use_awaitable);
+    if (st.ok() && resp.fabricmessage() != "hello myname") {
+      st = absl::InternalError("unexpected reply " + resp.fabricmessage());
+    }
+    co_return st;
+  };
+  fabricrpc::loadgen_ramp_result ramp;
+  fabricrpc::loadgen_result result;
+  if (!arrival_st.ok()) {
+    result.status = arrival_st;
+  } else if (options.ramp_steps != 0) {
+    ramp = fabricrpc::run_loadgen_ramp(options, call);
+    result.status = ramp.status;
+  } else {
+    result = fabricrpc::run_loadgen(options, call);
+  }
+
+  svr.shutdown();
+  server.join();
+  BOOST_REQUIRE_MESSAGE(result.status.ok(), result.status.ToString());
+  BOOST_REQUIRE_MESSAGE(serve_st.ok(), serve_st.ToString());
+  if (options.ramp_steps != 0) {
+    std::cout << "=========" << std::endl;
+    print_loadgen_ramp_result("/helloworld.FabricHello/SayHello", ramp,
+                              std::cout);
+    std::cout << "=========" << std::endl;
+    return;
+  }
+  BOOST_CHECK_EQUAL(result.stats.failed, 0u);
+
+  std::cout << "=========" << std::endl;
+  std::cout << "config: concurrency " << options.concurrency
+            << " connections " << options.connections << " test_sec "
+            << MyGlobalFixture::glb.test_sec << std::endl;
+  print_loadgen_result("/helloworld.FabricHello/SayHello", result, std::cout);
+  const fabricrpc::latency_histogram &latency = result.stats.latency;
+  bench_row row;
+  row.runtime =
+      MyGlobalFixture::glb.loopback ? "fabric_rpc2/loopback" : "fabric_rpc2";
+  row.connections = options.connections;
+  row.concurrency = options.concurrency;
+  row.seconds = result.elapsed.count();
+  row.success = result.stats.ok;
+  row.failure = result.stats.failed;
+  row.p50 = latency.percentile(0.5).count();
+  row.p90 = latency.percentile(0.9).count();
+  row.p99 = latency.percentile(0.99).count();
+  row.p999 = latency.percentile(0.999).count();
+  row.max = latency.max().count();
+  print_bench_row(std::cout, row);
+  if (spans) {
+    spans->print(std::cout);
+  }
+  std::cout << "=========" << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,10 +11,15 @@
 #include "helloworld.fabricrpc.h"
 
 #include "asio_waitable_callback.hpp"
+#include "bench_report.hpp"
 #include "fabricrpc_test_helpers.hpp"
+#include "fabricrpc_tool/loopback_transport.hpp"
+#include "latency_series.hpp"
 
 #include <boost/program_options.hpp>
 
+#include <mutex>
+
 class Service_Impl : public helloworld::FabricHello::Service {
 public:
   fabricrpc::Status
@@ -60,7 +65,11 @@ struct MyGlobalFixture {
         "connections", po::value(&glb.connections)->default_value(2),
         "number of client connection")(
         "test_sec", po::value(&glb.test_sec)->default_value(1),
-        "number of seconds to run");
+        "number of seconds to run")(
+        "series_ms", po::value(&glb.series_ms)->default_value(1000),
+        "interval of the latency over time series")(
+        "loopback", po::bool_switch(&glb.loopback),
+        "use the in process loopback transport instead of FabricTransport");
 
     po::variables_map vm;
     po::store(po::parse_command_line(
@@ -75,6 +84,9 @@ struct MyGlobalFixture {
       desc.print(ss);
       BOOST_REQUIRE_MESSAGE(false, ss.str());
     }
+    if (glb.loopback) {
+      fabricrpc::set_transport(fabricrpc::loopback_transport());
+    }
   }
   void teardown() { BOOST_TEST_MESSAGE("teardown fixture"); }
   ~MyGlobalFixture() {
@@ -86,6 +98,8 @@ struct MyGlobalFixture {
   int concurrency;
   int connections;
   int test_sec;
+  int series_ms;
+  bool loopback;
 };
 
 MyGlobalFixture MyGlobalFixture::glb;
@@ -96,16 +110,41 @@ BOOST_AUTO_TEST_SUITE(bench_suite)
 
 namespace net = boost::asio;
 
+// latency of all clients. Each client records into its own histograms, and
+// merges them here when it stops. Percentiles are within 1.6% of the
+// recorded latency.
+struct bench_latency {
+  bench_latency(std::chrono::steady_clock::time_point start,
+                std::chrono::milliseconds interval)
+      : start(start), interval(interval), mtx(), total(),
+        series(start, interval) {}
+
+  void merge(const fabricrpc::latency_histogram &client_total,
+             const latency_series &client_series) {
+    std::lock_guard<std::mutex> lk(mtx);
+    total.merge(client_total);
+    series.merge(client_series);
+  }
+
+  const std::chrono::steady_clock::time_point start;
+  const std::chrono::milliseconds interval;
+  std::mutex mtx;
+  fabricrpc::latency_histogram total;
+  latency_series series;
+};
+
 // concurrency determines how many requests to launch from one client at a time
 // connections determines how many clients in total
 
-void start_one_client(std::atomic<int> &successcount,
+void start_one_client(std::atomic<int> &successcount, bench_latency &latency,
                       std::shared_ptr<myclient> c, std::size_t concurrency,
                       std::stop_token st) {
   net::io_context io_context;
   HRESULT hr = S_OK;
 
   std::atomic<int> subSuccessCount = 0;
+  fabricrpc::latency_histogram subLatency;
+  latency_series subSeries(latency.start, latency.interval);
 
   helloworld::FabricHelloClient hc(c->GetClient());
   // need to hammer the server as much as possible
@@ -121,6 +160,9 @@ void start_one_client(std::atomic<int> &successcount,
       ctxs;
   std::map<IFabricAsyncOperationContext *, IFabricAsyncOperationCallback *>
       ctx2callback;
+  std::map<IFabricAsyncOperationCallback *,
+           std::chrono::steady_clock::time_point>
+      starts;
 
   std::function<void(void)> startfunc;
 
@@ -134,6 +176,11 @@ void start_one_client(std::atomic<int> &successcount,
     assert(reply == "hello myname");
 
     subSuccessCount++;
+    // latency includes the wait in the io_context queue, as callers see it.
+    auto done = std::chrono::steady_clock::now();
+    auto start = starts.at(ctx2callback.at(ctx));
+    subLatency.record(done - start);
+    subSeries.record(done, done - start);
 
     // loop to next run
     // it is safe to post first because this is single thread.
@@ -153,6 +200,7 @@ void start_one_client(std::atomic<int> &successcount,
     assert(1 == ctx2callback.erase(ctx));
     assert(1 == ctxs.erase(ctxtemp.get()));
     assert(1 == callbacks.erase(callbackPtr));
+    assert(1 == starts.erase(callbackPtr));
   };
 
   startfunc = [&]() {
@@ -163,6 +211,7 @@ void start_one_client(std::atomic<int> &successcount,
         winrt::make<asio_waitable_callback>(lamda_callback,
                                             io_context.get_executor());
     callbacks.emplace(callback.get(), callback);
+    starts.emplace(callback.get(), std::chrono::steady_clock::now());
 
     winrt::com_ptr<IFabricAsyncOperationContext> ctx;
     helloworld::FabricRequest req;
@@ -185,6 +234,25 @@ void start_one_client(std::atomic<int> &successcount,
   io_context.run();
   // BOOST_CHECK_EQUAL(concurrency, subSuccessCount.load());
   successcount += subSuccessCount;
+  latency.merge(subLatency, subSeries);
+}
+
+void print_latency(const bench_latency &latency) {
+  const fabricrpc::latency_histogram &h = latency.total;
+  std::cout << "latency us: p50 " << to_us(h.percentile(0.5)) << " p90 "
+            << to_us(h.percentile(0.9)) << " p99 " << to_us(h.percentile(0.99))
+            << " p99.9 " << to_us(h.percentile(0.999)) << " max "
+            << to_us(h.max()) << std::endl;
+  std::cout << "latency over time (ms count p50 p99 max):" << std::endl;
+  const std::vector<fabricrpc::latency_histogram> &intervals =
+      latency.series.intervals();
+  for (std::size_t i = 0; i < intervals.size(); i++) {
+    const fabricrpc::latency_histogram &w = intervals[i];
+    std::cout << i * latency.series.interval().count() << " " << w.count()
+              << " " << to_us(w.percentile(0.5)) << " "
+              << to_us(w.percentile(0.99)) << " " << to_us(w.max())
+              << std::endl;
+  }
 }
 
 BOOST_AUTO_TEST_CASE(test_1) {
@@ -216,13 +284,17 @@ BOOST_AUTO_TEST_CASE(test_1) {
   std::stop_source ss;
 
   std::size_t concurrency = MyGlobalFixture::glb.concurrency;
+  bench_latency latency(
+      std::chrono::steady_clock::now(),
+      std::chrono::milliseconds(MyGlobalFixture::glb.series_ms));
 
   // each thread runs one client
   std::vector<std::jthread> threads;
 
   for (int i = 0; i < connection; i++) {
-    std::jthread th(start_one_client, std::ref(successcount), clients[i],
-                    concurrency, ss.get_token());
+    std::jthread th(start_one_client, std::ref(successcount),
+                    std::ref(latency), clients[i], concurrency,
+                    ss.get_token());
     threads.emplace_back(std::move(th));
   }
 
@@ -252,6 +324,21 @@ BOOST_AUTO_TEST_CASE(test_1) {
   std::cout << "req/s: "
             << std::to_string(successcount.load() / test_duration_sec)
             << std::endl;
+  print_latency(latency);
+  const fabricrpc::latency_histogram &h = latency.total;
+  bench_row row;
+  row.runtime =
+      MyGlobalFixture::glb.loopback ? "fabric_rpc/loopback" : "fabric_rpc";
+  row.connections = connection;
+  row.concurrency = concurrency;
+  row.seconds = test_duration_sec;
+  row.success = successcount.load();
+  row.p50 = h.percentile(0.5).count();
+  row.p90 = h.percentile(0.9).count();
+  row.p99 = h.percentile(0.99).count();
+  row.p999 = h.percentile(0.999).count();
+  row.max = h.max().count();
+  print_bench_row(std::cout, row);
   std::cout << "=========" << std::endl;
 }
 
@@ -0,0 +1,56 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// summary shared by helloworld_bench (fabric_rpc) and helloworld2_bench
+// (fabric_rpc2). Both run SayHello with the same request, connections and
+// concurrency, so rows of the two can be compared side by side.
+struct bench_row {
+  std::string runtime;
+  std::size_t connections = 0;
+  std::size_t concurrency = 0;
+  double seconds = 0;
+  std::uint64_t success = 0;
+  std::uint64_t failure = 0;
+  // latencies in nanoseconds
+  std::uint64_t p50 = 0;
+  std::uint64_t p90 = 0;
+  std::uint64_t p99 = 0;
+  std::uint64_t p999 = 0;
+  std::uint64_t max = 0;
+};
+
+// nanoseconds as microseconds
+inline std::string to_us(std::uint64_t ns) {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << ns / 1000.0;
+  return ss.str();
+}
+
+inline std::string to_us(std::chrono::nanoseconds d) {
+  return to_us(static_cast<std::uint64_t>(d.count()));
+}
+
+// csv with a header line.
+inline void print_bench_row(std::ostream &os, const bench_row &row) {
+  os << "runtime,connections,concurrency,seconds,success,failure,req_per_sec,"
+        "p50_us,p90_us,p99_us,p999_us,max_us"
+     << std::endl;
+  double rps = row.seconds > 0 ? row.success / row.seconds : 0;
+  os << row.runtime << "," << row.connections << "," << row.concurrency << ","
+     << std::fixed << std::setprecision(1) << row.seconds << "," << row.success
+     << "," << row.failure << "," << rps << "," << to_us(row.p50) << ","
+     << to_us(row.p90) << "," << to_us(row.p99) << "," << to_us(row.p999)
+     << "," << to_us(row.max) << std::endl;
+}
@@ -0,0 +1,56 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#pragma once
+
+#include "fabricrpc_tool/latency_histogram.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <vector>
+
+// latency over time: one histogram per interval since start.
+// Not thread safe. Use one per thread, and merge.
+class latency_series {
+public:
+  latency_series(std::chrono::steady_clock::time_point start,
+                 std::chrono::milliseconds interval)
+      : start_(start), interval_(interval), intervals_() {
+    assert(interval.count() > 0);
+  }
+
+  // done is when the request completed.
+  void record(std::chrono::steady_clock::time_point done,
+              std::chrono::nanoseconds latency) {
+    auto since = std::max(done - start_, std::chrono::nanoseconds(0));
+    std::size_t i = static_cast<std::size_t>(since / interval_);
+    if (intervals_.size() <= i) {
+      intervals_.resize(i + 1);
+    }
+    intervals_[i].record(latency);
+  }
+
+  // other needs the same start and interval.
+  void merge(const latency_series &other) {
+    if (intervals_.size() < other.intervals_.size()) {
+      intervals_.resize(other.intervals_.size());
+    }
+    for (std::size_t i = 0; i < other.intervals_.size(); i++) {
+      intervals_[i].merge(other.intervals_[i]);
+    }
+  }
+
+  std::chrono::milliseconds interval() const { return interval_; }
+  const std::vector<fabricrpc::latency_histogram> &intervals() const {
+    return intervals_;
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::milliseconds interval_;
+  std::vector<fabricrpc::latency_histogram> intervals_;
+};
@@ -0,0 +1,241 @@
+// micro benchmarks of hot path pieces, without transport.
+// Run with --benchmark_filter=<regex> to pick benchmarks, and
+// --benchmark_repetitions=10 for stable numbers when comparing builds.
+
+#include <benchmark/benchmark.h>
+
+#include "fabricrpc.pb.h"
+#include "fabricrpc/FRPCHeader.hpp"
+#include "fabricrpc/any_context.hpp"
+#include "fabricrpc/basic_item_queue.hpp"
+#include "fabricrpc/parse.hpp"
+#include "fabricrpc/service.hpp"
+#include "fabricrpc_tool/tool_transport_msg.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;
+
+namespace {
+
+const std::string bench_url = "/helloworld.FabricHello/SayHello";
+
+std::string serialized_request_header() {
+  fabricrpc::request_header header;
+  header.set_url(bench_url);
+  header.set_accept_codec(fabricrpc::codec_lz4);
+  return header.SerializeAsString();
+}
+
+} // namespace
+
+static void BM_parse_request_header(benchmark::State &state) {
+  std::string data = serialized_request_header();
+  fabricrpc::request_header header;
+  for (auto _ : state) {
+    absl::Status st = fabricrpc::parse_request_header(data, &header);
+    benchmark::DoNotOptimize(st);
+  }
+}
+BENCHMARK(BM_parse_request_header);
+
+static void BM_parse_request_header_url(benchmark::State &state) {
+  std::string data = serialized_request_header();
+  std::string url;
+  for (auto _ : state) {
+    absl::Status st = fabricrpc::parse_request_header(data, url);
+    benchmark::DoNotOptimize(st);
+  }
+}
+BENCHMARK(BM_parse_request_header_url);
+
+// arg 0 is an ok reply, 1 is an error with a message.
+static void BM_parse_reply_header(benchmark::State &state) {
+  std::string data;
+  absl::Status reply_st = state.range(0) == 0
+                              ? absl::OkStatus()
+                              : absl::NotFoundError("key is not found");
+  if (!fabricrpc::serialize_reply_header(reply_st, &data).ok()) {
+    state.SkipWithError("cannot serialize reply header");
+    return;
+  }
+  for (auto _ : state) {
+    absl::Status st = fabricrpc::parse_reply_header(data);
+    benchmark::DoNotOptimize(st);
+  }
+}
+BENCHMARK(BM_parse_reply_header)->Arg(0)->Arg(1);
+
+static void BM_serialize_reply_header(benchmark::State &state) {
+  absl::Status reply_st = state.range(0) == 0
+                              ? absl::OkStatus()
+                              : absl::NotFoundError("key is not found");
+  std::string data;
+  for (auto _ : state) {
+    data.clear();
+    absl::Status st = fabricrpc::serialize_reply_header(reply_st, &data);
+    benchmark::DoNotOptimize(st);
+    benchmark::DoNotOptimize(data.data());
+  }
+}
+BENCHMARK(BM_serialize_reply_header)->Arg(0)->Arg(1);
+
+// header conversion of the fabric_rpc runtime, one round trip per iteration.
+static void BM_header_converter_request(benchmark::State &state) {
+  fabricrpc::FabricRPCHeaderProtoConverter<fabricrpc::request_header,
+                                           fabricrpc::reply_header>
+      cv;
+  fabricrpc::FabricRPCRequestHeader header(bench_url);
+  header.SetAcceptCodec(fabricrpc::BodyCodec::Lz4);
+  std::string data;
+  fabricrpc::FabricRPCRequestHeader parsed;
+  for (auto _ : state) {
+    data.clear();
+    bool ok = cv.SerializeRequestHeader(&header, &data) &&
+              cv.DeserializeRequestHeader(&data, &parsed);
+    benchmark::DoNotOptimize(ok);
+  }
+}
+BENCHMARK(BM_header_converter_request);
+
+static void BM_header_converter_reply(benchmark::State &state) {
+  fabricrpc::FabricRPCHeaderProtoConverter<fabricrpc::request_header,
+                                           fabricrpc::reply_header>
+      cv;
+  fabricrpc::FabricRPCReplyHeader header(0, "");
+  std::string data;
+  fabricrpc::FabricRPCReplyHeader parsed;
+  for (auto _ : state) {
+    data.clear();
+    bool ok = cv.SerializeReplyHeader(&header, &data) &&
+              cv.DeserializeReplyHeader(&data, &parsed);
+    benchmark::DoNotOptimize(ok);
+  }
+}
+BENCHMARK(BM_header_converter_reply);
+
+// arg 0 is the number of body buffers, arg 1 the size of each.
+static void BM_get_body(benchmark::State &state) {
+  std::vector<std::string> bodies(static_cast<std::size_t>(state.range(0)),
+                                  std::string(state.range(1), 'a'));
+  winrt::com_ptr<IFabricTransportMessage> msg =
+      winrt::make<fabricrpc::tool_transport_msg>(std::move(bodies),
+                                                 serialized_request_header());
+  for (auto _ : state) {
+    std::string body = fabricrpc::get_body(msg.get());
+    benchmark::DoNotOptimize(body.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          state.range(1));
+}
+BENCHMARK(BM_get_body)
+    ->Args({1, 64})
+    ->Args({1, 64 << 10})
+    ->Args({4, 16 << 10})
+    ->Args({16, 4 << 10});
+
+namespace {
+
+class bench_service : public fabricrpc::service {
+public:
+  explicit bench_service(std::string name) : name_(std::move(name)) {}
+  const std::string_view name() override { return name_; }
+  net::awaitable<absl::Status> execute(const std::string &url,
+                                       const std::string_view,
+                                       std::string *) override {
+    co_return absl::UnimplementedError(url);
+  }
+
+private:
+  std::string name_;
+};
+
+} // namespace
+
+// arg is the number of services. The url is owned by the last one, the worst
+// case of the linear lookup.
+static void BM_find_service(benchmark::State &state) {
+  std::vector<std::shared_ptr<fabricrpc::service>> svcs;
+  for (std::int64_t i = 0; i < state.range(0); i++) {
+    svcs.push_back(std::make_shared<bench_service>("helloworld.FabricHello" +
+                                                   std::to_string(i)));
+  }
+  std::string url = "/helloworld.FabricHello" +
+                    std::to_string(state.range(0) - 1) + "/SayHello";
+  std::shared_ptr<fabricrpc::service> svc;
+  for (auto _ : state) {
+    absl::Status st = fabricrpc::find_service(svcs, url, &svc);
+    benchmark::DoNotOptimize(st);
+  }
+}
+BENCHMARK(BM_find_service)->Arg(1)->Arg(4)->Arg(16);
+
+// each thread pushes an item and pops one, so a pop always finds an item and
+// completes inline. Threads contend on the queue lock.
+static void BM_item_queue_push_pop(benchmark::State &state) {
+  typedef net::io_context::executor_type executor_type;
+  static fabricrpc::basic_item_queue<std::string, executor_type> queue;
+  net::io_context ioc;
+  auto event = std::make_shared<fabricrpc::basic_event<executor_type>>(
+      ioc.get_executor());
+  std::string item(64, 'a');
+  std::string out;
+  for (auto _ : state) {
+    queue.push(item);
+    queue.async_pop(event, &out);
+    event->reset();
+    benchmark::DoNotOptimize(out.data());
+  }
+}
+BENCHMARK(BM_item_queue_push_pop)->ThreadRange(1, 8)->UseRealTime();
+
+namespace {
+
+class bench_callback
+    : public winrt::implements<bench_callback, IFabricAsyncOperationCallback> {
+public:
+  void STDMETHODCALLTYPE Invoke(IFabricAsyncOperationContext *) override {
+    invoked_.fetch_add(1, std::memory_order_relaxed);
+  }
+  std::uint64_t invoked() const { return invoked_.load(); }
+
+private:
+  std::atomic<std::uint64_t> invoked_{0};
+};
+
+} // namespace
+
+// creates a context, sets its content and completes it, as a server
+// operation does.
+static void BM_any_context_complete(benchmark::State &state) {
+  winrt::com_ptr<bench_callback> callback = winrt::make_self<bench_callback>();
+  for (auto _ : state) {
+    winrt::com_ptr<fabricrpc::any_context<std::string>> ctx =
+        winrt::make_self<fabricrpc::any_context<std::string>>(
+            callback.get());
+    ctx->set_content(std::string(bench_url));
+    ctx->complete();
+    benchmark::DoNotOptimize(ctx->get_content_view().data());
+  }
+  if (callback->invoked() !=
+      static_cast<std::uint64_t>(state.iterations())) {
+    state.SkipWithError("callback is not invoked for each context");
+  }
+}
+BENCHMARK(BM_any_context_complete);
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  google::protobuf::ShutdownProtobufLibrary();
+  return 0;
+}
@@ -0,0 +1,339 @@
+// ------------------------------------------------------------
+// Copyright 2023 Youyuan Wu
+// Licensed under the MIT License (MIT). See License.txt in the repo root for
+// license information.
+// ------------------------------------------------------------
+
+#define BOOST_TEST_MODULE sweep_bench
+#include <boost/test/unit_test.hpp>
+
+#include "fabricrpc/exp/AsyncAnyContext.hpp"
+#include "sweep.fabricrpc.h"
+
+#include "fabricrpc_test_helpers.hpp"
+#include "fabricrpc_tool/latency_histogram.hpp"
+#include "fabricrpc_tool/loopback_transport.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+// replies with a payload of the requested size.
+class Service_Impl : public sweep::Sweep::Service {
+public:
+  fabricrpc::Status
+  BeginEcho(const ::sweep::EchoRequest *request, DWORD timeoutMilliseconds,
+            IFabricAsyncOperationCallback *callback,
+            /*out*/ IFabricAsyncOperationContext **context) override {
+    UNREFERENCED_PARAMETER(timeoutMilliseconds);
+    std::string payload(request->replysize(), 'r');
+
+    CComPtr<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>> ctxPtr(
+        new CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>>());
+    ctxPtr->SetContent(std::move(payload));
+    ctxPtr->Initialize(callback);
+    callback->Invoke(ctxPtr);
+
+    *context = ctxPtr.Detach();
+    return fabricrpc::Status();
+  }
+  fabricrpc::Status
+  EndEcho(IFabricAsyncOperationContext *context,
+          /*out*/ ::sweep::EchoReply *response) override {
+    CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *ctx =
+        dynamic_cast<CComObjectNoLock<fabricrpc::AsyncAnyCtx<std::string>> *>(
+            context);
+    response->set_payload(ctx->GetContent());
+    return fabricrpc::Status();
+  }
+};
+
+namespace po = boost::program_options;
+
+// "64,1024" to {64, 1024}
+std::vector<std::size_t> parse_list(const std::string &list) {
+  std::vector<std::string> parts;
+  boost::split(parts, list, boost::is_any_of(","));
+  std::vector<std::size_t> ret;
+  for (const std::string &part : parts) {
+    if (!part.empty()) {
+      ret.push_back(std::stoull(part));
+    }
+  }
+  return ret;
+}
+
+// global fixture to tear down protobuf
+// protobuf has internal memories that needs to be freed before exit program
+struct MyGlobalFixture {
+  MyGlobalFixture() { BOOST_TEST_MESSAGE("ctor fixture"); }
+  void setup() {
+    BOOST_TEST_MESSAGE("setup fixture: parsing cmd args");
+    std::string request_sizes;
+    std::string reply_sizes;
+    std::string connections;
+    std::string concurrency;
+    po::options_description desc("Allowed options");
+    desc.add_options()("help", "produce help message")(
+        "request_sizes",
+        po::value(&request_sizes)
+            ->default_value("64,4096,65536,1048576,4194304"),
+        "request payload bytes to sweep")(
+        "reply_sizes", po::value(&reply_sizes)->default_value("64,4194304"),
+        "reply payload bytes to sweep")(
+        "connections", po::value(&connections)->default_value("1,4"),
+        "client connection counts to sweep")(
+        "concurrency", po::value(&concurrency)->default_value("1,8"),
+        "concurrent requests per connection to sweep")(
+        "cell_ms", po::value(&glb.cell_ms)->default_value(200),
+        "milliseconds to run each cell")(
+        "format", po::value(&glb.format)->default_value("csv"),
+        "csv or json, one row or object per cell")(
+        "out", po::value(&glb.out)->default_value(""),
+        "file for the results. Default is stdout")(
+        "loopback", po::bool_switch(&glb.loopback),
+        "use the in process loopback transport instead of FabricTransport");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(
+                  boost::unit_test::framework::master_test_suite().argc,
+                  boost::unit_test::framework::master_test_suite().argv, desc),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::stringstream ss;
+      ss << std::endl;
+      desc.print(ss);
+      BOOST_REQUIRE_MESSAGE(false, ss.str());
+    }
+    glb.request_sizes = parse_list(request_sizes);
+    glb.reply_sizes = parse_list(reply_sizes);
+    glb.connections = parse_list(connections);
+    glb.concurrency = parse_list(concurrency);
+    if (glb.loopback) {
+      fabricrpc::set_transport(fabricrpc::loopback_transport());
+    }
+  }
+  void teardown() { BOOST_TEST_MESSAGE("teardown fixture"); }
+  ~MyGlobalFixture() {
+    google::protobuf::ShutdownProtobufLibrary();
+    BOOST_TEST_MESSAGE("dtor fixture");
+  }
+  static MyGlobalFixture glb;
+
+  std::vector<std::size_t> request_sizes;
+  std::vector<std::size_t> reply_sizes;
+  std::vector<std::size_t> connections;
+  std::vector<std::size_t> concurrency;
+  int cell_ms;
+  std::string format;
+  std::string out;
+  bool loopback;
+};
+
+MyGlobalFixture MyGlobalFixture::glb;
+
+BOOST_TEST_GLOBAL_FIXTURE(MyGlobalFixture);
+
+BOOST_AUTO_TEST_SUITE(sweep_suite)
+
+// one point of the matrix
+struct sweep_cell {
+  std::size_t request_size;
+  std::size_t reply_size;
+  std::size_t connections;
+  std::size_t concurrency;
+};
+
+struct sweep_result {
+  sweep_cell cell;
+  std::uint64_t success = 0;
+  std::uint64_t failure = 0;
+  double seconds = 0;
+  fabricrpc::latency_histogram latency;
+};
+
+// sends requests one after another until stop. Each concurrent request of a
+// connection runs on its own thread.
+void run_one_caller(sweep::SweepClient &client, const sweep_cell &cell,
+                    std::mutex &mtx, sweep_result &result,
+                    std::stop_token st) {
+  sweep::EchoRequest req;
+  req.set_payload(std::string(cell.request_size, 'q'));
+  req.set_replysize(static_cast<std::uint32_t>(cell.reply_size));
+  fabricrpc::latency_histogram latency;
+  std::uint64_t success = 0;
+  std::uint64_t failure = 0;
+  while (!st.stop_requested()) {
+    auto start = std::chrono::steady_clock::now();
+    winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+        winrt::make<fabricrpc::waitable_callback>();
+    winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+    fabricrpc::Status err =
+        client.BeginEcho(&req, 30000, callback.get(), ctx.put());
+    if (err) {
+      failure++;
+      continue;
+    }
+    callback->Wait();
+    sweep::EchoReply reply;
+    err = client.EndEcho(ctx.get(), &reply);
+    if (err || reply.payload().size() != cell.reply_size) {
+      failure++;
+      continue;
+    }
+    success++;
+    latency.record(std::chrono::steady_clock::now() - start);
+  }
+  std::lock_guard<std::mutex> lk(mtx);
+  result.success += success;
+  result.failure += failure;
+  result.latency.merge(latency);
+}
+
+sweep_result run_cell(const std::wstring &addr, ULONG maxMessageSize,
+                      const sweep_cell &cell) {
+  sweep_result result;
+  result.cell = cell;
+  ULONG maxCalls = static_cast<ULONG>(cell.concurrency);
+  std::vector<std::shared_ptr<myclient>> clients;
+  std::vector<std::shared_ptr<sweep::SweepClient>> sweepClients;
+  for (std::size_t i = 0; i < cell.connections; i++) {
+    auto c = std::make_shared<myclient>();
+    HRESULT hr = c->Open(addr, maxMessageSize, maxCalls);
+    BOOST_REQUIRE_EQUAL(hr, S_OK);
+    clients.push_back(c);
+    sweepClients.push_back(
+        std::make_shared<sweep::SweepClient>(c->GetClient()));
+  }
+
+  std::mutex mtx;
+  std::stop_source ss;
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < cell.connections; i++) {
+      for (std::size_t j = 0; j < cell.concurrency; j++) {
+        threads.emplace_back(run_one_caller, std::ref(*sweepClients[i]),
+                             std::cref(cell), std::ref(mtx), std::ref(result),
+                             ss.get_token());
+      }
+    }
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(MyGlobalFixture::glb.cell_ms));
+    ss.request_stop();
+  }
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  for (std::shared_ptr<myclient> &c : clients) {
+    HRESULT hr = c->Close();
+    BOOST_REQUIRE_EQUAL(hr, S_OK);
+  }
+  return result;
+}
+
+// nanoseconds as microseconds
+std::string to_us(std::chrono::nanoseconds d) {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << d.count() / 1000.0;
+  return ss.str();
+}
+
+void print_csv_header(std::ostream &os) {
+  os << "request_bytes,reply_bytes,connections,concurrency,success,failure,"
+        "req_per_sec,mb_per_sec,p50_us,p99_us,p999_us,max_us"
+     << std::endl;
+}
+
+// mb_per_sec counts request and reply payloads.
+void print_result(std::ostream &os, const sweep_result &r, bool json) {
+  double rps = r.success / r.seconds;
+  double mbps = rps * (r.cell.request_size + r.cell.reply_size) / 1e6;
+  const fabricrpc::latency_histogram &h = r.latency;
+  if (json) {
+    os << "{\"request_bytes\":" << r.cell.request_size
+       << ",\"reply_bytes\":" << r.cell.reply_size
+       << ",\"connections\":" << r.cell.connections
+       << ",\"concurrency\":" << r.cell.concurrency
+       << ",\"success\":" << r.success << ",\"failure\":" << r.failure
+       << ",\"req_per_sec\":" << std::fixed << std::setprecision(1) << rps
+       << ",\"mb_per_sec\":" << mbps
+       << ",\"p50_us\":" << to_us(h.percentile(0.5))
+       << ",\"p99_us\":" << to_us(h.percentile(0.99))
+       << ",\"p999_us\":" << to_us(h.percentile(0.999))
+       << ",\"max_us\":" << to_us(h.max()) << "}" << std::endl;
+    return;
+  }
+  os << r.cell.request_size << "," << r.cell.reply_size << ","
+     << r.cell.connections << "," << r.cell.concurrency << "," << r.success
+     << "," << r.failure << "," << std::fixed << std::setprecision(1) << rps
+     << "," << mbps << "," << to_us(h.percentile(0.5)) << ","
+     << to_us(h.percentile(0.99)) << "," << to_us(h.percentile(0.999)) << ","
+     << to_us(h.max()) << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(sweep_test) {
+  const MyGlobalFixture &glb = MyGlobalFixture::glb;
+  std::size_t largest = 0;
+  for (std::size_t size : glb.request_sizes) {
+    largest = std::max(largest, size);
+  }
+  for (std::size_t size : glb.reply_sizes) {
+    largest = std::max(largest, size);
+  }
+  std::size_t mostConnections = 1;
+  for (std::size_t c : glb.connections) {
+    mostConnections = std::max(mostConnections, c);
+  }
+  std::size_t mostCalls = 1;
+  for (std::size_t c : glb.concurrency) {
+    mostCalls = std::max(mostCalls, c);
+  }
+  // room for headers and proto framing.
+  ULONG maxMessageSize = static_cast<ULONG>(largest + 64 * 1024);
+
+  std::shared_ptr<fabricrpc::MiddleWare> svc = std::make_shared<Service_Impl>();
+  winrt::com_ptr<IFabricTransportMessageHandler> handler;
+  sweep::CreateFabricRPCRequestHandler({svc}, handler.put());
+
+  myserver s;
+  HRESULT hr = s.StartServer(handler.get(), maxMessageSize,
+                             static_cast<ULONG>(mostConnections * mostCalls));
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+
+  std::ofstream file;
+  if (!glb.out.empty()) {
+    file.open(glb.out);
+    BOOST_REQUIRE(file.is_open());
+  }
+  std::ostream &os = glb.out.empty() ? std::cout : file;
+  bool json = glb.format == "json";
+  if (!json) {
+    print_csv_header(os);
+  }
+  for (std::size_t requestSize : glb.request_sizes) {
+    for (std::size_t replySize : glb.reply_sizes) {
+      for (std::size_t connections : glb.connections) {
+        for (std::size_t concurrency : glb.concurrency) {
+          sweep_cell cell{requestSize, replySize, connections, concurrency};
+          sweep_result r = run_cell(s.GetAddr(), maxMessageSize, cell);
+          BOOST_CHECK_EQUAL(r.failure, 0u);
+          print_result(os, r, json);
+        }
+      }
+    }
+  }
+
+  hr = s.CloseServer();
+  BOOST_REQUIRE_EQUAL(hr, S_OK);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
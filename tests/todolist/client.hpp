@@ -79,4 +79,40 @@ fabricrpc::Status DeleteOne(todolist::TodoClient &c, int id) {
   auto ri = resp.payload();
   BOOST_CHECK_EQUAL(ri.id(), id);
   return ec;
+}
+
+// add items in one batch. returns status of each item.
+fabricrpc::Status AddItemBatch(todolist::TodoClient &c,
+                               const std::vector<int> &ids,
+                               std::vector<fabricrpc::Status> *statuses) {
+  winrt::com_ptr<fabricrpc::IWaitableCallback> callback =
+      winrt::make<fabricrpc::waitable_callback>();
+  winrt::com_ptr<IFabricAsyncOperationContext> ctx;
+
+  std::vector<todolist::AddOneRequest> reqs(ids.size());
+  for (std::size_t i = 0; i < ids.size(); i++) {
+    auto item = reqs[i].mutable_payload();
+    item->set_completed(false);
+    item->set_description("myitem" + std::to_string(ids[i]));
+    item->set_id(ids[i]);
+  }
+  fabricrpc::Status ec =
+      c.BeginBatchAddOne(reqs, 1000, callback.get(), ctx.put());
+  if (ec) {
+    return ec;
+  }
+  callback->Wait();
+  std::vector<todolist::AddOneResponse> resps;
+  ec = c.EndBatchAddOne(ctx.get(), &resps, statuses);
+  if (ec) {
+    return ec;
+  }
+  BOOST_REQUIRE_EQUAL(resps.size(), ids.size());
+  BOOST_REQUIRE_EQUAL(statuses->size(), ids.size());
+  for (std::size_t i = 0; i < ids.size(); i++) {
+    if (!(*statuses)[i]) {
+      BOOST_CHECK_EQUAL(resps[i].payload().id(), ids[i]);
+    }
+  }
+  return ec;
 }
\ No newline at end of file
@@ -89,6 +89,21 @@ BOOST_AUTO_TEST_CASE(test_1) {
   ec = FindAll(todoClient, 2);
   BOOST_REQUIRE(!ec);
 
+  // batch add, where the existing id fails alone.
+  {
+    std::vector<fabricrpc::Status> statuses;
+    ec = AddItemBatch(todoClient, {10, 2, 11}, &statuses);
+    BOOST_REQUIRE(!ec);
+    BOOST_CHECK(!statuses[0]);
+    BOOST_REQUIRE(statuses[1]);
+    BOOST_CHECK_EQUAL(statuses[1].GetErrorCode(),
+                      fabricrpc::StatusCode::INVALID_ARGUMENT);
+    BOOST_CHECK_EQUAL(statuses[1].GetErrorMessage(), "id already exist: 2");
+    BOOST_CHECK(!statuses[2]);
+    ec = FindAll(todoClient, 4);
+    BOOST_REQUIRE(!ec);
+  }
+
   // test special error cases. TODO: more error cases
 
   // Send empty header to server